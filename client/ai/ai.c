@@ -33,12 +33,14 @@
 
 static char *server = NULL;
 static char *port = NULL;
+static gint server_fd = -1;
 static char *name = NULL;
 static char *ai;
 static int waittime = 1000;
 static gboolean silent = FALSE;
 static gboolean enable_debug = FALSE;
 static gboolean show_version = FALSE;
+static gboolean enable_profile = FALSE;
 static Map *map = NULL;
 
 static void logbot_init(void);
@@ -71,6 +73,10 @@ static GOptionEntry commandline_entries[] = {
 	{"port", 'p', 0, G_OPTION_ARG_STRING, &port,
 	 /* Commandline pioneersai: port */
 	 N_("Server Port"), PIONEERS_DEFAULT_GAME_PORT},
+	{"fd", '\0', 0, G_OPTION_ARG_INT, &server_fd,
+	 /* Commandline pioneersai: fd */
+	 N_("Use this file descriptor as the connection to the server"),
+	 "FD"},
 	{"name", 'n', 0, G_OPTION_ARG_STRING, &name,
 	 /* Commandline pioneersai: name */
 	 N_("Computer name (mandatory)"), NULL},
@@ -83,6 +89,17 @@ static GOptionEntry commandline_entries[] = {
 	{"algorithm", 'a', 0, G_OPTION_ARG_STRING, &ai,
 	 /* Commandline pioneersai: algorithm */
 	 N_("Type of computer player"), "greedy"},
+	{"profile", '\0', 0, G_OPTION_ARG_NONE, &enable_profile,
+	 /* Commandline option of ai: profile */
+	 N_("Profile the game states, and show the result when quitting"),
+	 NULL},
+	{"binary", '\0', 0, G_OPTION_ARG_NONE, &requested_binary,
+	 /* Commandline option of ai: use the binary protocol */
+	 N_("Use the binary protocol (the server must support it)"),
+	 NULL},
+	{"game-id", '\0', 0, G_OPTION_ARG_INT, &requested_game,
+	 /* Commandline option of ai: game id */
+	 N_("Join this game of a server that hosts several games"), "ID"},
 	{"debug", '\0', 0, G_OPTION_ARG_NONE, &enable_debug,
 	 /* Commandline option of ai: enable debug logging */
 	 N_("Enable debug messages"), NULL},
@@ -123,16 +140,31 @@ static void ai_init_glib_et_al(int argc, char **argv)
 	log_set_func_default();
 }
 
+static void write_profile(void)
+{
+	gchar *report = sm_profile_report();
+
+	if (report != NULL) {
+		g_printerr("%s", report);
+		g_free(report);
+	}
+}
+
 static void ai_init(void)
 {
 	set_enable_debug(enable_debug);
+	if (enable_profile) {
+		sm_profile_enable();
+		atexit(write_profile);
+	}
 
 	if (server == NULL)
 		server = g_strdup(PIONEERS_DEFAULT_GAME_HOST);
 	if (port == NULL)
 		port = g_strdup(PIONEERS_DEFAULT_GAME_PORT);
 
-	printf("ai port is %s\n", port);
+	if (server_fd < 0)
+		printf("ai port is %s\n", port);
 
 	g_random_set_seed(time(NULL) + getpid());
 
@@ -169,8 +201,14 @@ static void ai_offline(void)
 	style =
 	    g_strdup_printf("ai %s", algorithms[active_algorithm].name);
 	notifying_string_set(requested_style, style);
-	cb_connect(server, port,
-		   !algorithms[active_algorithm].request_player);
+	if (server_fd >= 0) {
+		/* The server started this computer player, and passed an
+		 * open connection */
+		cb_connect_fd(server_fd,
+			      !algorithms[active_algorithm].request_player);
+	} else
+		cb_connect(server, port,
+			   !algorithms[active_algorithm].request_player);
 	g_free(style);
 	g_free(name);
 }
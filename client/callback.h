@@ -279,6 +279,11 @@ struct callbacks {
 	void (*quit) (void);
 	/* special building phase!!!! */
 	void (*special_building_phase) (void);
+	/* the server sends a group of messages that belong together, the
+	 * display need not be updated until batch_end */
+	void (*batch_begin) (void);
+	/* the group of messages is complete */
+	void (*batch_end) (void);
 };
 
 extern struct callbacks callbacks;
@@ -292,6 +297,8 @@ extern gboolean color_chat_enabled;
  * changes to the board, etc.  The frontend should NEVER touch any game
  * structures directly (except for reading). */
 void cb_connect(const gchar * server, const gchar * port, gboolean viewer);
+/* use an open connection to a server */
+void cb_connect_fd(gint fd, gboolean viewer);
 void cb_disconnect(void);
 void cb_roll(void);
 void cb_build_road(const Edge * edge);
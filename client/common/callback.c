@@ -51,6 +51,15 @@ void cb_connect(const gchar * server, const gchar * port, gboolean viewer)
 	}
 }
 
+void cb_connect_fd(gint fd, gboolean viewer)
+{
+	/* use a connection to a server that is already open */
+	g_assert(callback_mode == MODE_INIT);
+	requested_viewer = viewer;
+	sm_use_fd(SM(), fd, FALSE);
+	sm_goto(SM(), mode_start);
+}
+
 void cb_disconnect(void)
 {
 	sm_close(SM());
@@ -40,6 +40,13 @@ int SBP_LENGTH_SECONDS = 0;
 int seconds_remaining;
 
 static enum callback_mode previous_mode;
+static gint batch_depth;	/* nesting level of the server's batches */
+static gchar *resume_token;	/* lets the server resume this player */
+static guint resume_seq;	/* lines received after the token */
+static gboolean resuming;	/* waiting for the server to resume */
+static gint resume_batch_offer;	/* batch version offered meanwhile */
+static gint resume_game_offer;	/* game offered meanwhile, or 0 */
+static guint resume_source;	/* idle source that reconnects */
 GameParams *game_params;
 static struct recovery_info_t {
 	gchar *prevstate;
@@ -57,9 +64,12 @@ static struct recovery_info_t {
 NotifyingString *requested_name = NULL;
 NotifyingString *requested_style = NULL;
 gboolean requested_viewer;
+gboolean requested_binary = FALSE;
+gint requested_game = 0;	/* game of a multi-game server, 0 for any */
 
 static gboolean global_unhandled(StateMachine * sm, gint event);
 static gboolean global_filter(StateMachine * sm, gint event);
+static void count_input(gpointer user_data, const gchar * line);
 static gboolean mode_offline(StateMachine * sm, gint event);
 static gboolean mode_players(StateMachine * sm, gint event);
 static gboolean mode_player_list(StateMachine * sm, gint event);
@@ -96,6 +106,7 @@ StateMachine *SM(void)
 		state_machine = sm_new(NULL);
 		sm_global_set(state_machine, global_filter);
 		sm_unhandled_set(state_machine, global_unhandled);
+		sm_input_set(state_machine, count_input);
 	}
 	return state_machine;
 }
@@ -226,6 +237,14 @@ static void dummy_special_building_phase(void)
 {;
 }
 
+static void dummy_batch_begin(void)
+{;
+}
+
+static void dummy_batch_end(void)
+{;
+}
+
 static void dummy_player_turn(G_GNUC_UNUSED gint player_num)
 {;
 }
@@ -502,6 +521,8 @@ void client_init(void)
 	callbacks.get_map = &dummy_get_map;
 	callbacks.set_map = &dummy_set_map;
 	callbacks.special_building_phase = &dummy_special_building_phase;
+	callbacks.batch_begin = &dummy_batch_begin;
+	callbacks.batch_end = &dummy_batch_end;
 	/* mainloop and quit are not set here */
 	resource_init();
 }
@@ -536,16 +557,136 @@ void client_start(int argc, char **argv)
  * return TRUE, the event will not be passed to the current state
  * function.
  */
+static void connection_lost(StateMachine * sm)
+{
+	log_message(MSG_ERROR, _("We have been kicked out of the game.\n"));
+	waiting_for_network(FALSE);
+	sm_pop_all_and_goto(sm, mode_offline);
+	callbacks.network_status(_("Offline"));
+}
+
+static void send_version(StateMachine * sm)
+{
+	if (requested_binary) {
+		/* Servers that know this version answer in
+		 * binary frames, others refuse it */
+		sm_send(sm, "version %s-binary\n", PROTOCOL_VERSION);
+		sm_set_binary(sm, TRUE);
+	} else
+		sm_send(sm, "version %s\n", PROTOCOL_VERSION);
+}
+
+/* The connection is made outside the handler of the closed session */
+static gboolean resume_connect(gpointer data)
+{
+	StateMachine *sm = data;
+
+	resume_source = 0;
+	if (!sm_reconnect(sm)) {
+		resuming = FALSE;
+		connection_lost(sm);
+	} else if (sm_is_connected(sm))
+		sm_send(sm, "extension resume %d %s\n", resume_seq,
+			resume_token);
+	return FALSE;
+}
+
+/* Handle the lines of a connection that is being resumed.  The
+ * server starts as for a new connection, until it knows the token.
+ */
+static gboolean resume_filter(StateMachine * sm)
+{
+	gint batch_version;
+
+	if (sm_recv(sm, "extension batch %d", &batch_version)) {
+		resume_batch_offer = batch_version;
+		return TRUE;
+	}
+	if (sm_recv(sm, "extension game %d", &resume_game_offer))
+		return TRUE;
+	if (sm_recv(sm, "version report"))
+		return TRUE;
+	if (sm_recv(sm, "extension resume ok")) {
+		log_message(MSG_INFO, _("The connection is restored.\n"));
+		resuming = FALSE;
+		/* The server sends the missed lines as before */
+		if (requested_binary)
+			sm_set_binary(sm, TRUE);
+		return TRUE;
+	}
+	if (sm_recv(sm, "extension resume failed")) {
+		/* Load the game again */
+		resuming = FALSE;
+		g_free(resume_token);
+		resume_token = NULL;
+		sm_pop_all_and_goto(sm, mode_start);
+		if (resume_game_offer > 0 && requested_game > 0
+		    && resume_game_offer != requested_game)
+			sm_send(sm, "extension game %d\n", requested_game);
+		if (resume_batch_offer > 0)
+			sm_send(sm, "extension batch %d\n",
+				MIN(resume_batch_offer, BATCH_VERSION));
+		send_version(sm);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* The server counts all lines it sent after the token, so every line
+ * is counted before the states see it, also those they handle.  The
+ * lines of the handshake of a resumed connection are not in the count.
+ */
+static void count_input(G_GNUC_UNUSED gpointer user_data,
+			const gchar * line)
+{
+	if (line != NULL && resume_token != NULL && !resuming)
+		++resume_seq;
+}
+
 static gboolean global_filter(StateMachine * sm, gint event)
 {
+	gchar *token;
+	gint seq;
+
 	switch (event) {
 	case SM_NET_CLOSE:
-		log_message(MSG_ERROR,
-			    _("We have been kicked out of the game.\n"));
-		waiting_for_network(FALSE);
-		sm_pop_all_and_goto(sm, mode_offline);
-		callbacks.network_status(_("Offline"));
+		/* Try once to resume the game on a new connection */
+		if (resume_token != NULL && !resuming) {
+			log_message(MSG_ERROR,
+				    _("The connection is lost, "
+				      "trying to restore it.\n"));
+			resuming = TRUE;
+			resume_batch_offer = 0;
+			resume_game_offer = 0;
+			resume_source = g_idle_add(resume_connect, sm);
+			return TRUE;
+		}
+		resuming = FALSE;
+		connection_lost(sm);
+		return TRUE;
+	case SM_NET_CONNECT:
+		if (!resuming)
+			break;
+		sm_send(sm, "extension resume %d %s\n", resume_seq,
+			resume_token);
+		return TRUE;
+	case SM_NET_CONNECT_FAIL:
+		if (!resuming)
+			break;
+		resuming = FALSE;
+		connection_lost(sm);
 		return TRUE;
+	case SM_RECV:
+		if (resuming)
+			return resume_filter(sm);
+		/* The server counts the lines after this one */
+		if (sm_recv(sm, "extension resume %d %S", &seq, &token)) {
+			g_free(resume_token);
+			resume_token = token;
+			resume_seq = seq;
+			return TRUE;
+		}
+		break;
 	default:
 		break;
 	}
@@ -558,6 +699,8 @@ static gboolean global_filter(StateMachine * sm, gint event)
 static gboolean global_unhandled(StateMachine * sm, gint event)
 {
 	gchar *str, *ptr;
+	gint batch_version;
+	gint game_id;
 
 	switch (event) {
 	case SM_NET_CLOSE:
@@ -591,6 +734,29 @@ static gboolean global_unhandled(StateMachine * sm, gint event)
 			g_free(str);
 			return TRUE;
 		}
+		/* a server with several games tells which one is joined */
+		if (sm_recv(sm, "extension game %d", &game_id)) {
+			if (requested_game > 0 && game_id != requested_game)
+				sm_send(sm, "extension game %d\n",
+					requested_game);
+			return TRUE;
+		}
+		/* the server offers to group its messages */
+		if (sm_recv(sm, "extension batch %d", &batch_version)) {
+			sm_send(sm, "extension batch %d\n",
+				MIN(batch_version, BATCH_VERSION));
+			return TRUE;
+		}
+		if (sm_recv(sm, "extension batch begin")) {
+			if (batch_depth++ == 0)
+				callbacks.batch_begin();
+			return TRUE;
+		}
+		if (sm_recv(sm, "extension batch end")) {
+			if (batch_depth > 0 && --batch_depth == 0)
+				callbacks.batch_end();
+			return TRUE;
+		}
 		/* protocol extensions which may be ignored have this prefix
 		 * before the next protocol changing version of the game is
 		 * released.  Notify the client about it anyway. */
@@ -604,6 +770,12 @@ static gboolean global_unhandled(StateMachine * sm, gint event)
 				ptr += strlen("special building phase time limit is ");
 				SBP_LENGTH_SECONDS = atoi(ptr);
 				return TRUE;
+			} else if (!strcmp(str, "compress zlib")) {
+				/* The server may compress the game */
+				sm_enable_inflate(sm);
+				sm_send(sm, "extension compress zlib\n");
+				g_free(str);
+				return TRUE;
 			} else {
 				log_message(MSG_INFO,
 						"Ignoring extension used by server: %s\n",
@@ -664,6 +836,78 @@ static gboolean check_chat_or_name(StateMachine * sm)
  * messages.  These can happen in almost any state in which the game
  * is running.
  */
+
+/* Messages about players, after "player %d " */
+enum {
+	OTHER_BUILT,
+	OTHER_MOVE,
+	OTHER_MOVE_BACK,
+	OTHER_REMOVE,
+	OTHER_RECEIVES,
+	OTHER_PLENTY,
+	OTHER_SPENT,
+	OTHER_REFUND,
+	OTHER_BOUGHT_DEVELOP,
+	OTHER_PLAY_DEVELOP,
+	OTHER_TURN,
+	OTHER_ROLLED,
+	OTHER_MUST_DISCARD,
+	OTHER_DISCARDED,
+	OTHER_IS_ROBBER,
+	OTHER_MOVED_ROBBER,
+	OTHER_MOVED_PIRATE,
+	OTHER_UNMOVED_ROBBER,
+	OTHER_UNMOVED_PIRATE,
+	OTHER_STOLE,
+	OTHER_MONOPOLY,
+	OTHER_LARGEST_ARMY,
+	OTHER_LONGEST_ROAD,
+	OTHER_GET_POINT,
+	OTHER_LOSE_POINT,
+	OTHER_TAKE_POINT,
+	OTHER_SETUP,
+	OTHER_SETUP_DOUBLE,
+	OTHER_WON,
+	OTHER_HAS,
+	OTHER_MARITIME_TRADE,
+};
+
+static const SmKeyword other_player_keywords[] = {
+	{"built", OTHER_BUILT},
+	{"move", OTHER_MOVE},
+	{"move-back", OTHER_MOVE_BACK},
+	{"remove", OTHER_REMOVE},
+	{"receives", OTHER_RECEIVES},
+	{"plenty", OTHER_PLENTY},
+	{"spent", OTHER_SPENT},
+	{"refund", OTHER_REFUND},
+	{"bought-develop", OTHER_BOUGHT_DEVELOP},
+	{"play-develop", OTHER_PLAY_DEVELOP},
+	{"turn", OTHER_TURN},
+	{"rolled", OTHER_ROLLED},
+	{"must-discard", OTHER_MUST_DISCARD},
+	{"discarded", OTHER_DISCARDED},
+	{"is-robber", OTHER_IS_ROBBER},
+	{"moved-robber", OTHER_MOVED_ROBBER},
+	{"moved-pirate", OTHER_MOVED_PIRATE},
+	{"unmoved-robber", OTHER_UNMOVED_ROBBER},
+	{"unmoved-pirate", OTHER_UNMOVED_PIRATE},
+	{"stole", OTHER_STOLE},
+	{"monopoly", OTHER_MONOPOLY},
+	{"largest-army", OTHER_LARGEST_ARMY},
+	{"longest-road", OTHER_LONGEST_ROAD},
+	{"get-point", OTHER_GET_POINT},
+	{"lose-point", OTHER_LOSE_POINT},
+	{"take-point", OTHER_TAKE_POINT},
+	{"setup", OTHER_SETUP},
+	{"setup-double", OTHER_SETUP_DOUBLE},
+	{"won", OTHER_WON},
+	{"has", OTHER_HAS},
+	{"maritime-trade", OTHER_MARITIME_TRADE},
+};
+
+static SmDispatch *other_player_dispatch;
+
 static gboolean check_other_players(StateMachine * sm)
 {
 	BuildType build_type;
@@ -682,198 +926,275 @@ static gboolean check_other_players(StateMachine * sm)
 	if (!sm_recv_prefix(sm, "player %d ", &player_num))
 		return FALSE;
 
-	if (sm_recv(sm, "built %B %d %d %d", &build_type, &x, &y, &pos)) {
-		player_build_add(player_num, build_type, x, y, pos, TRUE);
-		return TRUE;
-	}
-	if (sm_recv
-	    (sm, "move %d %d %d %d %d %d", &sx, &sy, &spos, &dx, &dy,
-	     &dpos)) {
-		player_build_move(player_num, sx, sy, spos, dx, dy, dpos,
-				  FALSE);
-		return TRUE;
-	}
-	if (sm_recv
-	    (sm, "move-back %d %d %d %d %d %d", &sx, &sy, &spos, &dx, &dy,
-	     &dpos)) {
-		player_build_move(player_num, sx, sy, spos, dx, dy, dpos,
-				  TRUE);
-		return TRUE;
-	}
-	if (sm_recv(sm, "remove %B %d %d %d", &build_type, &x, &y, &pos)) {
-		player_build_remove(player_num, build_type, x, y, pos);
-		return TRUE;
-	}
-	if (sm_recv(sm, "receives %R %R", resource_list, wanted_list)) {
-		gint i;
-		for (i = 0; i < NO_RESOURCE; ++i) {
-			if (resource_list[i] == wanted_list[i])
-				continue;
-			if (resource_list[i] == 0) {
-				log_message(MSG_RESOURCE,
-					    _(""
-					      "%s does not receive any %s, because the bank is empty.\n"),
-					    player_name(player_num, TRUE),
-					    resource_name(i, FALSE));
-			} else {
-				gint j, list[NO_RESOURCE];
-				gchar *buff;
-				for (j = 0; j < NO_RESOURCE; ++j)
-					list[j] = 0;
-				list[i] = resource_list[i];
-				resource_list[i] = 0;
-				buff = resource_format_num(list);
-				log_message(MSG_RESOURCE,
-					    _(""
-					      "%s only receives %s, because the bank didn't have any more.\n"),
-					    player_name(player_num, TRUE),
-					    buff);
-				g_free(buff);
-				resource_apply_list(player_num, list, 1);
+	if (other_player_dispatch == NULL)
+		other_player_dispatch =
+		    sm_dispatch_new(other_player_keywords,
+				    G_N_ELEMENTS(other_player_keywords));
+
+	switch (sm_dispatch(sm, other_player_dispatch)) {
+	case OTHER_BUILT:
+		if (sm_recv
+		    (sm, "built %B %d %d %d", &build_type, &x, &y, &pos)) {
+			player_build_add(player_num, build_type, x, y, pos,
+					 TRUE);
+			return TRUE;
+		}
+		break;
+	case OTHER_MOVE:
+		if (sm_recv
+		    (sm, "move %d %d %d %d %d %d", &sx, &sy, &spos, &dx, &dy,
+		     &dpos)) {
+			player_build_move(player_num, sx, sy, spos, dx, dy,
+					  dpos, FALSE);
+			return TRUE;
+		}
+		break;
+	case OTHER_MOVE_BACK:
+		if (sm_recv
+		    (sm, "move-back %d %d %d %d %d %d", &sx, &sy, &spos, &dx,
+		     &dy, &dpos)) {
+			player_build_move(player_num, sx, sy, spos, dx, dy,
+					  dpos, TRUE);
+			return TRUE;
+		}
+		break;
+	case OTHER_REMOVE:
+		if (sm_recv
+		    (sm, "remove %B %d %d %d", &build_type, &x, &y, &pos)) {
+			player_build_remove(player_num, build_type, x, y, pos);
+			return TRUE;
+		}
+		break;
+	case OTHER_RECEIVES:
+		if (sm_recv(sm, "receives %R %R", resource_list, wanted_list)) {
+			gint i;
+			for (i = 0; i < NO_RESOURCE; ++i) {
+				if (resource_list[i] == wanted_list[i])
+					continue;
+				if (resource_list[i] == 0) {
+					log_message(MSG_RESOURCE,
+						    _(""
+						      "%s does not receive any %s, because the bank is empty.\n"),
+						    player_name(player_num,
+								TRUE),
+						    resource_name(i, FALSE));
+				} else {
+					gint j, list[NO_RESOURCE];
+					gchar *buff;
+					for (j = 0; j < NO_RESOURCE; ++j)
+						list[j] = 0;
+					list[i] = resource_list[i];
+					resource_list[i] = 0;
+					buff = resource_format_num(list);
+					log_message(MSG_RESOURCE,
+						    _(""
+						      "%s only receives %s, because the bank didn't have any more.\n"),
+						    player_name(player_num,
+								TRUE), buff);
+					g_free(buff);
+					resource_apply_list(player_num,
+							    list, 1);
+				}
 			}
+			if (resource_count(resource_list) != 0)
+				player_resource_action(player_num,
+						       _("%s receives %s.\n"),
+						       resource_list, 1);
+			callbacks.get_rolled_resources(player_num,
+						       resource_list,
+						       wanted_list);
+			return TRUE;
 		}
-		if (resource_count(resource_list) != 0)
+		break;
+	case OTHER_PLENTY:
+		if (sm_recv(sm, "plenty %R", resource_list)) {
+			/* Year of Plenty */
+			player_resource_action(player_num, _("%s takes %s.\n"),
+					       resource_list, 1);
+			return TRUE;
+		}
+		break;
+	case OTHER_SPENT:
+		if (sm_recv(sm, "spent %R", resource_list)) {
+			player_resource_action(player_num, _("%s spent %s.\n"),
+					       resource_list, -1);
+			return TRUE;
+		}
+		break;
+	case OTHER_REFUND:
+		if (sm_recv(sm, "refund %R", resource_list)) {
 			player_resource_action(player_num,
-					       _("%s receives %s.\n"),
+					       _("%s is refunded %s.\n"),
 					       resource_list, 1);
-		callbacks.get_rolled_resources(player_num, resource_list,
-					       wanted_list);
-		return TRUE;
-	}
-	if (sm_recv(sm, "plenty %R", resource_list)) {
-		/* Year of Plenty */
-		player_resource_action(player_num, _("%s takes %s.\n"),
-				       resource_list, 1);
-		return TRUE;
-	}
-	if (sm_recv(sm, "spent %R", resource_list)) {
-		player_resource_action(player_num, _("%s spent %s.\n"),
-				       resource_list, -1);
-		return TRUE;
-	}
-	if (sm_recv(sm, "refund %R", resource_list)) {
-		player_resource_action(player_num,
-				       _("%s is refunded %s.\n"),
-				       resource_list, 1);
-		return TRUE;
-	}
-	if (sm_recv(sm, "bought-develop")) {
-		develop_bought(player_num);
-		return TRUE;
-	}
-	if (sm_recv(sm, "play-develop %d %D", &card_idx, &devel_type)) {
-		develop_played(player_num, card_idx, devel_type);
-		return TRUE;
-	}
-	if (sm_recv(sm, "turn %d", &turn_num)) {
-		turn_begin(player_num, turn_num);
-		return TRUE;
-	}
-	if (sm_recv(sm, "rolled %d %d", &die1, &die2)) {
-		turn_rolled_dice(player_num, die1, die2);
-		if (die1 + die2 != 7)
-			sm_push(sm, mode_wait_resources);
-		return TRUE;
-	}
-	if (sm_recv(sm, "must-discard %d", &discard_num)) {
-		waiting_for_network(FALSE);
-		sm_push(sm, mode_discard);
-		if (player_num == my_player_num())
-			callback_mode = MODE_DISCARD;
-		callbacks.discard_add(player_num, discard_num);
-		return TRUE;
-	}
-	if (sm_recv(sm, "discarded %R", resource_list)) {
-		player_resource_action(player_num, _("%s discarded %s.\n"),
-				       resource_list, -1);
-		callbacks.discard_remove(player_num);
-		return TRUE;
-	}
-	if (sm_recv(sm, "is-robber")) {
-		robber_begin_move(player_num);
-		return TRUE;
-	}
-	if (sm_recv(sm, "moved-robber %d %d", &x, &y)) {
-		robber_moved(player_num, x, y, FALSE);
-		return TRUE;
-	}
-	if (sm_recv(sm, "moved-pirate %d %d", &x, &y)) {
-		pirate_moved(player_num, x, y, FALSE);
-		return TRUE;
-	}
-	if (sm_recv(sm, "unmoved-robber %d %d", &x, &y)) {
-		robber_moved(player_num, x, y, TRUE);
-		return TRUE;
-	}
-	if (sm_recv(sm, "unmoved-pirate %d %d", &x, &y)) {
-		pirate_moved(player_num, x, y, TRUE);
-		return TRUE;
-	}
-	if (sm_recv(sm, "stole from %d", &victim_num)) {
-		player_stole_from(player_num, victim_num, NO_RESOURCE);
-		return TRUE;
-	}
-	if (sm_recv(sm, "stole %r from %d", &resource_type, &victim_num)) {
-		player_stole_from(player_num, victim_num, resource_type);
-		return TRUE;
-	}
-	if (sm_recv
-	    (sm, "monopoly %d %r from %d", &num, &resource_type,
-	     &victim_num)) {
-		monopoly_player(player_num, victim_num, num,
-				resource_type);
-		return TRUE;
-	}
-	if (sm_recv(sm, "largest-army")) {
-		player_largest_army(player_num);
-		return TRUE;
-	}
-	if (sm_recv(sm, "longest-road")) {
-		player_longest_road(player_num);
-		return TRUE;
-	}
-	if (sm_recv(sm, "get-point %d %d %S", &id, &num, &str)) {
-		player_get_point(player_num, id, str, num);
-		g_free(str);
-		return TRUE;
-	}
-	if (sm_recv(sm, "lose-point %d", &id)) {
-		player_lose_point(player_num, id);
-		return TRUE;
-	}
-	if (sm_recv(sm, "take-point %d %d", &id, &victim_num)) {
-		player_take_point(player_num, id, victim_num);
-		return TRUE;
-	}
-	if (sm_recv(sm, "setup %d", &backwards)) {
-		setup_begin(player_num);
-		if (backwards)
+			return TRUE;
+		}
+		break;
+	case OTHER_BOUGHT_DEVELOP:
+		if (sm_recv(sm, "bought-develop")) {
+			develop_bought(player_num);
+			return TRUE;
+		}
+		break;
+	case OTHER_PLAY_DEVELOP:
+		if (sm_recv(sm, "play-develop %d %D", &card_idx, &devel_type)) {
+			develop_played(player_num, card_idx, devel_type);
+			return TRUE;
+		}
+		break;
+	case OTHER_TURN:
+		if (sm_recv(sm, "turn %d", &turn_num)) {
+			turn_begin(player_num, turn_num);
+			return TRUE;
+		}
+		break;
+	case OTHER_ROLLED:
+		if (sm_recv(sm, "rolled %d %d", &die1, &die2)) {
+			turn_rolled_dice(player_num, die1, die2);
+			if (die1 + die2 != 7)
+				sm_push(sm, mode_wait_resources);
+			return TRUE;
+		}
+		break;
+	case OTHER_MUST_DISCARD:
+		if (sm_recv(sm, "must-discard %d", &discard_num)) {
+			waiting_for_network(FALSE);
+			sm_push(sm, mode_discard);
+			if (player_num == my_player_num())
+				callback_mode = MODE_DISCARD;
+			callbacks.discard_add(player_num, discard_num);
+			return TRUE;
+		}
+		break;
+	case OTHER_DISCARDED:
+		if (sm_recv(sm, "discarded %R", resource_list)) {
+			player_resource_action(player_num,
+					       _("%s discarded %s.\n"),
+					       resource_list, -1);
+			callbacks.discard_remove(player_num);
+			return TRUE;
+		}
+		break;
+	case OTHER_IS_ROBBER:
+		if (sm_recv(sm, "is-robber")) {
+			robber_begin_move(player_num);
+			return TRUE;
+		}
+		break;
+	case OTHER_MOVED_ROBBER:
+		if (sm_recv(sm, "moved-robber %d %d", &x, &y)) {
+			robber_moved(player_num, x, y, FALSE);
+			return TRUE;
+		}
+		break;
+	case OTHER_MOVED_PIRATE:
+		if (sm_recv(sm, "moved-pirate %d %d", &x, &y)) {
+			pirate_moved(player_num, x, y, FALSE);
+			return TRUE;
+		}
+		break;
+	case OTHER_UNMOVED_ROBBER:
+		if (sm_recv(sm, "unmoved-robber %d %d", &x, &y)) {
+			robber_moved(player_num, x, y, TRUE);
+			return TRUE;
+		}
+		break;
+	case OTHER_UNMOVED_PIRATE:
+		if (sm_recv(sm, "unmoved-pirate %d %d", &x, &y)) {
+			pirate_moved(player_num, x, y, TRUE);
+			return TRUE;
+		}
+		break;
+	case OTHER_STOLE:
+		if (sm_recv(sm, "stole from %d", &victim_num)) {
+			player_stole_from(player_num, victim_num, NO_RESOURCE);
+			return TRUE;
+		}
+		if (sm_recv
+		    (sm, "stole %r from %d", &resource_type, &victim_num)) {
+			player_stole_from(player_num, victim_num,
+					  resource_type);
+			return TRUE;
+		}
+		break;
+	case OTHER_MONOPOLY:
+		if (sm_recv
+		    (sm, "monopoly %d %r from %d", &num, &resource_type,
+		     &victim_num)) {
+			monopoly_player(player_num, victim_num, num,
+					resource_type);
+			return TRUE;
+		}
+		break;
+	case OTHER_LARGEST_ARMY:
+		if (sm_recv(sm, "largest-army")) {
+			player_largest_army(player_num);
+			return TRUE;
+		}
+		break;
+	case OTHER_LONGEST_ROAD:
+		if (sm_recv(sm, "longest-road")) {
+			player_longest_road(player_num);
+			return TRUE;
+		}
+		break;
+	case OTHER_GET_POINT:
+		if (sm_recv(sm, "get-point %d %d %S", &id, &num, &str)) {
+			player_get_point(player_num, id, str, num);
+			g_free(str);
+			return TRUE;
+		}
+		break;
+	case OTHER_LOSE_POINT:
+		if (sm_recv(sm, "lose-point %d", &id)) {
+			player_lose_point(player_num, id);
+			return TRUE;
+		}
+		break;
+	case OTHER_TAKE_POINT:
+		if (sm_recv(sm, "take-point %d %d", &id, &victim_num)) {
+			player_take_point(player_num, id, victim_num);
+			return TRUE;
+		}
+		break;
+	case OTHER_SETUP:
+		if (sm_recv(sm, "setup %d", &backwards)) {
+			setup_begin(player_num);
+			if (backwards)
+				sm_push(sm, mode_wait_resources);
+			return TRUE;
+		}
+		break;
+	case OTHER_SETUP_DOUBLE:
+		if (sm_recv(sm, "setup-double")) {
+			setup_begin_double(player_num);
 			sm_push(sm, mode_wait_resources);
-		return TRUE;
-	}
-	if (sm_recv(sm, "setup-double")) {
-		setup_begin_double(player_num);
-		sm_push(sm, mode_wait_resources);
-		return TRUE;
-	}
-	if (sm_recv(sm, "won with %d", &num)) {
-		callbacks.game_over(player_num, num);
-		log_message(MSG_DICE, _("%s has won the game with %d "
-					"victory points!\n"),
-			    player_name(player_num, TRUE), num);
-		sm_pop_all_and_goto(sm, mode_game_over);
-		return TRUE;
-	}
-	if (sm_recv(sm, "has quit")) {
-		player_has_quit(player_num);
-		return TRUE;
-	}
-
-	if (sm_recv(sm, "maritime-trade %d supply %r receive %r",
-		    &ratio, &supply_type, &receive_type)) {
-		player_maritime_trade(player_num, ratio, supply_type,
-				      receive_type);
-		return TRUE;
+			return TRUE;
+		}
+		break;
+	case OTHER_WON:
+		if (sm_recv(sm, "won with %d", &num)) {
+			callbacks.game_over(player_num, num);
+			log_message(MSG_DICE, _("%s has won the game with %d "
+						"victory points!\n"),
+				    player_name(player_num, TRUE), num);
+			sm_pop_all_and_goto(sm, mode_game_over);
+			return TRUE;
+		}
+		break;
+	case OTHER_HAS:
+		if (sm_recv(sm, "has quit")) {
+			player_has_quit(player_num);
+			return TRUE;
+		}
+		break;
+	case OTHER_MARITIME_TRADE:
+		if (sm_recv(sm, "maritime-trade %d supply %r receive %r",
+			    &ratio, &supply_type, &receive_type)) {
+			player_maritime_trade(player_num, ratio, supply_type,
+					      receive_type);
+			return TRUE;
+		}
+		break;
 	}
 
 	sm_cancel_prefix(sm);
@@ -920,6 +1241,19 @@ static gboolean mode_offline(StateMachine * sm, gint event)
 	sm_state_name(sm, "mode_offline");
 	switch (event) {
 	case SM_ENTER:
+		/* The game cannot be resumed anymore */
+		if (resume_source != 0) {
+			g_source_remove(resume_source);
+			resume_source = 0;
+		}
+		resuming = FALSE;
+		g_free(resume_token);
+		resume_token = NULL;
+		/* The end of an interrupted batch will not arrive */
+		if (batch_depth > 0) {
+			batch_depth = 0;
+			callbacks.batch_end();
+		}
 		callback_mode = MODE_INIT;
 		callbacks.offline();
 		break;
@@ -965,7 +1299,7 @@ gboolean mode_start(StateMachine * sm, gint event)
 	if (event != SM_RECV)
 		return FALSE;
 	if (sm_recv(sm, "version report")) {
-		sm_send(sm, "version %s\n", PROTOCOL_VERSION);
+		send_version(sm);
 		return TRUE;
 	}
 	if (sm_recv(sm, "status report")) {
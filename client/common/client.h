@@ -32,6 +32,8 @@ extern GameParams *game_params;
 extern NotifyingString *requested_name;
 extern NotifyingString *requested_style;
 extern gboolean requested_viewer;
+extern gboolean requested_binary;
+extern gint requested_game;
 
 /********* client.c ***********/
 /* client initialization */
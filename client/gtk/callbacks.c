@@ -176,4 +176,6 @@ void frontend_set_callbacks(void)
 	callbacks.get_map = &frontend_get_map;
 	callbacks.set_map = &frontend_set_map;
 	callbacks.special_building_phase = &frontend_special_building_phase;
+	callbacks.batch_begin = &frontend_batch_begin;
+	callbacks.batch_end = &frontend_batch_end;
 }
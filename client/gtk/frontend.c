@@ -82,13 +82,35 @@ void frontend_gui_register_init(void)
 	frontend_widgets = g_hash_table_new(NULL, NULL);
 }
 
+/* While a batch of messages arrives, the updates are postponed */
+static gboolean gui_update_deferred;
+static gboolean gui_update_pending;
+
 void frontend_gui_update(void)
 {
+	if (gui_update_deferred) {
+		gui_update_pending = TRUE;
+		return;
+	}
 	route_gui_event(GUI_UPDATE);
 	g_hash_table_foreach(frontend_widgets, (GHFunc) set_sensitive,
 			     NULL);
 }
 
+void frontend_batch_begin(void)
+{
+	gui_update_deferred = TRUE;
+}
+
+void frontend_batch_end(void)
+{
+	gui_update_deferred = FALSE;
+	if (gui_update_pending) {
+		gui_update_pending = FALSE;
+		frontend_gui_update();
+	}
+}
+
 void frontend_gui_check(GuiEvent event, gboolean sensitive)
 {
 	GuiWidgetState *gui;
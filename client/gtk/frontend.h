@@ -80,6 +80,11 @@ extern gboolean frontend_waiting_for_network;
 /** set all widgets to their programmed state. */
 void frontend_gui_update(void);
 
+/** postpone frontend_gui_update until the batch has been received. */
+void frontend_batch_begin(void);
+/** do the postponed frontend_gui_update. */
+void frontend_batch_end(void);
+
 /** program the state of a widget for when frontend_gui_update is called. */
 void frontend_gui_check(GuiEvent event, gboolean sensitive);
 
@@ -0,0 +1,270 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <glib.h>
+#include "driver.h"
+#include "common_epoll.h"
+
+/* Maximum number of events that are handled per epoll_wait */
+#define EVL_EPOLL_MAX_EVENTS 256
+
+typedef struct _EvlEpollFd EvlEpollFd;
+
+typedef struct {
+	guint tag;
+	EvlEpollFd *efd;
+	InputFunc func;
+	gpointer param;
+} EvlEpollWatch;
+
+/* epoll accepts only one registration per file descriptor,
+ * the read and the write watch share it.
+ */
+struct _EvlEpollFd {
+	gint fd;
+	guint32 events;		/* Registered events, 0 when not registered */
+	EvlEpollWatch *read;
+	EvlEpollWatch *write;
+};
+
+static gint epoll_fd = -1;
+static GHashTable *fd_hash;	/* fd -> EvlEpollFd */
+static GHashTable *tag_hash;	/* tag -> EvlEpollWatch */
+static guint last_tag;
+
+/* Records that are removed while their events are being dispatched
+ * can only be freed when the dispatch is done.
+ */
+static gint dispatch_depth;
+static GSList *dead_fds;
+
+static GPollFD epoll_poll_fd;
+
+static void evl_epoll_register(EvlEpollFd * efd)
+{
+	struct epoll_event ev;
+	guint32 events = 0;
+
+	if (efd->read != NULL)
+		events |= EPOLLIN;
+	if (efd->write != NULL)
+		events |= EPOLLOUT;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.data.ptr = efd;
+
+	if (events == 0) {
+		/* The descriptor may be closed already, which removed it */
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, efd->fd, &ev);
+		g_hash_table_remove(fd_hash, GINT_TO_POINTER(efd->fd));
+		if (dispatch_depth > 0)
+			dead_fds = g_slist_prepend(dead_fds, efd);
+		else
+			g_free(efd);
+		return;
+	}
+
+	/* Re-registering reports the current state again, so a watch
+	 * that is added late does not miss an edge.
+	 */
+	ev.events = events | EPOLLET;
+	if (efd->events != 0) {
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, efd->fd, &ev) == 0) {
+			efd->events = events;
+			return;
+		}
+		/* Closing the descriptor removed it from the epoll set */
+		if (errno != ENOENT) {
+			g_warning("epoll_ctl(%d): %s", efd->fd,
+				  g_strerror(errno));
+			return;
+		}
+	}
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, efd->fd, &ev) < 0) {
+		g_warning("epoll_ctl(%d): %s", efd->fd, g_strerror(errno));
+		return;
+	}
+	efd->events = events;
+}
+
+static guint evl_epoll_input_add_watch(gint fd, gboolean write,
+				       InputFunc func, gpointer param)
+{
+	EvlEpollFd *efd;
+	EvlEpollWatch *watch;
+
+	g_return_val_if_fail(epoll_fd >= 0, 0);
+
+	efd = g_hash_table_lookup(fd_hash, GINT_TO_POINTER(fd));
+	if (efd == NULL) {
+		efd = g_malloc0(sizeof(*efd));
+		efd->fd = fd;
+		g_hash_table_insert(fd_hash, GINT_TO_POINTER(fd), efd);
+	}
+	g_return_val_if_fail((write ? efd->write : efd->read) == NULL, 0);
+
+	watch = g_malloc0(sizeof(*watch));
+	do {
+		watch->tag = ++last_tag;
+	} while (watch->tag == 0
+		 || g_hash_table_lookup(tag_hash,
+					GUINT_TO_POINTER(watch->tag)));
+	watch->efd = efd;
+	watch->func = func;
+	watch->param = param;
+	g_hash_table_insert(tag_hash, GUINT_TO_POINTER(watch->tag), watch);
+
+	if (write)
+		efd->write = watch;
+	else
+		efd->read = watch;
+	evl_epoll_register(efd);
+
+	return watch->tag;
+}
+
+guint evl_epoll_input_add_read(gint fd, InputFunc func, gpointer param)
+{
+	return evl_epoll_input_add_watch(fd, FALSE, func, param);
+}
+
+guint evl_epoll_input_add_write(gint fd, InputFunc func, gpointer param)
+{
+	return evl_epoll_input_add_watch(fd, TRUE, func, param);
+}
+
+void evl_epoll_input_remove(guint tag)
+{
+	EvlEpollWatch *watch;
+	EvlEpollFd *efd;
+
+	watch = g_hash_table_lookup(tag_hash, GUINT_TO_POINTER(tag));
+	g_return_if_fail(watch != NULL);
+	g_hash_table_remove(tag_hash, GUINT_TO_POINTER(tag));
+
+	efd = watch->efd;
+	if (efd->read == watch)
+		efd->read = NULL;
+	if (efd->write == watch)
+		efd->write = NULL;
+	g_free(watch);
+
+	evl_epoll_register(efd);
+}
+
+gint evl_epoll_dispatch(gint timeout)
+{
+	struct epoll_event events[EVL_EPOLL_MAX_EVENTS];
+	gint num;
+	gint idx;
+
+	num = epoll_wait(epoll_fd, events, EVL_EPOLL_MAX_EVENTS, timeout);
+	if (num <= 0)
+		return num;
+
+	++dispatch_depth;
+	for (idx = 0; idx < num; ++idx) {
+		EvlEpollFd *efd = events[idx].data.ptr;
+		guint32 ev = events[idx].events;
+
+		/* Errors and hangups are reported to both watches, the
+		 * callbacks find out about them when they use the socket.
+		 * Each callback can remove any watch, so check again.
+		 */
+		if ((ev & (EPOLLIN | EPOLLHUP | EPOLLERR))
+		    && efd->read != NULL)
+			efd->read->func(efd->read->param);
+		if ((ev & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+		    && efd->write != NULL)
+			efd->write->func(efd->write->param);
+	}
+	if (--dispatch_depth == 0) {
+		while (dead_fds != NULL) {
+			g_free(dead_fds->data);
+			dead_fds = g_slist_delete_link(dead_fds, dead_fds);
+		}
+	}
+	return num;
+}
+
+/* The epoll descriptor is readable as long as events are pending.
+ * GLib polls it like any other descriptor, so its timeouts and idle
+ * handlers keep working.
+ */
+static gboolean evl_epoll_source_prepare(G_GNUC_UNUSED GSource * source,
+					 gint * timeout)
+{
+	*timeout = -1;
+	return FALSE;
+}
+
+static gboolean evl_epoll_source_check(G_GNUC_UNUSED GSource * source)
+{
+	return (epoll_poll_fd.revents & G_IO_IN) != 0;
+}
+
+static gboolean evl_epoll_source_dispatch(G_GNUC_UNUSED GSource * source,
+					  G_GNUC_UNUSED GSourceFunc
+					  callback,
+					  G_GNUC_UNUSED gpointer user_data)
+{
+	evl_epoll_dispatch(0);
+	return TRUE;
+}
+
+static GSourceFuncs evl_epoll_source_funcs = {
+	evl_epoll_source_prepare,
+	evl_epoll_source_check,
+	evl_epoll_source_dispatch,
+	NULL,
+	NULL,
+	NULL
+};
+
+gboolean evl_epoll_init(void)
+{
+	GSource *source;
+
+	if (epoll_fd >= 0)
+		return TRUE;
+
+	/* The size is only a hint */
+	epoll_fd = epoll_create(EVL_EPOLL_MAX_EVENTS);
+	if (epoll_fd < 0)
+		return FALSE;
+
+	fd_hash = g_hash_table_new(NULL, NULL);
+	tag_hash = g_hash_table_new(NULL, NULL);
+
+	source = g_source_new(&evl_epoll_source_funcs, sizeof(GSource));
+	epoll_poll_fd.fd = epoll_fd;
+	epoll_poll_fd.events = G_IO_IN;
+	g_source_add_poll(source, &epoll_poll_fd);
+	g_source_attach(source, NULL);
+	g_source_unref(source);
+
+	return TRUE;
+}
+
+#endif				/* HAVE_SYS_EPOLL_H */
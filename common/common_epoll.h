@@ -0,0 +1,48 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __common_epoll_h
+#define __common_epoll_h
+
+/* Input watches backed by a single edge-triggered epoll descriptor.
+ * The callbacks are only told that the state of the file descriptor
+ * changed, so they must read or write until the operation would block.
+ * Only available when HAVE_SYS_EPOLL_H is defined.
+ */
+
+/** Create the epoll descriptor and hook it into the default GLib main
+ * context.  It is safe to call this more than once.
+ * @return FALSE if epoll is not available, errno is set
+ */
+extern gboolean evl_epoll_init(void);
+
+extern guint evl_epoll_input_add_read(gint fd, InputFunc func,
+				      gpointer param);
+extern guint evl_epoll_input_add_write(gint fd, InputFunc func,
+				       gpointer param);
+extern void evl_epoll_input_remove(guint tag);
+
+/** Wait for events and call the callbacks, for programs that do not run
+ * a GLib main loop.
+ * @param timeout Maximum time to wait in milliseconds, -1 waits forever
+ * @return The number of file descriptors that had events,
+ *         or -1 on error (errno is set)
+ */
+extern gint evl_epoll_dispatch(gint timeout);
+
+#endif
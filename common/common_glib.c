@@ -27,12 +27,8 @@
 typedef struct {
 	void (*func) (gpointer);
 	gpointer param;
-	GIOChannel *channel;
 } evl_io_func;
 
-
-GHashTable *_evl_glib_hash = NULL;
-
 /* Local function prototypes. */
 guint evl_glib_input_add_read(gint fd, void (*func) (gpointer),
 			      gpointer param);
@@ -51,44 +47,30 @@ static gboolean evl_glib_call_func(G_GNUC_UNUSED GIOChannel * source,
 	return TRUE;
 }
 
-static void evl_glib_channel_destroyed(gpointer data)
-{
-	GIOChannel *io_channel = (GIOChannel *) data;
-	/* free the srv_io_func structure associated with the channel */
-	evl_io_func *io_func =
-	    g_hash_table_lookup(_evl_glib_hash, io_channel);
-
-	if (io_func)
-		g_free(io_func);
-
-	g_hash_table_remove(_evl_glib_hash, io_channel);
-}
-
-
+/* The watches are added to the main context of the thread, so a thread
+ * that runs its own main loop only gets the events of its own sockets.
+ * The thread that removes a watch must be the thread that added it.
+ */
 static guint evl_glib_input_add_watch(gint fd, GIOCondition condition,
 				      void (*func) (gpointer),
 				      gpointer param)
 {
 	GIOChannel *io_channel;
+	GSource *source;
 	evl_io_func *io_func = g_malloc0(sizeof(evl_io_func));
 	guint tag;
 
 	io_channel = g_io_channel_unix_new(fd);
 	io_func->func = func;
 	io_func->param = param;
-	io_func->channel = io_channel;
 
-	tag =
-	    g_io_add_watch_full(io_channel, G_PRIORITY_DEFAULT, condition,
-				evl_glib_call_func, io_func,
-				evl_glib_channel_destroyed);
-
-	/* allocate hash table if it hasn't yet been done */
-	if (!_evl_glib_hash)
-		_evl_glib_hash = g_hash_table_new(NULL, NULL);
-
-	/* insert the channel and function into a hash table; key on channel */
-	g_hash_table_insert(_evl_glib_hash, io_channel, io_func);
+	source = g_io_create_watch(io_channel, condition);
+	g_source_set_callback(source, (GSourceFunc) evl_glib_call_func,
+			      io_func, g_free);
+	tag = g_source_attach(source, g_main_context_get_thread_default());
+	/* The watch keeps both alive */
+	g_source_unref(source);
+	g_io_channel_unref(io_channel);
 
 	return tag;
 }
@@ -108,7 +90,12 @@ guint evl_glib_input_add_write(gint fd, InputFunc func, gpointer param)
 
 void evl_glib_input_remove(guint tag)
 {
-	g_source_remove(tag);
+	GSource *source =
+	    g_main_context_find_source_by_id
+	    (g_main_context_get_thread_default(), tag);
+
+	if (source != NULL)
+		g_source_destroy(source);
 }
 
 
@@ -748,6 +748,7 @@ gint game_vscanf(const gchar * line, const gchar * fmt, va_list ap)
 
 	while (*fmt != '\0' && line[offset] != '\0') {
 		gchar **str;
+		const gchar **slice;
 		gint *num;
 		gint idx;
 		gint len;
@@ -769,6 +770,11 @@ gint game_vscanf(const gchar * line, const gchar * fmt, va_list ap)
 			*str = g_strdup(line + offset);
 			offset += strlen(*str);
 			break;
+		case 's':	/* as %S, but points into the line */
+			slice = va_arg(ap, const gchar **);
+			*slice = line + offset;
+			offset += strlen(*slice);
+			break;
 		case 'd':	/* integer */
 			num = va_arg(ap, gint *);
 			len = get_num(line + offset, num);
@@ -842,13 +848,6 @@ gint game_vscanf(const gchar * line, const gchar * fmt, va_list ap)
 	return offset;
 }
 
-#define buff_append(result, format, value) \
-	do { \
-		gchar *old = result; \
-		result = g_strdup_printf("%s" format, result, value); \
-		g_free(old); \
-	} while (0)
-
 gchar *game_printf(const gchar * fmt, ...)
 {
 	va_list ap;
@@ -863,19 +862,30 @@ gchar *game_printf(const gchar * fmt, ...)
 
 gchar *game_vprintf(const gchar * fmt, va_list ap)
 {
-	/* initialize result to an allocated empty string */
-	gchar *result = g_strdup("");
+	GString *result = g_string_sized_new(64);
+
+	game_vprintf_buffer(result, fmt, ap);
+	return g_string_free(result, FALSE);
+}
+
+static void buffer_append_int(GString * buffer, gint value)
+{
+	gchar num[16];
+	gint len = g_snprintf(num, sizeof(num), "%d", value);
+
+	g_string_append_len(buffer, num, len);
+}
 
+void game_vprintf_buffer(GString * buffer, const gchar * fmt, va_list ap)
+{
 	while (*fmt != '\0') {
-		gchar *pos = strchr(fmt, '%');
+		const gchar *pos = strchr(fmt, '%');
 		if (pos == NULL) {
-			buff_append(result, "%s", fmt);
+			g_string_append(buffer, fmt);
 			break;
 		}
 		/* add format until next % to result */
-		result = g_realloc(result, strlen(result) + pos - fmt + 1);
-		result[strlen(result) + pos - fmt] = '\0';
-		memcpy(&result[strlen(result)], fmt, pos - fmt);
+		g_string_append_len(buffer, fmt, pos - fmt);
 		fmt = pos + 1;
 
 		switch (*fmt++) {
@@ -883,32 +893,32 @@ gchar *game_vprintf(const gchar * fmt, va_list ap)
 			const gint *num;
 			gint idx;
 		case 's':	/* string */
-			buff_append(result, "%s", va_arg(ap, gchar *));
+			g_string_append(buffer, va_arg(ap, gchar *));
 			break;
 		case 'd':	/* integer */
 		case 'D':	/* development card type */
-			buff_append(result, "%d", va_arg(ap, gint));
+			buffer_append_int(buffer, va_arg(ap, gint));
 			break;
 		case 'B':	/* build type */
 			build_type = va_arg(ap, BuildType);
 			switch (build_type) {
 			case BUILD_ROAD:
-				buff_append(result, "%s", "road");
+				g_string_append(buffer, "road");
 				break;
 			case BUILD_BRIDGE:
-				buff_append(result, "%s", "bridge");
+				g_string_append(buffer, "bridge");
 				break;
 			case BUILD_SHIP:
-				buff_append(result, "%s", "ship");
+				g_string_append(buffer, "ship");
 				break;
 			case BUILD_SETTLEMENT:
-				buff_append(result, "%s", "settlement");
+				g_string_append(buffer, "settlement");
 				break;
 			case BUILD_CITY:
-				buff_append(result, "%s", "city");
+				g_string_append(buffer, "city");
 				break;
 			case BUILD_CITY_WALL:
-				buff_append(result, "%s", "city_wall");
+				g_string_append(buffer, "city_wall");
 				break;
 			case BUILD_NONE:
 				g_error
@@ -924,18 +934,14 @@ gchar *game_vprintf(const gchar * fmt, va_list ap)
 			num = va_arg(ap, gint *);
 			for (idx = 0; idx < NO_RESOURCE; idx++) {
 				if (idx > 0)
-					buff_append(result, " %d",
-						    num[idx]);
-				else
-					buff_append(result, "%d",
-						    num[idx]);
+					g_string_append_c(buffer, ' ');
+				buffer_append_int(buffer, num[idx]);
 			}
 			break;
 		case 'r':	/* resource type */
-			buff_append(result, "%s",
-				    resource_types[va_arg(ap, Resource)]);
+			g_string_append(buffer,
+					resource_types[va_arg(ap, Resource)]);
 			break;
 		}
 	}
-	return result;
 }
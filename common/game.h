@@ -44,6 +44,7 @@ typedef enum {
 #define MAX_CHAT 496		/* maximum chat message size
 				 * (512 - strlen("player 0 chat \n") - 1) */
 #define MAX_NAME_LENGTH 30	/* maximum length for the name of a player */
+#define BATCH_VERSION 1		/* latest version of the batch extension */
 
 typedef enum {
 	VAR_DEFAULT,		/* plain out-of-the-box game */
@@ -135,6 +136,10 @@ void points_free(Points * points);
  *	%S - string from current position to end of line
  *		this takes a gchar ** argument, in which an allocated buffer
  *		is returned.  It must be freed by the caller.
+ *	%s - when parsing: as %S, but this takes a const gchar ** argument
+ *		that points into the line, nothing is allocated.  It is
+ *		valid as long as the line.
+ *		when printing: a string
  *	%d - integer
  *	%B - build type:
  *		'road' = BUILD_ROAD
@@ -180,6 +185,14 @@ gint game_scanf(const gchar * line, const gchar * fmt, ...);
  * @return A string (you must use g_free to free the string)
 */
 gchar *game_vprintf(const gchar * fmt, va_list ap);
+/** Print a line at the end of a buffer.
+ * Nothing is allocated when the buffer is large enough, so a buffer
+ * that is reused does not allocate anymore.
+ * @param buffer The buffer
+ * @param fmt Format of the line, see communication format
+ * @param ap Arguments to the format
+*/
+void game_vprintf_buffer(GString * buffer, const gchar * fmt, va_list ap);
 /** Print a line.
  * @param fmt Format of the line, see communication format
  * @return A string (you must use g_free to free the string)
@@ -220,7 +220,7 @@ void log_message(gint msg_type, const gchar * fmt, ...)
 	gchar *timestamp;
 	va_list ap;
 	time_t t;
-	struct tm *alpha;
+	struct tm alpha;
 
 	va_start(ap, fmt);
 	text = g_strdup_vprintf(fmt, ap);
@@ -228,11 +228,16 @@ void log_message(gint msg_type, const gchar * fmt, ...)
 
 	debug("[%s] %s", debug_type(msg_type), text);
 
+	/* Messages can be logged by several threads */
 	t = time(NULL);
-	alpha = localtime(&t);
-
-	timestamp = g_strdup_printf("%02d:%02d:%02d ", alpha->tm_hour,
-				    alpha->tm_min, alpha->tm_sec);
+#ifdef G_OS_WIN32
+	alpha = *localtime(&t);	/* the result is per thread */
+#else				/* G_OS_WIN32 */
+	localtime_r(&t, &alpha);
+#endif				/* G_OS_WIN32 */
+
+	timestamp = g_strdup_printf("%02d:%02d:%02d ", alpha.tm_hour,
+				    alpha.tm_min, alpha.tm_sec);
 
 	if (driver->log_write) {
 		driver->log_write(MSG_TIMESTAMP, timestamp);
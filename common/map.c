@@ -241,8 +241,6 @@ static void set_edge_hex(Hex * hex, int dir, Hex * new_hex)
 	get_edge(hex, dir)->hexes[(dir + 3) / 3 % 2] = new_hex;
 }
 
-GRand *g_rand_ctx = NULL;
-
 Hex *map_hex(Map * map, gint x, gint y)
 {
 	if (x < 0 || x >= map->x_size || y < 0 || y >= map->y_size)
@@ -590,9 +588,10 @@ static gboolean layout_chits(Map * map)
 
 /* Randomise a map.  We do this by shuffling all of the land hexes,
  * and randomly reassigning port types.  This is the procedure
- * described in the board game rules.
+ * described in the board game rules.  The same generator state gives
+ * the same map.
  */
-void map_shuffle_terrain(Map * map)
+void map_shuffle_terrain(Map * map, GRand * rand)
 {
 	gint terrain_count[LAST_TERRAIN];
 	gint port_count[ANY_RESOURCE + 1];
@@ -643,9 +642,7 @@ void map_shuffle_terrain(Map * map)
 			if (hex->terrain == SEA_TERRAIN) {
 				if (hex->resource == NO_RESOURCE)
 					continue;
-				num =
-				    g_rand_int_range(g_rand_ctx, 0,
-						     num_port);
+				num = g_rand_int_range(rand, 0, num_port);
 				for (idx = 0;
 				     idx < G_N_ELEMENTS(port_count);
 				     idx++) {
@@ -657,7 +654,7 @@ void map_shuffle_terrain(Map * map)
 				num_port--;
 				hex->resource = idx;
 			} else {
-				num = g_rand_int_range(g_rand_ctx, 0,
+				num = g_rand_int_range(rand, 0,
 						       num_terrain);
 				for (idx = 0;
 				     idx < G_N_ELEMENTS(terrain_count);
@@ -181,7 +181,7 @@ gboolean map_traverse(Map * map, HexFunc func, gpointer closure);
 typedef gboolean(*ConstHexFunc) (const Hex * hex, gpointer closure);
 gboolean map_traverse_const(const Map * map, ConstHexFunc func,
 			    gpointer closure);
-void map_shuffle_terrain(Map * map);
+void map_shuffle_terrain(Map * map, GRand * rand);
 Hex *map_robber_hex(Map * map);
 Hex *map_pirate_hex(Map * map);
 void map_move_robber(Map * map, gint x, gint y);
@@ -283,10 +283,10 @@ gboolean map_bridge_connect_ok(const Map * map, gint owner, gint x, gint y,
 			       gint pos);
 /* information gathering */
 void map_longest_road(Map * map, gint * lengths, gint num_players);
+void map_road_network(Edge * edge, GPtrArray * network);
+gint map_longest_road_network(GPtrArray * network);
 gboolean map_is_island_discovered(Map * map, Node * node, gint owner);
 void map_maritime_info(const Map * map, MaritimeInfo * info, gint owner);
 guint map_count_islands(const Map * map);
 
-extern GRand *g_rand_ctx;
-
 #endif
@@ -916,6 +916,25 @@ static BuildType bridge_as_road(BuildType type)
 		return type;
 }
 
+/* Can a road of the owner of edge pass node? */
+static gboolean road_passes(const Node * node, const Edge * edge)
+{
+	return node->type == BUILD_NONE || node->owner == edge->owner;
+}
+
+/* Can the road continue from edge with here, through node? */
+static gboolean road_continues(const Node * node, const Edge * edge,
+			       const Edge * here)
+{
+	if (here == NULL || here->owner != edge->owner)
+		return FALSE;
+	/* don't allow ships to extend roads, except if there is a
+	 * construction in between */
+	/* bridges are treated as roads */
+	return node->type != BUILD_NONE
+	    || bridge_as_road(here->type) == bridge_as_road(edge->type);
+}
+
 /* calculate the longest road */
 static gint find_longest_road_recursive(Edge * edge)
 {
@@ -931,7 +950,7 @@ static gint find_longest_road_recursive(Edge * edge)
 			continue;
 		/* don't continue counting if someone else's building is on
 		 * the node. */
-		if (node->type != BUILD_NONE && node->owner != edge->owner)
+		if (!road_passes(node, edge))
 			continue;
 		/* don't let other go back here */
 		node->visited = TRUE;
@@ -939,21 +958,13 @@ static gint find_longest_road_recursive(Edge * edge)
 		for (edgeidx = 0; edgeidx < G_N_ELEMENTS(node->edges);
 		     edgeidx++) {
 			Edge *here = node->edges[edgeidx];
-			if (here && !here->visited
-			    && here->owner == edge->owner) {
-				/* don't allow ships to extend roads, except
-				 * if there is a construction in between */
-				/* bridges are treated as roads */
-				if (node->type != BUILD_NONE ||
-				    bridge_as_road(here->type) ==
-				    bridge_as_road(edge->type)) {
-					gint thislen =
-					    find_longest_road_recursive
-					    (here);
-					/* take the maximum of all paths */
-					if (thislen > len)
-						len = thislen;
-				}
+			if (road_continues(node, edge, here)
+			    && !here->visited) {
+				gint thislen =
+				    find_longest_road_recursive(here);
+				/* take the maximum of all paths */
+				if (thislen > len)
+					len = thislen;
 			}
 		}
 		/* Allow other roads to use this node again. */
@@ -1017,6 +1028,76 @@ void map_longest_road(Map * map, gint * lengths, gint num_players)
 	map_traverse(map, find_longest_road, lengths);
 }
 
+/* Collect the road network of edge: the edges that a road through edge
+ * can continue with, and the edges that those can continue with.
+ */
+void map_road_network(Edge * edge, GPtrArray * network)
+{
+	GHashTable *seen;
+	guint idx;
+
+	g_return_if_fail(edge != NULL);
+	g_return_if_fail(edge->owner >= 0);
+
+	seen = g_hash_table_new(NULL, NULL);
+	g_ptr_array_add(network, edge);
+	g_hash_table_insert(seen, edge, edge);
+	for (idx = 0; idx < network->len; idx++) {
+		Edge *from = g_ptr_array_index(network, idx);
+		gint nodeidx, edgeidx;
+
+		for (nodeidx = 0; nodeidx < G_N_ELEMENTS(from->nodes);
+		     nodeidx++) {
+			Node *node = from->nodes[nodeidx];
+
+			if (!road_passes(node, from))
+				continue;
+			for (edgeidx = 0;
+			     edgeidx < G_N_ELEMENTS(node->edges);
+			     edgeidx++) {
+				Edge *here = node->edges[edgeidx];
+
+				if (road_continues(node, from, here)
+				    && g_hash_table_lookup(seen,
+							   here) == NULL) {
+					g_ptr_array_add(network, here);
+					g_hash_table_insert(seen, here,
+							    here);
+				}
+			}
+		}
+	}
+	g_hash_table_destroy(seen);
+}
+
+/* The longest road in a network of map_road_network.  It is the same
+ * as map_longest_road finds for the owner of the network, if the owner
+ * has no other network.
+ */
+gint map_longest_road_network(GPtrArray * network)
+{
+	gint len = 0;
+	guint idx;
+	gint nodeidx;
+
+	for (idx = 0; idx < network->len; idx++) {
+		Edge *edge = g_ptr_array_index(network, idx);
+
+		edge->visited = FALSE;
+		for (nodeidx = 0; nodeidx < G_N_ELEMENTS(edge->nodes);
+		     nodeidx++)
+			edge->nodes[nodeidx]->visited = FALSE;
+	}
+	for (idx = 0; idx < network->len; idx++) {
+		gint thislen =
+		    find_longest_road_recursive(g_ptr_array_index
+						(network, idx));
+		if (thislen > len)
+			len = thislen;
+	}
+	return len;
+}
+
 static gboolean map_island_recursive(Map * map, Node * node, gint owner)
 {
 	gint idx;
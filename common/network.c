@@ -36,6 +36,9 @@
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #endif
@@ -55,6 +58,7 @@
 #include "game.h"
 #include "map.h"
 #include "network.h"
+#include "wire.h"
 #include "log.h"
 
 typedef union {
@@ -73,6 +77,61 @@ static void net_attempt_to_connect(Session * ses);
  * (in the absence of other network activity).  */
 static const int PING_PERIOD = 30;
 
+/* The output of a session is kept in a queue of contiguous chunks.
+ * Small messages are appended to the last chunk, so a burst of lines
+ * ends up in a few chunks that can be sent with one writev.  */
+#define NET_CHUNK_SIZE 4096
+/* Maximum number of chunks sent with one writev */
+#define NET_MAX_IOV 64
+
+typedef struct {
+	gsize start;		/* first byte that is not sent yet */
+	gsize end;		/* end of the data in this chunk */
+	gsize size;		/* allocated size of data */
+	NetBuffer *shared;	/* holds the data instead of this chunk */
+	gchar data[1];
+} NetChunk;
+
+/* A message that is sent to several sessions.  Each session queues a
+ * chunk that refers to it, instead of a copy.  */
+struct _NetBuffer {
+	gint ref_count;
+	gsize len;
+	guint lines;		/* number of lines, for the statistics */
+	NetBuffer *encoded;	/* the message as binary frames, or NULL */
+	gchar data[1];		/* nul-terminated */
+};
+
+/* Initial size of the input buffer of a session */
+#define NET_READ_BUFFER_SIZE 4096
+/* Default maximum size of the input buffer of a session */
+#define NET_READ_BUFFER_LIMIT (64 * 1024)
+
+/* Maximum size of a compressed block, both before and after inflating */
+#define NET_BLOCK_LIMIT (4 * 1024 * 1024)
+
+/* Sessions with buffered output, flushed once per main loop iteration.
+ * Each thread flushes its own sessions in its own main context.
+ */
+typedef struct {
+	GQueue queue;
+	guint source_id;
+} FlushQueue;
+
+static GStaticPrivate flush_private = G_STATIC_PRIVATE_INIT;
+
+static FlushQueue *flush_queue_get(void)
+{
+	FlushQueue *flush = g_static_private_get(&flush_private);
+
+	if (flush == NULL) {
+		flush = g_malloc0(sizeof(*flush));
+		g_queue_init(&flush->queue);
+		g_static_private_set(&flush_private, flush, g_free);
+	}
+	return flush;
+}
+
 void set_enable_debug(gboolean enabled)
 {
 	debug_enabled = enabled;
@@ -123,6 +182,88 @@ void debug(const gchar * fmt, ...)
 
 static void read_ready(Session * ses);
 static void write_ready(Session * ses);
+static gboolean write_queue_send(Session * ses);
+static void write_queue_clear(Session * ses);
+static void schedule_flush(Session * ses);
+static gboolean net_set_socket_non_blocking(int fd);
+static void close_and_callback(Session * ses);
+static gboolean read_buffer_make_room(Session * ses);
+static void read_process_lines(Session * ses);
+
+/* The current time in microseconds, for the statistics */
+static gint64 net_time_usec(void)
+{
+	GTimeVal now;
+
+	g_get_current_time(&now);
+	return (gint64) now.tv_sec * G_USEC_PER_SEC + now.tv_usec;
+}
+
+static void net_stats_add_rtt(NetStats * stats, gint64 rtt)
+{
+	gint bucket;
+
+	if (rtt < 0)
+		rtt = 0;	/* The clock was set back */
+
+	if (stats->rtt_count == 0 || rtt < stats->rtt_min_usec)
+		stats->rtt_min_usec = rtt;
+	if (rtt > stats->rtt_max_usec)
+		stats->rtt_max_usec = rtt;
+	stats->rtt_sum_usec += rtt;
+	++stats->rtt_count;
+
+	rtt /= 1000;
+	for (bucket = 0; bucket < NET_RTT_BUCKETS - 1; ++bucket)
+		if (rtt < (1 << bucket))
+			break;
+	++stats->rtt_histogram[bucket];
+}
+
+gchar *net_stats_describe(const NetStats * stats)
+{
+	GString *str = g_string_new(NULL);
+	gint bucket;
+
+	g_string_append_printf(str,
+			       "bytes-in %" G_GUINT64_FORMAT
+			       " lines-in %u recv %u"
+			       " bytes-out %" G_GUINT64_FORMAT
+			       " lines-out %u send %u"
+			       " would-block %u blocked-ms %" G_GUINT64_FORMAT
+			       " queue-peak %" G_GSIZE_FORMAT,
+			       stats->bytes_in, stats->lines_in,
+			       stats->recv_calls, stats->bytes_out,
+			       stats->lines_out, stats->send_calls,
+			       stats->would_block,
+			       stats->blocked_usec / 1000,
+			       stats->write_queue_peak);
+	g_string_append_printf(str, " rtt-count %u", stats->rtt_count);
+	if (stats->rtt_count == 0)
+		return g_string_free(str, FALSE);
+
+	g_string_append_printf(str,
+			       " rtt-ms min %.1f avg %.1f max %.1f"
+			       " histogram",
+			       stats->rtt_min_usec / 1000.0,
+			       stats->rtt_sum_usec / 1000.0 /
+			       stats->rtt_count,
+			       stats->rtt_max_usec / 1000.0);
+	for (bucket = 0; bucket < NET_RTT_BUCKETS; ++bucket) {
+		if (stats->rtt_histogram[bucket] == 0)
+			continue;
+		if (bucket < NET_RTT_BUCKETS - 1)
+			g_string_append_printf(str, " <%d:%u", 1 << bucket,
+					       stats->rtt_histogram
+					       [bucket]);
+		else
+			g_string_append_printf(str, " >=%d:%u",
+					       1 << (bucket - 1),
+					       stats->rtt_histogram
+					       [bucket]);
+	}
+	return g_string_free(str, FALSE);
+}
 
 static void listen_read(Session * ses, gboolean monitor)
 {
@@ -189,25 +330,35 @@ static const gchar *net_errormsg(void)
 
 gboolean net_close(Session * ses)
 {
-	if (ses->timer_id != 0) {
-		g_source_remove(ses->timer_id);
-		ses->timer_id = 0;
+	timer_wheel_cancel(&ses->ping_timer);
+
+	if (ses->flush_scheduled) {
+		g_queue_remove(&flush_queue_get()->queue, ses);
+		ses->flush_scheduled = FALSE;
 	}
 
 	if (ses->fd >= 0) {
+		/* Send what the socket still accepts, the rest is lost */
+		if (net_connected(ses))
+			write_queue_send(ses);
 		listen_read(ses, FALSE);
 		listen_write(ses, FALSE);
 		net_closesocket(ses->fd);
 		ses->fd = -1;
 
-		while (ses->write_queue != NULL) {
-			char *data = ses->write_queue->data;
-
-			ses->write_queue
-			    = g_list_remove(ses->write_queue, data);
-			g_free(data);
-		}
+		write_queue_clear(ses);
+	}
+	if (ses->deflate_buff != NULL) {
+		g_string_free(ses->deflate_buff, TRUE);
+		ses->deflate_buff = NULL;
+	}
+	if (ses->inflate_buff != NULL) {
+		g_string_free(ses->inflate_buff, TRUE);
+		ses->inflate_buff = NULL;
 	}
+	ses->inflate_enabled = FALSE;
+	ses->inflate_remaining = 0;
+	ses->wire_binary = FALSE;
 #ifdef HAVE_GETADDRINFO_ET_AL
 	if (ses->base_ai) {
 		freeaddrinfo(ses->base_ai);
@@ -219,11 +370,115 @@ gboolean net_close(Session * ses)
 	return !ses->entered;
 }
 
+gint net_release_fd(Session * ses)
+{
+	gint fd = ses->fd;
+
+	timer_wheel_cancel(&ses->ping_timer);
+	if (ses->flush_scheduled) {
+		g_queue_remove(&flush_queue_get()->queue, ses);
+		ses->flush_scheduled = FALSE;
+	}
+	if (fd < 0)
+		return -1;
+
+	/* Send what the socket still accepts, the rest is lost */
+	write_queue_send(ses);
+	listen_read(ses, FALSE);
+	listen_write(ses, FALSE);
+	write_queue_clear(ses);
+	ses->fd = -1;
+	return fd;
+}
+
+/* The time that net_hand_over waits for the peer to read the output */
+#define HAND_OVER_TIMEOUT 5000
+
+gint net_hand_over(Session * ses, GString * unread)
+{
+	gint fd = ses->fd;
+	GPollFD poll_fd;
+	gint64 deadline;
+
+	if (fd < 0 || ses->connect_in_progress)
+		return -1;
+
+	listen_read(ses, FALSE);
+	listen_write(ses, FALSE);
+	deadline = net_time_usec() + HAND_OVER_TIMEOUT * 1000;
+	poll_fd.fd = fd;
+	poll_fd.events = G_IO_OUT;
+	for (;;) {
+		gint64 now = 0;
+
+		if (write_queue_send(ses)) {
+			if (g_queue_is_empty(&ses->write_queue))
+				break;
+			now = net_time_usec();
+		}
+		if (now == 0 || now >= deadline) {
+			/* The session keeps the socket, the flush reports
+			 * the error */
+			listen_read(ses, TRUE);
+			schedule_flush(ses);
+			return -1;
+		}
+		g_poll(&poll_fd, 1, (deadline - now) / 1000 + 1);
+	}
+	if (ses->flush_scheduled) {
+		g_queue_remove(&flush_queue_get()->queue, ses);
+		ses->flush_scheduled = FALSE;
+	}
+	timer_wheel_cancel(&ses->ping_timer);
+
+	/* A compressed block that was partly read starts again.  The
+	 * compressed data can contain NUL bytes. */
+	if (ses->inflate_remaining > 0) {
+		g_string_append_printf(unread, "zlib %" G_GSIZE_FORMAT "\n",
+				       ses->inflate_buff->len +
+				       ses->inflate_remaining);
+		g_string_append_len(unread, ses->inflate_buff->str,
+				    ses->inflate_buff->len);
+	}
+	g_string_append_len(unread, ses->read_buff + ses->read_start,
+			    ses->read_len - ses->read_start);
+	ses->fd = -1;
+	return fd;
+}
+
+void net_unread(Session * ses, const gchar * data, gsize len)
+{
+	g_return_if_fail(!ses->entered);
+
+	while (len > 0 && ses->fd >= 0) {
+		gsize num;
+
+		if (ses->read_len == ses->read_size
+		    && !read_buffer_make_room(ses)) {
+			net_close(ses);
+			break;
+		}
+		num = MIN(len, ses->read_size - ses->read_len);
+		memcpy(ses->read_buff + ses->read_len, data, num);
+		ses->read_len += num;
+		data += num;
+		len -= num;
+
+		ses->entered = TRUE;
+		read_process_lines(ses);
+		ses->entered = FALSE;
+	}
+	if (ses->fd < 0)
+		close_and_callback(ses);
+}
+
 void net_close_when_flushed(Session * ses)
 {
 	ses->waiting_for_close = TRUE;
-	if (ses->write_queue != NULL)
+	if (!g_queue_is_empty(&ses->write_queue)) {
+		schedule_flush(ses);
 		return;
+	}
 
 	if (net_close(ses))
 		notify(ses, NET_CLOSE, NULL);
@@ -240,7 +495,7 @@ static void close_and_callback(Session * ses)
 		notify(ses, NET_CLOSE, NULL);
 }
 
-static gboolean ping_function(gpointer s)
+static void ping_function(gpointer s)
 {
 	Session *ses = (Session *) s;
 	double interval = difftime(time(NULL), ses->last_response);
@@ -256,21 +511,310 @@ static gboolean ping_function(gpointer s)
 	} else if (interval >= PING_PERIOD) {
 		/* There was no activity.
 		 * Send a ping (but don't update activity time).  */
+		if (ses->ping_sent == 0)
+			ses->ping_sent = net_time_usec();
 		net_write(ses, "hello\n");
-		ses->timer_id =
-		    g_timeout_add(PING_PERIOD * 1000, ping_function, s);
+		timer_wheel_schedule(&ses->ping_timer, PING_PERIOD);
 	} else {
 		/* Everything is fine.  Reschedule this check.  */
-		ses->timer_id =
-		    g_timeout_add((PING_PERIOD - interval) * 1000,
-				  ping_function, s);
+		timer_wheel_schedule(&ses->ping_timer,
+				     PING_PERIOD - interval);
+	}
+}
+
+static NetChunk *net_chunk_new(gsize size)
+{
+	NetChunk *chunk =
+	    g_malloc(G_STRUCT_OFFSET(NetChunk, data) + size);
+
+	chunk->start = 0;
+	chunk->end = 0;
+	chunk->size = size;
+	chunk->shared = NULL;
+	return chunk;
+}
+
+static gchar *net_chunk_data(NetChunk * chunk)
+{
+	return chunk->shared != NULL ? chunk->shared->data : chunk->data;
+}
+
+static void net_chunk_free(NetChunk * chunk)
+{
+	if (chunk->shared != NULL)
+		net_buffer_unref(chunk->shared);
+	g_free(chunk);
+}
+
+NetBuffer *net_buffer_new(const gchar * prefix, const gchar * data)
+{
+	gsize prefix_len = prefix != NULL ? strlen(prefix) : 0;
+	gsize len = strlen(data);
+	NetBuffer *buffer =
+	    g_malloc(G_STRUCT_OFFSET(NetBuffer, data) + prefix_len + len +
+		     1);
+	const gchar *eol;
+
+	buffer->ref_count = 1;
+	buffer->len = prefix_len + len;
+	buffer->lines = 0;
+	buffer->encoded = NULL;
+	memcpy(buffer->data, prefix, prefix_len);
+	memcpy(buffer->data + prefix_len, data, len + 1);
+	for (eol = strchr(buffer->data, '\n'); eol != NULL;
+	     eol = strchr(eol + 1, '\n'))
+		++buffer->lines;
+	return buffer;
+}
+
+NetBuffer *net_buffer_ref(NetBuffer * buffer)
+{
+	++buffer->ref_count;
+	return buffer;
+}
+
+void net_buffer_unref(NetBuffer * buffer)
+{
+	if (--buffer->ref_count == 0) {
+		if (buffer->encoded != NULL)
+			net_buffer_unref(buffer->encoded);
+		g_free(buffer);
+	}
+}
+
+/** The message as binary frames.
+ * It is encoded once, for all sessions that use binary frames.
+ */
+static NetBuffer *net_buffer_encoded(NetBuffer * buffer)
+{
+	if (buffer->encoded == NULL) {
+		GString *frames = g_string_sized_new(buffer->len);
+		NetBuffer *encoded;
+
+		wire_encode(frames, buffer->data, buffer->len);
+		encoded =
+		    g_malloc(G_STRUCT_OFFSET(NetBuffer, data) + frames->len +
+			     1);
+		encoded->ref_count = 1;
+		encoded->len = frames->len;
+		encoded->lines = buffer->lines;
+		encoded->encoded = NULL;
+		memcpy(encoded->data, frames->str, frames->len + 1);
+		g_string_free(frames, TRUE);
+		buffer->encoded = encoded;
+	}
+	return buffer->encoded;
+}
+
+const gchar *net_buffer_data(const NetBuffer * buffer)
+{
+	return buffer->data;
+}
+
+gsize net_buffer_length(const NetBuffer * buffer)
+{
+	return buffer->len;
+}
+
+guint net_buffer_lines(const NetBuffer * buffer)
+{
+	return buffer->lines;
+}
+
+/** Copy data to the end of the output buffer of the session */
+static void write_queue_append(Session * ses, const gchar * data,
+			       gsize len)
+{
+	NetChunk *chunk = g_queue_peek_tail(&ses->write_queue);
+
+	while (len > 0) {
+		gsize num;
+
+		if (chunk == NULL || chunk->end == chunk->size) {
+			chunk = ses->spare_chunk;
+			ses->spare_chunk = NULL;
+			if (chunk == NULL || chunk->size < len) {
+				g_free(chunk);
+				chunk =
+				    net_chunk_new(MAX(len,
+						      NET_CHUNK_SIZE));
+			}
+			g_queue_push_tail(&ses->write_queue, chunk);
+		}
+		num = MIN(len, chunk->size - chunk->end);
+		memcpy(chunk->data + chunk->end, data, num);
+		chunk->end += num;
+		ses->write_len += num;
+		data += num;
+		len -= num;
+	}
+	if (ses->write_len > ses->stats.write_queue_peak)
+		ses->stats.write_queue_peak = ses->write_len;
+}
+
+/** Remove num sent bytes from the start of the output buffer */
+static void write_queue_consume(Session * ses, gsize num)
+{
+	ses->write_len -= num;
+	while (num > 0) {
+		NetChunk *chunk = g_queue_peek_head(&ses->write_queue);
+		gsize len = chunk->end - chunk->start;
+
+		if (num < len) {
+			chunk->start += num;
+			return;
+		}
+		num -= len;
+		g_queue_pop_head(&ses->write_queue);
+		if (ses->spare_chunk == NULL && chunk->shared == NULL
+		    && chunk->size == NET_CHUNK_SIZE) {
+			chunk->start = 0;
+			chunk->end = 0;
+			ses->spare_chunk = chunk;
+		} else
+			net_chunk_free(chunk);
+	}
+}
+
+static void write_queue_clear(Session * ses)
+{
+	NetChunk *chunk;
+
+	while ((chunk = g_queue_pop_head(&ses->write_queue)) != NULL)
+		net_chunk_free(chunk);
+	g_free(ses->spare_chunk);
+	ses->spare_chunk = NULL;
+	ses->write_len = 0;
+}
+
+/** Send as much of the output buffer as the socket accepts.
+ * @return FALSE if an error occurred
+ */
+static gboolean write_queue_send(Session * ses)
+{
+	while (!g_queue_is_empty(&ses->write_queue)) {
+		gssize num;
+		gsize len;
+#ifdef HAVE_WRITEV
+		struct iovec iov[NET_MAX_IOV];
+		gint iovcnt = 0;
+		GList *list;
+
+		len = 0;
+		for (list = ses->write_queue.head;
+		     list != NULL && iovcnt < NET_MAX_IOV;
+		     list = g_list_next(list)) {
+			NetChunk *chunk = list->data;
+
+			iov[iovcnt].iov_base =
+			    net_chunk_data(chunk) + chunk->start;
+			iov[iovcnt].iov_len = chunk->end - chunk->start;
+			len += iov[iovcnt].iov_len;
+			++iovcnt;
+		}
+		num = writev(ses->fd, iov, iovcnt);
+		debug("(%d) writev(%d chunks, %" G_GSIZE_FORMAT
+		      " bytes) = %" G_GSSIZE_FORMAT, ses->fd, iovcnt, len,
+		      num);
+#else				/* HAVE_WRITEV */
+		NetChunk *chunk = g_queue_peek_head(&ses->write_queue);
+
+		len = chunk->end - chunk->start;
+		num =
+		    send(ses->fd, net_chunk_data(chunk) + chunk->start, len,
+			 0);
+		debug("(%d) send(%" G_GSIZE_FORMAT " bytes) = %"
+		      G_GSSIZE_FORMAT, ses->fd, len, num);
+#endif				/* HAVE_WRITEV */
+		++ses->stats.send_calls;
+		if (num < 0 && !net_would_block())
+			return FALSE;
+		if (num > 0) {
+			ses->stats.bytes_out += num;
+			if (ses->blocked_since != 0) {
+				ses->stats.blocked_usec +=
+				    net_time_usec() - ses->blocked_since;
+				ses->blocked_since = 0;
+			}
+			write_queue_consume(ses, num);
+		}
+		if (num < (gssize) len) {
+			/* The socket is full */
+			++ses->stats.would_block;
+			if (ses->blocked_since == 0)
+				ses->blocked_since = net_time_usec();
+			break;
+		}
+	}
+	return TRUE;
+}
+
+/** Send the output buffer, and watch the socket if not everything
+ *  could be sent.
+ */
+static void write_queue_flush(Session * ses)
+{
+	if (!write_queue_send(ses)) {
+		if (net_write_error())
+			log_message(MSG_ERROR,
+				    _("Error writing socket: %s\n"),
+				    net_errormsg());
+		close_and_callback(ses);
+		return;
+	}
+
+	/* Stop spinning when nothing to do.
+	 */
+	if (g_queue_is_empty(&ses->write_queue)) {
+		if (ses->waiting_for_close)
+			close_and_callback(ses);
+		else
+			listen_write(ses, FALSE);
+	} else
+		listen_write(ses, TRUE);
+}
+
+static gboolean flush_sessions(gpointer data)
+{
+	FlushQueue *flush = data;
+	Session *ses;
+
+	flush->source_id = 0;
+	/* Sessions can be closed by the callbacks, they will then remove
+	 * themselves from the queue */
+	while ((ses = g_queue_pop_head(&flush->queue)) != NULL) {
+		ses->flush_scheduled = FALSE;
+		if (ses->write_tag == 0)
+			write_queue_flush(ses);
 	}
-	/* Return FALSE to not reschedule this timeout.  If it needed to be
-	 * rescheduled, it has been done explicitly above (with a different
-	 * timeout).  */
 	return FALSE;
 }
 
+/** Flush the session in the next iteration of the main loop.
+ *  When the socket is full, write_ready will send the data.
+ */
+static void schedule_flush(Session * ses)
+{
+	FlushQueue *flush;
+
+	if (ses->flush_scheduled || ses->write_tag != 0)
+		return;
+
+	flush = flush_queue_get();
+	ses->flush_scheduled = TRUE;
+	g_queue_push_tail(&flush->queue, ses);
+	if (flush->source_id == 0) {
+		GSource *source = g_idle_source_new();
+
+		g_source_set_priority(source, G_PRIORITY_DEFAULT);
+		g_source_set_callback(source, flush_sessions, flush, NULL);
+		flush->source_id =
+		    g_source_attach(source,
+				    g_main_context_get_thread_default());
+		g_source_unref(source);
+	}
+}
+
 static void write_ready(Session * ses)
 {
 	if (!ses || ses->fd < 0)
@@ -315,88 +859,91 @@ static void write_ready(Session * ses)
 			notify(ses, NET_CONNECT, NULL);
 			listen_write(ses, FALSE);
 			listen_read(ses, TRUE);
+			if (!g_queue_is_empty(&ses->write_queue))
+				schedule_flush(ses);
 		}
 		return;
 	}
 
-	while (ses->write_queue != NULL) {
-		int num;
-		char *data = ses->write_queue->data;
-		int len = strlen(data);
+	write_queue_flush(ses);
+}
 
-		num = send(ses->fd, data, len, 0);
-		debug("write_ready: write(%d, \"%.*s\", %d) = %d",
-		      ses->fd, len, data, len, num);
-		if (num < 0) {
-			if (net_would_block())
-				break;
-			if (net_write_error())
-				log_message(MSG_ERROR,
-					    _(""
-					      "Error writing socket: %s\n"),
-					    net_errormsg());
-			close_and_callback(ses);
-			return;
-		} else if (num == len) {
-			ses->write_queue
-			    = g_list_remove(ses->write_queue, data);
-			g_free(data);
-		} else {
-			memmove(data, data + num, len - num + 1);
-			break;
-		}
-	}
+void net_write(Session * ses, const gchar * data)
+{
+	const gchar *eol;
+	gsize len;
 
-	/* Stop spinning when nothing to do.
-	 */
-	if (ses->write_queue == NULL) {
-		if (ses->waiting_for_close)
-			close_and_callback(ses);
-		else
-			listen_write(ses, FALSE);
+	if (!ses || ses->fd < 0)
+		return;
+
+	if (strcmp(data, "yes\n") && strcmp(data, "hello\n"))
+		debug("(%d) --> %s", ses->fd, data);
+
+	len = strlen(data);
+	for (eol = memchr(data, '\n', len); eol != NULL;
+	     eol = memchr(eol + 1, '\n', data + len - eol - 1))
+		++ses->stats.lines_out;
+
+	if (ses->deflate_buff != NULL) {
+		g_string_append_len(ses->deflate_buff, data, len);
+		return;
 	}
+
+	if (ses->wire_binary) {
+		g_string_truncate(ses->wire_out, 0);
+		wire_encode(ses->wire_out, data, len);
+		write_queue_append(ses, ses->wire_out->str,
+				   ses->wire_out->len);
+	} else
+		write_queue_append(ses, data, len);
+	/* While connecting, the data is sent by write_ready */
+	if (net_connected(ses))
+		schedule_flush(ses);
 }
 
-void net_write(Session * ses, const gchar * data)
+void net_write_buffer(Session * ses, NetBuffer * buffer)
 {
+	NetChunk *chunk;
+
 	if (!ses || ses->fd < 0)
 		return;
-	if (ses->write_queue != NULL || !net_connected(ses)) {
-		/* reassign the pointer, because the glib docs say it may
-		 * change and because if we're in the process of connecting the
-		 * pointer may currently be null. */
-		ses->write_queue =
-		    g_list_append(ses->write_queue, g_strdup(data));
-	} else {
-		int len;
-		int num;
 
-		len = strlen(data);
-		num = send(ses->fd, data, len, 0);
-		if (num > 0) {
-			if (strcmp(data, "yes\n")
-			    && strcmp(data, "hello\n"))
-				debug("(%d) --> %s", ses->fd, data);
-		} else if (!net_would_block())
-			debug("(%d) --- Error writing to socket.",
-			      ses->fd);
-		if (num < 0) {
-			if (!net_would_block()) {
-				log_message(MSG_ERROR,
-					    _(""
-					      "Error writing to socket: %s\n"),
-					    net_errormsg());
-				close_and_callback(ses);
-				return;
-			}
-			num = 0;
-		}
-		if (num != len) {
-			ses->write_queue
-			    = g_list_append(NULL, g_strdup(data + num));
-			listen_write(ses, TRUE);
-		}
+	debug("(%d) --> %s", ses->fd, buffer->data);
+	ses->stats.lines_out += buffer->lines;
+
+	if (ses->deflate_buff != NULL) {
+		g_string_append_len(ses->deflate_buff, buffer->data,
+				    buffer->len);
+		return;
 	}
+	if (ses->wire_binary)
+		buffer = net_buffer_encoded(buffer);
+
+	/* The chunk is full, so nothing is appended to it */
+	chunk = net_chunk_new(0);
+	chunk->shared = net_buffer_ref(buffer);
+	chunk->end = buffer->len;
+	chunk->size = buffer->len;
+	g_queue_push_tail(&ses->write_queue, chunk);
+	ses->write_len += buffer->len;
+	if (ses->write_len > ses->stats.write_queue_peak)
+		ses->stats.write_queue_peak = ses->write_len;
+
+	/* While connecting, the data is sent by write_ready */
+	if (net_connected(ses))
+		schedule_flush(ses);
+}
+
+void net_flush(Session * ses)
+{
+	if (!ses || !net_connected(ses))
+		return;
+
+	if (ses->flush_scheduled) {
+		g_queue_remove(&flush_queue_get()->queue, ses);
+		ses->flush_scheduled = FALSE;
+	}
+	write_queue_flush(ses);
 }
 
 void net_printf(Session * ses, const gchar * fmt, ...)
@@ -412,97 +959,401 @@ void net_printf(Session * ses, const gchar * fmt, ...)
 	g_free(buff);
 }
 
-static int find_line(char *buff, int len)
+/** Run data through a zlib converter.
+ * @param converter The compressor or decompressor
+ * @param data The input
+ * @param len The length of the input
+ * @param limit The maximum length of the output
+ * @retval error The error if it fails
+ * @return The output, or NULL if it fails
+ */
+static GString *net_convert(GConverter * converter, const gchar * data,
+			    gsize len, gsize limit, GError ** error)
 {
-	int idx;
+	GString *out = g_string_sized_new(MAX(len, NET_CHUNK_SIZE));
+	gsize used = 0;
+
+	for (;;) {
+		GConverterResult result;
+		gsize bytes_read;
+		gsize bytes_written;
+		gsize room;
+
+		/* Keep a byte for the terminator of the GString */
+		room = out->allocated_len - used - 1;
+		result =
+		    g_converter_convert(converter, data, len,
+					out->str + used, room,
+					G_CONVERTER_INPUT_AT_END,
+					&bytes_read, &bytes_written, error);
+		if (result == G_CONVERTER_ERROR) {
+			if (!g_error_matches
+			    (*error, G_IO_ERROR, G_IO_ERROR_NO_SPACE))
+				break;
+			g_clear_error(error);
+			bytes_read = 0;
+			bytes_written = 0;
+		}
+		data += bytes_read;
+		len -= bytes_read;
+		used += bytes_written;
+		if (result == G_CONVERTER_FINISHED) {
+			/* The converter wrote past the length of out,
+			 * g_string_truncate would not extend it */
+			g_string_set_size(out, used);
+			return out;
+		}
+		if (used > limit) {
+			g_set_error(error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+				    "Block larger than %" G_GSIZE_FORMAT
+				    " bytes", limit);
+			break;
+		}
+		if (bytes_written == room || result == G_CONVERTER_ERROR) {
+			/* Grow the output */
+			g_string_set_size(out, out->allocated_len * 2);
+		}
+	}
+	g_string_free(out, TRUE);
+	return NULL;
+}
 
-	for (idx = 0; idx < len; idx++)
-		if (buff[idx] == '\n')
-			return idx;
-	return -1;
+void net_deflate_begin(Session * ses)
+{
+	if (!ses || ses->fd < 0 || ses->deflate_buff != NULL)
+		return;
+	ses->deflate_buff = g_string_sized_new(NET_CHUNK_SIZE);
 }
 
-static void read_ready(Session * ses)
+void net_deflate_end(Session * ses)
 {
-	int num;
-	int offset;
+	GString *data;
+	GString *compressed;
+	GConverter *converter;
+	GError *error = NULL;
+	gchar *header;
 
-	/* There is data from this connection: record the time.  */
-	ses->last_response = time(NULL);
+	if (!ses || ses->deflate_buff == NULL)
+		return;
+	data = ses->deflate_buff;
+	ses->deflate_buff = NULL;
 
-	if (ses->read_len == sizeof(ses->read_buff)) {
-		/* We are in trouble now - the application has not
-		 * been processing the data we have been
-		 * reading. Assume something has gone wrong and
-		 * disconnect
-		 */
-		log_message(MSG_ERROR,
-			    _("Read buffer overflow - disconnecting\n"));
-		close_and_callback(ses);
+	if (ses->fd < 0 || data->len == 0) {
+		g_string_free(data, TRUE);
 		return;
 	}
 
-	num = recv(ses->fd, ses->read_buff + ses->read_len,
-		   sizeof(ses->read_buff) - ses->read_len, 0);
-	if (num < 0) {
-		if (net_would_block())
-			return;
-		log_message(MSG_ERROR, _("Error reading socket: %s\n"),
-			    net_errormsg());
-		close_and_callback(ses);
+	converter =
+	    G_CONVERTER(g_zlib_compressor_new
+			(G_ZLIB_COMPRESSOR_FORMAT_ZLIB, -1));
+	compressed =
+	    net_convert(converter, data->str, data->len, NET_BLOCK_LIMIT,
+			&error);
+	g_object_unref(converter);
+
+	if (compressed == NULL) {
+		/* Send it uncompressed, the peer understands that too */
+		log_message(MSG_ERROR, _("Error compressing data: %s\n"),
+			    error->message);
+		g_error_free(error);
+		write_queue_append(ses, data->str, data->len);
+	} else {
+		debug("(%d) --> zlib %" G_GSIZE_FORMAT " bytes (%"
+		      G_GSIZE_FORMAT " uncompressed)", ses->fd,
+		      compressed->len, data->len);
+		header =
+		    g_strdup_printf("zlib %" G_GSIZE_FORMAT "\n",
+				    compressed->len);
+		write_queue_append(ses, header, strlen(header));
+		write_queue_append(ses, compressed->str, compressed->len);
+		g_free(header);
+		g_string_free(compressed, TRUE);
+	}
+	g_string_free(data, TRUE);
+
+	if (net_connected(ses))
+		schedule_flush(ses);
+}
+
+void net_enable_inflate(Session * ses)
+{
+	ses->inflate_enabled = TRUE;
+}
+
+void net_set_binary(Session * ses, gboolean binary)
+{
+	if (!ses)
 		return;
+	if (binary && ses->wire_line == NULL) {
+		ses->wire_line = g_string_sized_new(256);
+		ses->wire_out = g_string_sized_new(NET_CHUNK_SIZE);
 	}
+	ses->wire_binary = binary;
+}
 
-	if (num == 0) {
-		close_and_callback(ses);
+/** Make room at the end of the input buffer.
+ * The unprocessed data is moved to the start of the buffer, and the
+ * buffer grows when needed.  This must not be called while the lines in
+ * the buffer are being processed.
+ * @return FALSE if the buffer is full and cannot grow
+ */
+static gboolean read_buffer_make_room(Session * ses)
+{
+	if (ses->read_start > 0) {
+		memmove(ses->read_buff, ses->read_buff + ses->read_start,
+			ses->read_len - ses->read_start);
+		ses->read_len -= ses->read_start;
+		ses->read_scan -= ses->read_start;
+		ses->read_start = 0;
+	}
+	if (ses->read_len < ses->read_size)
+		return TRUE;
+	if (ses->read_size >= ses->read_limit)
+		return FALSE;
+
+	ses->read_size =
+	    MIN(MAX(ses->read_size * 2, NET_READ_BUFFER_SIZE),
+		ses->read_limit);
+	ses->read_buff = g_realloc(ses->read_buff, ses->read_size);
+	return TRUE;
+}
+
+/** Hand a line to the application, unless it is a keepalive message */
+static void read_process_line(Session * ses, gchar * line)
+{
+	if (!strcmp(line, "hello")) {
+		net_write(ses, "yes\n");
 		return;
 	}
+	if (!strcmp(line, "yes")) {
+		/* The answer to our ping */
+		if (ses->ping_sent != 0) {
+			net_stats_add_rtt(&ses->stats,
+					  net_time_usec() - ses->ping_sent);
+			ses->ping_sent = 0;
+		}
+		return;		/* Don't notify the program */
+	}
+
+	debug("(%d) <-- %s", ses->fd, line);
 
-	ses->read_len += num;
+	notify(ses, NET_READ, line);
+}
 
-	if (ses->entered)
+/** Inflate a complete compressed block, and process its lines */
+static void read_process_block(Session * ses)
+{
+	GString *block = ses->inflate_buff;
+	GString *data;
+	GConverter *converter;
+	GError *error = NULL;
+	gchar *line;
+	gchar *eol;
+
+	ses->inflate_buff = NULL;
+	converter =
+	    G_CONVERTER(g_zlib_decompressor_new
+			(G_ZLIB_COMPRESSOR_FORMAT_ZLIB));
+	data =
+	    net_convert(converter, block->str, block->len, NET_BLOCK_LIMIT,
+			&error);
+	g_object_unref(converter);
+	g_string_free(block, TRUE);
+
+	if (data == NULL) {
+		/* The lines are lost, the connection cannot be trusted */
+		log_message(MSG_ERROR, _("Error inflating data: %s\n"),
+			    error->message);
+		g_error_free(error);
+		net_close(ses);
 		return;
-	ses->entered = TRUE;
+	}
+	debug("(%d) <-- zlib %" G_GSIZE_FORMAT " bytes", ses->fd,
+	      data->len);
+
+	line = data->str;
+	while (ses->fd >= 0
+	       && (eol = memchr(line, '\n',
+				data->str + data->len - line)) != NULL) {
+		*eol = '\0';
+		++ses->stats.lines_in;
+		read_process_line(ses, line);
+		line = eol + 1;
+	}
+	g_string_free(data, TRUE);
+}
 
-	offset = 0;
-	while (ses->fd >= 0 && offset < ses->read_len) {
-		char *line = ses->read_buff + offset;
-		int len = find_line(line, ses->read_len - offset);
+/** Hand all complete lines in the input buffer to the application.
+ * The lines are terminated in place, and passed without copying.
+ * Compressed blocks are collected, and their lines are handed over when
+ * the block is complete.
+ */
+static void read_process_lines(Session * ses)
+{
+	while (ses->fd >= 0) {
+		gchar *line = ses->read_buff + ses->read_start;
+		gchar *eol;
+		guint64 size;
+
+		if (ses->inflate_remaining > 0) {
+			gsize num = MIN(ses->inflate_remaining,
+					ses->read_len - ses->read_start);
+
+			g_string_append_len(ses->inflate_buff, line, num);
+			ses->inflate_remaining -= num;
+			ses->read_start = ses->read_scan =
+			    ses->read_start + num;
+			if (ses->inflate_remaining > 0)
+				break;
+			read_process_block(ses);
+			continue;
+		}
 
-		if (len < 0)
-			break;
-		line[len] = '\0';
-		offset += len + 1;
+		if (ses->wire_binary && ses->read_scan == ses->read_start
+		    && ses->read_start < ses->read_len
+		    && *line == WIRE_FRAME_MARK && !ses->read_discarding) {
+			gssize len = wire_decode(ses->wire_line, line,
+						 ses->read_len -
+						 ses->read_start,
+						 ses->read_limit);
 
-		if (!strcmp(line, "hello")) {
-			net_write(ses, "yes\n");
+			if (len < 0) {
+				log_message(MSG_ERROR,
+					    _("Invalid binary frame\n"));
+				net_close(ses);
+				break;
+			}
+			if (len == 0)
+				break;	/* wait for the rest of the frame */
+			ses->read_start = ses->read_scan =
+			    ses->read_start + len;
+			++ses->stats.lines_in;
+			read_process_line(ses, ses->wire_line->str);
 			continue;
 		}
-		if (!strcmp(line, "yes")) {
-			continue;	/* Don't notify the program */
+
+		eol = memchr(ses->read_buff + ses->read_scan, '\n',
+			     ses->read_len - ses->read_scan);
+		if (eol == NULL) {
+			ses->read_scan = ses->read_len;
+			break;
 		}
+		*eol = '\0';
+		ses->read_start = ses->read_scan = eol - ses->read_buff + 1;
+		++ses->stats.lines_in;
 
-		debug("(%d) <-- %s", ses->fd, line);
+		if (ses->read_discarding) {
+			/* This is the end of the discarded line */
+			ses->read_discarding = FALSE;
+			continue;
+		}
+		if (ses->inflate_enabled && !strncmp(line, "zlib ", 5)) {
+			/* The start of a compressed block */
+			size = g_ascii_strtoull(line + 5, NULL, 10);
+			if (size == 0 || size > NET_BLOCK_LIMIT) {
+				log_message(MSG_ERROR,
+					    _("Invalid compressed block: "
+					      "%s\n"), line);
+				net_close(ses);
+				break;
+			}
+			ses->inflate_remaining = size;
+			ses->inflate_buff = g_string_sized_new(size);
+			continue;
+		}
 
-		notify(ses, NET_READ, line);
+		read_process_line(ses, line);
 	}
 
-	if (offset < ses->read_len) {
-		/* Did not process all data in buffer - discard
-		 * processed data and copy remaining data to beginning
-		 * of buffer until next time
-		 */
-		memmove(ses->read_buff, ses->read_buff + offset,
-			ses->read_len - offset);
-		ses->read_len -= offset;
-	} else
+	if (ses->read_start == ses->read_len) {
 		/* Processed all data in buffer, discard it
 		 */
+		ses->read_start = 0;
+		ses->read_scan = 0;
 		ses->read_len = 0;
+	}
+}
 
-	ses->entered = FALSE;
-	if (ses->fd < 0) {
-		close_and_callback(ses);
+static void read_ready(Session * ses)
+{
+	gssize num;
+	gsize requested;
+
+	/* There is data from this connection: record the time.  */
+	ses->last_response = time(NULL);
+
+	/* Read until the socket is drained, an edge triggered event loop
+	 * does not report the data that is left behind again.
+	 */
+	for (;;) {
+		if (ses->read_len == ses->read_size) {
+			if (ses->entered) {
+				/* The application is still processing the
+				 * lines in the buffer, so the buffer cannot
+				 * be moved.  Continue reading when it is
+				 * done.
+				 */
+				listen_read(ses, FALSE);
+				return;
+			}
+			if (!read_buffer_make_room(ses)) {
+				/* The line does not fit in the buffer.
+				 * Skip it, instead of dropping the
+				 * connection.
+				 */
+				if (!ses->read_discarding)
+					log_message(MSG_ERROR,
+						    _(""
+						      "Line too long - discarding it\n"));
+				ses->read_discarding = TRUE;
+				ses->read_start = 0;
+				ses->read_scan = 0;
+				ses->read_len = 0;
+			}
+		}
+
+		requested = ses->read_size - ses->read_len;
+		num = recv(ses->fd, ses->read_buff + ses->read_len,
+			   requested, 0);
+		++ses->stats.recv_calls;
+		if (num < 0) {
+			if (net_would_block())
+				return;
+			log_message(MSG_ERROR,
+				    _("Error reading socket: %s\n"),
+				    net_errormsg());
+			close_and_callback(ses);
+			return;
+		}
+
+		if (num == 0) {
+			close_and_callback(ses);
+			return;
+		}
+
+		ses->read_len += num;
+		ses->stats.bytes_in += num;
+
+		if (ses->entered) {
+			if ((gsize) num < requested)
+				return;
+			continue;
+		}
+		ses->entered = TRUE;
+
+		read_process_lines(ses);
+
+		ses->entered = FALSE;
+		if (ses->fd < 0) {
+			close_and_callback(ses);
+			return;
+		}
+		/* Resume reading, if it was paused */
+		listen_read(ses, TRUE);
+
+		/* A short read means that the socket is empty */
+		if ((gsize) num < requested)
+			return;
 	}
 }
 
@@ -514,17 +1365,30 @@ Session *net_new(NetNotifyFunc notify_func, void *user_data)
 	ses->notify_func = notify_func;
 	ses->user_data = user_data;
 	ses->fd = -1;
+	ses->read_limit = NET_READ_BUFFER_LIMIT;
+	timer_wheel_entry_init(&ses->ping_timer, ping_function, ses);
 
 	return ses;
 }
 
+void net_set_read_limit(Session * ses, gsize limit)
+{
+	g_return_if_fail(limit > 0);
+	/* The buffer does not shrink below its current size */
+	ses->read_limit = MAX(limit, ses->read_size);
+}
+
 void net_use_fd(Session * ses, int fd, gboolean do_ping)
 {
 	ses->fd = fd;
+	/* The socket is read until it would block */
+	if (net_set_socket_non_blocking(fd))
+		log_message(MSG_ERROR,
+			    _("Error setting socket non-blocking: %s\n"),
+			    net_errormsg());
 	if (do_ping) {
 		ses->last_response = time(NULL);
-		ses->timer_id =
-		    g_timeout_add(PING_PERIOD * 1000, ping_function, ses);
+		timer_wheel_schedule(&ses->ping_timer, PING_PERIOD);
 	}
 	listen_read(ses, TRUE);
 }
@@ -698,6 +1562,11 @@ void net_free(Session ** ses)
 		g_free((*ses)->host);
 	if ((*ses)->port != NULL)
 		g_free((*ses)->port);
+	g_free((*ses)->read_buff);
+	if ((*ses)->wire_line != NULL)
+		g_string_free((*ses)->wire_line, TRUE);
+	if ((*ses)->wire_out != NULL)
+		g_string_free((*ses)->wire_out, TRUE);
 	g_free(*ses);
 	*ses = NULL;
 }
@@ -835,8 +1704,11 @@ void net_closesocket(int fd)
 #endif				/* G_OS_WIN32 */
 }
 
-gboolean net_get_peer_name(gint fd, gchar ** hostname, gchar ** servname,
-			   gchar ** error_message)
+/** Get the name of the peer, with the given flags for getnameinfo */
+static gboolean net_get_peer_name_flags(gint fd, gchar ** hostname,
+					gchar ** servname,
+					gchar ** error_message,
+					G_GNUC_UNUSED gint flags)
 {
 #ifdef HAVE_GETADDRINFO_ET_AL
 	sockaddr_t peer;
@@ -860,7 +1732,7 @@ gboolean net_get_peer_name(gint fd, gchar ** hostname, gchar ** servname,
 
 		if ((err =
 		     getnameinfo(&peer.sa, peer_len, host, NI_MAXHOST,
-				 port, NI_MAXSERV, 0))) {
+				 port, NI_MAXSERV, flags))) {
 			*error_message =
 			    g_strdup_printf(_(""
 					      "Error resolving address: %s"),
@@ -882,6 +1754,226 @@ gboolean net_get_peer_name(gint fd, gchar ** hostname, gchar ** servname,
 #endif				/* HAVE_GETADDRINFO_ET_AL */
 }
 
+gboolean net_get_peer_name(gint fd, gchar ** hostname, gchar ** servname,
+			   gchar ** error_message)
+{
+	return net_get_peer_name_flags(fd, hostname, servname,
+				       error_message, 0);
+}
+
+gboolean net_get_peer_address(gint fd, gchar ** hostname,
+			      gchar ** servname, gchar ** error_message)
+{
+#ifdef HAVE_GETADDRINFO_ET_AL
+	return net_get_peer_name_flags(fd, hostname, servname,
+				       error_message,
+				       NI_NUMERICHOST | NI_NUMERICSERV);
+#else				/* HAVE_GETADDRINFO_ET_AL */
+	return net_get_peer_name_flags(fd, hostname, servname,
+				       error_message, 0);
+#endif				/* HAVE_GETADDRINFO_ET_AL */
+}
+
+typedef struct {
+	GCancellable *cancellable;
+	NetPeerNameFunc func;
+	gpointer user_data;
+} PeerNameLookup;
+
+static void peer_name_resolved(GObject * source, GAsyncResult * result,
+			       gpointer data)
+{
+	PeerNameLookup *lookup = data;
+	GError *error = NULL;
+	gchar *hostname;
+
+	hostname =
+	    g_resolver_lookup_by_address_finish(G_RESOLVER(source), result,
+						&error);
+	if (lookup->cancellable != NULL
+	    && g_cancellable_is_cancelled(lookup->cancellable)) {
+		/* The requester is gone */
+	} else if (hostname != NULL) {
+		lookup->func(hostname, lookup->user_data);
+	} else {
+		log_message(MSG_INFO, _("Error resolving address: %s\n"),
+			    error->message);
+	}
+	if (error != NULL)
+		g_error_free(error);
+	g_free(hostname);
+	if (lookup->cancellable != NULL)
+		g_object_unref(lookup->cancellable);
+	g_free(lookup);
+}
+
+void net_get_peer_name_async(gint fd, GCancellable * cancellable,
+			     NetPeerNameFunc func, gpointer user_data)
+{
+#ifdef HAVE_GETADDRINFO_ET_AL
+	sockaddr_t peer;
+	socklen_t peer_len;
+	GSocketAddress *address;
+	GResolver *resolver;
+	PeerNameLookup *lookup;
+
+	peer_len = sizeof(peer);
+	if (getpeername(fd, &peer.sa, &peer_len) < 0) {
+		log_message(MSG_ERROR, _("Error getting peer name: %s\n"),
+			    net_errormsg());
+		return;
+	}
+	address = g_socket_address_new_from_native(&peer.sa, peer_len);
+	if (address == NULL || !G_IS_INET_SOCKET_ADDRESS(address)) {
+		/* Not an internet connection, there is no name */
+		if (address != NULL)
+			g_object_unref(address);
+		return;
+	}
+
+	lookup = g_malloc0(sizeof(*lookup));
+	if (cancellable != NULL)
+		lookup->cancellable = g_object_ref(cancellable);
+	lookup->func = func;
+	lookup->user_data = user_data;
+
+	/* The default resolver does the lookup in a separate thread */
+	resolver = g_resolver_get_default();
+	g_resolver_lookup_by_address_async(resolver,
+					   g_inet_socket_address_get_address
+					   (G_INET_SOCKET_ADDRESS(address)),
+					   cancellable, peer_name_resolved,
+					   lookup);
+	g_object_unref(resolver);
+	g_object_unref(address);
+#endif				/* HAVE_GETADDRINFO_ET_AL */
+}
+
+gboolean net_socketpair(gint fds[2], gchar ** error_message)
+{
+#ifdef HAVE_SOCKETPAIR
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		*error_message =
+		    g_strdup_printf(_("Error creating socket pair: %s"),
+				    net_errormsg());
+		return FALSE;
+	}
+	*error_message = NULL;
+	return TRUE;
+#else				/* HAVE_SOCKETPAIR */
+	*error_message =
+	    g_strdup(_("Socket pairs are not supported on this platform."));
+	return FALSE;
+#endif				/* HAVE_SOCKETPAIR */
+}
+
+#if defined(HAVE_SOCKETPAIR) && defined(SCM_RIGHTS)
+gboolean net_send_fd(gint sock, gint fd, const gchar * data, gsize len)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		struct cmsghdr align;
+		gchar buf[CMSG_SPACE(sizeof(gint))];
+	} control;
+	gssize num;
+
+	g_return_val_if_fail(len > 0, FALSE);
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = (gchar *) data;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (fd >= 0) {
+		struct cmsghdr *cmsg;
+
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(gint));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(gint));
+	}
+	do
+		num = sendmsg(sock, &msg, 0);
+	while (num < 0 && errno == EINTR);
+	if (num < 0)
+		return FALSE;
+
+	/* The socket went with the first byte */
+	for (data += num, len -= num; len > 0; data += num, len -= num) {
+		num = send(sock, data, len, 0);
+		if (num < 0 && errno == EINTR)
+			num = 0;
+		else if (num <= 0)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+gboolean net_recv_fd(gint sock, gint * fd, gchar * data, gsize len)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union {
+		struct cmsghdr align;
+		gchar buf[CMSG_SPACE(sizeof(gint))];
+	} control;
+	gssize num;
+
+	g_return_val_if_fail(len > 0, FALSE);
+
+	*fd = -1;
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = data;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	do
+		num = recvmsg(sock, &msg, 0);
+	while (num < 0 && errno == EINTR);
+	if (num <= 0)
+		return FALSE;
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+	     cmsg = CMSG_NXTHDR(&msg, cmsg))
+		if (cmsg->cmsg_level == SOL_SOCKET
+		    && cmsg->cmsg_type == SCM_RIGHTS)
+			memcpy(fd, CMSG_DATA(cmsg), sizeof(gint));
+
+	for (data += num, len -= num; len > 0; data += num, len -= num) {
+		num = recv(sock, data, len, 0);
+		if (num < 0 && errno == EINTR)
+			num = 0;
+		else if (num <= 0) {
+			if (*fd >= 0)
+				close(*fd);
+			*fd = -1;
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+#else				/* HAVE_SOCKETPAIR && SCM_RIGHTS */
+gboolean net_send_fd(G_GNUC_UNUSED gint sock, G_GNUC_UNUSED gint fd,
+		     G_GNUC_UNUSED const gchar * data,
+		     G_GNUC_UNUSED gsize len)
+{
+	return FALSE;
+}
+
+gboolean net_recv_fd(G_GNUC_UNUSED gint sock, gint * fd,
+		     G_GNUC_UNUSED gchar * data, G_GNUC_UNUSED gsize len)
+{
+	*fd = -1;
+	return FALSE;
+}
+#endif				/* HAVE_SOCKETPAIR && SCM_RIGHTS */
+
 gint net_accept(gint accept_fd, gchar ** error_message)
 {
 	gint fd;
@@ -891,10 +1983,24 @@ gint net_accept(gint accept_fd, gchar ** error_message)
 	addr_len = sizeof(addr);
 	fd = accept(accept_fd, &addr.sa, &addr_len);
 	if (fd < 0) {
+		if (net_would_block())
+			*error_message = NULL;
+		else
+			*error_message =
+			    g_strdup_printf(_(""
+					      "Error accepting connection: %s"),
+					    net_errormsg());
+		return fd;
+	}
+	if (net_set_socket_non_blocking(fd)) {
 		*error_message =
-		    g_strdup_printf(_("Error accepting connection: %s"),
+		    g_strdup_printf(_(""
+				      "Error setting socket non-blocking: %s\n"),
 				    net_errormsg());
+		net_closesocket(fd);
+		return -1;
 	}
+	*error_message = NULL;
 	return fd;
 }
 
@@ -23,7 +23,9 @@
 #define __network_h
 
 #include <glib.h>
+#include <gio/gio.h>
 #include <time.h>
+#include "timer_wheel.h"
 
 typedef enum {
 	NET_CONNECT,
@@ -35,11 +37,43 @@ typedef enum {
 typedef void (*NetNotifyFunc) (NetEvent event, void *user_data,
 			       gchar * line);
 
+/* Number of buckets in the round trip time histogram.
+ * Bucket 0 counts the times below 1 ms, bucket i the times below 2^i ms,
+ * the last bucket counts all longer times.
+ */
+#define NET_RTT_BUCKETS 16
+
+/* Traffic statistics of a session */
+typedef struct {
+	guint64 bytes_in;
+	guint64 bytes_out;
+	guint lines_in;
+	guint lines_out;
+	guint recv_calls;
+	guint send_calls;
+	guint would_block;	/* sends that did not send everything */
+	guint64 blocked_usec;	/* time spent waiting for a full socket */
+	gsize write_queue_peak;	/* largest amount of queued output */
+
+	/* Round trip time of the keepalive ping */
+	guint rtt_count;
+	guint64 rtt_sum_usec;
+	guint64 rtt_min_usec;
+	guint64 rtt_max_usec;
+	guint rtt_histogram[NET_RTT_BUCKETS];
+} NetStats;
+
+/* A reference counted message, see net_write_buffer */
+typedef struct _NetBuffer NetBuffer;
+
 typedef struct _Session Session;
 struct _Session {
 	int fd;
 	time_t last_response;	/* used for activity detection.  */
-	guint timer_id;
+	TimerWheelEntry ping_timer;
+	gint64 ping_sent;	/* time of the unanswered ping, or 0 */
+	gint64 blocked_since;	/* time the socket got full, or 0 */
+	NetStats stats;
 	void *user_data;
 
 	gboolean connect_in_progress;
@@ -52,11 +86,28 @@ struct _Session {
 	char *port;
 
 	gint read_tag;
-	char read_buff[16 * 1024];
-	int read_len;
+	gchar *read_buff;	/* input buffer, grows up to read_limit */
+	gsize read_size;	/* allocated size of read_buff */
+	gsize read_limit;	/* maximum size of read_buff */
+	gsize read_start;	/* start of the first unprocessed line */
+	gsize read_scan;	/* there is no newline before this offset */
+	gsize read_len;		/* end of the data in read_buff */
+	gboolean read_discarding;	/* skipping the rest of a long line */
 	gboolean entered;
 	gint write_tag;
-	GList *write_queue;
+	GQueue write_queue;	/* NetChunks waiting to be sent */
+	gsize write_len;	/* number of bytes in write_queue */
+	gpointer spare_chunk;	/* emptied chunk, kept for reuse */
+	gboolean flush_scheduled;	/* will be flushed in the next loop */
+	GString *deflate_buff;	/* output for the compressed block, or NULL */
+
+	gboolean inflate_enabled;	/* "zlib" lines start a compressed block */
+	gsize inflate_remaining;	/* bytes of the block still to be read */
+	GString *inflate_buff;	/* the compressed block read so far */
+
+	gboolean wire_binary;	/* lines are sent as binary frames */
+	GString *wire_line;	/* the last decoded frame */
+	GString *wire_out;	/* scratch buffer for encoding */
 
 	NetNotifyFunc notify_func;
 };
@@ -74,6 +125,14 @@ Session *net_new(NetNotifyFunc notify_func, void *user_data);
 void net_free(Session ** ses);
 
 void net_use_fd(Session * ses, int fd, gboolean do_ping);
+
+/** Set the maximum size of the input buffer of the session.
+ *  Lines that are longer than this are discarded.  When the application
+ *  is still processing earlier lines, reading pauses until it is done.
+ * @param ses   The session
+ * @param limit The maximum number of bytes
+ */
+void net_set_read_limit(Session * ses, gsize limit);
 gboolean net_connect(Session * ses, const gchar * host,
 		     const gchar * port);
 gboolean net_connected(Session * ses);
@@ -100,9 +159,115 @@ void net_closesocket(int fd);
 gboolean net_get_peer_name(gint fd, gchar ** hostname, gchar ** servname,
 			   gchar ** error_message);
 
-/** Accept incoming connections
- * @param accept_fd The file descriptor
+/** Get the numeric address of the peer.
+ *  This does not use DNS, so it never blocks.
+ *  @param fd File descriptor to resolve
+ *  @retval hostname The numeric address
+ *  @retval servname The numeric port
+ *  @retval error_message The error message when it fails
+ *  @return TRUE is successful
+ */
+gboolean net_get_peer_address(gint fd, gchar ** hostname,
+			      gchar ** servname, gchar ** error_message);
+
+typedef void (*NetPeerNameFunc) (const gchar * hostname,
+				 gpointer user_data);
+
+/** Look up the name of the peer, without blocking the main loop.
+ *  @param fd File descriptor to resolve
+ *  @param cancellable When it is cancelled, func will not be called
+ *  @param func Called from the main loop with the hostname,
+ *              if the lookup succeeds
+ *  @param user_data Passed to func
+ */
+void net_get_peer_name_async(gint fd, GCancellable * cancellable,
+			     NetPeerNameFunc func, gpointer user_data);
+
+/** Create a message that can be sent to several sessions.
+ * @param prefix Text that is put before the data, or NULL
+ * @param data The message, it is copied
+ * @return The message, with a reference count of 1
+ */
+NetBuffer *net_buffer_new(const gchar * prefix, const gchar * data);
+NetBuffer *net_buffer_ref(NetBuffer * buffer);
+void net_buffer_unref(NetBuffer * buffer);
+/** The text of the message, it is nul-terminated */
+const gchar *net_buffer_data(const NetBuffer * buffer);
+gsize net_buffer_length(const NetBuffer * buffer);
+guint net_buffer_lines(const NetBuffer * buffer);
+
+/** Queue a message without copying it.
+ *  The session keeps a reference until the message is sent.
+ * @param ses The session
+ * @param buffer The message
+ */
+void net_write_buffer(Session * ses, NetBuffer * buffer);
+
+/** Collect the output in one compressed block, until net_deflate_end.
+ *  Only use this when the peer called net_enable_inflate.
+ * @param ses The session
+ */
+void net_deflate_begin(Session * ses);
+
+/** Compress the output since net_deflate_begin, and send it.
+ *  The block is sent as a line "zlib <size>", followed by the zlib data.
+ * @param ses The session
+ */
+void net_deflate_end(Session * ses);
+
+/** Accept compressed blocks from the peer.
+ *  The lines in a block are handed to the application when the whole
+ *  block has arrived.  This is reset when the session is closed.
+ * @param ses The session
+ */
+void net_enable_inflate(Session * ses);
+
+/** Send the lines as binary frames, see wire.h.
+ * Frames from the peer are accepted once this is turned on, text lines
+ * are always accepted.
+ * @param ses The session
+ * @param binary Use binary frames
+ */
+void net_set_binary(Session * ses, gboolean binary);
+
+/** Describe the statistics of a session on a single line.
+ * @param stats The statistics
+ * @return The description, free it with g_free
+ */
+gchar *net_stats_describe(const NetStats * stats);
+
+/** Create a pair of connected sockets, to talk to a child process.
+ * @retval fds The sockets
  * @retval error_message The message if it fails
+ * @return TRUE if the sockets were created
+ */
+gboolean net_socketpair(gint fds[2], gchar ** error_message);
+
+/** Send data over a socket of net_socketpair, with another socket
+ *  attached to it.  It blocks until all data is sent.
+ * @param sock The socket of the pair
+ * @param fd The socket that is passed, or -1
+ * @param data The data, at least one byte
+ * @param len The length of data
+ * @return FALSE if it cannot be sent, or if the platform cannot pass
+ *         sockets
+ */
+gboolean net_send_fd(gint sock, gint fd, const gchar * data, gsize len);
+
+/** Receive the data of net_send_fd.  It blocks until all data is read.
+ * @param sock The other socket of the pair
+ * @retval fd The socket that was passed, or -1
+ * @param data The data is stored here
+ * @param len The length of data
+ * @return FALSE if it cannot be received
+ */
+gboolean net_recv_fd(gint sock, gint * fd, gchar * data, gsize len);
+
+/** Accept incoming connections.
+ * The new connection is non-blocking.
+ * @param accept_fd The file descriptor
+ * @retval error_message The message if it fails, NULL when there are no
+ *                       more pending connections
  * @return The file descriptor of the connection
  */
 gint net_accept(gint accept_fd, gchar ** error_message);
@@ -112,16 +277,49 @@ gint net_accept(gint accept_fd, gchar ** error_message);
  * @return TRUE if the session can be removed
  */
 gboolean net_close(Session * ses);
+
+/** Take the socket away from a session, without closing it.
+ * The output that the socket does not accept at once, and the input that
+ * was read but not handled yet, are lost.  Only release the socket when
+ * the peer waits for an answer.
+ * @param ses The session, it is not connected anymore
+ * @return The socket, or -1 if the session has none
+ */
+gint net_release_fd(Session * ses);
+/** Take the socket away from a session, to give it to another process.
+ *  Unlike net_release_fd, it waits until the output is sent, and keeps
+ *  the input that was not handled.  net_use_fd gives the socket back.
+ * @param ses The session, it is not connected anymore
+ * @param unread The input that was read but not handled is appended
+ * @return The socket, or -1 if the output cannot be sent
+ */
+gint net_hand_over(Session * ses, GString * unread);
+/** Handle data as if it was read from the socket of the session, for a
+ *  socket that was handed over by another process.
+ * @param ses The session, its socket is in use
+ * @param data What net_hand_over kept
+ * @param len The length of data
+ */
+void net_unread(Session * ses, const gchar * data, gsize len);
 void net_close_when_flushed(Session * ses);
 void net_wait_for_close(Session * ses);
 void net_printf(Session * ses, const gchar * fmt, ...);
 
 /** Write data.
+ * The data is appended to the output buffer of the session, which is
+ * sent with a single vectored write once per iteration of the main loop,
+ * or earlier when net_flush is called.
  * @param ses  The session
  * @param data The data to send
  */
 void net_write(Session * ses, const gchar * data);
 
+/** Send all buffered data of the session now, as far as the socket
+ *  accepts it.  The remainder is sent when the socket becomes writable.
+ * @param ses  The session
+ */
+void net_flush(Session * ses);
+
 /** Get the hostname of this computer.
  * @return "localhost" if the hostname could not be determined.
  */
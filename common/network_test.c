@@ -0,0 +1,444 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* The tests of the input of a session: the lines that a peer writes
+ * must arrive whole and in order, however they are split by the
+ * socket.  Run with -m perf to measure the speed of the line framing
+ * with clients that send bursts of lines, and the cost of many idle
+ * connections with the GLib and the epoll event loops.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <glib.h>
+#include "driver.h"
+#include "common_glib.h"
+#ifdef HAVE_SYS_EPOLL_H
+#include "common_epoll.h"
+#endif
+#include "network.h"
+
+#define BURST_CLIENTS 50
+#define BURST_LINES 400
+#define BURST_ROUNDS 50
+#define IDLE_SESSIONS 5000
+#define IDLE_ROUNDS 2000
+
+/* A session and the socket of its peer */
+typedef struct {
+	Session *ses;
+	gint peer;
+	guint sent;		/* number of lines written */
+	guint received;		/* number of lines that arrived */
+	guint wrong;		/* number of lines that are not as sent */
+	gboolean closed;
+} Client;
+
+static UIDriver test_driver;
+static guint errors;		/* number of logged errors */
+
+static void test_log(gint msg_type, G_GNUC_UNUSED const gchar * text)
+{
+	if (msg_type == MSG_ERROR)
+		++errors;
+}
+
+/** The line with a number, as a fast computer player sends it */
+static void format_line(GString * str, guint num)
+{
+	g_string_append_printf(str,
+			       "player %u domestic-trade call supply "
+			       "1 0 %u 0 0 receive 0 0 1 0 0\n", num % 6,
+			       num);
+}
+
+static void client_notify(NetEvent event, Client * client, gchar * line)
+{
+	GString *expect;
+
+	switch (event) {
+	case NET_READ:
+		expect = g_string_new(NULL);
+		format_line(expect, client->received);
+		/* The line arrives without its newline */
+		g_string_truncate(expect, expect->len - 1);
+		if (strcmp(line, expect->str) != 0)
+			++client->wrong;
+		++client->received;
+		g_string_free(expect, TRUE);
+		break;
+	case NET_CLOSE:
+		client->closed = TRUE;
+		break;
+	default:
+		break;
+	}
+}
+
+/** Use the input functions of GLib, or of epoll */
+static void use_event_loop(gboolean epoll)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	if (epoll) {
+		g_assert(evl_epoll_init());
+		test_driver.input_add_read = evl_epoll_input_add_read;
+		test_driver.input_add_write = evl_epoll_input_add_write;
+		test_driver.input_remove = evl_epoll_input_remove;
+		return;
+	}
+#else
+	g_assert(!epoll);
+#endif
+	test_driver.input_add_read = evl_glib_input_add_read;
+	test_driver.input_add_write = evl_glib_input_add_write;
+	test_driver.input_remove = evl_glib_input_remove;
+}
+
+static Client *client_new(void)
+{
+	Client *client = g_malloc0(sizeof(*client));
+	gint fds[2];
+	gchar *error_message;
+
+	if (!net_socketpair(fds, &error_message))
+		g_error("%s", error_message);
+	client->ses = net_new((NetNotifyFunc) client_notify, client);
+	net_use_fd(client->ses, fds[0], FALSE);
+	client->peer = fds[1];
+	return client;
+}
+
+static void client_free(Client * client)
+{
+	net_free(&client->ses);
+	close(client->peer);
+	g_free(client);
+}
+
+/** Write the data to the peer socket, it must fit in the socket */
+static void client_write(Client * client, const gchar * data, gsize len)
+{
+	while (len > 0) {
+		gssize num = write(client->peer, data, len);
+
+		g_assert_cmpint(num, >, 0);
+		data += num;
+		len -= num;
+	}
+}
+
+/** Write the next lines, in one burst */
+static void client_burst(Client * client, guint num_lines)
+{
+	GString *str = g_string_new(NULL);
+	guint idx;
+
+	for (idx = 0; idx < num_lines; ++idx)
+		format_line(str, client->sent++);
+	client_write(client, str->str, str->len);
+	g_string_free(str, TRUE);
+}
+
+/** Run the main loop until the clients received all lines */
+static void wait_for_lines(Client ** clients, guint num_clients)
+{
+	guint idx = 0;
+
+	while (idx < num_clients) {
+		if (clients[idx]->closed
+		    || clients[idx]->received == clients[idx]->sent) {
+			++idx;
+			continue;
+		}
+		g_main_context_iteration(NULL, TRUE);
+	}
+}
+
+static void test_split(void)
+{
+	Client *client = client_new();
+	GString *str = g_string_new(NULL);
+	gsize pos;
+	gsize size;
+
+	/* The lines arrive in pieces of every size from 1 to 64 bytes */
+	for (client->sent = 0; client->sent < 200; ++client->sent)
+		format_line(str, client->sent);
+	pos = 0;
+	for (size = 1; pos < str->len; size = size % 64 + 1) {
+		gsize len = MIN(size, str->len - pos);
+
+		client_write(client, str->str + pos, len);
+		pos += len;
+		/* Read the piece, it may hold no newline */
+		while (g_main_context_iteration(NULL, FALSE));
+	}
+	wait_for_lines(&client, 1);
+	g_assert_cmpuint(client->received, ==, 200);
+	g_assert_cmpuint(client->wrong, ==, 0);
+	g_assert(!client->closed);
+
+	g_string_free(str, TRUE);
+	client_free(client);
+}
+
+static void test_burst(void)
+{
+	Client *client = client_new();
+
+	/* Much more than the first size of the buffer, the buffer grows */
+	client_burst(client, 1000);
+	wait_for_lines(&client, 1);
+	g_assert_cmpuint(client->received, ==, 1000);
+	g_assert_cmpuint(client->wrong, ==, 0);
+	g_assert(!client->closed);
+	g_assert_cmpuint(client->ses->read_size, <=,
+			 client->ses->read_limit);
+
+	client_free(client);
+}
+
+static void test_read_limit(void)
+{
+	Client *client = client_new();
+	gchar *long_line;
+
+	net_set_read_limit(client->ses, 1024);
+	client_burst(client, 5);
+	wait_for_lines(&client, 1);
+
+	/* A line that does not fit is discarded, the session stays */
+	errors = 0;
+	long_line = g_strnfill(5000, 'x');
+	client_write(client, long_line, strlen(long_line));
+	client_write(client, "\n", 1);
+	g_free(long_line);
+	client_burst(client, 5);
+	wait_for_lines(&client, 1);
+
+	g_assert_cmpuint(client->received, ==, 10);
+	g_assert_cmpuint(client->wrong, ==, 0);
+	g_assert(!client->closed);
+	g_assert_cmpuint(errors, ==, 1);
+	g_assert_cmpuint(client->ses->read_size, <=, 1024);
+
+	client_free(client);
+}
+
+static void ignore_notify(G_GNUC_UNUSED NetEvent event,
+			  G_GNUC_UNUSED gpointer user_data,
+			  G_GNUC_UNUSED gchar * line)
+{
+}
+
+static void test_deflate(void)
+{
+	Client *client = client_new();
+	Session *sender = net_new(ignore_notify, NULL);
+	GString *str = g_string_new(NULL);
+
+	/* The block is compressed and inflated in more than one step */
+	net_use_fd(sender, dup(client->peer), FALSE);
+	net_enable_inflate(client->ses);
+	net_deflate_begin(sender);
+	for (client->sent = 0; client->sent < 2000; ++client->sent) {
+		g_string_truncate(str, 0);
+		format_line(str, client->sent);
+		net_write(sender, str->str);
+	}
+	net_deflate_end(sender);
+	wait_for_lines(&client, 1);
+
+	g_assert_cmpuint(client->received, ==, 2000);
+	g_assert_cmpuint(client->wrong, ==, 0);
+	g_assert(!client->closed);
+	g_assert_cmpuint(client->ses->stats.bytes_in, <, str->len * 2000);
+
+	g_string_free(str, TRUE);
+	net_free(&sender);
+	client_free(client);
+}
+
+static void test_burst_speed(void)
+{
+	Client *clients[BURST_CLIENTS];
+	gdouble elapsed;
+	guint64 bytes = 0;
+	guint idx;
+	gint round;
+
+	for (idx = 0; idx < BURST_CLIENTS; ++idx)
+		clients[idx] = client_new();
+
+	/* All clients send a burst at the same time, and wait until the
+	 * other side has read all of it */
+	g_test_timer_start();
+	for (round = 0; round < BURST_ROUNDS; ++round) {
+		for (idx = 0; idx < BURST_CLIENTS; ++idx)
+			client_burst(clients[idx], BURST_LINES);
+		wait_for_lines(clients, BURST_CLIENTS);
+	}
+	elapsed = g_test_timer_elapsed();
+
+	for (idx = 0; idx < BURST_CLIENTS; ++idx) {
+		g_assert_cmpuint(clients[idx]->received, ==,
+				 BURST_LINES * BURST_ROUNDS);
+		g_assert_cmpuint(clients[idx]->wrong, ==, 0);
+		g_assert(!clients[idx]->closed);
+		bytes += clients[idx]->ses->stats.bytes_in;
+	}
+	g_test_maximized_result(BURST_CLIENTS * BURST_LINES * BURST_ROUNDS /
+				elapsed,
+				"Framed %.0f lines per second from %d "
+				"clients in bursts of %d lines",
+				BURST_CLIENTS * BURST_LINES * BURST_ROUNDS /
+				elapsed, BURST_CLIENTS, BURST_LINES);
+	g_test_message("%.1f MB per second, %u reads by the first client",
+		       bytes / elapsed / 1e6,
+		       clients[0]->ses->stats.recv_calls);
+
+	for (idx = 0; idx < BURST_CLIENTS; ++idx)
+		client_free(clients[idx]);
+}
+
+/** Raise the limit of open files as far as allowed.
+ * @return The number of idle sessions that fit
+ */
+static guint idle_sessions_possible(void)
+{
+	struct rlimit limit;
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+		return 0;
+	if (limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+		getrlimit(RLIMIT_NOFILE, &limit);
+	}
+	/* Each session has two descriptors, keep some for the rest */
+	if (limit.rlim_cur == RLIM_INFINITY
+	    || limit.rlim_cur / 2 > IDLE_SESSIONS + 50)
+		return IDLE_SESSIONS;
+	return limit.rlim_cur / 2 > 50 ? limit.rlim_cur / 2 - 50 : 0;
+}
+
+/** One client exchanges single lines, while many others are connected
+ * and silent.
+ * @return The number of lines per second
+ */
+static gdouble idle_round_trips(gboolean epoll, guint num_idle)
+{
+	Client **idle;
+	Client *active;
+	gdouble elapsed;
+	guint idx;
+
+	use_event_loop(epoll);
+	idle = g_malloc(num_idle * sizeof(*idle));
+	for (idx = 0; idx < num_idle; ++idx)
+		idle[idx] = client_new();
+	active = client_new();
+
+	g_test_timer_start();
+	for (idx = 0; idx < IDLE_ROUNDS; ++idx) {
+		client_burst(active, 1);
+		wait_for_lines(&active, 1);
+	}
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(active->received, ==, IDLE_ROUNDS);
+	g_assert_cmpuint(active->wrong, ==, 0);
+	for (idx = 0; idx < num_idle; ++idx) {
+		g_assert_cmpuint(idle[idx]->received, ==, 0);
+		g_assert(!idle[idx]->closed);
+		client_free(idle[idx]);
+	}
+	client_free(active);
+	g_free(idle);
+	use_event_loop(FALSE);
+
+	return IDLE_ROUNDS / elapsed;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static void test_epoll(void)
+{
+	Client *clients[10];
+	guint idx;
+
+	/* The read callback is only called when new data arrives, so the
+	 * session must drain the socket each time */
+	use_event_loop(TRUE);
+	for (idx = 0; idx < G_N_ELEMENTS(clients); ++idx)
+		clients[idx] = client_new();
+	for (idx = 0; idx < G_N_ELEMENTS(clients); ++idx)
+		client_burst(clients[idx], 1000);
+	wait_for_lines(clients, G_N_ELEMENTS(clients));
+	for (idx = 0; idx < G_N_ELEMENTS(clients); ++idx) {
+		g_assert_cmpuint(clients[idx]->received, ==, 1000);
+		g_assert_cmpuint(clients[idx]->wrong, ==, 0);
+		g_assert(!clients[idx]->closed);
+		client_free(clients[idx]);
+	}
+	use_event_loop(FALSE);
+}
+#endif
+
+static void test_idle_speed(void)
+{
+	guint num_idle = idle_sessions_possible();
+	gdouble speed;
+
+	if (num_idle < IDLE_SESSIONS)
+		g_test_message("Only %u idle sessions fit in the limit of "
+			       "open files", num_idle);
+
+	speed = idle_round_trips(FALSE, num_idle);
+	g_test_minimized_result(1e6 / speed,
+				"GLib: %.1f us per line with %u idle sessions",
+				1e6 / speed, num_idle);
+#ifdef HAVE_SYS_EPOLL_H
+	speed = idle_round_trips(TRUE, num_idle);
+	g_test_minimized_result(1e6 / speed,
+				"epoll: %.1f us per line with %u idle sessions",
+				1e6 / speed, num_idle);
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+	test_driver.log_write = test_log;
+	use_event_loop(FALSE);
+	driver = &test_driver;
+
+	g_test_add_func("/network/split", test_split);
+	g_test_add_func("/network/burst", test_burst);
+	g_test_add_func("/network/read-limit", test_read_limit);
+	g_test_add_func("/network/deflate", test_deflate);
+#ifdef HAVE_SYS_EPOLL_H
+	g_test_add_func("/network/epoll", test_epoll);
+#endif
+	if (g_test_perf()) {
+		g_test_add_func("/network/burst/speed", test_burst_speed);
+		g_test_add_func("/network/idle/speed", test_idle_speed);
+	}
+	return g_test_run();
+}
@@ -32,6 +32,37 @@
 #include "log.h"
 #include "state.h"
 
+const NetStats *sm_get_net_stats(StateMachine * sm)
+{
+	if (sm->ses == NULL)
+		return NULL;
+	return &sm->ses->stats;
+}
+
+void sm_deflate_begin(StateMachine * sm)
+{
+	if (sm->ses != NULL)
+		net_deflate_begin(sm->ses);
+}
+
+void sm_deflate_end(StateMachine * sm)
+{
+	if (sm->ses != NULL)
+		net_deflate_end(sm->ses);
+}
+
+void sm_enable_inflate(StateMachine * sm)
+{
+	if (sm->ses != NULL)
+		net_enable_inflate(sm->ses);
+}
+
+void sm_set_binary(StateMachine * sm, gboolean binary)
+{
+	if (sm->ses != NULL)
+		net_set_binary(sm->ses, binary);
+}
+
 static void route_event(StateMachine * sm, gint event);
 
 void sm_inc_use_count(StateMachine * sm)
@@ -58,7 +89,151 @@ void sm_state_name(StateMachine * sm, const gchar * name)
 
 gboolean sm_is_connected(StateMachine * sm)
 {
-	return sm->ses != NULL && net_connected(sm->ses);
+	return sm->detached
+	    || (sm->ses != NULL && net_connected(sm->ses));
+}
+
+/* Number of event types, they start at SM_NET_CONNECT */
+#define SM_PROFILE_EVENTS (SM_FREE - SM_NET_CONNECT + 1)
+
+/* The profile of a state function */
+typedef struct {
+	const gchar *name;	/* NULL until the state names itself */
+	guint events[SM_PROFILE_EVENTS];
+	guint to_global;	/* lines the state did not handle */
+	guint to_unhandled;	/* lines that nobody handled */
+	gdouble seconds;	/* time spent in the state function */
+} SmProfile;
+
+static GHashTable *profile_table;	/* StateFunc -> SmProfile */
+static GTimer *profile_timer;
+/* The state machines of several threads share the profile */
+static GStaticMutex profile_mutex = G_STATIC_MUTEX_INIT;
+
+void sm_profile_enable(void)
+{
+	g_static_mutex_lock(&profile_mutex);
+	if (profile_table == NULL) {
+		profile_timer = g_timer_new();
+		profile_table =
+		    g_hash_table_new_full(NULL, NULL, NULL, g_free);
+	}
+	g_static_mutex_unlock(&profile_mutex);
+}
+
+gboolean sm_profile_is_enabled(void)
+{
+	return profile_table != NULL;
+}
+
+/* The caller holds profile_mutex */
+static SmProfile *sm_profile_get(StateFunc state)
+{
+	SmProfile *profile = g_hash_table_lookup(profile_table, (gpointer) state);
+
+	if (profile == NULL) {
+		profile = g_malloc0(sizeof(*profile));
+		g_hash_table_insert(profile_table, (gpointer) state,
+				    profile);
+	}
+	return profile;
+}
+
+/** Call a state function, and profile it when profiling is enabled.
+ * @param name The name of the function, or NULL if it is the current
+ *             state, which names itself.
+ */
+static gboolean sm_call(StateMachine * sm, StateFunc state,
+			gpointer user_data, gint event, const gchar * name)
+{
+	SmProfile *profile;
+	gdouble start;
+	gboolean handled;
+
+	if (profile_table == NULL)
+		return state(user_data, event);
+
+	start = g_timer_elapsed(profile_timer, NULL);
+	handled = state(user_data, event);
+	g_static_mutex_lock(&profile_mutex);
+	profile = sm_profile_get(state);
+	profile->seconds += g_timer_elapsed(profile_timer, NULL) - start;
+	++profile->events[event - SM_NET_CONNECT];
+	if (name == NULL && sm->stack_ptr >= 0 && sm_current(sm) == state)
+		name = sm->current_state;
+	if (name != NULL)
+		profile->name = name;
+	g_static_mutex_unlock(&profile_mutex);
+	return handled;
+}
+
+/** Count a line that the state did not handle.
+ * @param to_global TRUE if it goes to the global handler, FALSE if
+ *                  nobody handled it
+ */
+static void sm_profile_pass(StateFunc state, gboolean to_global)
+{
+	SmProfile *profile;
+
+	if (profile_table == NULL || state == NULL)
+		return;
+	g_static_mutex_lock(&profile_mutex);
+	profile = sm_profile_get(state);
+	if (to_global)
+		++profile->to_global;
+	else
+		++profile->to_unhandled;
+	g_static_mutex_unlock(&profile_mutex);
+}
+
+static gint sm_profile_compare(gconstpointer a, gconstpointer b)
+{
+	const SmProfile *pa = a;
+	const SmProfile *pb = b;
+
+	if (pa->seconds > pb->seconds)
+		return -1;
+	return pa->seconds < pb->seconds;
+}
+
+gchar *sm_profile_report(void)
+{
+	static const gchar *event_names[SM_PROFILE_EVENTS] = {
+		"connect", "connect-fail", "close", "enter", "init",
+		"recv", "free"
+	};
+	GString *report;
+	GList *list;
+	GList *profiles;
+
+	if (profile_table == NULL)
+		return NULL;
+
+	report = g_string_new(NULL);
+	g_static_mutex_lock(&profile_mutex);
+	profiles =
+	    g_list_sort(g_hash_table_get_values(profile_table),
+			sm_profile_compare);
+	for (list = profiles; list != NULL; list = g_list_next(list)) {
+		const SmProfile *profile = list->data;
+		gint idx;
+
+		g_string_append_printf(report, "%s time %.6f",
+				       profile->name !=
+				       NULL ? profile->name : "unnamed",
+				       profile->seconds);
+		for (idx = 0; idx < SM_PROFILE_EVENTS; ++idx)
+			g_string_append_printf(report, " %s %u",
+					       event_names[idx],
+					       profile->events[idx]);
+		g_string_append_printf(report,
+				       " to-global %u to-unhandled %u\n",
+				       profile->to_global,
+				       profile->to_unhandled);
+	}
+	g_static_mutex_unlock(&profile_mutex);
+	g_list_free(profiles);
+	return g_string_free(report, FALSE);
 }
 
 static void route_event(StateMachine * sm, gint event)
@@ -79,7 +254,7 @@ static void route_event(StateMachine * sm, gint event)
 	if (event == SM_FREE) {
 		/* send death notifications only to global handler */
 		if (sm->global !=NULL)
-			sm->global (user_data, event);
+			sm_call(sm, sm->global, user_data, event, "global");
 		return;
 	}
 
@@ -89,34 +264,39 @@ static void route_event(StateMachine * sm, gint event)
 	switch (event) {
 	case SM_ENTER:
 		if (curr_state != NULL)
-			curr_state(user_data, event);
+			sm_call(sm, curr_state, user_data, event, NULL);
 		break;
 	case SM_INIT:
 		if (curr_state != NULL)
-			curr_state(user_data, event);
+			sm_call(sm, curr_state, user_data, event, NULL);
 		if (!sm->is_dead && sm->global !=NULL)
-			sm->global (user_data, event);
+			sm_call(sm, sm->global, user_data, event, "global");
 		break;
 	case SM_RECV:
 		sm_cancel_prefix(sm);
-		if (curr_state != NULL && curr_state(user_data, event))
+		if (curr_state != NULL
+		    && sm_call(sm, curr_state, user_data, event, NULL))
 			break;
+		sm_profile_pass(curr_state, TRUE);
 		sm_cancel_prefix(sm);
 		if (!sm->is_dead
-		    && sm->global !=NULL && sm->global (user_data, event))
+		    && sm->global !=NULL
+		    && sm_call(sm, sm->global, user_data, event, "global"))
 			break;
 
+		sm_profile_pass(curr_state, FALSE);
 		sm_cancel_prefix(sm);
 		if (!sm->is_dead && sm->unhandled != NULL)
-			sm->unhandled(user_data, event);
+			sm_call(sm, sm->unhandled, user_data, event,
+				"unhandled");
 		break;
 	case SM_NET_CLOSE:
 		sm_close(sm);
 	default:
 		if (curr_state != NULL)
-			curr_state(user_data, event);
+			sm_call(sm, curr_state, user_data, event, NULL);
 		if (!sm->is_dead && sm->global !=NULL)
-			sm->global (user_data, event);
+			sm_call(sm, sm->global, user_data, event, "global");
 		break;
 	}
 }
@@ -138,6 +318,8 @@ static void net_event(NetEvent event, StateMachine * sm, gchar * line)
 		route_event(sm, SM_NET_CONNECT_FAIL);
 		break;
 	case NET_CLOSE:
+		if (sm->input != NULL)
+			sm->input(sm->user_data, NULL);
 		route_event(sm, SM_NET_CLOSE);
 		break;
 	case NET_READ:
@@ -145,9 +327,11 @@ static void net_event(NetEvent event, StateMachine * sm, gchar * line)
 		/* Only handle data if there is a context.  Fixes bug that
 		 * clients starting to send data immediately crash the
 		 * server */
-		if (sm->stack_ptr != -1)
+		if (sm->stack_ptr != -1) {
+			if (sm->input != NULL)
+				sm->input(sm->user_data, line);
 			route_event(sm, SM_RECV);
-		else {
+		} else {
 			sm_dec_use_count(sm);
 			return;
 		}
@@ -158,6 +342,27 @@ static void net_event(NetEvent event, StateMachine * sm, gchar * line)
 	sm_dec_use_count(sm);
 }
 
+void sm_inject(StateMachine * sm, const gchar * line)
+{
+	gchar *copy = g_strdup(line);
+
+	net_event(NET_READ, sm, copy);
+	g_free(copy);
+}
+
+void sm_detach(StateMachine * sm)
+{
+	if (sm->ses != NULL)
+		net_free(&(sm->ses));
+	sm->detached = TRUE;
+}
+
+void sm_inject_close(StateMachine * sm)
+{
+	sm->detached = FALSE;
+	net_event(NET_CLOSE, sm, NULL);
+}
+
 gboolean sm_connect(StateMachine * sm, const gchar * host,
 		    const gchar * port)
 {
@@ -165,6 +370,8 @@ gboolean sm_connect(StateMachine * sm, const gchar * host,
 		net_free(&(sm->ses));
 
 	sm->ses = net_new((NetNotifyFunc) net_event, sm);
+	if (sm->read_limit > 0)
+		net_set_read_limit(sm->ses, sm->read_limit);
 	log_message(MSG_INFO, _("Connecting to %s, port %s\n"), host,
 		    port);
 	if (net_connect(sm->ses, host, port))
@@ -174,12 +381,34 @@ gboolean sm_connect(StateMachine * sm, const gchar * host,
 	return FALSE;
 }
 
+gboolean sm_reconnect(StateMachine * sm)
+{
+	gchar *host;
+	gchar *port;
+	gboolean result;
+
+	if (sm->ses == NULL || sm->ses->host == NULL
+	    || sm->ses->port == NULL)
+		return FALSE;
+
+	/* sm_connect frees the session */
+	host = g_strdup(sm->ses->host);
+	port = g_strdup(sm->ses->port);
+	result = sm_connect(sm, host, port);
+	g_free(host);
+	g_free(port);
+	return result;
+}
+
 void sm_use_fd(StateMachine * sm, gint fd, gboolean do_ping)
 {
 	if (sm->ses != NULL)
 		net_free(&(sm->ses));
 
 	sm->ses = net_new((NetNotifyFunc) net_event, sm);
+	sm->detached = FALSE;
+	if (sm->read_limit > 0)
+		net_set_read_limit(sm->ses, sm->read_limit);
 	net_use_fd(sm->ses, fd, do_ping);
 }
 
@@ -210,43 +439,237 @@ gboolean sm_recv_prefix(StateMachine * sm, const gchar * fmt, ...)
 	return TRUE;
 }
 
-void sm_write(StateMachine * sm, const gchar * str)
+/* Open addressing hash table, at most half full */
+struct _SmDispatch {
+	guint mask;
+	const SmKeyword **slots;
+};
+
+static guint sm_dispatch_hash(const gchar * word, gsize len)
 {
-	if (sm->use_cache) {
-		/* Protect against strange/slow connects */
-		if (g_list_length(sm->cache) > 1000) {
+	guint hash = 5381;
+
+	while (len-- > 0)
+		hash = hash * 33 + (guchar) * word++;
+	return hash;
+}
+
+static gsize sm_dispatch_word_length(const gchar * word)
+{
+	const gchar *end = word;
+
+	while (*end != '\0' && *end != ' ')
+		++end;
+	return end - word;
+}
+
+SmDispatch *sm_dispatch_new(const SmKeyword * keywords,
+			    guint num_keywords)
+{
+	SmDispatch *dispatch = g_malloc(sizeof(*dispatch));
+	guint size = 8;
+	guint idx;
+
+	while (size < 2 * num_keywords)
+		size *= 2;
+	dispatch->mask = size - 1;
+	dispatch->slots = g_malloc0(size * sizeof(*dispatch->slots));
+
+	for (idx = 0; idx < num_keywords; ++idx) {
+		const gchar *word = keywords[idx].keyword;
+		gsize len = sm_dispatch_word_length(word);
+		guint slot = sm_dispatch_hash(word, len) & dispatch->mask;
+
+		g_assert(word[len] == '\0');
+		while (dispatch->slots[slot] != NULL)
+			slot = (slot + 1) & dispatch->mask;
+		dispatch->slots[slot] = &keywords[idx];
+	}
+	return dispatch;
+}
+
+gint sm_dispatch(StateMachine * sm, const SmDispatch * dispatch)
+{
+	const gchar *word = sm->line + sm->line_offset;
+	gsize len = sm_dispatch_word_length(word);
+	guint slot = sm_dispatch_hash(word, len) & dispatch->mask;
+	const SmKeyword *keyword;
+
+	while ((keyword = dispatch->slots[slot]) != NULL) {
+		if (strncmp(keyword->keyword, word, len) == 0
+		    && keyword->keyword[len] == '\0')
+			return keyword->id;
+		slot = (slot + 1) & dispatch->mask;
+	}
+	return -1;
+}
+
+/* Default maximum size of the cache */
+#define SM_CACHE_LIMIT (512 * 1024)
+
+/** Add a message to the cache */
+static void sm_cache_append(StateMachine * sm, NetBuffer * buffer)
+{
+	gsize len = net_buffer_length(buffer);
+
+	/* Protect against strange/slow connects */
+	if (sm->cache_size + len > sm->cache_limit) {
+		if (sm->ses != NULL && !sm->ses->waiting_for_close) {
 			net_write(sm->ses, "ERR connection too slow\n");
 			net_close_when_flushed(sm->ses);
-		} else {
-			sm->cache =
-			    g_list_append(sm->cache, g_strdup(str));
 		}
-	} else
+		net_buffer_unref(buffer);
+		return;
+	}
+	g_queue_push_tail(&sm->cache, buffer);
+	sm->cache_size += len;
+}
+
+static void sm_cache_clear(StateMachine * sm)
+{
+	NetBuffer *buffer;
+
+	while ((buffer = g_queue_pop_head(&sm->cache)) != NULL)
+		net_buffer_unref(buffer);
+	sm->cache_size = 0;
+}
+
+/** Add the text of a message that is sent to the history.
+ * The text is copied to the end of one buffer and the oldest lines are
+ * dropped at its start, so this does not allocate once the buffer is
+ * large enough.
+ */
+static void sm_history_append(StateMachine * sm, const gchar * data,
+			      gsize len)
+{
+	const gchar *eol;
+	const gchar *start;
+	const gchar *end;
+
+	/* The rest of a line that did not fit is not kept */
+	if (sm->history_partial) {
+		eol = memchr(data, '\n', len);
+		if (eol == NULL)
+			return;
+		++sm->history_seq;
+		sm->history_partial = FALSE;
+		len -= eol + 1 - data;
+		data = eol + 1;
+	}
+
+	if (sm->history == NULL)
+		sm->history = g_string_sized_new(sm->history_limit);
+	g_string_append_len(sm->history, data, len);
+	sm->history_size += len;
+	for (eol = memchr(data, '\n', len); eol != NULL;
+	     eol = memchr(eol + 1, '\n', data + len - eol - 1))
+		++sm->history_seq;
+
+	if (sm->history_size <= sm->history_limit)
+		return;
+
+	/* Forget the oldest lines */
+	start = sm->history->str + sm->history_start;
+	end = sm->history->str + sm->history->len;
+	while (sm->history_size > sm->history_limit) {
+		eol = memchr(start, '\n', end - start);
+		if (eol == NULL) {
+			/* The line that is being sent is lost too */
+			sm->history_first = sm->history_seq + 1;
+			sm->history_partial = TRUE;
+			sm->history_size = 0;
+			break;
+		}
+		sm->history_size -= eol + 1 - start;
+		start = eol + 1;
+		++sm->history_first;
+	}
+	sm->history_start = sm->history->len - sm->history_size;
+
+	/* Move the history to the start of the buffer when the dropped
+	 * lines are as large as the history can be */
+	if (sm->history_start >= sm->history_limit) {
+		g_string_erase(sm->history, 0, sm->history_start);
+		sm->history_start = 0;
+	}
+}
+
+static void sm_history_clear(StateMachine * sm)
+{
+	if (sm->history != NULL) {
+		g_string_free(sm->history, TRUE);
+		sm->history = NULL;
+	}
+	sm->history_start = 0;
+	sm->history_size = 0;
+	sm->history_first = sm->history_seq;
+}
+
+void sm_write(StateMachine * sm, const gchar * str)
+{
+	if (sm->use_cache)
+		sm_cache_append(sm, net_buffer_new(NULL, str));
+	else {
+		if (sm->history_limit > 0)
+			sm_history_append(sm, str, strlen(str));
 		net_write(sm->ses, str);
+	}
+}
+
+void sm_write_buffer(StateMachine * sm, NetBuffer * buffer)
+{
+	if (sm->use_cache)
+		sm_cache_append(sm, net_buffer_ref(buffer));
+	else {
+		if (sm->history_limit > 0)
+			sm_history_append(sm, net_buffer_data(buffer),
+					  net_buffer_length(buffer));
+		net_write_buffer(sm->ses, buffer);
+	}
 }
 
 void sm_write_uncached(StateMachine * sm, const gchar * str)
 {
-	g_assert(sm->ses);
+	g_assert(sm->ses || sm->detached);
 	g_assert(sm->use_cache);
 
 	net_write(sm->ses, str);
 }
 
+/** Format a message in the scratch buffer of the state machine.
+ * The buffer is reused, so this does not allocate once it is large
+ * enough.  The message must be written before the next call.
+ */
+static const gchar *sm_format(StateMachine * sm, const gchar * fmt,
+			      va_list ap)
+{
+	if (sm->send_buffer == NULL)
+		sm->send_buffer = g_string_sized_new(256);
+	g_string_truncate(sm->send_buffer, 0);
+	game_vprintf_buffer(sm->send_buffer, fmt, ap);
+	return sm->send_buffer->str;
+}
+
 void sm_send(StateMachine * sm, const gchar * fmt, ...)
 {
 	va_list ap;
-	gchar *buff;
 
 	if (!sm->ses)
 		return;
 
 	va_start(ap, fmt);
-	buff = game_vprintf(fmt, ap);
+	sm_write(sm, sm_format(sm, fmt, ap));
 	va_end(ap);
+}
+
+void sm_vwrite(StateMachine * sm, const gchar * fmt, va_list ap)
+{
+	sm_write(sm, sm_format(sm, fmt, ap));
+}
 
-	sm_write(sm, buff);
-	g_free(buff);
+void sm_vwrite_uncached(StateMachine * sm, const gchar * fmt, va_list ap)
+{
+	sm_write_uncached(sm, sm_format(sm, fmt, ap));
 }
 
 void sm_set_use_cache(StateMachine * sm, gboolean use_cache)
@@ -255,22 +678,112 @@ void sm_set_use_cache(StateMachine * sm, gboolean use_cache)
 		return;
 
 	if (!use_cache) {
-		/* The cache is turned off, send the delayed data */
-		GList *list = sm->cache;
-		while (list) {
-			gchar *data = list->data;
-			net_write(sm->ses, data);
-			list = g_list_remove(list, data);
-			g_free(data);
+		/* The cache is turned off, send the delayed data.
+		 * The buffers are queued without copying, and sent with
+		 * as few writes as possible. */
+		NetBuffer *buffer;
+
+		while ((buffer = g_queue_pop_head(&sm->cache)) != NULL) {
+			if (sm->history_limit > 0)
+				sm_history_append(sm,
+						  net_buffer_data(buffer),
+						  net_buffer_length(buffer));
+			net_write_buffer(sm->ses, buffer);
+			net_buffer_unref(buffer);
 		}
-		sm->cache = NULL;
+		sm->cache_size = 0;
+		/* The initial data is complete, send it immediately */
+		net_flush(sm->ses);
 	} else {
 		/* Be sure that the cache is empty */
-		g_assert(!sm->cache);
+		g_assert(g_queue_is_empty(&sm->cache));
 	}
 	sm->use_cache = use_cache;
 }
 
+void sm_flush(StateMachine * sm)
+{
+	if (!sm->use_cache)
+		net_flush(sm->ses);
+}
+
+void sm_set_cache_limit(StateMachine * sm, gsize limit)
+{
+	sm->cache_limit = limit;
+}
+
+void sm_set_read_limit(StateMachine * sm, gsize limit)
+{
+	sm->read_limit = limit;
+	if (sm->ses != NULL && limit > 0)
+		net_set_read_limit(sm->ses, limit);
+}
+
+void sm_set_history_limit(StateMachine * sm, gsize limit)
+{
+	sm->history_limit = limit;
+	if (limit == 0)
+		sm_history_clear(sm);
+}
+
+guint sm_history_seq(StateMachine * sm)
+{
+	return sm->history_seq;
+}
+
+/** Find the first line after a sequence number.
+ * @return FALSE if the history does not have that line
+ */
+static gboolean sm_history_find(StateMachine * sm, guint seq,
+				gsize * offset)
+{
+	const gchar *data;
+	guint line;
+
+	if (seq < sm->history_first || seq > sm->history_seq)
+		return FALSE;
+	if (sm->history == NULL) {
+		*offset = 0;
+		return TRUE;
+	}
+
+	data = sm->history->str + sm->history_start;
+	for (line = sm->history_first; line < seq; ++line)
+		data = strchr(data, '\n') + 1;
+	*offset = data - sm->history->str;
+	return TRUE;
+}
+
+gboolean sm_history_covers(StateMachine * sm, guint seq)
+{
+	gsize offset;
+
+	return sm_history_find(sm, seq, &offset);
+}
+
+gboolean sm_history_replay(StateMachine * sm, guint seq)
+{
+	gsize offset;
+
+	if (!sm_history_find(sm, seq, &offset))
+		return FALSE;
+	if (sm->history != NULL && offset < sm->history->len)
+		net_write(sm->ses, sm->history->str + offset);
+	return TRUE;
+}
+
+void sm_move_session(StateMachine * sm, StateMachine * from)
+{
+	if (sm->ses != NULL)
+		net_free(&(sm->ses));
+	sm->ses = from->ses;
+	from->ses = NULL;
+	sm->detached = from->detached;
+	from->detached = FALSE;
+	if (sm->ses != NULL)
+		sm->ses->user_data = sm;
+}
+
 void sm_global_set(StateMachine * sm, StateFunc state)
 {
 	sm->global = state;
@@ -281,6 +794,11 @@ void sm_unhandled_set(StateMachine * sm, StateFunc state)
 	sm->unhandled = state;
 }
 
+void sm_input_set(StateMachine * sm, SmInputFunc func)
+{
+	sm->input = func;
+}
+
 static void push_new_state(StateMachine * sm)
 {
 	++sm->stack_ptr;
@@ -437,6 +955,8 @@ StateMachine *sm_new(gpointer user_data)
 
 	sm->user_data = user_data;
 	sm->stack_ptr = -1;
+	g_queue_init(&sm->cache);
+	sm->cache_limit = SM_CACHE_LIMIT;
 
 	return sm;
 }
@@ -453,23 +973,24 @@ void sm_free(StateMachine * sm)
 		sm->is_dead = TRUE;
 	else {
 		route_event(sm, SM_FREE);
+		sm_cache_clear(sm);
+		sm_history_clear(sm);
+		if (sm->send_buffer != NULL)
+			g_string_free(sm->send_buffer, TRUE);
 		g_free(sm);
 	}
 }
 
 void sm_close(StateMachine * sm)
 {
-	net_free(&(sm->ses));
+	/* The connections of a replay have no session */
+	if (sm->ses != NULL)
+		net_free(&(sm->ses));
+	sm->detached = FALSE;
 	if (sm->use_cache) {
 		/* Purge the cache */
-		GList *list = sm->cache;
-		sm->cache = NULL;
+		sm_cache_clear(sm);
 		sm_set_use_cache(sm, FALSE);
-		while (list) {
-			gchar *data = list->data;
-			list = g_list_remove(list, data);
-			g_free(data);
-		}
 	}
 }
 
@@ -45,6 +45,12 @@
  * sm_cancel_prefix()
  *	Set start position in current line back to beginning.
  *
+ * sm_dispatch(dispatch)
+ *	Look up the first word of the current line from the start
+ *	position in a table of keywords.  States that handle many
+ *	messages use this to select the sm_recv to try, instead of
+ *	trying all of them in turn.
+ *
  * sm_send(fmt, ...)
  *	Send data back to the server.
  *
@@ -90,6 +96,11 @@ typedef struct StateMachine StateMachine;
  */
 typedef gboolean(*StateFunc) (StateMachine * sm, gint event);
 
+/* Sees the input of a state machine before it is handled: each line,
+ * and NULL when the connection closes
+ */
+typedef void (*SmInputFunc) (gpointer user_data, const gchar * line);
+
 struct StateMachine {
 	gpointer user_data;	/* parameter for mode functions */
 	/* FIXME RC 2004-11-13 in practice: 
@@ -100,6 +111,7 @@ struct StateMachine {
 
 	StateFunc global;	/* global state - test after current state */
 	StateFunc unhandled;	/* global state - process unhandled states */
+	SmInputFunc input;	/* sees the input, NULL if nobody does */
 	StateFunc stack[16];	/* handle sm_push() to save context */
 	const gchar *stack_name[16];	/* state names used for a stack dump */
 	gint stack_ptr;		/* stack index */
@@ -109,11 +121,23 @@ struct StateMachine {
 	gint line_offset;	/* line prefix handling */
 
 	Session *ses;		/* network session feeding state machine */
+	gsize read_limit;	/* maximum size of a line read, 0 for default */
+	gboolean detached;	/* the input is injected, there is no peer */
 	gint use_count;		/* # functions is in use by */
 	gboolean is_dead;	/* is this machine waiting to be killed? */
 
 	gboolean use_cache;	/* cache the data that is sent */
-	GList *cache;		/* cache for the delayed data */
+	GQueue cache;		/* NetBuffers with the delayed data */
+	gsize cache_size;	/* number of bytes in the cache */
+	gsize cache_limit;	/* maximum number of bytes in the cache */
+	GString *history;	/* the text that was sent, for resuming */
+	gsize history_start;	/* offset of the oldest line in history */
+	gsize history_size;	/* number of bytes in the history */
+	gsize history_limit;	/* maximum size of the history, 0 for none */
+	guint history_seq;	/* number of lines that were sent */
+	guint history_first;	/* number of lines dropped from the history */
+	gboolean history_partial;	/* the rest of a dropped line is to come */
+	GString *send_buffer;	/* scratch buffer to format messages */
 };
 
 StateMachine *sm_new(gpointer user_data);
@@ -124,16 +148,92 @@ void sm_state_name(StateMachine * sm, const gchar * name);
 gboolean sm_recv(StateMachine * sm, const gchar * fmt, ...);
 gboolean sm_recv_prefix(StateMachine * sm, const gchar * fmt, ...);
 void sm_cancel_prefix(StateMachine * sm);
+
+/* A keyword of a dispatch table, and the value sm_dispatch returns for it.
+ * The keyword is the text of the format up to the first space.
+ */
+typedef struct {
+	const gchar *keyword;
+	gint id;
+} SmKeyword;
+
+typedef struct _SmDispatch SmDispatch;
+
+/** Build a dispatch table.  It is meant to be built once and kept.
+ * @param keywords The keywords, they are not copied
+ * @param num_keywords The number of keywords
+ * @return The table
+ */
+SmDispatch *sm_dispatch_new(const SmKeyword * keywords,
+			    guint num_keywords);
+/** Look up the first word of the current line.
+ * The word is found by its length and a hash, so this takes time in
+ * proportion to the length of the word, not the size of the table.
+ * @param sm The state machine
+ * @param dispatch The table
+ * @return The id of the keyword, or -1 if it is not in the table
+ */
+gint sm_dispatch(StateMachine * sm, const SmDispatch * dispatch);
 void sm_write(StateMachine * sm, const gchar * str);
+/** As sm_write, but the session shares the buffer instead of copying it.
+ *  When caching is turned on, the cache keeps a reference.
+ */
+void sm_write_buffer(StateMachine * sm, NetBuffer * buffer);
 /** Send the data, even when caching is turned on */
 void sm_write_uncached(StateMachine * sm, const gchar * str);
 void sm_send(StateMachine * sm, const gchar * fmt, ...);
+/** Format a message and sm_write it.
+ *  Unlike sm_send, the message is cached when there is no connection.
+ */
+void sm_vwrite(StateMachine * sm, const gchar * fmt, va_list ap);
+/** Format a message and sm_write_uncached it */
+void sm_vwrite_uncached(StateMachine * sm, const gchar * fmt, va_list ap);
 /** Cache the messages that are sent.
  * When the caching is turned off, all cached data is sent.
  * @param sm The statemachine
  * @param use_cache Turn the caching on/off
  */
 void sm_set_use_cache(StateMachine * sm, gboolean use_cache);
+/** Send the queued data now, instead of when the main loop is idle.
+ * Nothing is sent while caching is turned on.
+ */
+void sm_flush(StateMachine * sm);
+/** Set the maximum size of the cache.
+ * When more data is cached, the connection is closed.
+ * @param sm The statemachine
+ * @param limit The maximum number of bytes
+ */
+void sm_set_cache_limit(StateMachine * sm, gsize limit);
+/** Set the maximum size of the input buffer of the connections of the
+ * statemachine, see net_set_read_limit.
+ * @param sm The statemachine
+ * @param limit The maximum number of bytes, 0 for the default
+ */
+void sm_set_read_limit(StateMachine * sm, gsize limit);
+/** Keep the most recent lines that were sent, so a peer that lost the
+ * connection can get the lines it missed.  Only the lines that pass the
+ * cache are kept, including those that are sent while there is no
+ * connection.
+ * @param sm The statemachine
+ * @param limit The maximum size of the history, 0 to keep none
+ */
+void sm_set_history_limit(StateMachine * sm, gsize limit);
+/** The number of lines that were sent, the sequence number of the last
+ * line in the history */
+guint sm_history_seq(StateMachine * sm);
+/** Does the history have all lines after a sequence number? */
+gboolean sm_history_covers(StateMachine * sm, guint seq);
+/** Send the lines after a sequence number again.
+ * @param sm The statemachine
+ * @param seq The last line the peer has
+ * @return FALSE if the history does not have all lines after seq,
+ *         nothing is sent then
+ */
+gboolean sm_history_replay(StateMachine * sm, guint seq);
+/** Take over the connection of another statemachine.
+ * The lines that are received next are routed to sm.
+ */
+void sm_move_session(StateMachine * sm, StateMachine * from);
 
 void sm_debug(const gchar * function, const gchar * state);
 #define sm_goto(a, b) do { sm_debug("sm_goto", #b); sm_goto_nomacro(a, b); } while (0)
@@ -151,13 +251,59 @@ StateFunc sm_current(StateMachine * sm);
 StateFunc sm_stack_inspect(const StateMachine * sm, guint offset);
 void sm_global_set(StateMachine * sm, StateFunc state);
 void sm_unhandled_set(StateMachine * sm, StateFunc state);
+/** Let a function see all input of the state machine.
+ * It is called with the user data of the state machine.
+ * @param func The function, or NULL to stop
+ */
+void sm_input_set(StateMachine * sm, SmInputFunc func);
 
 gboolean sm_is_connected(StateMachine * sm);
+/** The network statistics of the state machine.
+ * @return The statistics, or NULL if there is no connection
+ */
+const NetStats *sm_get_net_stats(StateMachine * sm);
+/** Send the uncached output as one compressed block.
+ *  The block ends at sm_deflate_end.  The peer must have called
+ *  sm_enable_inflate.
+ */
+void sm_deflate_begin(StateMachine * sm);
+void sm_deflate_end(StateMachine * sm);
+/** Accept compressed blocks from the peer */
+void sm_enable_inflate(StateMachine * sm);
+/** Exchange binary frames instead of text lines with the peer */
+void sm_set_binary(StateMachine * sm, gboolean binary);
 gboolean sm_connect(StateMachine * sm, const gchar * host,
 		    const gchar * port);
+/** Connect again to the host and port of the last sm_connect.
+ * @return FALSE if the session was not made with sm_connect
+ */
+gboolean sm_reconnect(StateMachine * sm);
 void sm_use_fd(StateMachine * sm, gint fd, gboolean do_ping);
+/** Handle a line as if it was received from the peer.
+ * For a connection that was accepted elsewhere, and whose first line
+ * was read there.
+ */
+void sm_inject(StateMachine * sm, const gchar * line);
+/** Drop the session, the input will only come from sm_inject.
+ * The state machine counts as connected, and what it sends is lost.
+ */
+void sm_detach(StateMachine * sm);
+/** Handle a close as if the peer of a detached state machine closed.
+ */
+void sm_inject_close(StateMachine * sm);
 void sm_dec_use_count(StateMachine * sm);
 void sm_inc_use_count(StateMachine * sm);
+/** Start profiling the state functions of all state machines.
+ *  For each state function the events, the time spent in it, and the
+ *  lines it did not handle are counted.  The time includes the events
+ *  that the function caused, like entering a new state.
+ */
+void sm_profile_enable(void);
+gboolean sm_profile_is_enabled(void);
+/** The profile, one line per state function, the slowest first.
+ * @return The report (free it with g_free), or NULL if profiling is off
+ */
+gchar *sm_profile_report(void);
 /** Dump the stack */
 void sm_stack_dump(StateMachine * sm);
 #endif
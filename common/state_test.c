@@ -0,0 +1,571 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* The tests of the state machine.  The lines are injected, or sent to
+ * a socket of which the test reads the other end.  Run with -m perf to
+ * compare the keyword dispatch with trying all formats in turn.
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <glib.h>
+#include "game.h"
+#include "driver.h"
+#include "common_glib.h"
+#include "state.h"
+
+#define DISPATCH_ROUNDS 200
+#define HISTORY_LIMIT 100
+
+/* The "player" lines that a computer player received in a game of four
+ * computer players (default game, seed 7), and how often they came */
+static const struct {
+	const gchar *line;
+	guint count;
+} recorded_mix[] = {
+	{"player 3 receives 1 1 0 0 1 1 1 0 0 1", 139},
+	{"player 0 turn 1", 56},
+	{"player 0 rolled 5 4", 56},
+	{"player 2 spent 0 1 1 1 0", 35},
+	{"player 0 built settlement 3 2 5", 26},
+	{"player 2 stole ore from 0", 21},
+	{"player 2 moved-robber 3 2", 21},
+	{"player 1 is-robber", 16},
+	{"player 1 play-develop 0 8", 13},
+	{"player 1 bought-develop", 13},
+	{"player 3 maritime-trade 4 supply ore receive brick", 11},
+	{"player 2 must-discard 4", 8},
+	{"player 2 discarded 0 0 4 0 0", 8},
+	{"player 0 setup 0", 4},
+	{"player 1 monopoly 0 grain from 0", 3},
+	{"player 1 plenty 1 1 0 0 0", 2},
+	{"player 3 setup-double", 1},
+	{"player 1 won with 10", 1},
+	{"player 1 largest-army", 1}
+};
+
+/* The messages about other players, as the client handles them */
+enum {
+	OTHER_BUILT,
+	OTHER_MOVE,
+	OTHER_MOVE_BACK,
+	OTHER_REMOVE,
+	OTHER_RECEIVES,
+	OTHER_PLENTY,
+	OTHER_SPENT,
+	OTHER_REFUND,
+	OTHER_BOUGHT_DEVELOP,
+	OTHER_PLAY_DEVELOP,
+	OTHER_TURN,
+	OTHER_ROLLED,
+	OTHER_MUST_DISCARD,
+	OTHER_DISCARDED,
+	OTHER_IS_ROBBER,
+	OTHER_MOVED_ROBBER,
+	OTHER_MOVED_PIRATE,
+	OTHER_UNMOVED_ROBBER,
+	OTHER_UNMOVED_PIRATE,
+	OTHER_STOLE,
+	OTHER_MONOPOLY,
+	OTHER_LARGEST_ARMY,
+	OTHER_LONGEST_ROAD,
+	OTHER_GET_POINT,
+	OTHER_LOSE_POINT,
+	OTHER_TAKE_POINT,
+	OTHER_SETUP,
+	OTHER_SETUP_DOUBLE,
+	OTHER_WON,
+	OTHER_HAS,
+	OTHER_MARITIME_TRADE
+};
+
+static const SmKeyword other_keywords[] = {
+	{"built", OTHER_BUILT},
+	{"move", OTHER_MOVE},
+	{"move-back", OTHER_MOVE_BACK},
+	{"remove", OTHER_REMOVE},
+	{"receives", OTHER_RECEIVES},
+	{"plenty", OTHER_PLENTY},
+	{"spent", OTHER_SPENT},
+	{"refund", OTHER_REFUND},
+	{"bought-develop", OTHER_BOUGHT_DEVELOP},
+	{"play-develop", OTHER_PLAY_DEVELOP},
+	{"turn", OTHER_TURN},
+	{"rolled", OTHER_ROLLED},
+	{"must-discard", OTHER_MUST_DISCARD},
+	{"discarded", OTHER_DISCARDED},
+	{"is-robber", OTHER_IS_ROBBER},
+	{"moved-robber", OTHER_MOVED_ROBBER},
+	{"moved-pirate", OTHER_MOVED_PIRATE},
+	{"unmoved-robber", OTHER_UNMOVED_ROBBER},
+	{"unmoved-pirate", OTHER_UNMOVED_PIRATE},
+	{"stole", OTHER_STOLE},
+	{"monopoly", OTHER_MONOPOLY},
+	{"largest-army", OTHER_LARGEST_ARMY},
+	{"longest-road", OTHER_LONGEST_ROAD},
+	{"get-point", OTHER_GET_POINT},
+	{"lose-point", OTHER_LOSE_POINT},
+	{"take-point", OTHER_TAKE_POINT},
+	{"setup", OTHER_SETUP},
+	{"setup-double", OTHER_SETUP_DOUBLE},
+	{"won", OTHER_WON},
+	{"has", OTHER_HAS},
+	{"maritime-trade", OTHER_MARITIME_TRADE}
+};
+
+static UIDriver test_driver;
+static SmDispatch *other_dispatch;
+static gint matched;		/* the message of the last line, -1 if none */
+
+static gboolean handled(gint id)
+{
+	matched = id;
+	return TRUE;
+}
+
+/* The formats of the messages, which both states try */
+typedef struct {
+	BuildType build_type;
+	DevelType devel_type;
+	Resource resource_type, supply_type, receive_type;
+	gint player_num, victim_num, card_idx, backwards;
+	gint turn_num, discard_num, num, ratio, die1, die2, x, y, pos;
+	gint id;
+	gint resource_list[NO_RESOURCE], wanted_list[NO_RESOURCE];
+	gint sx, sy, spos, dx, dy, dpos;
+	const gchar *str;
+} Args;
+
+/** Try the formats of a message
+ * @param id The message, or -1 to try all messages in turn
+ */
+static gboolean recv_other(StateMachine * sm, gint id, Args * a)
+{
+	if ((id < 0 || id == OTHER_BUILT)
+	    && sm_recv(sm, "built %B %d %d %d", &a->build_type, &a->x,
+		       &a->y, &a->pos))
+		return handled(OTHER_BUILT);
+	if ((id < 0 || id == OTHER_MOVE)
+	    && sm_recv(sm, "move %d %d %d %d %d %d", &a->sx, &a->sy,
+		       &a->spos, &a->dx, &a->dy, &a->dpos))
+		return handled(OTHER_MOVE);
+	if ((id < 0 || id == OTHER_MOVE_BACK)
+	    && sm_recv(sm, "move-back %d %d %d %d %d %d", &a->sx, &a->sy,
+		       &a->spos, &a->dx, &a->dy, &a->dpos))
+		return handled(OTHER_MOVE_BACK);
+	if ((id < 0 || id == OTHER_REMOVE)
+	    && sm_recv(sm, "remove %B %d %d %d", &a->build_type, &a->x,
+		       &a->y, &a->pos))
+		return handled(OTHER_REMOVE);
+	if ((id < 0 || id == OTHER_RECEIVES)
+	    && sm_recv(sm, "receives %R %R", a->resource_list,
+		       a->wanted_list))
+		return handled(OTHER_RECEIVES);
+	if ((id < 0 || id == OTHER_PLENTY)
+	    && sm_recv(sm, "plenty %R", a->resource_list))
+		return handled(OTHER_PLENTY);
+	if ((id < 0 || id == OTHER_SPENT)
+	    && sm_recv(sm, "spent %R", a->resource_list))
+		return handled(OTHER_SPENT);
+	if ((id < 0 || id == OTHER_REFUND)
+	    && sm_recv(sm, "refund %R", a->resource_list))
+		return handled(OTHER_REFUND);
+	if ((id < 0 || id == OTHER_BOUGHT_DEVELOP)
+	    && sm_recv(sm, "bought-develop"))
+		return handled(OTHER_BOUGHT_DEVELOP);
+	if ((id < 0 || id == OTHER_PLAY_DEVELOP)
+	    && sm_recv(sm, "play-develop %d %D", &a->card_idx,
+		       &a->devel_type))
+		return handled(OTHER_PLAY_DEVELOP);
+	if ((id < 0 || id == OTHER_TURN)
+	    && sm_recv(sm, "turn %d", &a->turn_num))
+		return handled(OTHER_TURN);
+	if ((id < 0 || id == OTHER_ROLLED)
+	    && sm_recv(sm, "rolled %d %d", &a->die1, &a->die2))
+		return handled(OTHER_ROLLED);
+	if ((id < 0 || id == OTHER_MUST_DISCARD)
+	    && sm_recv(sm, "must-discard %d", &a->discard_num))
+		return handled(OTHER_MUST_DISCARD);
+	if ((id < 0 || id == OTHER_DISCARDED)
+	    && sm_recv(sm, "discarded %R", a->resource_list))
+		return handled(OTHER_DISCARDED);
+	if ((id < 0 || id == OTHER_IS_ROBBER)
+	    && sm_recv(sm, "is-robber"))
+		return handled(OTHER_IS_ROBBER);
+	if ((id < 0 || id == OTHER_MOVED_ROBBER)
+	    && sm_recv(sm, "moved-robber %d %d", &a->x, &a->y))
+		return handled(OTHER_MOVED_ROBBER);
+	if ((id < 0 || id == OTHER_MOVED_PIRATE)
+	    && sm_recv(sm, "moved-pirate %d %d", &a->x, &a->y))
+		return handled(OTHER_MOVED_PIRATE);
+	if ((id < 0 || id == OTHER_UNMOVED_ROBBER)
+	    && sm_recv(sm, "unmoved-robber %d %d", &a->x, &a->y))
+		return handled(OTHER_UNMOVED_ROBBER);
+	if ((id < 0 || id == OTHER_UNMOVED_PIRATE)
+	    && sm_recv(sm, "unmoved-pirate %d %d", &a->x, &a->y))
+		return handled(OTHER_UNMOVED_PIRATE);
+	if ((id < 0 || id == OTHER_STOLE)
+	    && (sm_recv(sm, "stole from %d", &a->victim_num)
+		|| sm_recv(sm, "stole %r from %d", &a->resource_type,
+			   &a->victim_num)))
+		return handled(OTHER_STOLE);
+	if ((id < 0 || id == OTHER_MONOPOLY)
+	    && sm_recv(sm, "monopoly %d %r from %d", &a->num,
+		       &a->resource_type, &a->victim_num))
+		return handled(OTHER_MONOPOLY);
+	if ((id < 0 || id == OTHER_LARGEST_ARMY)
+	    && sm_recv(sm, "largest-army"))
+		return handled(OTHER_LARGEST_ARMY);
+	if ((id < 0 || id == OTHER_LONGEST_ROAD)
+	    && sm_recv(sm, "longest-road"))
+		return handled(OTHER_LONGEST_ROAD);
+	if ((id < 0 || id == OTHER_GET_POINT)
+	    && sm_recv(sm, "get-point %d %d %s", &a->id, &a->num,
+		       &a->str))
+		return handled(OTHER_GET_POINT);
+	if ((id < 0 || id == OTHER_LOSE_POINT)
+	    && sm_recv(sm, "lose-point %d", &a->id))
+		return handled(OTHER_LOSE_POINT);
+	if ((id < 0 || id == OTHER_TAKE_POINT)
+	    && sm_recv(sm, "take-point %d %d", &a->id, &a->victim_num))
+		return handled(OTHER_TAKE_POINT);
+	if ((id < 0 || id == OTHER_SETUP)
+	    && sm_recv(sm, "setup %d", &a->backwards))
+		return handled(OTHER_SETUP);
+	if ((id < 0 || id == OTHER_SETUP_DOUBLE)
+	    && sm_recv(sm, "setup-double"))
+		return handled(OTHER_SETUP_DOUBLE);
+	if ((id < 0 || id == OTHER_WON)
+	    && sm_recv(sm, "won with %d", &a->num))
+		return handled(OTHER_WON);
+	if ((id < 0 || id == OTHER_HAS)
+	    && sm_recv(sm, "has quit"))
+		return handled(OTHER_HAS);
+	if ((id < 0 || id == OTHER_MARITIME_TRADE)
+	    && sm_recv(sm, "maritime-trade %d supply %r receive %r",
+		       &a->ratio, &a->supply_type, &a->receive_type))
+		return handled(OTHER_MARITIME_TRADE);
+	return FALSE;
+}
+
+/* Try all formats in turn, as check_other_players did */
+static gboolean mode_chain(StateMachine * sm, gint event)
+{
+	Args args;
+
+	sm_state_name(sm, "mode_chain");
+	if (event != SM_RECV)
+		return FALSE;
+	matched = -1;
+	if (!sm_recv_prefix(sm, "player %d ", &args.player_num))
+		return FALSE;
+	return recv_other(sm, -1, &args);
+}
+
+/* Only try the formats of the keyword */
+static gboolean mode_dispatch(StateMachine * sm, gint event)
+{
+	Args args;
+	gint id;
+
+	sm_state_name(sm, "mode_dispatch");
+	if (event != SM_RECV)
+		return FALSE;
+	matched = -1;
+	if (!sm_recv_prefix(sm, "player %d ", &args.player_num))
+		return FALSE;
+	id = sm_dispatch(sm, other_dispatch);
+	if (id < 0)
+		return FALSE;
+	return recv_other(sm, id, &args);
+}
+
+static StateMachine *detached_sm_new(StateFunc state)
+{
+	StateMachine *sm = sm_new(NULL);
+
+	sm_detach(sm);
+	sm_goto_nomacro(sm, state);
+	return sm;
+}
+
+static void test_dispatch(void)
+{
+	static const gchar *const unknown[] = {
+		"player 1 chat Hello",
+		"player 1 rolled",
+		"player 1 move-",
+		"player 1 setup-doubl",
+		"player 1 stole",
+		"player 1 ",
+		"turn 12"
+	};
+	StateMachine *chain = detached_sm_new(mode_chain);
+	StateMachine *dispatch = detached_sm_new(mode_dispatch);
+	guint idx;
+
+	/* Both states find the same message for the recorded lines */
+	for (idx = 0; idx < G_N_ELEMENTS(recorded_mix); ++idx) {
+		gint expect;
+
+		sm_inject(chain, recorded_mix[idx].line);
+		expect = matched;
+		g_assert_cmpint(expect, >=, 0);
+		sm_inject(dispatch, recorded_mix[idx].line);
+		g_assert_cmpint(matched, ==, expect);
+	}
+	/* Words that only start like a keyword are not found */
+	for (idx = 0; idx < G_N_ELEMENTS(unknown); ++idx) {
+		sm_inject(chain, unknown[idx]);
+		g_assert_cmpint(matched, ==, -1);
+		sm_inject(dispatch, unknown[idx]);
+		g_assert_cmpint(matched, ==, -1);
+	}
+	/* Every keyword is in the table */
+	for (idx = 0; idx < G_N_ELEMENTS(other_keywords); ++idx) {
+		gchar *line = g_strdup_printf("player 0 %s",
+					      other_keywords[idx].keyword);
+
+		dispatch->line = line;
+		dispatch->line_offset = strlen("player 0 ");
+		g_assert_cmpint(sm_dispatch(dispatch, other_dispatch), ==,
+				other_keywords[idx].id);
+		dispatch->line = NULL;
+		g_free(line);
+	}
+
+	sm_free(chain);
+	sm_free(dispatch);
+}
+
+/** Inject the recorded lines a number of times.
+ * @return The time per line in nanoseconds
+ */
+static gdouble inject_mix(StateFunc state)
+{
+	StateMachine *sm = detached_sm_new(state);
+	guint num_lines = 0;
+	gdouble elapsed;
+	gint round;
+	guint idx;
+	guint count;
+
+	g_test_timer_start();
+	for (round = 0; round < DISPATCH_ROUNDS; ++round) {
+		for (idx = 0; idx < G_N_ELEMENTS(recorded_mix); ++idx) {
+			for (count = 0; count < recorded_mix[idx].count;
+			     ++count) {
+				sm_inject(sm, recorded_mix[idx].line);
+				g_assert_cmpint(matched, >=, 0);
+			}
+			num_lines += recorded_mix[idx].count;
+		}
+	}
+	elapsed = g_test_timer_elapsed();
+
+	sm_free(sm);
+	return elapsed * 1e9 / num_lines;
+}
+
+static void test_dispatch_speed(void)
+{
+	gdouble chain;
+	gdouble dispatch;
+
+	chain = inject_mix(mode_chain);
+	dispatch = inject_mix(mode_dispatch);
+	g_test_minimized_result(chain,
+				"All formats in turn: %.0f ns per line",
+				chain);
+	g_test_minimized_result(dispatch,
+				"Keyword dispatch: %.0f ns per line",
+				dispatch);
+}
+
+/** A state machine that sends to a socket.
+ * @retval peer The other end of the socket
+ */
+static StateMachine *connected_sm_new(gint * peer)
+{
+	StateMachine *sm = sm_new(NULL);
+	gint fds[2];
+	gchar *error_message;
+
+	if (!net_socketpair(fds, &error_message))
+		g_error("%s", error_message);
+	sm_use_fd(sm, fds[0], FALSE);
+	*peer = fds[1];
+	return sm;
+}
+
+/** Send the queued data, and read what arrived at the peer.
+ * @return The data, free it with g_free
+ */
+static gchar *read_peer(StateMachine * sm, gint peer)
+{
+	GString *data = g_string_new(NULL);
+	gchar buff[1024];
+	gssize num;
+
+	sm_flush(sm);
+	while (g_main_context_iteration(NULL, FALSE));
+	for (;;) {
+		num = recv(peer, buff, sizeof(buff), MSG_DONTWAIT);
+		if (num <= 0)
+			break;
+		g_string_append_len(data, buff, num);
+	}
+	g_assert(num == 0 || errno == EAGAIN || errno == EWOULDBLOCK);
+	return g_string_free(data, FALSE);
+}
+
+/** Send the lines "line <first>" to "line <last>" */
+static void send_lines(StateMachine * sm, guint first, guint last)
+{
+	guint idx;
+
+	for (idx = first; idx <= last; ++idx) {
+		gchar *line = g_strdup_printf("line %02u\n", idx);
+
+		sm_write(sm, line);
+		g_free(line);
+	}
+}
+
+static void test_history_trim(void)
+{
+	gint peer;
+	StateMachine *sm = connected_sm_new(&peer);
+	gchar *data;
+	gchar *long_line;
+
+	sm_set_history_limit(sm, HISTORY_LIMIT);
+	send_lines(sm, 1, 50);
+	g_assert_cmpuint(sm_history_seq(sm), ==, 50);
+	g_free(read_peer(sm, peer));
+
+	/* 12 lines of 8 bytes fit in the history */
+	g_assert_cmpuint(sm->history_size, <=, HISTORY_LIMIT);
+	g_assert(!sm_history_covers(sm, 37));
+	g_assert(sm_history_covers(sm, 38));
+	g_assert(sm_history_covers(sm, 50));
+	g_assert(!sm_history_covers(sm, 51));
+	/* The dropped lines are removed from the buffer */
+	g_assert_cmpuint(sm->history->len, <, 2 * HISTORY_LIMIT + 8);
+
+	/* A line that is larger than the history empties it */
+	long_line = g_strnfill(HISTORY_LIMIT * 2, 'x');
+	sm_write(sm, long_line);
+	g_assert(!sm_history_covers(sm, 50));
+	sm_write(sm, "\n");
+	g_assert_cmpuint(sm_history_seq(sm), ==, 51);
+	g_assert(!sm_history_covers(sm, 50));
+	g_assert(sm_history_covers(sm, 51));
+	g_assert_cmpuint(sm->history_size, ==, 0);
+	g_free(long_line);
+	g_free(read_peer(sm, peer));
+	/* Its end is not sent as a line of its own */
+	g_assert(sm_history_replay(sm, 51));
+	data = read_peer(sm, peer);
+	g_assert_cmpstr(data, ==, "");
+	g_free(data);
+
+	/* Cached lines count when they are sent */
+	sm_set_use_cache(sm, TRUE);
+	send_lines(sm, 52, 54);
+	g_assert_cmpuint(sm_history_seq(sm), ==, 51);
+	sm_set_use_cache(sm, FALSE);
+	g_assert_cmpuint(sm_history_seq(sm), ==, 54);
+	data = read_peer(sm, peer);
+	g_assert_cmpstr(data, ==, "line 52\nline 53\nline 54\n");
+	g_free(data);
+
+	sm_free(sm);
+	close(peer);
+}
+
+static void test_history_replay(void)
+{
+	gint peer;
+	StateMachine *sm = connected_sm_new(&peer);
+	gchar *data;
+
+	sm_set_history_limit(sm, HISTORY_LIMIT);
+	send_lines(sm, 1, 50);
+	g_free(read_peer(sm, peer));
+
+	/* The lines after the sequence number are sent again */
+	g_assert(sm_history_replay(sm, 45));
+	data = read_peer(sm, peer);
+	g_assert_cmpstr(data, ==,
+			"line 46\nline 47\nline 48\nline 49\nline 50\n");
+	g_free(data);
+
+	g_assert(sm_history_replay(sm, 38));
+	data = read_peer(sm, peer);
+	g_assert(g_str_has_prefix(data, "line 39\n"));
+	g_assert(g_str_has_suffix(data, "line 50\n"));
+	g_assert_cmpuint(strlen(data), ==, 12 * 8);
+	g_free(data);
+
+	/* The peer has everything */
+	g_assert(sm_history_replay(sm, 50));
+	data = read_peer(sm, peer);
+	g_assert_cmpstr(data, ==, "");
+	g_free(data);
+
+	/* Lines that are dropped, or that are not sent yet */
+	g_assert(!sm_history_replay(sm, 37));
+	g_assert(!sm_history_replay(sm, 51));
+	data = read_peer(sm, peer);
+	g_assert_cmpstr(data, ==, "");
+	g_free(data);
+
+	/* The offsets are still right after the buffer moved */
+	send_lines(sm, 51, 70);
+	g_free(read_peer(sm, peer));
+	g_assert(sm_history_replay(sm, 68));
+	data = read_peer(sm, peer);
+	g_assert_cmpstr(data, ==, "line 69\nline 70\n");
+	g_free(data);
+
+	sm_free(sm);
+	close(peer);
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+	test_driver.input_add_read = evl_glib_input_add_read;
+	test_driver.input_add_write = evl_glib_input_add_write;
+	test_driver.input_remove = evl_glib_input_remove;
+	driver = &test_driver;
+	other_dispatch =
+	    sm_dispatch_new(other_keywords, G_N_ELEMENTS(other_keywords));
+
+	g_test_add_func("/state/dispatch", test_dispatch);
+	g_test_add_func("/state/history/trim", test_history_trim);
+	g_test_add_func("/state/history/replay", test_history_replay);
+	if (g_test_perf())
+		g_test_add_func("/state/dispatch/speed",
+				test_dispatch_speed);
+	return g_test_run();
+}
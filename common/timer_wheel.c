@@ -0,0 +1,214 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include <time.h>
+#include <glib.h>
+#include "timer_wheel.h"
+
+/* Each level has 64 slots.  A slot of level 0 spans one second, a slot
+ * of the next level spans a full turn of the level below it.  Four
+ * levels cover more than 190 days, longer delays are clamped.
+ */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_MAX_DELAY ((1UL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+/* Each thread has its own wheel, which runs in the main context of the
+ * thread.  A timer must be scheduled and cancelled by the same thread.
+ */
+typedef struct {
+	/* The slots are circular lists, the heads are not timers */
+	TimerWheelEntry slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	gulong tick;		/* the last tick that was handled */
+	time_t time;		/* the time of tick */
+	guint pending;		/* number of scheduled timers */
+	guint source;		/* the GLib timeout, 0 when stopped */
+} TimerWheel;
+
+static GStaticPrivate wheel_private = G_STATIC_PRIVATE_INIT;
+
+static TimerWheel *wheel_get(void)
+{
+	TimerWheel *wheel = g_static_private_get(&wheel_private);
+	gint level;
+	gint slot;
+
+	if (wheel != NULL)
+		return wheel;
+
+	wheel = g_malloc0(sizeof(*wheel));
+	for (level = 0; level < WHEEL_LEVELS; ++level)
+		for (slot = 0; slot < WHEEL_SLOTS; ++slot) {
+			wheel->slots[level][slot].next =
+			    &wheel->slots[level][slot];
+			wheel->slots[level][slot].prev =
+			    &wheel->slots[level][slot];
+		}
+	g_static_private_set(&wheel_private, wheel, g_free);
+	return wheel;
+}
+
+static void wheel_unlink(TimerWheelEntry * entry)
+{
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+	entry->next = NULL;
+	entry->prev = NULL;
+}
+
+/* Put the timer in the slot that is handled last before it expires */
+static void wheel_insert(TimerWheel * wheel, TimerWheelEntry * entry)
+{
+	gulong delay = entry->expires - wheel->tick;
+	TimerWheelEntry *head;
+	gint level;
+
+	for (level = 0; level < WHEEL_LEVELS - 1; ++level)
+		if (delay < (1UL << (WHEEL_BITS * (level + 1))))
+			break;
+	head =
+	    &wheel->slots[level][(entry->expires >> (WHEEL_BITS * level)) &
+				 WHEEL_MASK];
+
+	entry->next = head;
+	entry->prev = head->prev;
+	head->prev->next = entry;
+	head->prev = entry;
+}
+
+/* Move the timers of a slot to the levels below */
+static void wheel_cascade(TimerWheel * wheel, gint level)
+{
+	TimerWheelEntry *head =
+	    &wheel->slots[level][(wheel->tick >> (WHEEL_BITS * level)) &
+				 WHEEL_MASK];
+
+	while (head->next != head) {
+		TimerWheelEntry *entry = head->next;
+
+		wheel_unlink(entry);
+		wheel_insert(wheel, entry);
+	}
+}
+
+static void wheel_advance(TimerWheel * wheel)
+{
+	TimerWheelEntry *head;
+	gint level;
+
+	++wheel->tick;
+	for (level = 1; level < WHEEL_LEVELS; ++level) {
+		if ((wheel->tick >> (WHEEL_BITS * (level - 1))) & WHEEL_MASK)
+			break;
+		wheel_cascade(wheel, level);
+	}
+
+	/* Rescheduled timers never end up in the current slot */
+	head = &wheel->slots[0][wheel->tick & WHEEL_MASK];
+	while (head->next != head) {
+		TimerWheelEntry *entry = head->next;
+
+		wheel_unlink(entry);
+		--wheel->pending;
+		entry->func(entry->user_data);
+	}
+}
+
+static gboolean wheel_tick_function(gpointer data)
+{
+	TimerWheel *wheel = data;
+	time_t now = time(NULL);
+
+	/* Don't go back in time when the clock is set back */
+	if (now < wheel->time)
+		wheel->time = now;
+
+	/* Catch up when the timeout was delayed */
+	while (wheel->time < now && wheel->pending > 0) {
+		++wheel->time;
+		wheel_advance(wheel);
+	}
+
+	if (wheel->pending == 0) {
+		wheel->source = 0;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+void timer_wheel_entry_init(TimerWheelEntry * entry, TimerWheelFunc func,
+			    gpointer user_data)
+{
+	entry->next = NULL;
+	entry->prev = NULL;
+	entry->expires = 0;
+	entry->func = func;
+	entry->user_data = user_data;
+}
+
+void timer_wheel_schedule(TimerWheelEntry * entry, guint seconds)
+{
+	TimerWheel *wheel;
+	time_t now;
+	gulong delay;
+
+	g_return_if_fail(entry->func != NULL);
+
+	wheel = wheel_get();
+	if (entry->next != NULL)
+		wheel_unlink(entry);
+	else
+		++wheel->pending;
+
+	now = time(NULL);
+	if (wheel->source == 0) {
+		GSource *source = g_timeout_source_new_seconds(1);
+
+		/* The wheel was idle, it starts now */
+		wheel->time = now;
+		g_source_set_callback(source, wheel_tick_function, wheel,
+				      NULL);
+		wheel->source =
+		    g_source_attach(source,
+				    g_main_context_get_thread_default());
+		g_source_unref(source);
+	}
+
+	/* The timeout may not have caught up with the clock yet */
+	delay = seconds;
+	if (now > wheel->time)
+		delay += now - wheel->time;
+	entry->expires = wheel->tick + CLAMP(delay, 1, WHEEL_MAX_DELAY);
+	wheel_insert(wheel, entry);
+}
+
+void timer_wheel_cancel(TimerWheelEntry * entry)
+{
+	if (entry->next == NULL)
+		return;
+	wheel_unlink(entry);
+	--wheel_get()->pending;
+}
+
+gboolean timer_wheel_is_scheduled(const TimerWheelEntry * entry)
+{
+	return entry->next != NULL;
+}
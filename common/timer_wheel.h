@@ -0,0 +1,71 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __timer_wheel_h
+#define __timer_wheel_h
+
+#include <glib.h>
+
+/* A hierarchical timer wheel with a resolution of one second.
+ * The timers of a thread share a single GLib timeout in the main context
+ * of that thread, which only runs while a timer is scheduled.  A timer
+ * must be cancelled by the thread that scheduled it.  The timers are
+ * embedded in the structures that use them, so scheduling and cancelling
+ * allocate nothing and take constant time.
+ */
+
+typedef void (*TimerWheelFunc) (gpointer user_data);
+
+typedef struct _TimerWheelEntry TimerWheelEntry;
+struct _TimerWheelEntry {
+	TimerWheelEntry *next;	/* NULL when not scheduled */
+	TimerWheelEntry *prev;
+	gulong expires;		/* tick at which the timer fires */
+	TimerWheelFunc func;
+	gpointer user_data;
+};
+
+/** Prepare a timer, it is not scheduled.
+ * A zero-filled entry is not scheduled either, but has no function.
+ * @param entry The timer
+ * @param func The function to call when the timer expires
+ * @param user_data The argument for func
+ */
+void timer_wheel_entry_init(TimerWheelEntry * entry, TimerWheelFunc func,
+			    gpointer user_data);
+
+/** Schedule a timer, or reschedule it when it is already scheduled.
+ * The function is called once, the timer is not scheduled anymore when
+ * it is called.
+ * @param entry The timer
+ * @param seconds The delay
+ */
+void timer_wheel_schedule(TimerWheelEntry * entry, guint seconds);
+
+/** Cancel a timer.  It is harmless if the timer is not scheduled.
+ * @param entry The timer
+ */
+void timer_wheel_cancel(TimerWheelEntry * entry);
+
+/** Is the timer scheduled?
+ * @param entry The timer
+ * @return TRUE if the function will be called
+ */
+gboolean timer_wheel_is_scheduled(const TimerWheelEntry * entry);
+
+#endif
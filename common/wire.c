@@ -0,0 +1,313 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include <string.h>
+#include <glib.h>
+#include "wire.h"
+
+/* Tokens in the payload of a frame */
+#define WIRE_INT 0
+#define WIRE_STRING 1
+#define WIRE_KEYWORD 2		/* opcode of the first keyword */
+
+/* The opcodes are the positions in this table, so both ends must use
+ * the same table.  Only append to it, and never more than 254 words.
+ */
+static const gchar *const wire_keywords[] = {
+	/* keepalive */
+	"hello", "yes",
+	/* framing of the messages */
+	"player", "extension", "viewer", "OK", "ERR", "NOTE", "NOTE1",
+	"INFO",
+	/* connection */
+	"version", "report", "status", "newplayer", "newviewer",
+	"reconnect", "name", "style", "players", "game", "gameinfo",
+	"start", "end", "chat", "quit", "batch", "begin", "compress",
+	"zlib",
+	/* the turn */
+	"turn", "roll", "rolled", "done", "receives", "spent", "refund",
+	"setup", "setup-double", "build", "built", "remove", "move",
+	"move-back", "undo", "road", "ship", "bridge", "settlement",
+	"city", "city_wall",
+	/* robber and pirate */
+	"move-robber", "moved-robber", "move-pirate", "moved-pirate",
+	"unmoved-robber", "unmoved-pirate", "you-are-robber",
+	"robber-done", "rob", "stole", "discard", "discarded",
+	"must-discard", "lose-point", "get-point", "take-point",
+	/* gold */
+	"prepare-gold", "choose-gold", "receive-gold",
+	/* development cards */
+	"buy-develop", "bought-develop", "play-develop", "played-develop",
+	"monopoly", "plenty", "largest-army", "longest-road",
+	/* trade */
+	"maritime-trade", "domestic-trade", "domestic-quote", "call",
+	"supply", "receive", "quote", "finish", "delete", "accept",
+	"reject",
+	/* errors */
+	"bad-pos", "too-expensive", "too-many", "wrong-time",
+	"roll-dice", "already-rolled", "won",
+};
+
+/* Open addressing hash table of the keywords, at most half full.
+ * A slot holds the opcode, or 0 when it is empty.
+ */
+#define WIRE_SLOTS 512
+static guint8 wire_slots[WIRE_SLOTS];
+static gsize wire_slots_initialised;
+
+static guint wire_hash(const gchar * word, gsize len)
+{
+	guint hash = 5381;
+
+	while (len-- > 0)
+		hash = hash * 33 + (guchar) * word++;
+	return hash;
+}
+
+static void wire_init(void)
+{
+	guint idx;
+
+	if (!g_once_init_enter(&wire_slots_initialised))
+		return;
+
+	g_assert(G_N_ELEMENTS(wire_keywords) <= 255 - WIRE_KEYWORD);
+	g_assert(2 * G_N_ELEMENTS(wire_keywords) <= WIRE_SLOTS);
+	for (idx = 0; idx < G_N_ELEMENTS(wire_keywords); ++idx) {
+		const gchar *word = wire_keywords[idx];
+		guint slot =
+		    wire_hash(word, strlen(word)) & (WIRE_SLOTS - 1);
+
+		while (wire_slots[slot] != 0)
+			slot = (slot + 1) & (WIRE_SLOTS - 1);
+		wire_slots[slot] = idx + WIRE_KEYWORD;
+	}
+	g_once_init_leave(&wire_slots_initialised, 1);
+}
+
+/** @return The opcode of the word, or 0 if it is not a keyword */
+static guint8 wire_lookup(const gchar * word, gsize len)
+{
+	guint slot = wire_hash(word, len) & (WIRE_SLOTS - 1);
+	guint8 opcode;
+
+	while ((opcode = wire_slots[slot]) != 0) {
+		const gchar *keyword = wire_keywords[opcode - WIRE_KEYWORD];
+		if (strncmp(keyword, word, len) == 0
+		    && keyword[len] == '\0')
+			return opcode;
+		slot = (slot + 1) & (WIRE_SLOTS - 1);
+	}
+	return 0;
+}
+
+/** Is the word an integer that is written the way "%d" writes it?
+ * Only those are sent as integers, so that decoding gives the same text.
+ */
+static gboolean wire_parse_int(const gchar * word, gsize len,
+			       gint * value)
+{
+	const gchar *end = word + len;
+	gboolean negative = FALSE;
+	gint num = 0;
+
+	if (len > 0 && *word == '-') {
+		negative = TRUE;
+		++word;
+	}
+	/* Nine digits always fit */
+	if (word == end || end - word > 9
+	    || (*word == '0' && (end - word > 1 || negative)))
+		return FALSE;
+	for (; word < end; ++word) {
+		if (*word < '0' || *word > '9')
+			return FALSE;
+		num = num * 10 + (*word - '0');
+	}
+	*value = negative ? -num : num;
+	return TRUE;
+}
+
+/** Write a varint to buf, which has room for five bytes.
+ * @return The number of bytes written
+ */
+static gsize wire_varint_write(gchar * buf, guint32 value)
+{
+	gsize len = 0;
+
+	while (value >= 0x80) {
+		buf[len++] = (gchar) ((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	buf[len++] = (gchar) value;
+	return len;
+}
+
+static void wire_put_varint(GString * out, guint32 value)
+{
+	gchar buf[5];
+
+	g_string_append_len(out, buf, wire_varint_write(buf, value));
+}
+
+/** Read a varint.
+ * @return The number of bytes used, 0 if data ends before the varint,
+ *         or -1 if it is too long
+ */
+static gint wire_get_varint(const gchar * data, gsize len,
+			    guint32 * value)
+{
+	guint32 result = 0;
+	gsize idx;
+
+	for (idx = 0; idx < len; ++idx) {
+		guchar byte = data[idx];
+
+		if (idx == 4 && byte > 0x0f)
+			return -1;
+		result |= (guint32) (byte & 0x7f) << (7 * idx);
+		if ((byte & 0x80) == 0) {
+			*value = result;
+			return idx + 1;
+		}
+	}
+	return len >= 5 ? -1 : 0;
+}
+
+/* Room for the mark and the longest varint of the payload length */
+#define WIRE_HEADER_SIZE 6
+
+static void wire_encode_line(GString * out, const gchar * line,
+			     gsize len)
+{
+	gsize header = out->len;
+	gsize payload;
+	gsize header_len;
+	const gchar *end = line + len;
+
+	/* The length is only known at the end, reserve room for it */
+	g_string_set_size(out, header + WIRE_HEADER_SIZE);
+	for (;;) {
+		const gchar *word = line;
+		gsize word_len;
+		guint8 opcode;
+		gint num;
+
+		while (line < end && *line != ' ')
+			++line;
+		word_len = line - word;
+
+		if ((opcode = wire_lookup(word, word_len)) != 0) {
+			g_string_append_c(out, (gchar) opcode);
+		} else if (wire_parse_int(word, word_len, &num)) {
+			/* zigzag, so small negative numbers are short */
+			guint32 zigzag =
+			    ((guint32) num << 1) ^ (guint32) (num >> 31);
+
+			g_string_append_c(out, WIRE_INT);
+			wire_put_varint(out, zigzag);
+		} else {
+			g_string_append_c(out, WIRE_STRING);
+			wire_put_varint(out, word_len);
+			g_string_append_len(out, word, word_len);
+		}
+		if (line == end)
+			break;
+		++line;		/* skip the space */
+	}
+
+	/* Move the payload against the header */
+	payload = out->len - header - WIRE_HEADER_SIZE;
+	out->str[header] = WIRE_FRAME_MARK;
+	header_len = 1 + wire_varint_write(out->str + header + 1, payload);
+	memmove(out->str + header + header_len,
+		out->str + header + WIRE_HEADER_SIZE, payload);
+	g_string_truncate(out, header + header_len + payload);
+}
+
+void wire_encode(GString * out, const gchar * data, gsize len)
+{
+	const gchar *end = data + len;
+	const gchar *eol;
+
+	wire_init();
+	while ((eol = memchr(data, '\n', end - data)) != NULL) {
+		wire_encode_line(out, data, eol - data);
+		data = eol + 1;
+	}
+	g_string_append_len(out, data, end - data);
+}
+
+gssize wire_decode(GString * line, const gchar * data, gsize len,
+		   gsize limit)
+{
+	guint32 payload;
+	gint used;
+	const gchar *start;
+	const gchar *pos;
+	const gchar *end;
+
+	g_return_val_if_fail(len > 0 && data[0] == WIRE_FRAME_MARK, -1);
+
+	used = wire_get_varint(data + 1, len - 1, &payload);
+	if (used <= 0)
+		return used;
+	if (1 + used + (gsize) payload > limit)
+		return -1;
+	if (1 + used + (gsize) payload > len)
+		return 0;
+
+	g_string_truncate(line, 0);
+	start = data + 1 + used;
+	end = start + payload;
+	for (pos = start; pos < end;) {
+		guchar token = *pos;
+		guint32 value;
+
+		/* The words are separated by spaces */
+		if (pos++ != start)
+			g_string_append_c(line, ' ');
+
+		if (token >= WIRE_KEYWORD) {
+			token -= WIRE_KEYWORD;
+			if (token >= G_N_ELEMENTS(wire_keywords))
+				return -1;
+			g_string_append(line, wire_keywords[token]);
+			continue;
+		}
+
+		used = wire_get_varint(pos, end - pos, &value);
+		if (used <= 0)
+			return -1;
+		pos += used;
+		if (token == WIRE_INT) {
+			gint num = (gint) (value >> 1) ^ -(gint) (value & 1);
+
+			g_string_append_printf(line, "%d", num);
+		} else {
+			/* A frame holds a single line */
+			if (value > (guint32) (end - pos)
+			    || memchr(pos, '\n', value) != NULL)
+				return -1;
+			g_string_append_len(line, pos, value);
+			pos += value;
+		}
+	}
+	return end - data;
+}
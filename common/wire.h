@@ -0,0 +1,58 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __wire_h
+#define __wire_h
+
+#include <glib.h>
+
+/* The binary form of the line protocol.
+ *
+ * Each line is sent as a frame: WIRE_FRAME_MARK, the length of the
+ * payload as a varint, and the payload.  The payload holds the words of
+ * the line, which are separated by single spaces:
+ *  - a known keyword is a single opcode byte,
+ *  - an integer is WIRE_INT followed by its zigzag varint,
+ *  - anything else is WIRE_STRING, the length as a varint, and the bytes.
+ * A text line never starts with WIRE_FRAME_MARK, so a reader can accept
+ * both forms on the same connection.  Decoding a frame gives exactly the
+ * line that was encoded.
+ */
+
+#define WIRE_FRAME_MARK '\001'
+
+/** Encode the complete lines of data as frames.
+ * A trailing incomplete line is copied unchanged.
+ * @param out The frames are appended to this string
+ * @param data The lines
+ * @param len The length of data
+ */
+void wire_encode(GString * out, const gchar * data, gsize len);
+
+/** Decode the frame at the start of data.
+ * @param line Is set to the line, without the newline
+ * @param data The received data, it starts with WIRE_FRAME_MARK
+ * @param len The length of data
+ * @param limit The maximum length of a frame
+ * @return The length of the frame, 0 if it is not complete yet,
+ *         or -1 if it is invalid or too long
+ */
+gssize wire_decode(GString * line, const gchar * data, gsize len,
+		   gsize limit);
+
+#endif
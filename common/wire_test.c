@@ -0,0 +1,271 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* The tests of the binary form of the protocol.  Run with -m perf to
+ * measure the speed of the encoder and the decoder too.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <glib.h>
+#include "wire.h"
+
+#define LIMIT 4096
+
+/* Lines as the server and the clients send them, and the corner cases
+ * of the words */
+static const gchar *const lines[] = {
+	"player 2 built road 34 5 2",
+	"player 0 receives 1 0 2 0 0",
+	"player 3 domestic-trade call supply 1 0 0 0 0 receive 0 0 1 0 0",
+	"rolled 3 4",
+	"turn 12",
+	"extension chat Hello, world!",
+	"NOTE1 %s has won the game with %d victory points!|Anne|10",
+	"version 0.12-binary",
+	"",
+	" leading",
+	"trailing ",
+	"two  spaces",
+	"  ",
+	"-0",
+	"00",
+	"-",
+	"0",
+	"-1",
+	"123456789",
+	"-123456789",
+	"999999999",
+	"-999999999",
+	"1234567890",
+	"-1234567890",
+	"2147483648",
+	"turn-",
+	"rolle",
+	"rolled-",
+	"\xc3\xa9t\xc3\xa9 \xe2\x82\xac 5",
+	"\001 not a frame",
+};
+
+/** Decode all frames of data, and check that each gives the next line */
+static void check_decode(const gchar * data, gsize len,
+			 const gchar * const *expected, gsize num)
+{
+	GString *line = g_string_new(NULL);
+	gsize idx;
+
+	for (idx = 0; idx < num; ++idx) {
+		gssize used = wire_decode(line, data, len, LIMIT);
+
+		g_assert_cmpint(used, >, 0);
+		g_assert_cmpstr(line->str, ==, expected[idx]);
+		data += used;
+		len -= used;
+	}
+	g_assert_cmpuint(len, ==, 0);
+	g_string_free(line, TRUE);
+}
+
+static void test_round_trip(void)
+{
+	gsize idx;
+
+	for (idx = 0; idx < G_N_ELEMENTS(lines); ++idx) {
+		GString *frame = g_string_new(NULL);
+		gchar *text = g_strconcat(lines[idx], "\n", NULL);
+
+		wire_encode(frame, text, strlen(text));
+		g_assert(frame->str[0] == WIRE_FRAME_MARK);
+		check_decode(frame->str, frame->len, &lines[idx], 1);
+		g_string_free(frame, TRUE);
+		g_free(text);
+	}
+}
+
+static void test_many_lines(void)
+{
+	GString *text = g_string_new(NULL);
+	GString *frames = g_string_new(NULL);
+	gsize idx;
+	gsize len;
+
+	for (idx = 0; idx < G_N_ELEMENTS(lines); ++idx)
+		g_string_append_printf(text, "%s\n", lines[idx]);
+	/* A line without its newline is not a frame yet */
+	g_string_append(text, "player 1");
+
+	wire_encode(frames, text->str, text->len);
+	len = frames->len - strlen("player 1");
+	g_assert(memcmp(frames->str + len, "player 1", 8) == 0);
+	check_decode(frames->str, len, lines, G_N_ELEMENTS(lines));
+
+	g_string_free(text, TRUE);
+	g_string_free(frames, TRUE);
+}
+
+/* Integers that "%d" writes differently are strings, so that they stay
+ * the same */
+static void test_integers(void)
+{
+	static const struct {
+		const gchar *word;
+		gsize size;	/* the size of the frame */
+	} cases[] = {
+		{ "0", 4 },
+		{ "-1", 4 },
+		{ "63", 4 },
+		{ "64", 5 },
+		{ "-999999999", 8 },
+		{ "-0", 6 },
+		{ "007", 7 },
+		{ "1234567890", 14 },
+	};
+	gsize idx;
+
+	for (idx = 0; idx < G_N_ELEMENTS(cases); ++idx) {
+		GString *frame = g_string_new(NULL);
+		gchar *text = g_strconcat(cases[idx].word, "\n", NULL);
+
+		wire_encode(frame, text, strlen(text));
+		g_assert_cmpuint(frame->len, ==, cases[idx].size);
+		check_decode(frame->str, frame->len, &cases[idx].word, 1);
+		g_string_free(frame, TRUE);
+		g_free(text);
+	}
+}
+
+static void test_truncated(void)
+{
+	GString *frame = g_string_new(NULL);
+	GString *line = g_string_new(NULL);
+	const gchar *text = "player 2 built road 34 5 2 extension\n";
+	gsize len;
+
+	wire_encode(frame, text, strlen(text));
+	for (len = 1; len < frame->len; ++len)
+		g_assert_cmpint(wire_decode(line, frame->str, len, LIMIT), ==,
+				0);
+	g_assert_cmpint(wire_decode(line, frame->str, frame->len, LIMIT),
+			==, frame->len);
+
+	g_string_free(frame, TRUE);
+	g_string_free(line, TRUE);
+}
+
+static void test_invalid(void)
+{
+	/* Each starts with the mark and the length of the payload */
+	static const struct {
+		const gchar *data;
+		gsize len;
+	} cases[] = {
+		/* an opcode after the last keyword */
+		{ "\001\001\377", 3 },
+		/* a string that is longer than the payload */
+		{ "\001\003\001\005ab", 6 },
+		/* a string with a newline */
+		{ "\001\004\001\002a\n", 6 },
+		/* an integer without its value */
+		{ "\001\001\000", 3 },
+		/* a varint that does not end */
+		{ "\001\006\000\377\377\377\377\377", 8 },
+		/* a length of more than 32 bits */
+		{ "\001\377\377\377\377\177", 6 },
+	};
+	GString *line = g_string_new(NULL);
+	GString *frame = g_string_new(NULL);
+	gsize idx;
+
+	for (idx = 0; idx < G_N_ELEMENTS(cases); ++idx)
+		g_assert_cmpint(wire_decode(line, cases[idx].data,
+					    cases[idx].len, LIMIT), ==, -1);
+
+	/* A frame that is longer than the limit */
+	wire_encode(frame, "extension chat 0123456789\n", 26);
+	g_assert_cmpint(wire_decode(line, frame->str, frame->len,
+				    frame->len - 1), ==, -1);
+	g_assert_cmpint(wire_decode(line, frame->str, frame->len,
+				    frame->len), ==, frame->len);
+
+	g_string_free(line, TRUE);
+	g_string_free(frame, TRUE);
+}
+
+#define PERF_ROUNDS 20000
+
+static void test_speed(void)
+{
+	GString *text = g_string_new(NULL);
+	GString *frames = g_string_new(NULL);
+	GString *line = g_string_new(NULL);
+	gdouble elapsed;
+	gsize idx;
+	gint round;
+
+	/* The lines of the game, without the corner cases */
+	for (idx = 0; idx < 8; ++idx)
+		g_string_append_printf(text, "%s\n", lines[idx]);
+
+	g_test_timer_start();
+	for (round = 0; round < PERF_ROUNDS; ++round) {
+		g_string_truncate(frames, 0);
+		wire_encode(frames, text->str, text->len);
+	}
+	elapsed = g_test_timer_elapsed();
+	g_test_maximized_result(text->len * PERF_ROUNDS / elapsed / 1e6,
+				"Encoded %.1f MB of text per second",
+				text->len * PERF_ROUNDS / elapsed / 1e6);
+	g_test_message("%" G_GSIZE_FORMAT " bytes of text in %"
+		       G_GSIZE_FORMAT " bytes of frames", text->len,
+		       frames->len);
+
+	g_test_timer_start();
+	for (round = 0; round < PERF_ROUNDS; ++round) {
+		const gchar *data = frames->str;
+		gsize len = frames->len;
+
+		while (len > 0) {
+			gssize used = wire_decode(line, data, len, LIMIT);
+
+			g_assert_cmpint(used, >, 0);
+			data += used;
+			len -= used;
+		}
+	}
+	elapsed = g_test_timer_elapsed();
+	g_test_maximized_result(8 * PERF_ROUNDS / elapsed,
+				"Decoded %.0f lines per second",
+				8 * PERF_ROUNDS / elapsed);
+
+	g_string_free(text, TRUE);
+	g_string_free(frames, TRUE);
+	g_string_free(line, TRUE);
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+	g_test_add_func("/wire/round-trip", test_round_trip);
+	g_test_add_func("/wire/many-lines", test_many_lines);
+	g_test_add_func("/wire/integers", test_integers);
+	g_test_add_func("/wire/truncated", test_truncated);
+	g_test_add_func("/wire/invalid", test_invalid);
+	if (g_test_perf())
+		g_test_add_func("/wire/speed", test_speed);
+	return g_test_run();
+}
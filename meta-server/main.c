@@ -44,6 +44,8 @@
 #include <glib.h>
 #include "network.h"
 #include "game.h"
+#include "driver.h"
+#include "common_epoll.h"
 #include "version.h"
 
 typedef enum {
@@ -64,6 +66,8 @@ struct _Client {
 	char read_buff[16 * 1024];
 	int read_len;
 	GList *write_queue;
+	guint read_tag;		/* Only used with epoll */
+	guint write_tag;
 	gboolean waiting_for_close;
 	gint protocol_major;
 	gint protocol_minor;
@@ -102,8 +106,15 @@ static gchar *port_range = NULL;
 static gboolean enable_debug = FALSE;
 static gboolean enable_syslog_debug = FALSE;
 static gboolean show_version = FALSE;
+#ifdef HAVE_SYS_EPOLL_H
+static gboolean use_epoll = FALSE;
+#endif
 
 static void client_printf(Client * client, const char *fmt, ...);
+#ifdef HAVE_SYS_EPOLL_H
+static void client_read_ready(Client * client);
+static void client_write_ready(Client * client);
+#endif
 
 #define MINUTE 60
 #define HOUR (60 * MINUTE)
@@ -199,6 +210,52 @@ static void find_new_max_fd(void)
 	}
 }
 
+static void client_listen_read(Client * client, gboolean monitor)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	if (use_epoll) {
+		if (monitor && client->read_tag == 0)
+			client->read_tag =
+			    evl_epoll_input_add_read(client->fd,
+						     (InputFunc)
+						     client_read_ready,
+						     client);
+		if (!monitor && client->read_tag != 0) {
+			evl_epoll_input_remove(client->read_tag);
+			client->read_tag = 0;
+		}
+		return;
+	}
+#endif				/* HAVE_SYS_EPOLL_H */
+	if (monitor)
+		FD_SET(client->fd, &read_fds);
+	else
+		FD_CLR(client->fd, &read_fds);
+}
+
+static void client_listen_write(Client * client, gboolean monitor)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	if (use_epoll) {
+		if (monitor && client->write_tag == 0)
+			client->write_tag =
+			    evl_epoll_input_add_write(client->fd,
+						      (InputFunc)
+						      client_write_ready,
+						      client);
+		if (!monitor && client->write_tag != 0) {
+			evl_epoll_input_remove(client->write_tag);
+			client->write_tag = 0;
+		}
+		return;
+	}
+#endif				/* HAVE_SYS_EPOLL_H */
+	if (monitor)
+		FD_SET(client->fd, &write_fds);
+	else
+		FD_CLR(client->fd, &write_fds);
+}
+
 static void client_free(Client * client)
 {
 	if (client->type == META_SERVER)
@@ -229,8 +286,8 @@ static void client_close(Client * client)
 	if (client->fd == max_fd)
 		find_new_max_fd();
 
-	FD_CLR(client->fd, &read_fds);
-	FD_CLR(client->fd, &write_fds);
+	client_listen_read(client, FALSE);
+	client_listen_write(client, FALSE);
 	net_closesocket(client->fd);
 
 	while (client->write_queue != NULL) {
@@ -312,7 +369,7 @@ static void client_do_write(Client * client)
 			client_close(client);
 			return;
 		} else
-			FD_CLR(client->fd, &write_fds);
+			client_listen_write(client, FALSE);
 	}
 
 	set_client_event_at(client);
@@ -328,7 +385,7 @@ static void client_printf(Client * client, const char *fmt, ...)
 	va_end(ap);
 
 	client->write_queue = g_list_append(client->write_queue, buff);
-	FD_SET(client->fd, &write_fds);
+	client_listen_write(client, TRUE);
 
 	set_client_event_at(client);
 }
@@ -775,9 +832,13 @@ static int find_line(char *buff, int len)
 	return -1;
 }
 
-static void client_do_read(Client * client)
+/* Read from the client and process the complete lines.
+ * Returns TRUE when the socket may have more data.
+ */
+static gboolean client_do_read(Client * client)
 {
 	int num;
+	int requested;
 	int offset;
 	gboolean finished;
 
@@ -787,11 +848,12 @@ static void client_do_read(Client * client)
 		 */
 		my_syslog(LOG_ERR, "read buffer overflow - disconnecting");
 		client_close(client);
-		return;
+		return FALSE;
 	}
 
+	requested = sizeof(client->read_buff) - client->read_len;
 	num = read(client->fd, client->read_buff + client->read_len,
-		   sizeof(client->read_buff) - client->read_len);
+		   requested);
 
 	if (num > 0) {
 		meta_debug("client_do_read: read(%d, %d) = %d, \"%.*s\"\n",
@@ -801,16 +863,16 @@ static void client_do_read(Client * client)
 		client->read_anything = TRUE;
 	} else if (num < 0) {
 		if (errno == EAGAIN)
-			return;
+			return FALSE;
 		my_syslog(LOG_ERR, "reading socket: %s",
 			  g_strerror(errno));
 		client_close(client);
-		return;
+		return FALSE;
 	} else {
 		meta_debug("client_do_read: EOF seen on fd %d\n",
 			   client->fd);
 		client_close(client);
-		return;
+		return FALSE;
 	}
 
 	client->read_len += num;
@@ -842,9 +904,13 @@ static void client_do_read(Client * client)
 		client->read_len = 0;
 
 	set_client_event_at(client);
+	return num == requested && client->fd >= 0;
 }
 
-static void accept_new_client(void)
+/* Accept a new client.
+ * Returns FALSE when no client could be accepted.
+ */
+static gboolean accept_new_client(void)
 {
 	int fd;
 	gchar *error_message;
@@ -852,10 +918,21 @@ static void accept_new_client(void)
 
 	fd = net_accept(accept_fd, &error_message);
 	if (fd < 0) {
-		my_syslog(LOG_ERR, "%s", error_message);
-		g_free(error_message);
-		return;
+		if (error_message != NULL) {
+			my_syslog(LOG_ERR, "%s", error_message);
+			g_free(error_message);
+		}
+		return FALSE;
 	}
+#ifdef HAVE_SYS_EPOLL_H
+	if (!use_epoll)
+#endif
+		if (fd >= FD_SETSIZE) {
+			my_syslog(LOG_ERR,
+				  "too many connections for select()");
+			net_closesocket(fd);
+			return FALSE;
+		}
 	if (fd > max_fd)
 		max_fd = fd;
 
@@ -874,9 +951,10 @@ static void accept_new_client(void)
 		client_printf(client,
 			      "welcome to the pioneers-meta-server version %s\n",
 			      META_PROTOCOL_VERSION);
-		FD_SET(client->fd, &read_fds);
+		client_listen_read(client, TRUE);
 	}
 	set_client_event_at(client);
+	return TRUE;
 }
 
 static struct timeval *find_next_delay(void)
@@ -930,6 +1008,16 @@ static void check_timeouts(void)
 	}
 }
 
+/* Finish the processing of a client after its socket was handled */
+static void client_ready(Client * client)
+{
+	if (client->waiting_for_close && client->write_queue == NULL)
+		client_close(client);
+
+	if (client->fd < 0)
+		client_free(client);
+}
+
 static void select_loop(void)
 {
 	for (;;) {
@@ -981,15 +1069,53 @@ static void select_loop(void)
 				num--;
 			}
 
-			if (client->waiting_for_close
-			    && client->write_queue == NULL)
-				client_close(client);
+			client_ready(client);
+		}
+	}
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static void client_read_ready(Client * client)
+{
+	/* The socket must be drained, epoll is edge triggered */
+	while (client_do_read(client));
+	client_ready(client);
+}
+
+static void client_write_ready(Client * client)
+{
+	client_do_write(client);
+	client_ready(client);
+}
 
-			if (client->fd < 0)
-				client_free(client);
+static void accept_ready(G_GNUC_UNUSED gpointer data)
+{
+	/* Accept all pending connections at once */
+	while (accept_new_client());
+}
+
+static void epoll_loop(void)
+{
+	for (;;) {
+		struct timeval *timeout;
+
+		reap_children();
+		check_timeouts();
+		timeout = find_next_delay();
+
+		if (evl_epoll_dispatch(timeout->tv_sec * 1000) < 0) {
+			if (errno == EINTR)
+				continue;
+			else {
+				my_syslog(LOG_ALERT,
+					  "could not epoll_wait: %s",
+					  g_strerror(errno));
+				exit(1);
+			}
 		}
 	}
 }
+#endif				/* HAVE_SYS_EPOLL_H */
 
 static gboolean setup_accept_sock(const gchar * port)
 {
@@ -1003,6 +1129,12 @@ static gboolean setup_accept_sock(const gchar * port)
 		return FALSE;
 	}
 	accept_fd = max_fd = fd;
+#ifdef HAVE_SYS_EPOLL_H
+	if (use_epoll) {
+		evl_epoll_input_add_read(accept_fd, accept_ready, NULL);
+		return TRUE;
+	}
+#endif				/* HAVE_SYS_EPOLL_H */
 	FD_SET(accept_fd, &read_fds);
 	return TRUE;
 }
@@ -1083,6 +1215,12 @@ static GOptionEntry commandline_entries[] = {
 	{"debug", '\0', 0, G_OPTION_ARG_NONE, &enable_debug,
 	 /* Commandline option of meta server: enable debug logging */
 	 N_("Enable debug messages"), NULL},
+#ifdef HAVE_SYS_EPOLL_H
+	{"epoll", 0, 0, G_OPTION_ARG_NONE, &use_epoll,
+	 /* Commandline meta-server: epoll */
+	 N_("Use epoll instead of select to wait for network events"),
+	 NULL},
+#endif
 	{"syslog-debug", '\0', 0, G_OPTION_ARG_NONE, &enable_syslog_debug,
 	 /* Commandline option of meta server: syslog-debug */
 	 N_("Debug syslog messages"), NULL},
@@ -1168,11 +1306,23 @@ int main(int argc, char *argv[])
 
 	if (!myhostname)
 		myhostname = get_meta_server_name(FALSE);
+#ifdef HAVE_SYS_EPOLL_H
+	if (use_epoll && !evl_epoll_init()) {
+		my_syslog(LOG_ALERT, "could not use epoll: %s",
+			  g_strerror(errno));
+		return 1;
+	}
+#endif				/* HAVE_SYS_EPOLL_H */
 	if (!setup_accept_sock(PIONEERS_DEFAULT_META_PORT))
 		return 1;
 
 	my_syslog(LOG_INFO, "Pioneers meta server started.");
-	select_loop();
+#ifdef HAVE_SYS_EPOLL_H
+	if (use_epoll)
+		epoll_loop();
+	else
+#endif				/* HAVE_SYS_EPOLL_H */
+		select_loop();
 
 	g_thread_exit(0);
 	g_free(pidfile);
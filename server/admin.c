@@ -54,7 +54,16 @@ typedef enum {
 	MESSAGE,
 	HELP,
 	INFO,
-	FIXDICE
+	FIXDICE,
+	NETSTATS,
+	PROFILE,
+	CREATEGAME,
+	DESTROYGAME,
+	LISTGAMES,
+	SETSEED,
+	SAVEGAME,
+	LOADGAME,
+	HOTRESTART
 } AdminCommandType;
 
 typedef struct {
@@ -82,9 +91,76 @@ static AdminCommand admin_commands[] = {
 	{ HELP,           "help",                FALSE, FALSE, FALSE },
 	{ INFO,           "info",                FALSE, FALSE, FALSE },
 	{ FIXDICE,        "fix-dice",            TRUE,  FALSE, FALSE },
+	{ NETSTATS,       "net-stats",           FALSE, FALSE, FALSE },
+	{ PROFILE,        "profile",             FALSE, FALSE, FALSE },
+	{ CREATEGAME,     "create-game",         FALSE, FALSE, TRUE  },
+	{ DESTROYGAME,    "destroy-game",        TRUE,  FALSE, FALSE },
+	{ LISTGAMES,      "list-games",          FALSE, FALSE, FALSE },
+	{ SETSEED,        "set-seed",            TRUE,  FALSE, FALSE },
+	{ SAVEGAME,       "save-game",           TRUE,  FALSE, FALSE },
+	{ LOADGAME,       "load-game",           TRUE,  FALSE, FALSE },
+	{ HOTRESTART,     "hot-restart",         FALSE, FALSE, FALSE },
 };
 /* *INDENT-ON* */
 
+/* A command that reads or changes a game runs in the worker of the game */
+typedef struct {
+	Game *game;
+	const gchar *argument;	/* the argument of the command */
+	GString *reply;		/* the lines for the admin */
+	gsize size;		/* the memory of the game */
+	gsize fixed;		/* the memory that does not change */
+} AdminCall;
+
+static void admin_call_message(gpointer data)
+{
+	AdminCall *call = data;
+
+	admin_broadcast(call->game, call->argument);
+}
+
+static void admin_call_net_stats(gpointer data)
+{
+	AdminCall *call = data;
+	GList *list;
+
+	for (list = call->game->player_list; list != NULL;
+	     list = g_list_next(list)) {
+		Player *player = list->data;
+		gchar *stats = player_network_stats(player);
+
+		if (stats == NULL)
+			continue;
+		g_string_append_printf(call->reply,
+				       "INFO net-stats player %d %s name %s\n",
+				       player->num, stats, player->name);
+		g_free(stats);
+	}
+}
+
+static void admin_call_save(gpointer data)
+{
+	AdminCall *call = data;
+	gchar *error_message;
+
+	if (record_save(call->game, call->argument, &error_message))
+		g_string_append_printf(call->reply, "INFO game saved %d\n",
+				       call->game->id);
+	else {
+		g_string_append_printf(call->reply,
+				       "ERROR game not saved: %s\n",
+				       error_message);
+		g_free(error_message);
+	}
+}
+
+static void admin_call_memory(gpointer data)
+{
+	AdminCall *call = data;
+
+	call->size = server_game_memory(call->game, &call->fixed);
+}
+
 /* parse 'line' and run the command requested */
 void admin_run_command(Session * admin_session, const gchar * line)
 {
@@ -97,6 +173,12 @@ void admin_run_command(Session * admin_session, const gchar * line)
 	static gboolean register_server = TRUE;
 	static GameParams *params = NULL;
 	static Game *game = NULL;
+	static gint game_id = 0;
+
+	/* A game of a multi-game server can be freed by itself, and
+	 * another game can get the same address */
+	if (!server_game_exists(game) || game->id != game_id)
+		game = NULL;
 
 	if (!g_str_has_prefix(line, "admin")) {
 		net_printf(admin_session,
@@ -150,7 +232,9 @@ void admin_run_command(Session * admin_session, const gchar * line)
 			   "ERROR command '%s' needs a valid game\n",
 			   command);
 	} else {
+		/* The games of a multi-game server keep running */
 		if (admin_commands[command_number].stop_server
+		    && !server_is_multi_game()
 		    && server_is_running(game)) {
 			server_stop(game);
 			game_free(game);
@@ -176,13 +260,17 @@ void admin_run_command(Session * admin_session, const gchar * line)
 					server_port =
 					    g_strdup
 					    (PIONEERS_DEFAULT_GAME_PORT);
-				if (game != NULL)
+				/* A multi-game server starts one more game,
+				 * like create-game */
+				if (!server_is_multi_game() && game != NULL)
 					game_free(game);
 				game =
 				    server_start(params, get_server_name(),
 						 server_port,
 						 register_server,
 						 meta_server_name, TRUE);
+				if (game != NULL)
+					game_id = game->id;
 				g_free(meta_server_name);
 			}
 			break;
@@ -222,8 +310,14 @@ void admin_run_command(Session * admin_session, const gchar * line)
 			break;
 		case MESSAGE:
 			g_strdelimit(argument, "|", '_');
-			if (server_is_running(game))
-				admin_broadcast(game, argument);
+			if (server_is_running(game)) {
+				AdminCall call;
+
+				call.game = game;
+				call.argument = argument;
+				worker_call(game->worker,
+					    admin_call_message, &call);
+			}
 			break;
 		case HELP:
 			for (command_number = 1;
@@ -255,6 +349,10 @@ void admin_run_command(Session * admin_session, const gchar * line)
 			net_printf(admin_session,
 				   "INFO server running %d\n",
 				   server_is_running(game));
+			if (server_is_running(game))
+				net_printf(admin_session,
+					   "INFO seed %" G_GUINT32_FORMAT
+					   "\n", game->seed);
 			if (params) {
 				net_printf(admin_session, "INFO game %s\n",
 					   params->title);
@@ -290,6 +388,211 @@ void admin_run_command(Session * admin_session, const gchar * line)
 			else
 				net_printf(admin_session,
 					   "INFO dice rolled normally\n");
+			break;
+		case NETSTATS:
+			{
+				GList *games = server_running_games();
+				GList *list;
+				AdminCall call;
+
+				call.reply = g_string_new(NULL);
+				for (list = games; list != NULL;
+				     list = g_list_next(list)) {
+					call.game = list->data;
+					worker_call(call.game->worker,
+						    admin_call_net_stats,
+						    &call);
+				}
+				net_write(admin_session, call.reply->str);
+				g_string_free(call.reply, TRUE);
+				g_list_free(games);
+			}
+			break;
+		case CREATEGAME:
+			{
+				gchar *meta_server_name;
+				Game *created;
+
+				if (!server_is_multi_game()) {
+					net_printf(admin_session,
+						   "ERROR the server hosts a single game\n");
+					break;
+				}
+				meta_server_name =
+				    get_meta_server_name(TRUE);
+				created =
+				    server_start(params, get_server_name(),
+						 server_port ? server_port :
+						 PIONEERS_DEFAULT_GAME_PORT,
+						 register_server,
+						 meta_server_name, TRUE);
+				g_free(meta_server_name);
+				if (created != NULL)
+					net_printf(admin_session,
+						   "INFO game created %d\n",
+						   created->id);
+				else
+					net_printf(admin_session,
+						   "ERROR game not created\n");
+			}
+			break;
+		case DESTROYGAME:
+			{
+				Game *destroyed =
+				    server_find_game(atoi(argument));
+
+				if (destroyed == NULL) {
+					net_printf(admin_session,
+						   "ERROR game '%s' not found\n",
+						   argument);
+					break;
+				}
+				if (destroyed == game)
+					game = NULL;
+				net_printf(admin_session,
+					   "INFO game destroyed %d\n",
+					   destroyed->id);
+				game_free(destroyed);
+			}
+			break;
+		case LISTGAMES:
+			{
+				GList *games = server_running_games();
+				GList *list;
+				gsize total = 0;
+
+				for (list = games; list != NULL;
+				     list = g_list_next(list)) {
+					Game *running = list->data;
+					AdminCall call;
+
+					call.game = running;
+					worker_call(running->worker,
+						    admin_call_memory,
+						    &call);
+					net_printf(admin_session,
+						   "INFO game %d players %d/%d memory %"
+						   G_GSIZE_FORMAT " fixed %"
+						   G_GSIZE_FORMAT " seed %"
+						   G_GUINT32_FORMAT
+						   " title %s\n",
+						   running->id,
+						   running->num_players,
+						   running->params->
+						   num_players, call.size,
+						   call.fixed,
+						   running->seed,
+						   running->params->title);
+					total += call.size;
+				}
+				g_list_free(games);
+				net_printf(admin_session,
+					   "INFO games memory %" G_GSIZE_FORMAT
+					   "\n", total);
+			}
+			break;
+		case SETSEED:
+			/* For the next game, to play a game again */
+			server_set_seed((guint32)
+					strtoul(argument, NULL, 10));
+			break;
+		case SAVEGAME:
+			{
+				/* The game can be chosen by its id */
+				Game *saved = game;
+				gchar *filename = argument;
+				gchar *end;
+				gint id = strtol(argument, &end, 10);
+				AdminCall call;
+
+				if (end != argument && g_ascii_isspace(*end)) {
+					saved = server_find_game(id);
+					filename = g_strchug(end);
+				}
+				if (!server_is_running(saved)) {
+					net_printf(admin_session,
+						   "ERROR no game to save\n");
+					break;
+				}
+				call.game = saved;
+				call.argument = filename;
+				call.reply = g_string_new(NULL);
+				worker_call(saved->worker, admin_call_save,
+					    &call);
+				net_write(admin_session, call.reply->str);
+				g_string_free(call.reply, TRUE);
+			}
+			break;
+		case LOADGAME:
+			{
+				gchar *meta_server_name;
+				Game *loaded;
+
+				/* The game that runs stays when the record
+				 * cannot be loaded */
+				loaded = record_recover(argument);
+				if (loaded == NULL) {
+					net_printf(admin_session,
+						   "ERROR game not loaded\n");
+					break;
+				}
+				/* A single game is replaced, it frees the
+				 * port */
+				if (!server_is_multi_game() && game != NULL) {
+					game_free(game);
+					game = NULL;
+				}
+				meta_server_name =
+				    get_meta_server_name(TRUE);
+				loaded =
+				    server_serve(loaded, get_server_name(),
+						 server_port ? server_port :
+						 PIONEERS_DEFAULT_GAME_PORT,
+						 register_server,
+						 meta_server_name);
+				g_free(meta_server_name);
+				if (loaded == NULL) {
+					net_printf(admin_session,
+						   "ERROR game not loaded\n");
+					break;
+				}
+				if (!server_is_multi_game()) {
+					game = loaded;
+					game_id = game->id;
+				}
+				net_printf(admin_session,
+					   "INFO game loaded %d\n",
+					   loaded->id);
+			}
+			break;
+		case HOTRESTART:
+			/* Only returns if the games stay here */
+			net_write(admin_session, "INFO restarting\n");
+			net_flush(admin_session);
+			if (!restart_hand_over())
+				net_printf(admin_session,
+					   "ERROR restart failed\n");
+			break;
+		case PROFILE:
+			/* The first command starts the profiler */
+			if (!sm_profile_is_enabled()) {
+				sm_profile_enable();
+				net_printf(admin_session,
+					   "INFO profile started\n");
+			} else {
+				gchar *report = sm_profile_report();
+				gchar **lines = g_strsplit(report, "\n", 0);
+				gint idx;
+
+				for (idx = 0; lines[idx] != NULL; ++idx)
+					if (lines[idx][0] != '\0')
+						net_printf(admin_session,
+							   "INFO profile %s\n",
+							   lines[idx]);
+				g_strfreev(lines);
+				g_free(report);
+			}
+			break;
 		}
 	}
 	g_free(command);
@@ -344,7 +647,7 @@ void admin_event(NetEvent event, Session * admin_session,
 	}
 }
 
-/* accept a connection made to the admin port */
+/* accept the connections made to the admin port */
 void admin_connect(comm_info * admin_info)
 {
 	Session *admin_session;
@@ -353,38 +656,49 @@ void admin_connect(comm_info * admin_info)
 
 	/* somebody connected to the administration port, so we... */
 
-	/* (1) create a new network session */
-	admin_session = net_new((NetNotifyFunc) admin_event, NULL);
+	/* (1) accept the connection into a new file descriptor, until
+	 * there are no more pending connections */
+	while ((new_fd = accept_connection(admin_info->fd, &location)) >= 0) {
+		g_free(location);
 
-	/* (2) set the session as the session's user data, so we can free it 
-	 * later (this way we don't have to keep any globals holding all the 
-	 * sessions) */
-	admin_session->user_data = admin_session;
+		/* (2) create a new network session */
+		admin_session = net_new((NetNotifyFunc) admin_event, NULL);
 
-	/* (3) accept the connection into a new file descriptor */
-	new_fd = accept_connection(admin_info->fd, &location);
+		/* (3) set the session as the session's user data, so we can
+		 * free it later (this way we don't have to keep any globals
+		 * holding all the sessions) */
+		admin_session->user_data = admin_session;
 
-	/* (4) tie the new file descriptor to the session we created earlier.
-	 * Don't use keepalive pings on this connection.  */
-	net_use_fd(admin_session, new_fd, FALSE);
+		/* (4) tie the new file descriptor to the session we created
+		 * earlier.  Don't use keepalive pings on this connection.  */
+		net_use_fd(admin_session, new_fd, FALSE);
+	}
 }
 
 /* set up the administration port */
 gboolean admin_listen(const gchar * port)
 {
 	gchar *error_message;
-
-	if (!_accept_info) {
-		_accept_info = g_malloc0(sizeof(comm_info));
-	}
+	gint fd;
 
 	/* open up a socket on which to listen for connections */
-	_accept_info->fd = net_open_listening_socket(port, &error_message);
-	if (_accept_info->fd == -1) {
+	fd = net_open_listening_socket(port, &error_message);
+	if (fd == -1) {
 		log_message(MSG_ERROR, "%s\n", error_message);
 		g_free(error_message);
 		return FALSE;
 	}
+	admin_listen_fd(fd);
+	return TRUE;
+}
+
+void admin_listen_fd(gint fd)
+{
+	if (!_accept_info) {
+		_accept_info = g_malloc0(sizeof(comm_info));
+	}
+
+	_accept_info->fd = fd;
 #ifdef PRINT_INFO
 	g_print("admin_listen: fd = %d\n", _accept_info->fd);
 #endif
@@ -394,5 +708,9 @@ gboolean admin_listen(const gchar * port)
 	    driver->input_add_read(_accept_info->fd,
 				   (InputFunc) admin_connect,
 				   _accept_info);
-	return TRUE;
+}
+
+gint admin_accept_fd(void)
+{
+	return _accept_info != NULL ? _accept_info->fd : -1;
 }
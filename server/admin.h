@@ -50,4 +50,12 @@ void admin_connect(comm_info * admin_info);
  */
 gboolean admin_listen(const gchar * port);
 
+/** set up the administration port on a socket that listens already
+ * @param fd The socket
+ */
+void admin_listen_fd(gint fd);
+
+/** @return The socket of the administration port, or -1 */
+gint admin_accept_fd(void);
+
 #endif				/* __admin_h */
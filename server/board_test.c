@@ -0,0 +1,559 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* The tests of the tables that the server keeps of the board: the road
+ * networks with their longest road, and the hexes of each roll.  Each
+ * is compared with a search of the whole map.  Run with -m perf to
+ * measure both ways too.
+ */
+
+#include "config.h"
+#include <glib.h>
+#include "driver.h"
+#include "server.h"
+
+/* The boards of the tests, with six players */
+static const gchar *const game_files[] = {
+	"5-6-player.game",
+	"seafarers.game",
+	"ubuntuland.game",
+};
+
+#define NUM_PLAYERS 6
+#define RANDOM_STEPS 600
+#define PERF_ROUNDS 200
+
+/* The library calls these, the programs define them */
+void game_is_over(G_GNUC_UNUSED Game * game)
+{
+}
+
+void request_server_stop(G_GNUC_UNUSED Game * game)
+{
+}
+
+static UIDriver test_driver;
+
+typedef struct {
+	Game *game;
+	GRand *rand;
+	gint max_edges;		/* the roads, ships and bridges of a player */
+	GPtrArray *edges;	/* each edge of the map once */
+	GPtrArray *nodes;	/* each node of the map once */
+} Board;
+
+static gboolean collect_board(Hex * hex, gpointer closure)
+{
+	Board *board = closure;
+	gint idx;
+
+	/* The edges and the nodes belong to one hex */
+	for (idx = 0; idx < G_N_ELEMENTS(hex->edges); idx++) {
+		Edge *edge = hex->edges[idx];
+
+		if (edge->x == hex->x && edge->y == hex->y)
+			g_ptr_array_add(board->edges, edge);
+	}
+	for (idx = 0; idx < G_N_ELEMENTS(hex->nodes); idx++) {
+		Node *node = hex->nodes[idx];
+
+		if (node->x == hex->x && node->y == hex->y)
+			g_ptr_array_add(board->nodes, node);
+	}
+	return FALSE;
+}
+
+static Board *board_new(const gchar * name, guint32 seed)
+{
+	Board *board = g_malloc0(sizeof(*board));
+	gchar *filename = g_build_filename(TEST_GAME_DIR, name, NULL);
+	GameParams *params = params_load_file(filename);
+
+	g_assert(params != NULL);
+	params->num_players = NUM_PLAYERS;
+	board->game = game_new(params, seed);
+	board->rand = g_rand_new_with_seed(seed);
+	board->max_edges = params->num_build_type[BUILD_ROAD]
+	    + params->num_build_type[BUILD_SHIP]
+	    + params->num_build_type[BUILD_BRIDGE];
+	board->edges = g_ptr_array_new();
+	board->nodes = g_ptr_array_new();
+	map_traverse(board->game->params->map, collect_board, board);
+
+	params_free(params);
+	g_free(filename);
+	return board;
+}
+
+static void board_free(Board * board)
+{
+	game_free(board->game);
+	g_rand_free(board->rand);
+	g_ptr_array_free(board->edges, TRUE);
+	g_ptr_array_free(board->nodes, TRUE);
+	g_free(board);
+}
+
+/** Compare the lengths of the networks with a search of the map */
+static void check_lengths(Board * board)
+{
+	gint cached[MAX_PLAYERS];
+	gint searched[MAX_PLAYERS];
+	gint idx;
+
+	longest_road_lengths(board->game, cached);
+	map_longest_road(board->game->params->map, searched, NUM_PLAYERS);
+	for (idx = 0; idx < NUM_PLAYERS; idx++)
+		g_assert_cmpint(cached[idx], ==, searched[idx]);
+}
+
+static void set_edge(Board * board, Edge * edge, gint owner,
+		     BuildType type)
+{
+	edge->owner = owner;
+	edge->type = owner < 0 ? BUILD_NONE : type;
+	longest_road_edge_changed(board->game, edge);
+}
+
+static void set_node(Board * board, Node * node, gint owner,
+		     BuildType type)
+{
+	node->owner = owner;
+	node->type = owner < 0 ? BUILD_NONE : type;
+	longest_road_node_changed(board->game, node);
+}
+
+/* What can be built on edge: a road or a ship at the coast, and a
+ * bridge now and then over the sea */
+static BuildType edge_build_type(Board * board, const Edge * edge)
+{
+	gboolean land = is_edge_on_land(edge);
+	gboolean sea = is_edge_on_sea(edge);
+
+	if (land && sea)
+		return g_rand_boolean(board->rand) ? BUILD_ROAD : BUILD_SHIP;
+	if (land)
+		return BUILD_ROAD;
+	if (!sea)
+		return BUILD_NONE;
+	if (board->game->params->map->have_bridges
+	    && g_rand_int_range(board->rand, 0, 4) == 0)
+		return BUILD_BRIDGE;
+	return BUILD_SHIP;
+}
+
+/* The number of nodes of edge where an edge of owner ends */
+static gint edge_touches(const Edge * edge, gint owner)
+{
+	gint count = 0;
+	gint nodeidx, edgeidx;
+
+	for (nodeidx = 0; nodeidx < G_N_ELEMENTS(edge->nodes); nodeidx++) {
+		const Node *node = edge->nodes[nodeidx];
+
+		for (edgeidx = 0; edgeidx < G_N_ELEMENTS(node->edges);
+		     edgeidx++)
+			if (node->edges[edgeidx] != NULL
+			    && node->edges[edgeidx]->owner == owner) {
+				++count;
+				break;
+			}
+	}
+	return count;
+}
+
+static gint count_edges(Board * board, gint owner)
+{
+	gint count = 0;
+	guint idx;
+
+	for (idx = 0; idx < board->edges->len; idx++)
+		if (((Edge *) g_ptr_array_index(board->edges, idx))->owner ==
+		    owner)
+			++count;
+	return count;
+}
+
+/** Give owner one more edge next to its others.
+ * @param compact Prefer the edges that close a circle, which gives the
+ *                road search the most branches
+ * @return FALSE if no edge can be built
+ */
+static gboolean grow_network(Board * board, gint owner, gboolean compact)
+{
+	GPtrArray *candidates = g_ptr_array_new();
+	gboolean first = count_edges(board, owner) == 0;
+	gint best = 1;
+	guint idx;
+	Edge *edge;
+
+	for (idx = 0; idx < board->edges->len; idx++) {
+		gint touches;
+
+		edge = g_ptr_array_index(board->edges, idx);
+		if (edge->owner >= 0 || edge_build_type(board, edge)
+		    == BUILD_NONE)
+			continue;
+		touches = edge_touches(edge, owner);
+		if (!first && touches < best)
+			continue;
+		if (compact && touches > best) {
+			g_ptr_array_set_size(candidates, 0);
+			best = touches;
+		}
+		g_ptr_array_add(candidates, edge);
+	}
+	if (candidates->len == 0) {
+		g_ptr_array_free(candidates, TRUE);
+		return FALSE;
+	}
+	edge = g_ptr_array_index(candidates,
+				 g_rand_int_range(board->rand, 0,
+						  (gint) candidates->len));
+	set_edge(board, edge, owner, edge_build_type(board, edge));
+	g_ptr_array_free(candidates, TRUE);
+	return TRUE;
+}
+
+static Edge *random_edge(Board * board)
+{
+	return g_ptr_array_index(board->edges,
+				 g_rand_int_range(board->rand, 0,
+						  (gint) board->edges->len));
+}
+
+static Node *random_node(Board * board)
+{
+	return g_ptr_array_index(board->nodes,
+				 g_rand_int_range(board->rand, 0,
+						  (gint) board->nodes->len));
+}
+
+/* Build and remove at random, and compare after each change */
+static void test_random(void)
+{
+	gsize file;
+
+	for (file = 0; file < G_N_ELEMENTS(game_files); file++) {
+		Board *board = board_new(game_files[file], 42 + file);
+		gint step;
+
+		check_lengths(board);
+		for (step = 0; step < RANDOM_STEPS; step++) {
+			gint owner =
+			    g_rand_int_range(board->rand, 0, NUM_PLAYERS);
+			Edge *edge;
+			Node *node;
+
+			switch (g_rand_int_range(board->rand, 0, 10)) {
+			case 0:
+			case 1:
+			case 2:
+			case 3:
+			case 4:
+			case 5:
+				if (count_edges(board, owner) <
+				    board->max_edges)
+					grow_network(board, owner, FALSE);
+				break;
+			case 6:
+				node = random_node(board);
+				if (node->owner < 0)
+					set_node(board, node, owner,
+						 BUILD_SETTLEMENT);
+				else if (node->type == BUILD_SETTLEMENT)
+					set_node(board, node, node->owner,
+						 BUILD_CITY);
+				break;
+			case 7:
+			case 8:
+				edge = random_edge(board);
+				if (edge->owner >= 0)
+					set_edge(board, edge, -1,
+						 BUILD_NONE);
+				break;
+			case 9:
+				node = random_node(board);
+				if (node->owner >= 0)
+					set_node(board, node, -1,
+						 BUILD_NONE);
+				break;
+			}
+			check_lengths(board);
+		}
+		board_free(board);
+	}
+}
+
+/* Every player builds all its roads, ships and bridges as close
+ * together as it can */
+static void build_branching(Board * board)
+{
+	gint owner;
+	gint count;
+
+	for (owner = 0; owner < NUM_PLAYERS; owner++)
+		for (count = 0; count < board->max_edges; count++)
+			if (!grow_network(board, owner, TRUE))
+				break;
+}
+
+/* Remove each edge and each building once, and put it back */
+static void test_branching(void)
+{
+	gsize file;
+
+	for (file = 0; file < G_N_ELEMENTS(game_files); file++) {
+		Board *board = board_new(game_files[file], 7 + file);
+		guint idx;
+
+		build_branching(board);
+		check_lengths(board);
+		for (idx = 0; idx < board->edges->len; idx++) {
+			Edge *edge = g_ptr_array_index(board->edges, idx);
+			gint owner = edge->owner;
+			BuildType type = edge->type;
+
+			if (owner < 0)
+				continue;
+			set_edge(board, edge, -1, BUILD_NONE);
+			check_lengths(board);
+			set_edge(board, edge, owner, type);
+			check_lengths(board);
+		}
+		/* A settlement of someone else cuts the roads */
+		for (idx = 0; idx < board->nodes->len; idx++) {
+			Node *node = g_ptr_array_index(board->nodes, idx);
+			gint owner = -1;
+			gint edgeidx;
+
+			for (edgeidx = 0;
+			     edgeidx < G_N_ELEMENTS(node->edges); edgeidx++)
+				if (node->edges[edgeidx] != NULL
+				    && node->edges[edgeidx]->owner >= 0)
+					owner = node->edges[edgeidx]->owner;
+			if (node->owner >= 0 || owner < 0)
+				continue;
+			set_node(board, node, (owner + 1) % NUM_PLAYERS,
+				 BUILD_SETTLEMENT);
+			check_lengths(board);
+			set_node(board, node, -1, BUILD_NONE);
+			check_lengths(board);
+		}
+		board_free(board);
+	}
+}
+
+/* Time the change of an edge, and the lengths after it */
+static void test_longest_road_speed(void)
+{
+	gsize file;
+
+	for (file = 0; file < G_N_ELEMENTS(game_files); file++) {
+		Board *board = board_new(game_files[file], 7 + file);
+		GPtrArray *built = g_ptr_array_new();
+		gint lengths[MAX_PLAYERS];
+		gdouble cached, searched;
+		gint round;
+		guint idx;
+
+		build_branching(board);
+		for (idx = 0; idx < board->edges->len; idx++) {
+			Edge *edge = g_ptr_array_index(board->edges, idx);
+
+			if (edge->owner >= 0)
+				g_ptr_array_add(built, edge);
+		}
+		longest_road_lengths(board->game, lengths);
+
+		g_test_timer_start();
+		for (round = 0; round < PERF_ROUNDS; round++) {
+			Edge *edge = g_ptr_array_index(built,
+						       round % built->len);
+			gint owner = edge->owner;
+			BuildType type = edge->type;
+
+			set_edge(board, edge, -1, BUILD_NONE);
+			longest_road_lengths(board->game, lengths);
+			set_edge(board, edge, owner, type);
+			longest_road_lengths(board->game, lengths);
+		}
+		cached = g_test_timer_elapsed();
+
+		g_test_timer_start();
+		for (round = 0; round < PERF_ROUNDS; round++) {
+			Edge *edge = g_ptr_array_index(built,
+						       round % built->len);
+			gint owner = edge->owner;
+			BuildType type = edge->type;
+
+			edge->owner = -1;
+			edge->type = BUILD_NONE;
+			map_longest_road(board->game->params->map, lengths,
+					 NUM_PLAYERS);
+			edge->owner = owner;
+			edge->type = type;
+			map_longest_road(board->game->params->map, lengths,
+					 NUM_PLAYERS);
+		}
+		searched = g_test_timer_elapsed();
+
+		g_test_minimized_result(cached / (2 * PERF_ROUNDS),
+					"%s: %.1f us per change with the "
+					"networks", game_files[file],
+					cached / (2 * PERF_ROUNDS) * 1e6);
+		g_test_message("%s: %.1f us per change with a search of "
+			       "the map, %u edges built", game_files[file],
+			       searched / (2 * PERF_ROUNDS) * 1e6,
+			       built->len);
+
+		g_ptr_array_free(built, TRUE);
+		board_free(board);
+	}
+}
+
+typedef struct {
+	gint roll;
+	GPtrArray *hexes;
+} RollScan;
+
+static gboolean scan_roll(Hex * hex, gpointer closure)
+{
+	RollScan *scan = closure;
+
+	if (hex->roll == scan->roll)
+		g_ptr_array_add(scan->hexes, hex);
+	return FALSE;
+}
+
+/* The buildings that a roll gives resources to */
+static gint count_producers(GPtrArray * hexes)
+{
+	gint count = 0;
+	guint idx;
+	gint nodeidx;
+
+	for (idx = 0; idx < hexes->len; idx++) {
+		const Hex *hex = g_ptr_array_index(hexes, idx);
+
+		if (hex->robber)
+			continue;
+		for (nodeidx = 0; nodeidx < G_N_ELEMENTS(hex->nodes);
+		     nodeidx++)
+			if (hex->nodes[nodeidx]->type != BUILD_NONE)
+				++count;
+	}
+	return count;
+}
+
+/* The index has the hexes that the search of the map finds */
+static void test_rolls(void)
+{
+	gsize file;
+
+	for (file = 0; file < G_N_ELEMENTS(game_files); file++) {
+		Board *board = board_new(game_files[file], 3 + file);
+		RollScan scan;
+
+		scan.hexes = g_ptr_array_new();
+		for (scan.roll = 2; scan.roll <= 12; scan.roll++) {
+			GPtrArray *index = board->game->roll_hexes[scan.roll];
+			guint idx;
+
+			g_ptr_array_set_size(scan.hexes, 0);
+			map_traverse(board->game->params->map, scan_roll,
+				     &scan);
+			g_assert_cmpuint(index->len, ==, scan.hexes->len);
+			for (idx = 0; idx < index->len; idx++)
+				g_assert(g_ptr_array_index(index, idx) ==
+					 g_ptr_array_index(scan.hexes, idx));
+		}
+		g_ptr_array_free(scan.hexes, TRUE);
+		board_free(board);
+	}
+}
+
+/* Time the lookup of the producing buildings of all rolls */
+static void test_roll_speed(void)
+{
+	gsize file;
+
+	for (file = 0; file < G_N_ELEMENTS(game_files); file++) {
+		Board *board = board_new(game_files[file], 3 + file);
+		RollScan scan;
+		gdouble indexed, searched;
+		gint total_indexed = 0;
+		gint total_searched = 0;
+		gint round;
+
+		/* The settlements and cities of a game near its end */
+		for (round = 0; round < NUM_PLAYERS * 5; round++) {
+			Node *node = random_node(board);
+
+			if (node->owner >= 0 || !is_node_on_land(node))
+				continue;
+			node->owner = round % NUM_PLAYERS;
+			node->type = round % 2 ? BUILD_CITY : BUILD_SETTLEMENT;
+		}
+
+		g_test_timer_start();
+		for (round = 0; round < PERF_ROUNDS * 100; round++)
+			total_indexed +=
+			    count_producers(board->game->roll_hexes
+					    [2 + round % 11]);
+		indexed = g_test_timer_elapsed();
+
+		scan.hexes = g_ptr_array_new();
+		g_test_timer_start();
+		for (round = 0; round < PERF_ROUNDS * 100; round++) {
+			scan.roll = 2 + round % 11;
+			g_ptr_array_set_size(scan.hexes, 0);
+			map_traverse(board->game->params->map, scan_roll,
+				     &scan);
+			total_searched += count_producers(scan.hexes);
+		}
+		searched = g_test_timer_elapsed();
+		g_ptr_array_free(scan.hexes, TRUE);
+
+		g_assert_cmpint(total_indexed, ==, total_searched);
+		g_test_minimized_result(indexed / (PERF_ROUNDS * 100),
+					"%s: %.2f us per roll with the index",
+					game_files[file],
+					indexed / (PERF_ROUNDS * 100) * 1e6);
+		g_test_message("%s: %.2f us per roll with a search of the "
+			       "map", game_files[file],
+			       searched / (PERF_ROUNDS * 100) * 1e6);
+		board_free(board);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+	driver = &test_driver;
+
+	g_test_add_func("/board/longest-road/random", test_random);
+	g_test_add_func("/board/longest-road/branching", test_branching);
+	g_test_add_func("/board/rolls", test_rolls);
+	if (g_test_perf()) {
+		g_test_add_func("/board/longest-road/speed",
+				test_longest_road_speed);
+		g_test_add_func("/board/rolls/speed", test_roll_speed);
+	}
+	return g_test_run();
+}
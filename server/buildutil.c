@@ -19,28 +19,182 @@
  */
 
 #include "config.h"
+#include <string.h>
 #include "buildrec.h"
 #include "cost.h"
 #include "server.h"
 
+/* The roads, ships and bridges of a player that connect, and the length
+ * of the longest road through them.  A change of the board only changes
+ * the networks at the place of the change, so only those are measured
+ * again.
+ */
+typedef struct {
+	gint owner;
+	gint length;
+	GPtrArray *edges;
+} RoadNetwork;
+
+static void road_network_add(Game * game, Edge * edge)
+{
+	RoadNetwork *network;
+	guint idx;
+
+	if (edge->owner < 0
+	    || g_hash_table_lookup(game->road_networks, edge) != NULL)
+		return;
+
+	network = g_malloc0(sizeof(*network));
+	network->owner = edge->owner;
+	network->edges = g_ptr_array_new();
+	map_road_network(edge, network->edges);
+	network->length = map_longest_road_network(network->edges);
+	for (idx = 0; idx < network->edges->len; idx++)
+		g_hash_table_insert(game->road_networks,
+				    g_ptr_array_index(network->edges, idx),
+				    network);
+}
+
+static gboolean road_network_build(Hex * hex, gpointer closure)
+{
+	gint idx;
+
+	for (idx = 0; idx < G_N_ELEMENTS(hex->edges); idx++)
+		road_network_add(closure, hex->edges[idx]);
+	return FALSE;
+}
+
+/** Forget the network of edge.
+ * @param orphans The edges of the network are added to this
+ */
+static void road_network_remove(Game * game, Edge * edge,
+				GPtrArray * orphans)
+{
+	RoadNetwork *network;
+	guint idx;
+
+	if (edge == NULL
+	    || (network =
+		g_hash_table_lookup(game->road_networks, edge)) == NULL)
+		return;
+
+	for (idx = 0; idx < network->edges->len; idx++) {
+		Edge *orphan = g_ptr_array_index(network->edges, idx);
+
+		g_hash_table_remove(game->road_networks, orphan);
+		g_ptr_array_add(orphans, orphan);
+	}
+	g_ptr_array_free(network->edges, TRUE);
+	g_free(network);
+}
+
+/* Measure the networks around the nodes again */
+static void road_network_update(Game * game, Node ** nodes, gint num,
+				GPtrArray * orphans)
+{
+	gint nodeidx, edgeidx;
+	guint idx;
+
+	for (nodeidx = 0; nodeidx < num; nodeidx++)
+		for (edgeidx = 0;
+		     edgeidx < G_N_ELEMENTS(nodes[nodeidx]->edges);
+		     edgeidx++)
+			road_network_remove(game,
+					    nodes[nodeidx]->edges[edgeidx],
+					    orphans);
+	for (idx = 0; idx < orphans->len; idx++)
+		road_network_add(game, g_ptr_array_index(orphans, idx));
+	g_ptr_array_free(orphans, TRUE);
+}
+
+/** The owner or the type of edge has changed. */
+void longest_road_edge_changed(Game * game, Edge * edge)
+{
+	GPtrArray *orphans;
+
+	if (game->road_networks == NULL)
+		return;
+	orphans = g_ptr_array_new();
+	g_ptr_array_add(orphans, edge);
+	road_network_remove(game, edge, orphans);
+	road_network_update(game, edge->nodes,
+			    G_N_ELEMENTS(edge->nodes), orphans);
+}
+
+/** The building on node has changed. */
+void longest_road_node_changed(Game * game, Node * node)
+{
+	if (game->road_networks == NULL)
+		return;
+	road_network_update(game, &node, 1, g_ptr_array_new());
+}
+
+void longest_road_free(Game * game)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	GPtrArray *networks;
+	guint idx;
+
+	if (game->road_networks == NULL)
+		return;
+
+	/* Each network is in the table once for every edge */
+	networks = g_ptr_array_new();
+	g_hash_table_iter_init(&iter, game->road_networks);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		RoadNetwork *network = value;
+
+		if (g_ptr_array_index(network->edges, 0) == key)
+			g_ptr_array_add(networks, network);
+	}
+	g_hash_table_destroy(game->road_networks);
+	game->road_networks = NULL;
+
+	for (idx = 0; idx < networks->len; idx++) {
+		RoadNetwork *network = g_ptr_array_index(networks, idx);
+
+		g_ptr_array_free(network->edges, TRUE);
+		g_free(network);
+	}
+	g_ptr_array_free(networks, TRUE);
+}
+
+void longest_road_lengths(Game * game, gint * road_len)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	if (game->road_networks == NULL) {
+		game->road_networks = g_hash_table_new(NULL, NULL);
+		map_traverse(game->params->map, road_network_build, game);
+	}
+
+	memset(road_len, 0, MAX_PLAYERS * sizeof(*road_len));
+	g_hash_table_iter_init(&iter, game->road_networks);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		RoadNetwork *network = value;
+
+		if (network->length > road_len[network->owner])
+			road_len[network->owner] = network->length;
+	}
+}
+
 void check_longest_road(Game * game, gboolean can_cut)
 {
-	Map *map = game->params->map;
 	gint road_len[MAX_PLAYERS];	/* work out the longest road */
-	GList *list;
+	Player *player;
 	Player *new_longest;
 	gint num_have_longest;
 	gboolean was_cut;	/* was the longest road cut? */
 
-	map_longest_road(map, road_len, game->params->num_players);
+	longest_road_lengths(game, road_len);
 
 	new_longest = NULL;
 	was_cut = FALSE;
 	num_have_longest = 0;
-	for (list = player_first_real(game);
-	     list != NULL; list = player_next_real(list)) {
-		Player *player = list->data;
-
+	for (player = player_first_real(game);
+	     player != NULL; player = player_next_real(player)) {
 #ifdef DEBUG_LONGEST
 		log_message(MSG_INFO, "%s", player->name);
 		if (game->longest_road == player)
@@ -240,6 +394,7 @@ void node_add(Player * player,
 	}
 
 	/* see if the longest road was cut */
+	longest_road_node_changed(game, node);
 	check_longest_road(game, TRUE);
 }
 
@@ -313,6 +468,7 @@ void edge_add(Player * player, BuildType type, int x, int y, int pos,
 			 "built %B %d %d %d\n", type, x, y, pos);
 
 	/* perhaps the longest road changed owner */
+	longest_road_edge_changed(game, edge);
 	check_longest_road(game, FALSE);
 }
 
@@ -360,6 +516,7 @@ gboolean perform_undo(Player * player)
 				 BUILD_ROAD, rec->x, rec->y, rec->pos);
 		hex->edges[rec->pos]->owner = -1;
 		hex->edges[rec->pos]->type = BUILD_NONE;
+		longest_road_edge_changed(game, hex->edges[rec->pos]);
 		break;
 	case BUILD_BRIDGE:
 		player->num_bridges--;
@@ -369,6 +526,7 @@ gboolean perform_undo(Player * player)
 				 BUILD_BRIDGE, rec->x, rec->y, rec->pos);
 		hex->edges[rec->pos]->owner = -1;
 		hex->edges[rec->pos]->type = BUILD_NONE;
+		longest_road_edge_changed(game, hex->edges[rec->pos]);
 		break;
 	case BUILD_SHIP:
 		player->num_ships--;
@@ -378,6 +536,7 @@ gboolean perform_undo(Player * player)
 				 BUILD_SHIP, rec->x, rec->y, rec->pos);
 		hex->edges[rec->pos]->owner = -1;
 		hex->edges[rec->pos]->type = BUILD_NONE;
+		longest_road_edge_changed(game, hex->edges[rec->pos]);
 		break;
 	case BUILD_CITY:
 		player->num_cities--;
@@ -400,6 +559,7 @@ gboolean perform_undo(Player * player)
 				 rec->pos);
 		hex->nodes[rec->pos]->type = BUILD_NONE;
 		hex->nodes[rec->pos]->owner = -1;
+		longest_road_node_changed(game, hex->nodes[rec->pos]);
 		break;
 	case BUILD_CITY_WALL:
 		player->num_city_walls--;
@@ -415,9 +575,11 @@ gboolean perform_undo(Player * player)
 	case BUILD_MOVE_SHIP:
 		hex->edges[rec->pos]->owner = -1;
 		hex->edges[rec->pos]->type = BUILD_NONE;
+		longest_road_edge_changed(game, hex->edges[rec->pos]);
 		hex = map_hex(map, rec->prev_x, rec->prev_y);
 		hex->edges[rec->prev_pos]->owner = player->num;
 		hex->edges[rec->prev_pos]->type = BUILD_SHIP;
+		longest_road_edge_changed(game, hex->edges[rec->prev_pos]);
 		map->has_moved_ship = FALSE;
 		player_broadcast(player, PB_RESPOND, FIRST_VERSION,
 				 LATEST_VERSION,
@@ -46,7 +46,7 @@ void develop_shuffle(Game * game)
 	for (idx = 0; idx < game->num_develop; idx++) {
 		int card_idx;
 
-		card_idx = get_rand(game->num_develop - idx);
+		card_idx = get_rand(game, game->num_develop - idx);
 		for (shuffle_idx = 0;
 		     shuffle_idx < G_N_ELEMENTS(shuffle_counts);
 		     shuffle_idx++) {
@@ -174,8 +174,9 @@ gboolean mode_road_building(Player * player, gint event)
 		/* Send ack to client, check for victory, and quit.
 		 */
 		player_send(player, FIRST_VERSION, LATEST_VERSION, "OK\n");
-		check_victory(player);
-		sm_pop(sm);
+		if (!check_victory(player))
+			/* A game that is over has no state to return to */
+			sm_pop(sm);
 		return TRUE;
 	}
 
@@ -284,7 +285,7 @@ gboolean mode_monopoly(Player * player, gint event)
 {
 	StateMachine *sm = player->sm;
 	Game *game = player->game;
-	GList *list;
+	Player *scan;
 	Resource type;
 
 	sm_state_name(sm, "mode_monopoly");
@@ -296,10 +297,8 @@ gboolean mode_monopoly(Player * player, gint event)
 
 	/* Now inform the various parties of the monopoly.
 	 */
-	for (list = player_first_real(game);
-	     list != NULL; list = player_next_real(list)) {
-		Player *scan = list->data;
-
+	for (scan = player_first_real(game);
+	     scan != NULL; scan = player_next_real(scan)) {
 		if (scan == player)
 			continue;
 
@@ -321,14 +320,12 @@ gboolean mode_monopoly(Player * player, gint event)
 
 static void check_largest_army(Game * game)
 {
-	GList *list;
+	Player *player;
 	Player *new_largest;
 
 	new_largest = NULL;
-	for (list = player_first_real(game);
-	     list != NULL; list = player_next_real(list)) {
-		Player *player = list->data;
-
+	for (player = player_first_real(game);
+	     player != NULL; player = player_next_real(player)) {
 		/* Only 3 or more soldiers can earn largest army
 		 */
 		if (player->num_soldiers < 3)
@@ -25,13 +25,13 @@
 
 static void check_finished_discard(Game * game, gboolean was_discard)
 {
-	GList *list;
+	Player *scan;
 	/* is everyone finished yet? */
-	for (list = player_first_real(game);
-	     list != NULL; list = player_next_real(list))
-		if (((Player *) list->data)->discard_num > 0)
+	for (scan = player_first_real(game);
+	     scan != NULL; scan = player_next_real(scan))
+		if (scan->discard_num > 0)
 			break;
-	if (list != NULL)
+	if (scan != NULL)
 		return;
 
 	/* tell players the discarding phase is over, but only if there
@@ -42,9 +42,8 @@ static void check_finished_discard(Game * game, gboolean was_discard)
 				 "discard-done\n");
 	/* everyone is done discarding, pop all the state machines to their
 	 * original state and push the robber to whoever wants it. */
-	for (list = player_first_real(game);
-	     list != NULL; list = player_next_real(list)) {
-		Player *scan = list->data;
+	for (scan = player_first_real(game);
+	     scan != NULL; scan = player_next_real(scan)) {
 		sm_pop(scan->sm);
 		if (sm_current(scan->sm) == (StateFunc) mode_turn)
 			robber_place(scan);
@@ -105,12 +104,11 @@ gboolean mode_discard_resources(Player * player, gint event)
  */
 void discard_resources(Game * game)
 {
-	GList *list;
+	Player *scan;
 	gboolean have_discard = FALSE;
 
-	for (list = player_first_real(game);
-	     list != NULL; list = player_next_real(list)) {
-		Player *scan = list->data;
+	for (scan = player_first_real(game);
+	     scan != NULL; scan = player_next_real(scan)) {
 		gint num;
 		gint idx;
 		gint num_types;
@@ -133,7 +131,7 @@ void discard_resources(Game * game)
 					total += scan->assets[idx];
 				}
 				while (scan->discard_num) {
-					gint choice = get_rand(total);
+					gint choice = get_rand(game, total);
 					for (idx = 0; idx < NO_RESOURCE;
 					     idx++) {
 						choice -=
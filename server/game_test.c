@@ -0,0 +1,318 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* The tests of the games of the server, through the commands of the
+ * admin port.  The server hosts a single game in the first tests, and
+ * several games from the first test of /game/multi on, so the order of
+ * the tests matters.
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <glib.h>
+#include "driver.h"
+#include "common_glib.h"
+#include "admin.h"
+#include "server.h"
+
+/* The library calls these, the programs define them */
+void game_is_over(G_GNUC_UNUSED Game * game)
+{
+}
+
+void request_server_stop(G_GNUC_UNUSED Game * game)
+{
+}
+
+static UIDriver test_driver;
+
+static void test_log(G_GNUC_UNUSED gint msg_type,
+		     G_GNUC_UNUSED const gchar * text)
+{
+}
+
+static void test_player_event(G_GNUC_UNUSED void *data)
+{
+}
+
+/* The connection of the admin */
+static Session *admin_ses;
+static gint admin_peer;
+
+static void admin_notify(G_GNUC_UNUSED NetEvent event,
+			 G_GNUC_UNUSED gpointer user_data,
+			 G_GNUC_UNUSED gchar * line)
+{
+}
+
+/** Handle the events that are ready, and read what arrived at a socket.
+ * @return The data, free it with g_free
+ */
+static gchar *read_socket(gint fd)
+{
+	GString *data = g_string_new(NULL);
+	gchar buff[1024];
+	gssize num;
+
+	while (g_main_context_iteration(NULL, FALSE));
+	for (;;) {
+		num = recv(fd, buff, sizeof(buff), MSG_DONTWAIT);
+		if (num <= 0)
+			break;
+		g_string_append_len(data, buff, num);
+	}
+	g_assert(num == 0 || errno == EAGAIN || errno == EWOULDBLOCK);
+	return g_string_free(data, FALSE);
+}
+
+/** Run an admin command.
+ * @return The reply, free it with g_free
+ */
+static gchar *admin(const gchar * command)
+{
+	gchar *line = g_strconcat("admin ", command, NULL);
+
+	admin_run_command(admin_ses, line);
+	g_free(line);
+	net_flush(admin_ses);
+	return read_socket(admin_peer);
+}
+
+/** Run an admin command, and check its reply */
+static void admin_expect(const gchar * command, const gchar * reply)
+{
+	gchar *result = admin(command);
+
+	g_assert_cmpstr(result, ==, reply);
+	g_free(result);
+}
+
+/** Connect a player to a game.
+ * @return The socket of the player
+ */
+static gint connect_player(Game * game)
+{
+	gint fds[2];
+	gchar *error_message;
+
+	if (!net_socketpair(fds, &error_message))
+		g_error("%s", error_message);
+	g_assert(player_new_connection(game, fds[0], "test") != NULL);
+	g_free(read_socket(fds[1]));
+	return fds[1];
+}
+
+/** Has the server closed the socket of a player? */
+static gboolean is_closed(gint fd)
+{
+	gchar buff[1024];
+	gssize num;
+
+	while (g_main_context_iteration(NULL, FALSE));
+	while ((num = recv(fd, buff, sizeof(buff), MSG_DONTWAIT)) > 0);
+	return num == 0;
+}
+
+static void test_single_create(void)
+{
+	/* Only a multi-game server creates more games */
+	admin_expect("create-game",
+		     "ERROR the server hosts a single game\n");
+}
+
+static void test_single_save_load(void)
+{
+	Game *saved;
+	Game *loaded;
+	gint saved_id;
+	guint32 seed;
+	gint fd;
+	gchar *filename;
+	gchar *command;
+	gchar *reply;
+	GError *error = NULL;
+
+	fd = g_file_open_tmp("game_test-XXXXXX", &filename, &error);
+	if (fd < 0)
+		g_error("%s", error->message);
+	close(fd);
+
+	admin_expect("start-server", "");
+	command = g_strdup_printf("save-game %s", filename);
+	reply = admin(command);
+	g_free(command);
+	g_assert(g_str_has_prefix(reply, "INFO game saved "));
+	saved_id = atoi(reply + strlen("INFO game saved "));
+	saved = server_find_game(saved_id);
+	g_assert(saved != NULL);
+	seed = saved->seed;
+	g_free(reply);
+	fd = connect_player(saved);
+
+	/* The game stays when the record cannot be loaded */
+	admin_expect("load-game " TEST_GAME_DIR "/default.game",
+		     "ERROR game not loaded\n");
+	g_assert(server_game_exists(saved));
+	g_assert(server_is_running(saved));
+	g_assert(!is_closed(fd));
+
+	/* A record that is loaded replaces the game */
+	command = g_strdup_printf("load-game %s", filename);
+	reply = admin(command);
+	g_free(command);
+	g_assert(g_str_has_prefix(reply, "INFO game loaded "));
+	loaded = server_find_game(atoi(reply + strlen("INFO game loaded ")));
+	g_free(reply);
+	g_assert(loaded != NULL);
+	g_assert(!server_game_exists(saved));
+	g_assert(is_closed(fd));
+	g_assert(server_is_running(loaded));
+	g_assert_cmpuint(loaded->seed, ==, seed);
+
+	admin_expect("stop-server", "INFO server stopped\n");
+	g_assert(!server_game_exists(loaded));
+	close(fd);
+	unlink(filename);
+	g_free(filename);
+}
+
+static void test_multi_create_destroy(void)
+{
+	Game *first;
+	Game *second;
+	gint first_id;
+	gint second_id;
+	gint first_fd;
+	gint second_fd;
+	gchar *reply;
+	gchar *expect;
+
+	g_assert(server_listen_shared("0"));
+	g_assert(server_is_multi_game());
+
+	reply = admin("create-game");
+	g_assert(g_str_has_prefix(reply, "INFO game created "));
+	first_id = atoi(reply + strlen("INFO game created "));
+	first = server_find_game(first_id);
+	g_assert(first != NULL);
+	g_free(reply);
+
+	reply = admin("create-game");
+	g_assert(g_str_has_prefix(reply, "INFO game created "));
+	second_id = atoi(reply + strlen("INFO game created "));
+	second = server_find_game(second_id);
+	g_assert(second != NULL);
+	g_assert(second != first);
+	g_assert_cmpint(second_id, !=, first_id);
+	g_free(reply);
+
+	/* Both games run, and accept connections */
+	g_assert(server_is_running(first));
+	g_assert(server_is_running(second));
+	first_fd = connect_player(first);
+	second_fd = connect_player(second);
+	g_assert_cmpuint(g_list_length(first->player_list), ==, 1);
+	g_assert_cmpuint(g_list_length(second->player_list), ==, 1);
+
+	reply = admin("list-games");
+	expect = g_strdup_printf("INFO game %d players 0/", first_id);
+	g_assert(strstr(reply, expect) != NULL);
+	g_free(expect);
+	expect = g_strdup_printf("INFO game %d players 0/", second_id);
+	g_assert(strstr(reply, expect) != NULL);
+	g_free(expect);
+	g_free(reply);
+
+	/* The players of a destroyed game lose the connection, the other
+	 * game continues */
+	expect = g_strdup_printf("destroy-game %d", first_id);
+	reply = admin(expect);
+	g_free(expect);
+	expect = g_strdup_printf("INFO game destroyed %d\n", first_id);
+	g_assert_cmpstr(reply, ==, expect);
+	g_free(expect);
+	g_free(reply);
+	g_assert(!server_game_exists(first));
+	g_assert(is_closed(first_fd));
+	g_assert(server_game_exists(second));
+	g_assert(server_is_running(second));
+	g_assert(!is_closed(second_fd));
+
+	reply = admin("list-games");
+	expect = g_strdup_printf("INFO game %d ", second_id);
+	g_assert(g_str_has_prefix(reply, expect));
+	g_free(expect);
+	g_assert(strchr(reply, '\n') ==
+		 strstr(reply, "\nINFO games memory "));
+	g_free(reply);
+
+	admin_expect("destroy-game 9999",
+		     "ERROR game '9999' not found\n");
+
+	expect = g_strdup_printf("destroy-game %d", second_id);
+	g_free(admin(expect));
+	g_free(expect);
+	g_assert(!server_game_exists(second));
+	g_assert(is_closed(second_fd));
+	reply = admin("list-games");
+	g_assert(g_str_has_prefix(reply, "INFO games memory "));
+	g_free(reply);
+
+	close(first_fd);
+	close(second_fd);
+}
+
+int main(int argc, char *argv[])
+{
+	gint fds[2];
+	gchar *error_message;
+
+	g_test_init(&argc, &argv, NULL);
+	test_driver.log_write = test_log;
+	test_driver.input_add_read = evl_glib_input_add_read;
+	test_driver.input_add_write = evl_glib_input_add_write;
+	test_driver.input_remove = evl_glib_input_remove;
+	test_driver.player_added = test_player_event;
+	test_driver.player_renamed = test_player_event;
+	test_driver.player_removed = test_player_event;
+	test_driver.player_change = test_player_event;
+	driver = &test_driver;
+	server_init();
+
+	/* The games are found by their title in the directory of the
+	 * tests, and not announced */
+	g_setenv("PIONEERS_DIR", TEST_GAME_DIR, TRUE);
+	if (!net_socketpair(fds, &error_message))
+		g_error("%s", error_message);
+	admin_ses = net_new(admin_notify, NULL);
+	net_use_fd(admin_ses, fds[0], FALSE);
+	admin_peer = fds[1];
+	admin_expect("set-register-server 0", "");
+	admin_expect("set-game Default", "");
+	admin_expect("set-port 0", "");
+
+	g_test_add_func("/game/single/create", test_single_create);
+	g_test_add_func("/game/single/save-load", test_single_save_load);
+	g_test_add_func("/game/multi/create-destroy",
+			test_multi_create_destroy);
+	return g_test_run();
+}
@@ -60,7 +60,6 @@ void srv_player_change(G_GNUC_UNUSED void *data)
 	GList *current;
 	Game *game = (Game *) data;
 	g_print("Players connected:\n");
-	playerlist_inc_use_count(game);
 	for (current = game->player_list; current != NULL;
 	     current = g_list_next(current)) {
 		Player *p = (Player *) current->data;
@@ -68,6 +67,5 @@ void srv_player_change(G_GNUC_UNUSED void *data)
 			p->num, p->name, p->location,
 			p->disconnected ? "not" : "");
 	}
-	playerlist_dec_use_count(game);
 #endif
 }
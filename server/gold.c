@@ -62,18 +62,18 @@ gboolean gold_limited_bank(const Game * game, int limit,
 /* this function distributes resources until someone who receives gold is
  * found.  It is called again when that person chose his/her gold and
  * continues the distribution */
-static void distribute_next(GList * list)
+static void distribute_next(Player * player)
 {
-	Player *player = list->data;
 	Game *game = player->game;
+	Player *scan;
 	gint idx;
 	gboolean in_setup = FALSE;
 
 	/* give resources until someone should choose gold */
-	for (; list != NULL; list = next_player_loop(list, player)) {
+	for (scan = player; scan != NULL;
+	     scan = next_player_loop(scan, player)) {
 		gint resource[NO_RESOURCE], wanted[NO_RESOURCE];
 		gboolean send_message = FALSE;
-		Player *scan = list->data;
 
 		/* calculate what resources to give */
 		for (idx = 0; idx < NO_RESOURCE; ++idx) {
@@ -116,7 +116,7 @@ static void distribute_next(GList * list)
 				}
 				while ((scan->gold > 0) && (totalbank > 0)) {
 					/* choose one of them */
-					choice = get_rand(totalbank);
+					choice = get_rand(game, totalbank);
 					/* find out which resource it is */
 					for (idx = 0; idx < NO_RESOURCE;
 					     ++idx) {
@@ -155,17 +155,16 @@ static void distribute_next(GList * list)
 			 "done-resources\n");
 	/* pop everyone back to the state before we started giving out
 	 * resources */
-	for (list = player_first_real(game); list != NULL;
-	     list = player_next_real(list)) {
-		Player *p = list->data;
+	for (scan = player_first_real(game); scan != NULL;
+	     scan = player_next_real(scan)) {
 		/* viewers were not pushed, they should not be popped */
-		if (player_is_viewer(game, p->num))
+		if (player_is_viewer(game, scan->num))
 			continue;
-		sm_pop(p->sm);
+		sm_pop(scan->sm);
 		/* this is a hack to get the next setup player.  I'd like to
 		 * do it differently, but I don't know how. */
-		if (sm_current(p->sm) == (StateFunc) mode_setup) {
-			sm_goto(p->sm, (StateFunc) mode_idle);
+		if (sm_current(scan->sm) == (StateFunc) mode_setup) {
+			sm_goto(scan->sm, (StateFunc) mode_idle);
 			in_setup = TRUE;
 		}
 	}
@@ -179,7 +178,6 @@ gboolean mode_choose_gold(Player * player, gint event)
 	Game *game = player->game;
 	gint resources[NO_RESOURCE];
 	gint idx, num;
-	GList *list;
 
 	sm_state_name(sm, "mode_choose_gold");
 	if (event != SM_RECV)
@@ -215,22 +213,19 @@ gboolean mode_choose_gold(Player * player, gint event)
 			 "receive-gold %R\n", resources);
 	/* pop back to mode_idle */
 	sm_pop(sm);
-	list = next_player_loop(list_from_player(player), player);
-	distribute_next(list);
+	distribute_next(next_player_loop(player, player));
 	return TRUE;
 }
 
 /* this function is called by mode_turn to let resources and gold be
  * distributed */
-void distribute_first(GList * list)
+void distribute_first(Player * player)
 {
-	GList *looper;
-	Player *player = list->data;
+	Player *scan;
 	Game *game = player->game;
 	/* tell everybody who's receiving gold */
-	for (looper = list; looper != NULL;
-	     looper = next_player_loop(looper, player)) {
-		Player *scan = looper->data;
+	for (scan = player; scan != NULL;
+	     scan = next_player_loop(scan, player)) {
 		/* leave the viewers out of this */
 		if (player_is_viewer(game, scan->num))
 			continue;
@@ -249,5 +244,5 @@ void distribute_first(GList * list)
 			(StateFunc) mode_wait_for_gold_choosing_players);
 	}
 	/* start giving out resources */
-	distribute_next(list);
+	distribute_next(player);
 }
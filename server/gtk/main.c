@@ -430,7 +430,6 @@ static void gui_player_change(void *data)
 	guint number_of_players = 0;
 
 	gtk_list_store_clear(store);
-	playerlist_inc_use_count(game);
 	for (current = game->player_list; current != NULL;
 	     current = g_list_next(current)) {
 		GtkTreeIter iter;
@@ -450,7 +449,6 @@ static void gui_player_change(void *data)
 				   !p->disconnected,
 				   PLAYER_COLUMN_ISVIEWER, isViewer, -1);
 	}
-	playerlist_dec_use_count(game);
 	if (number_of_players == 0 && game->is_game_over) {
 		g_timeout_add(100, everybody_left, NULL);
 	}
@@ -32,9 +32,11 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <limits.h>
+#include <errno.h>
 #include <glib.h>
 
 #include "driver.h"
+#include "common_epoll.h"
 #include "game.h"
 #include "cards.h"
 #include "map.h"
@@ -71,6 +73,20 @@ static gchar *meta_server_name = NULL;
 static gboolean fixed_seating_order = FALSE;
 static gboolean enable_debug = FALSE;
 static gboolean show_version = FALSE;
+static gboolean no_reverse_lookup = FALSE;
+static gint cache_limit = 0;
+static gint read_limit = 0;
+static gboolean enable_profile = FALSE;
+static gboolean multi_game = FALSE;
+static gint num_threads = 0;
+static gchar *seed = NULL;
+static gchar *record_dir = NULL;
+static gchar *replay_file = NULL;
+static gchar *recover_file = NULL;
+static gint take_over_fd = -1;
+#ifdef HAVE_SYS_EPOLL_H
+static gboolean use_epoll = FALSE;
+#endif
 
 static GOptionEntry commandline_game_entries[] = {
 	{"game-title", 'g', 0, G_OPTION_ARG_STRING, &game_title,
@@ -103,6 +119,9 @@ static GOptionEntry commandline_game_entries[] = {
 	{"sbp-timer", 's', 0, G_OPTION_ARG_INT, &sbp_time_limit,
 	 /* Commandline option of server-console: sbp-timer */
 	 N_("Special Building Phase time limit in seconds (0 to disable SBP)"), 0},
+	{"seed", 0, 0, G_OPTION_ARG_STRING, &seed,
+	 /* Commandline server-console: seed */
+	 N_("Seed of the random choices of the first game"), "N"},
 	{"version", '\0', 0, G_OPTION_ARG_NONE, &show_version,
 	 /* Commandline option of server-console: version */
 	 N_("Show version information"), NULL},
@@ -142,21 +161,87 @@ static GOptionEntry commandline_other_entries[] = {
 	 N_(""
 	    "Don't start game immediately, wait for a command on admin port"),
 	 NULL},
+	{"multi-game", 0, 0, G_OPTION_ARG_NONE, &multi_game,
+	 /* Commandline server-console: multi-game */
+	 N_(""
+	    "Host several games on the port, more games are created with "
+	    "the admin port"),
+	 NULL},
+	{"threads", 0, 0, G_OPTION_ARG_INT, &num_threads,
+	 /* Commandline server-console: threads */
+	 N_("Run the games in N threads, needs --multi-game"), "N"},
 	{"fixed-seating-order", 0, 0, G_OPTION_ARG_NONE,
 	 &fixed_seating_order,
 	 /* Commandline server-console: fixed-seating-order */
 	 N_(""
 	    "Give players numbers according to the order they enter the game"),
 	 NULL},
+	{"no-reverse-lookup", 0, 0, G_OPTION_ARG_NONE, &no_reverse_lookup,
+	 /* Commandline server-console: no-reverse-lookup */
+	 N_("Don't look up the hostnames of connecting players"), NULL},
+	{"cache-limit", 0, 0, G_OPTION_ARG_INT, &cache_limit,
+	 /* Commandline server-console: cache-limit */
+	 N_(""
+	    "Maximum size in kB of the messages kept for a joining player"),
+	 "KB"},
+	{"read-limit", 0, 0, G_OPTION_ARG_INT, &read_limit,
+	 /* Commandline server-console: read-limit */
+	 N_("Maximum size in kB of a line from a player"), "KB"},
+#ifdef HAVE_SYS_EPOLL_H
+	{"epoll", 0, 0, G_OPTION_ARG_NONE, &use_epoll,
+	 /* Commandline server-console: epoll */
+	 N_("Use epoll to wait for network events"), NULL},
+#endif
+	{"record", 0, 0, G_OPTION_ARG_STRING, &record_dir,
+	 /* Commandline server-console: record */
+	 N_("Record the games in this directory"), "DIR"},
+	{"check-replay", 0, 0, G_OPTION_ARG_STRING, &replay_file,
+	 /* Commandline server-console: check-replay */
+	 N_(""
+	    "Replay a recorded game, and check that it makes the same "
+	    "random choices"), "FILE"},
+	{"recover", 0, 0, G_OPTION_ARG_STRING, &recover_file,
+	 /* Commandline server-console: recover */
+	 N_(""
+	    "Continue the recorded game of a server that stopped, instead "
+	    "of starting a new game"), "FILE"},
+	/* Started by hot-restart, with the socket to the old process */
+	{"take-over", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT,
+	 &take_over_fd, NULL, NULL},
+	{"profile", 0, 0, G_OPTION_ARG_NONE, &enable_profile,
+	 /* Commandline server-console: profile */
+	 N_("Profile the game states, and show the result when quitting"),
+	 NULL},
 	{"debug", '\0', 0, G_OPTION_ARG_NONE, &enable_debug,
 	 /* Commandline option of server: enable debug logging */
 	 N_("Enable debug messages"), NULL},
 	{NULL, '\0', 0, 0, NULL, NULL, NULL}
 };
 
+/* The computer players of the first game connect in its worker */
+static void start_computer_players(gpointer data)
+{
+	Game *game = data;
+	gint i;
+
+	num_ai_players = CLAMP(num_ai_players, 0, game->params->num_players);
+	for (i = 0; i < num_ai_players; ++i)
+		add_computer_player(game, TRUE);
+}
+
+/* The profile is written on every exit, the admin can quit with exit() */
+static void write_profile(void)
+{
+	gchar *report = sm_profile_report();
+
+	if (report != NULL) {
+		g_printerr("%s", report);
+		g_free(report);
+	}
+}
+
 int main(int argc, char *argv[])
 {
-	int i;
 	GOptionContext *context;
 	GOptionGroup *context_group;
 	GError *error = NULL;
@@ -180,6 +265,15 @@ int main(int argc, char *argv[])
 
 	server_init();
 
+	/* The games of a multi-game server can run in threads */
+	if (!g_thread_supported())
+		g_thread_init(NULL);
+
+#if !GLIB_CHECK_VERSION(2,36,0)
+	/* The asynchronous name lookup uses gio */
+	g_type_init();
+#endif
+
 	/* Long description in the commandline for server-console: help */
 	context = g_option_context_new(_("- Host a game of Pioneers"));
 	g_option_context_add_main_entries(context,
@@ -206,6 +300,7 @@ int main(int argc, char *argv[])
 	g_option_group_add_entries(context_group,
 				   commandline_other_entries);
 	g_option_context_add_group(context, context_group);
+	restart_set_command(argv);
 	g_option_context_parse(context, &argc, &argv, &error);
 	if (error != NULL) {
 		g_print("%s\n", error->message);
@@ -221,6 +316,44 @@ int main(int argc, char *argv[])
 	}
 
 	set_enable_debug(enable_debug);
+	server_set_reverse_lookup(!no_reverse_lookup);
+	if (cache_limit > 0)
+		server_set_cache_limit((gsize) cache_limit * 1024);
+	if (read_limit > 0)
+		server_set_read_limit((gsize) read_limit * 1024);
+	if (enable_profile) {
+		sm_profile_enable();
+		atexit(write_profile);
+	}
+	if (seed != NULL)
+		server_set_seed((guint32) strtoul(seed, NULL, 10));
+	record_set_dir(record_dir);
+
+	if (num_threads > 0 && !multi_game) {
+		/* server-console commandline error */
+		g_print(_("Threads can only be used with --multi-game\n"));
+		return 8;
+	}
+
+#ifdef HAVE_SYS_EPOLL_H
+	/* The epoll loop only runs in the main thread */
+	if (num_threads > 0 && use_epoll) {
+		/* server-console commandline error */
+		g_print(_("Cannot use threads and epoll at the same time\n"));
+		return 9;
+	}
+	if (use_epoll) {
+		if (!evl_epoll_init()) {
+			/* server-console commandline error */
+			g_print(_("Cannot use epoll: %s\n"),
+				g_strerror(errno));
+			return 6;
+		}
+		driver->input_add_read = evl_epoll_input_add_read;
+		driver->input_add_write = evl_epoll_input_add_write;
+		driver->input_remove = evl_epoll_input_remove;
+	}
+#endif
 
 	if (server_port == NULL)
 		server_port = g_strdup(PIONEERS_DEFAULT_GAME_PORT);
@@ -283,7 +416,11 @@ int main(int argc, char *argv[])
 
 	net_init();
 
-	if (admin_port != NULL) {
+	if (replay_file != NULL)
+		return record_check(replay_file) ? 0 : 11;
+
+	/* The process that takes over receives the listening sockets */
+	if (admin_port != NULL && take_over_fd < 0) {
 		if (!admin_listen(admin_port)) {
 			/* Error message */
 			g_print(_("Admin port not available.\n"));
@@ -300,22 +437,53 @@ int main(int argc, char *argv[])
 
 	}
 
-	if (!disable_game_start) {
+	if (multi_game && take_over_fd < 0
+	    && !server_listen_shared(server_port)) {
+		/* server-console commandline error */
+		g_print(_("Port not available.\n"));
+		return 7;
+	}
+	if (num_threads > 0 && !workers_start(num_threads))
+		return 10;
+
+	if (take_over_fd >= 0) {
+		GList *games;
+
+		if (!restart_take_over(take_over_fd, hostname, server_port,
+				       register_server, meta_server_name))
+			return 13;
+		games = server_running_games();
+		if (!multi_game && games != NULL) {
+			game = games->data;
+			game->no_player_timeout = timeout;
+			avahi_register_game(game);
+		}
+		g_list_free(games);
+	} else if (recover_file != NULL) {
+		game =
+		    server_recover(recover_file, hostname, server_port,
+				   register_server, meta_server_name);
+		if (game == NULL)
+			return 12;
+		game->no_player_timeout = timeout;
+		avahi_register_game(game);
+	} else if (!disable_game_start) {
 		game =
 		    server_start(params, hostname, server_port,
 				 register_server, meta_server_name,
 				 !fixed_seating_order);
 		if (game != NULL) {
 			game->no_player_timeout = timeout;
-			num_ai_players =
-			    CLAMP(num_ai_players, 0,
-				  game->params->num_players);
-			for (i = 0; i < num_ai_players; ++i)
-				add_computer_player(game, TRUE);
+			worker_call(game->worker, start_computer_players,
+				    game);
 			avahi_register_game(game);
 		}
 	}
-	if (disable_game_start || game != NULL) {
+	if (take_over_fd >= 0 || disable_game_start || game != NULL) {
+		/* The games of a multi-game server are freed when they
+		 * stop */
+		if (multi_game)
+			game = NULL;
 		event_loop = g_main_loop_new(NULL, FALSE);
 		g_main_loop_run(event_loop);
 		g_main_loop_unref(event_loop);
@@ -341,17 +509,39 @@ static gboolean exit_func(G_GNUC_UNUSED gpointer data)
 	return TRUE;
 }
 
+static gboolean free_game_func(gpointer data)
+{
+	if (server_game_exists(data))
+		game_free(data);
+	return FALSE;
+}
+
+static gboolean stop_game_func(gpointer data)
+{
+	if (server_game_exists(data))
+		request_server_stop(data);
+	return FALSE;
+}
+
 void game_is_over(Game * game)
 {
 	/* quit in ten seconds if configured */
 	if (game->params->quit_when_done) {
-		g_timeout_add(10 * 1000, &exit_func, NULL);
+		if (multi_game)
+			g_timeout_add(10 * 1000, stop_game_func, game);
+		else
+			g_timeout_add(10 * 1000, &exit_func, NULL);
 	}
 }
 
 void request_server_stop(Game * game)
 {
 	if (server_stop(game)) {
-		g_main_loop_quit(event_loop);
+		/* The other games continue, free this one when the
+		 * caller is done with it */
+		if (multi_game)
+			g_idle_add(free_game_func, game);
+		else
+			g_main_loop_quit(event_loop);
 	}
 }
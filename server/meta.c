@@ -24,16 +24,20 @@
 #include <stdlib.h>
 #include "server.h"
 
-static Session *ses;
-static enum {
+typedef enum {
 	MODE_SIGNON,
 	MODE_REDIRECT,
 	MODE_SERVER_LIST
-} meta_mode;
+} MetaMode;
 
-static gint meta_server_version_major;
-static gint meta_server_version_minor;
-static gint num_redirects;
+/* Each game registers on its own */
+struct MetaLink {
+	Session *ses;
+	MetaMode mode;
+	gint version_major;
+	gint version_minor;
+	gint num_redirects;
+};
 
 gchar *get_server_name(void)
 {
@@ -46,26 +50,30 @@ gchar *get_server_name(void)
 	return server_name;
 }
 
-void meta_start_game(void)
+void meta_start_game(Game * game)
 {
 #ifdef CLOSE_META_AT_START
-	if (ses != NULL) {
-		net_printf(ses, "begin\n");
-		net_free(&ses);
+	if (game->meta != NULL && game->meta->ses != NULL) {
+		net_printf(game->meta->ses, "begin\n");
+		net_free(&game->meta->ses);
 	}
 #endif
 }
 
-void meta_report_num_players(gint num_players)
+void meta_report_num_players(Game * game)
 {
-	if (ses != NULL)
-		net_printf(ses, "curr=%d\n", num_players);
+	if (game->meta != NULL && game->meta->ses != NULL)
+		net_printf(game->meta->ses, "curr=%d\n",
+			   game->num_players);
 }
 
 void meta_send_details(Game * game)
 {
-	if (ses == NULL)
+	Session *ses;
+
+	if (game->meta == NULL || game->meta->ses == NULL)
 		return;
+	ses = game->meta->ses;
 
 	net_printf(ses,
 		   "server\n"
@@ -79,7 +87,7 @@ void meta_send_details(Game * game)
 	if (game->hostname) {
 		net_printf(ses, "host=%s\n", game->hostname);
 	}
-	if (meta_server_version_major >= 1) {
+	if (game->meta->version_major >= 1) {
 		net_printf(ses,
 			   "vpoints=%d\n"
 			   "sevenrule=%s\n"
@@ -104,17 +112,19 @@ void meta_send_details(Game * game)
 
 static void meta_event(NetEvent event, Game * game, char *line)
 {
+	MetaLink *meta = game->meta;
+
 	switch (event) {
 	case NET_READ:
-		switch (meta_mode) {
+		switch (meta->mode) {
 		case MODE_SIGNON:
 		case MODE_REDIRECT:
 			if (strncmp(line, "goto ", 5) == 0) {
 				gchar **split_result;
 				const gchar *port;
-				meta_mode = MODE_REDIRECT;
-				net_free(&ses);
-				if (num_redirects++ == 10) {
+				meta->mode = MODE_REDIRECT;
+				net_free(&meta->ses);
+				if (meta->num_redirects++ == 10) {
 					log_message(MSG_INFO,
 						    _(""
 						      "Too many meta-server redirects\n"));
@@ -138,23 +148,21 @@ static void meta_event(NetEvent event, Game * game, char *line)
 				g_strfreev(split_result);
 			}
 
-			meta_server_version_major =
-			    meta_server_version_minor = 0;
+			meta->version_major = meta->version_minor = 0;
 			if (strncmp(line, "welcome ", 8) == 0) {
 				char *p = strstr(line, "version ");
 				if (p) {
 					p += 8;
-					meta_server_version_major =
-					    atoi(p);
+					meta->version_major = atoi(p);
 					p += strspn(p, "0123456789");
 					if (*p == '.')
-						meta_server_version_minor =
+						meta->version_minor =
 						    atoi(p + 1);
 				}
 			}
-			net_printf(ses, "version %s\n",
+			net_printf(meta->ses, "version %s\n",
 				   META_PROTOCOL_VERSION);
-			meta_mode = MODE_SERVER_LIST;
+			meta->mode = MODE_SERVER_LIST;
 			meta_send_details(game);
 			break;
 		default:
@@ -167,7 +175,7 @@ static void meta_event(NetEvent event, Game * game, char *line)
 		break;
 	case NET_CLOSE:
 		log_message(MSG_ERROR, _("Meta-server kicked us off\n"));
-		net_free(&ses);
+		net_free(&meta->ses);
 		break;
 	case NET_CONNECT:
 	case NET_CONNECT_FAIL:
@@ -177,7 +185,13 @@ static void meta_event(NetEvent event, Game * game, char *line)
 
 void meta_register(const gchar * server, const gchar * port, Game * game)
 {
-	if (num_redirects > 0)
+	MetaLink *meta;
+
+	if (game->meta == NULL)
+		game->meta = g_malloc0(sizeof(*game->meta));
+	meta = game->meta;
+
+	if (meta->num_redirects > 0)
 		log_message(MSG_INFO,
 			    _(""
 			      "Redirected to meta-server at %s, port %s\n"),
@@ -188,21 +202,27 @@ void meta_register(const gchar * server, const gchar * port, Game * game)
 			      "Register with meta-server at %s, port %s\n"),
 			    server, port);
 
-	if (ses != NULL)
-		net_free(&ses);
+	if (meta->ses != NULL)
+		net_free(&meta->ses);
 
-	ses = net_new((NetNotifyFunc) meta_event, game);
-	if (net_connect(ses, server, port))
-		meta_mode = MODE_SIGNON;
+	meta->ses = net_new((NetNotifyFunc) meta_event, game);
+	if (net_connect(meta->ses, server, port))
+		meta->mode = MODE_SIGNON;
 	else {
-		net_free(&ses);
+		net_free(&meta->ses);
 	}
 }
 
-void meta_unregister(void)
+void meta_unregister(Game * game)
 {
-	if (ses != NULL) {
+	MetaLink *meta = game->meta;
+
+	if (meta == NULL)
+		return;
+	if (meta->ses != NULL) {
 		log_message(MSG_INFO, _("Unregister from meta-server\n"));
-		net_free(&ses);
+		net_free(&meta->ses);
 	}
+	g_free(meta);
+	game->meta = NULL;
 }
@@ -37,6 +37,8 @@ static void player_setup(Player * player, int playernum,
 static Player *player_by_name(Game * game, char *name);
 
 #define tournament_minute 1000 * 60
+/* Size of the history of a player that can resume */
+#define resume_history_limit 64 * 1024
 #define time_to_wait_for_players 30 * 60 * 1000
 
 /** Is the game a tournament game?
@@ -58,31 +60,20 @@ static gint next_free_player_num(Game * game, gboolean force_viewer)
 	gint idx;
 
 	if (!force_viewer) {
-		GList *list;
-		gboolean player_taken[MAX_PLAYERS];
-		gint available = game->params->num_players;
-
-		memset(player_taken, 0, sizeof(player_taken));
-		playerlist_inc_use_count(game);
-		for (list = game->player_list;
-		     list != NULL; list = g_list_next(list)) {
-			Player *player = list->data;
-			if (player->num >= 0
-			    && !player_is_viewer(game, player->num)) {
-				player_taken[player->num] = TRUE;
-				--available;
-			}
-		}
-		playerlist_dec_use_count(game);
+		gint available = 0;
+
+		for (idx = 0; idx < game->params->num_players; ++idx)
+			if (game->seats[idx] == NULL)
+				++available;
 		if (available > 0) {
 			gint skip;
 			if (game->random_order) {
-				skip = get_rand(available);
+				skip = get_rand(game, available);
 			} else {
 				skip = 0;
 			}
 			idx = 0;
-			while (player_taken[idx] || skip-- != 0)
+			while (game->seats[idx] != NULL || skip-- != 0)
 				++idx;
 			return idx;
 		}
@@ -100,6 +91,7 @@ static gboolean mode_global(Player * player, gint event)
 	StateMachine *sm = player->sm;
 	Game *game = player->game;
 	gchar *text;
+	const gchar *slice;
 
 	switch (event) {
 	case SM_FREE:
@@ -109,13 +101,18 @@ static gboolean mode_global(Player * player, gint event)
 			g_free(player->style);
 		if (player->location != NULL)
 			g_free(player->location);
+		g_free(player->resume_token);
+		if (player->location_lookup != NULL) {
+			g_cancellable_cancel(player->location_lookup);
+			g_object_unref(player->location_lookup);
+		}
 		if (player->devel != NULL)
 			deck_free(player->devel);
 		if (player->num >= 0
 		    && !player_is_viewer(game, player->num)
 		    && !player->disconnected) {
 			game->num_players--;
-			meta_report_num_players(game->num_players);
+			meta_report_num_players(game);
 		}
 		g_list_free(player->build_list);
 		g_list_free(player->special_points);
@@ -133,8 +130,8 @@ static gboolean mode_global(Player * player, gint event)
 		driver->player_change(game);
 		return TRUE;
 	case SM_RECV:
-		if (sm_recv(sm, "chat %S", &text)) {
-			if (strlen(text) > MAX_CHAT)
+		if (sm_recv(sm, "chat %s", &slice)) {
+			if (strlen(slice) > MAX_CHAT)
 				player_send(player, FIRST_VERSION,
 					    LATEST_VERSION, "ERR %s\n",
 					    _("chat too long"));
@@ -142,8 +139,7 @@ static gboolean mode_global(Player * player, gint event)
 				player_broadcast(player, PB_ALL,
 						 FIRST_VERSION,
 						 LATEST_VERSION,
-						 "chat %s\n", text);
-			g_free(text);
+						 "chat %s\n", slice);
 			return TRUE;
 		}
 		if (sm_recv(sm, "name %S", &text)) {
@@ -179,18 +175,17 @@ static gboolean mode_global(Player * player, gint event)
 static gboolean mode_unhandled(Player * player, gint event)
 {
 	StateMachine *sm = player->sm;
-	gchar *text;
+	const gchar *slice;
 
 	switch (event) {
 	case SM_RECV:
-		if (sm_recv(sm, "extension %S", &text)) {
+		if (sm_recv(sm, "extension %s", &slice)) {
 			player_send(player, FIRST_VERSION, LATEST_VERSION,
 				    "NOTE %s\n",
 				    N_("ignoring unknown extension"));
 			log_message(MSG_INFO,
 				    "ignoring unknown extension from %s: %s\n",
-				    player->name, text);
-			g_free(text);
+				    player->name, slice);
 			return TRUE;
 		}
 		break;
@@ -200,18 +195,13 @@ static gboolean mode_unhandled(Player * player, gint event)
 	return FALSE;
 }
 
-/* Called to start the game (if it hasn't been yet). Add computer
- * players to fill any empty spots
- * 
- */
-static gboolean tournament_start_cb(gpointer data)
+gboolean tournament_start(Game * game)
 {
 	int i;
-	Game *game = (Game *) data;
 	GList *player;
 	gboolean human_player_present;
 
-	g_source_remove(game->tournament_timer);
+	worker_source_remove(game->tournament_timer);
 	game->tournament_timer = 0;
 
 	/* if game already started */
@@ -230,7 +220,6 @@ static gboolean tournament_start_cb(gpointer data)
 	}
 
 	/* remove all disconnected players */
-	playerlist_inc_use_count(game);
 	for (player = game->player_list; player != NULL;
 	     player = g_list_next(player)) {
 		Player *p = player->data;
@@ -238,21 +227,17 @@ static gboolean tournament_start_cb(gpointer data)
 			player_free(p);
 		}
 	}
-	playerlist_dec_use_count(game);
 
 	/* if no human players are present, quit */
-	playerlist_inc_use_count(game);
 	human_player_present = FALSE;
-	for (player = game->player_list;
-	     player != NULL && !human_player_present;
-	     player = g_list_next(player)) {
-		Player *p = player->data;
-		if (!player_is_viewer(game, p->num)
+	for (i = 0; i < game->params->num_players && !human_player_present;
+	     ++i) {
+		Player *p = game->seats[i];
+		if (p != NULL
 		    && determine_player_type(p->style) == PLAYER_HUMAN) {
 			human_player_present = TRUE;
 		}
 	}
-	playerlist_dec_use_count(game);
 	if (!human_player_present) {
 		player_broadcast(player_none(game), PB_SILENT,
 				 FIRST_VERSION, LATEST_VERSION,
@@ -265,6 +250,21 @@ static gboolean tournament_start_cb(gpointer data)
 	player_broadcast(player_none(game), PB_SILENT, FIRST_VERSION,
 			 LATEST_VERSION, "NOTE %s\n",
 			 N_("Game starts, adding computer players."));
+	return TRUE;
+}
+
+/* Called to start the game (if it hasn't been yet). Add computer
+ * players to fill any empty spots
+ * 
+ */
+static gboolean tournament_start_cb(gpointer data)
+{
+	int i;
+	Game *game = (Game *) data;
+
+	record_event(game, "tournament");
+	if (!tournament_start(game))
+		return FALSE;
 
 	/* add computer players to start game */
 	for (i = game->num_players; i < game->params->num_players; i++) {
@@ -297,7 +297,7 @@ static gboolean talk_about_tournament_cb(gpointer data)
 					  "tournament timer is reset."));
 			game->tournament_countdown =
 			    game->params->tournament_time;
-			g_source_remove(game->tournament_timer);
+			worker_source_remove(game->tournament_timer);
 			game->tournament_timer = 0;
 		}
 		return FALSE;
@@ -315,8 +315,8 @@ static gboolean talk_about_tournament_cb(gpointer data)
 	game->tournament_countdown--;
 
 	if (game->tournament_countdown > 0)
-		g_timeout_add(tournament_minute,
-			      &talk_about_tournament_cb, game);
+		worker_timeout_add(tournament_minute,
+				   &talk_about_tournament_cb, game);
 
 	return FALSE;
 }
@@ -408,6 +408,8 @@ Player *player_new(Game * game, const gchar * name)
 
 	sm_global_set(sm, (StateFunc) mode_global);
 	sm_unhandled_set(sm, (StateFunc) mode_unhandled);
+	sm_set_cache_limit(sm, server_get_cache_limit());
+	sm_set_read_limit(sm, server_get_read_limit());
 
 	player->game = game;
 	player->location = g_strdup("not connected");
@@ -432,22 +434,47 @@ Player *player_new(Game * game, const gchar * name)
 	return player;
 }
 
-Player *player_new_connection(Game * game, int fd, const gchar * location)
+/** Find a name for a connecting player, some functions need it.
+ * @return FALSE if there are too many pending connections
+ */
+static gboolean connecting_name(Game * game, gchar * name, gsize size)
 {
-	gchar name[100];
-	gint i;
-	Player *player;
-	StateMachine *sm;
+	gsize i;
 
-	/* give player a name, some functions need it */
 	strcpy(name, "connecting");
-	for (i = strlen(name); i < G_N_ELEMENTS(name) - 1; ++i) {
+	for (i = strlen(name); i < size - 1; ++i) {
 		if (player_by_name(game, name) == NULL)
-			break;
+			return TRUE;
 		name[i] = '_';
 		name[i + 1] = 0;
 	}
-	if (i == G_N_ELEMENTS(name) - 1) {
+	return FALSE;
+}
+
+/* Send the offers of mode_check_version before the version is asked, so
+ * the answers arrive while the player is still in that state.  Older
+ * clients ignore them.
+ */
+static void player_send_offers(Player * player)
+{
+	/* Tell which game is joined, the client can choose another one */
+	if (server_is_multi_game())
+		player_send_uncached(player, FIRST_VERSION, LATEST_VERSION,
+				     "extension game %d\n", player->game->id);
+	player_send_uncached(player, FIRST_VERSION, LATEST_VERSION,
+			     "extension batch %d\n", BATCH_VERSION);
+	player_send_uncached(player, FIRST_VERSION, LATEST_VERSION,
+			     "version report\n");
+}
+
+static Player *player_new_session(Game * game, int fd,
+				  const gchar * location)
+{
+	gchar name[100];
+	Player *player;
+	StateMachine *sm;
+
+	if (!connecting_name(game, name, sizeof(name))) {
 		/* there are too many pending connections */
 		write(fd, "ERR Too many connections\n", 25);
 		net_closesocket(fd);
@@ -491,6 +518,112 @@ Player *player_new_connection(Game * game, int fd, const gchar * location)
 	return player;
 }
 
+Player *player_new_connection(Game * game, int fd, const gchar * location)
+{
+	Player *player = player_new_session(game, fd, location);
+
+	if (player != NULL) {
+		record_connect(player);
+		player_send_offers(player);
+	}
+	return player;
+}
+
+Player *player_new_handoff(Game * game, int fd, const gchar * location,
+			   gint batch_version)
+{
+	Player *player = player_new_session(game, fd, location);
+
+	if (player != NULL) {
+		player->batch_version = batch_version;
+		record_connect(player);
+	}
+	return player;
+}
+
+/** A connection of a game that is replayed from its record.  It has
+ * no session, its input is injected.
+ */
+Player *player_new_replay(Game * game, gint batch_version)
+{
+	gchar name[100];
+	Player *player;
+
+	if (!connecting_name(game, name, sizeof(name)))
+		return NULL;
+
+	player = player_new(game, name);
+	sm_detach(player->sm);
+	g_free(player->location);
+	player->location = g_strdup("replay");
+	sm_set_use_cache(player->sm, TRUE);
+	sm_goto(player->sm, (StateFunc) mode_check_version);
+	player->batch_version = batch_version;
+	record_connect(player);
+	driver->player_change(game);
+	return player;
+}
+
+/** Move a connecting player to another game of the server.
+ * @param player The player, it has not joined its game yet
+ * @param game The new game
+ * @return FALSE if the player cannot join that game
+ */
+gboolean player_move_to_game(Player * player, Game * game)
+{
+	Game *old = player->game;
+	gchar name[100];
+
+	g_return_val_if_fail(player->num < 0, FALSE);
+	if (game == old)
+		return TRUE;
+	/* A game in another thread cannot be joined */
+	if (!server_is_running(game) || game->is_game_over
+	    || !worker_is_current(game->worker)
+	    || !connecting_name(game, name, sizeof(name)))
+		return FALSE;
+
+	record_leave(player);
+	old->player_list = g_list_remove(old->player_list, player);
+	driver->player_change(old);
+
+	g_free(player->name);
+	player->name = g_strdup(name);
+	deck_free(player->devel);
+	player->devel = deck_new(game->params);
+	player->game = game;
+	game->player_list = g_list_append(game->player_list, player);
+	record_connect(player);
+	stop_timeout(game);
+	driver->player_change(game);
+	return TRUE;
+}
+
+static void player_location_resolved(const gchar * hostname,
+				     gpointer data)
+{
+	Player *player = data;
+
+	g_object_unref(player->location_lookup);
+	player->location_lookup = NULL;
+
+	g_free(player->location);
+	player->location = g_strdup(hostname);
+	driver->player_change(player->game);
+}
+
+/** Look up the hostname of the player in the background.
+ *  Until it is known, the numeric address is used as location.
+ */
+void player_lookup_location(Player * player, gint fd)
+{
+	g_return_if_fail(player->location_lookup == NULL);
+
+	player->location_lookup = g_cancellable_new();
+	net_get_peer_name_async(fd, player->location_lookup,
+				player_location_resolved, player);
+}
+
 /* set the player name.  Most of the time, player_set_name is called instead,
  * which calls this function with public set to TRUE.  Only player_setup calls
  * this with public == FALSE, because it doesn't want the broadcast. */
@@ -526,6 +659,18 @@ static void player_set_name_real(Player * player, gchar * name,
 	driver->player_change(game);
 }
 
+/** Take the player out of its seat, or out of the viewers */
+static void player_unseat(Player * player)
+{
+	Game *game = player->game;
+
+	if (player->num >= 0 && !player_is_viewer(game, player->num)) {
+		if (game->seats[player->num] == player)
+			game->seats[player->num] = NULL;
+	} else
+		game->viewers = g_list_remove(game->viewers, player);
+}
+
 static void player_setup(Player * player, int playernum,
 			 const gchar * name, gboolean force_viewer)
 {
@@ -534,14 +679,20 @@ static void player_setup(Player * player, int playernum,
 	StateMachine *sm = player->sm;
 	Player *other;
 
+	player_unseat(player);
 	player->num = playernum;
 	if (player->num < 0) {
 		player->num = next_free_player_num(game, force_viewer);
 	}
+	/* A revived player takes the seat of the old one */
+	if (player_is_viewer(game, player->num))
+		game->viewers = g_list_append(game->viewers, player);
+	else
+		game->seats[player->num] = player;
 
 	if (!player_is_viewer(game, player->num)) {
 		game->num_players++;
-		meta_report_num_players(game->num_players);
+		meta_report_num_players(game);
 	}
 
 	player->num_roads = 0;
@@ -605,21 +756,85 @@ static void player_setup(Player * player, int playernum,
 		sm_goto(sm, (StateFunc) mode_pre_game);
 }
 
+/** Remove the dead players from player_list and free them. */
+void player_reap(Game * game)
+{
+	GList *list;
+
+	if (game->reap_tag != 0) {
+		worker_source_remove(game->reap_tag);
+		game->reap_tag = 0;
+	}
+	if (game->dead_players == NULL)
+		return;
+	for (list = game->dead_players; list != NULL;
+	     list = g_list_next(list)) {
+		Player *player = list->data;
+
+		game->player_list =
+		    g_list_remove(game->player_list, player);
+		sm_free(player->sm);
+	}
+	g_list_free(game->dead_players);
+	game->dead_players = NULL;
+	driver->player_change(game);
+}
+
+static gboolean player_reap_cb(gpointer data)
+{
+	Game *game = data;
+
+	game->reap_tag = 0;
+	player_reap(game);
+	return FALSE;
+}
+
+/** The player leaves its seat at once.  It stays in player_list until
+ * the game is idle, so the loops over player_list need not care whether
+ * the body frees a player.
+ */
 void player_free(Player * player)
 {
 	Game *game = player->game;
 
-	if (game->player_list_use_count > 0) {
-		game->dead_players =
-		    g_list_append(game->dead_players, player);
-		player->disconnected = TRUE;
+	if (g_list_find(game->dead_players, player) != NULL)
 		return;
-	}
+	player_unseat(player);
+	player->disconnected = TRUE;
+	game->dead_players = g_list_append(game->dead_players, player);
+	if (game->reap_tag == 0)
+		game->reap_tag =
+		    worker_timeout_add(0, player_reap_cb, game);
+}
 
-	game->player_list = g_list_remove(game->player_list, player);
-	driver->player_change(game);
+/** Give the player a token, with which the client can take over this
+ * player again when the connection is lost.  The client counts the
+ * lines that follow, so this must be sent before the cache is flushed.
+ */
+void player_enable_resume(Player * player)
+{
+	if (player_is_viewer(player->game, player->num))
+		return;
+
+	/* The token starts with the game, so the acceptor of the server
+	 * knows where the player is */
+	if (player->resume_token == NULL)
+		player->resume_token =
+		    g_strdup_printf("%d.%08x%08x", player->game->id,
+				    g_random_int(), g_random_int());
+	record_resume_token(player);
+	sm_set_history_limit(player->sm, resume_history_limit);
+	player_send_uncached(player, FIRST_VERSION, LATEST_VERSION,
+			     "extension resume %d %s\n",
+			     (gint) sm_history_seq(player->sm),
+			     player->resume_token);
+}
 
-	sm_free(player->sm);
+static void player_disable_resume(Player * player)
+{
+	g_free(player->resume_token);
+	player->resume_token = NULL;
+	sm_set_history_limit(player->sm, 0);
 }
 
 static gboolean timed_out(gpointer data)
@@ -650,6 +865,14 @@ void player_archive(Player * player)
 	/* If the player was in the middle of a trade, pop the state
 	   machine and inform others as necessary */
 	state = sm_current(player->sm);
+	if (state == (StateFunc) mode_domestic_quote
+	    || state == (StateFunc) mode_domestic_initiate
+	    || state == (StateFunc) mode_select_robbed
+	    || state == (StateFunc) mode_select_pirated)
+		/* The state changes behind the back of the client, it
+		 * cannot resume */
+		player_disable_resume(player);
+
 	if (state == (StateFunc) mode_domestic_quote_rejected) {
 		/* No special actions needed */
 	} else if (state == (StateFunc) mode_domestic_quote) {
@@ -680,27 +903,24 @@ void player_archive(Player * player)
 	/* Mark the player as disconnected */
 	player->disconnected = TRUE;
 	game->num_players--;
-	meta_report_num_players(game->num_players);
+	meta_report_num_players(game);
 
 	/* if no human players are present, start timer */
-	playerlist_inc_use_count(game);
 	gboolean human_player_present = FALSE;
-	GList *pl = game->player_list;
-	for (pl = game->player_list;
-	     pl != NULL && !human_player_present; pl = g_list_next(pl)) {
-		Player *p = pl->data;
-		if (!player_is_viewer(game, p->num)
-		    && !p->disconnected
+	gint idx;
+	for (idx = 0; idx < game->params->num_players
+	     && !human_player_present; ++idx) {
+		Player *p = game->seats[idx];
+		if (p != NULL && !p->disconnected
 		    && determine_player_type(p->style) == PLAYER_HUMAN) {
 			human_player_present = TRUE;
 		}
 	}
-	playerlist_dec_use_count(game);
 	if (!human_player_present && game->no_humans_timer == 0
 	    && is_tournament_game(game)) {
 		game->no_humans_timer =
-		    g_timeout_add(time_to_wait_for_players, timed_out,
-				  game);
+		    worker_timeout_add(time_to_wait_for_players,
+				       timed_out, game);
 		player_broadcast(player_none(game), PB_SILENT,
 				 FIRST_VERSION, LATEST_VERSION,
 				 "NOTE %s\n",
@@ -716,13 +936,13 @@ void player_archive(Player * player)
 void player_revive(Player * newp, char *name)
 {
 	Game *game = newp->game;
-	GList *current = NULL;
+	gint idx;
 	Player *p = NULL;
 	gboolean reviving_player_in_setup;
 	gchar *safe_name;
 
 	if (game->no_humans_timer != 0) {
-		g_source_remove(game->no_humans_timer);
+		worker_source_remove(game->no_humans_timer);
 		game->no_humans_timer = 0;
 		player_broadcast(player_none(game), PB_SILENT,
 				 FIRST_VERSION, LATEST_VERSION,
@@ -731,19 +951,18 @@ void player_revive(Player * newp, char *name)
 
 	/* first see if a player with the given name exists */
 	if (name) {
-		playerlist_inc_use_count(game);
-		for (current = game->player_list; current != NULL;
-		     current = g_list_next(current)) {
-			p = current->data;
-			if (!strcmp(name, p->name))
+		for (idx = 0; idx < game->params->num_players; ++idx) {
+			p = game->seats[idx];
+			if (p != NULL && !strcmp(name, p->name))
 				if (p->disconnected && !p->sm->use_cache
 				    && p != newp)
 					break;
 		}
-		playerlist_dec_use_count(game);
+		if (idx == game->params->num_players)
+			p = NULL;
 	}
 	/* if not, try to find an unused player number */
-	if (current == NULL) {
+	if (p == NULL) {
 		gint num;
 
 		num = next_free_player_num(game, FALSE);
@@ -753,26 +972,24 @@ void player_revive(Player * newp, char *name)
 		}
 	}
 	/* if not, try to take over another disconnected player */
-	if (current == NULL) {
-		playerlist_inc_use_count(game);
-		for (current = game->player_list; current != NULL;
-		     current = g_list_next(current)) {
-			p = current->data;
-			if (p->disconnected && !p->sm->use_cache
-			    && p != newp)
+	if (p == NULL) {
+		for (idx = 0; idx < game->params->num_players; ++idx) {
+			p = game->seats[idx];
+			if (p != NULL && p->disconnected
+			    && !p->sm->use_cache && p != newp)
 				break;
 		}
-		playerlist_dec_use_count(game);
+		if (idx == game->params->num_players)
+			p = NULL;
 	}
 	/* if still no player is found, do a normal setup */
-	if (current == NULL) {
+	if (p == NULL) {
 		player_setup(newp, -1, name, FALSE);
 		return;
 	}
 
 	/* Reviving the player that is currently in the setup phase */
-	reviving_player_in_setup =
-	    (game->setup_player && game->setup_player->data == p);
+	reviving_player_in_setup = game->setup_player == p;
 
 	/* remove the disconnected player from the player list, it's memory will be freed at the end of this routine */
 	game->player_list = g_list_remove(game->player_list, p);
@@ -837,16 +1054,8 @@ void player_revive(Player * newp, char *name)
 	if (game->largest_army == p)
 		game->largest_army = newp;
 
-	if (reviving_player_in_setup) {
-		/* Restore the pointer */
-		game->setup_player = game->player_list;
-		while (game->setup_player
-		       && game->setup_player->data != newp) {
-			game->setup_player =
-			    g_list_next(game->setup_player);
-		}
-		g_assert(game->setup_player != NULL);
-	}
+	if (reviving_player_in_setup)
+		game->setup_player = newp;
 	p->num = -1;		/* prevent the number of players
 				   from getting decremented */
 
@@ -863,6 +1072,88 @@ void player_revive(Player * newp, char *name)
 	return;
 }
 
+static Player *player_find_resumable(Game * game, const gchar * token)
+{
+	gint idx;
+
+	for (idx = 0; idx < game->params->num_players; ++idx) {
+		Player *p = game->seats[idx];
+
+		if (p != NULL && p->disconnected && !p->sm->use_cache
+		    && p->resume_token != NULL
+		    && !strcmp(p->resume_token, token))
+			return p;
+	}
+	return NULL;
+}
+
+/** Let a new connection take over a disconnected player, and send the
+ * lines it missed.
+ * @param newp The player of the new connection, it is freed on success
+ * @param token The resume token of the disconnected player
+ * @param seq The number of lines the client has received
+ * @return FALSE if the player cannot be resumed
+ */
+static gboolean player_resume(Player * newp, const gchar * token,
+			      gint seq)
+{
+	Game *game;
+	Player *p;
+	gchar *safe_name;
+
+	/* The client asks for its game after the resume, the token tells
+	 * which game it is */
+	game = newp->game;
+	if (server_is_multi_game())
+		game = server_find_game(atoi(token));
+	if (game == NULL || !worker_is_current(game->worker))
+		return FALSE;
+	p = player_find_resumable(game, token);
+	if (p == NULL || seq < 0 || !sm_history_covers(p->sm, seq))
+		return FALSE;
+
+	/* Move the connection to the old player, and send the lines it
+	 * missed.  The client counted the lines in the previous session,
+	 * so it expects the same encoding.  The answer is not part of
+	 * the history, it is sent before the move. */
+	player_send_uncached(newp, FIRST_VERSION, LATEST_VERSION,
+			     "extension resume ok\n");
+	sm_move_session(p->sm, newp->sm);
+	if (p->version >= V0_12_BINARY)
+		sm_set_binary(p->sm, TRUE);
+	sm_history_replay(p->sm, seq);
+
+	g_free(p->location);
+	p->location = newp->location;
+	newp->location = NULL;
+	player_free(newp);
+
+	if (game->no_humans_timer != 0) {
+		worker_source_remove(game->no_humans_timer);
+		game->no_humans_timer = 0;
+	}
+	p->disconnected = FALSE;
+	game->num_players++;
+	meta_report_num_players(game);
+	driver->player_added(p);
+	driver->player_change(game);
+
+	/* The other players saw this player quit */
+	player_broadcast(p, PB_OTHERS, FIRST_VERSION, LATEST_VERSION,
+			 "is %s\n", p->name);
+	if (p->style != NULL)
+		player_broadcast(p, PB_OTHERS, V0_11, LATEST_VERSION,
+				 "style %s\n", p->style);
+	safe_name = g_strdup(p->name);
+	g_strdelimit(safe_name, "|", '_');
+	player_broadcast(p, PB_SILENT, FIRST_VERSION, LATEST_VERSION,
+			 "NOTE1 %s|%s\n", safe_name,
+			 /* %s is the name of the reconnecting player */
+			 N_("%s has reconnected."));
+	g_free(safe_name);
+	return TRUE;
+}
+
 gboolean mode_viewer(Player * player, gint event)
 {
 	gint num;
@@ -937,6 +1228,8 @@ static const gchar *client_version_type_to_string(ClientVersionType cvt)
 		return "0.11";
 	case V0_12:
 		return "0.12";
+	case V0_12_BINARY:
+		return "0.12-binary";
 	}
 	g_return_val_if_reached("");
 }
@@ -960,18 +1253,52 @@ static gboolean mode_check_version(Player * player, gint event)
 {
 	StateMachine *sm = player->sm;
 	gchar *version;
+	gint batch_version;
+	gchar *token;
+	gint seq;
+	gint game_id;
 
 	sm_state_name(sm, "mode_check_version");
 	switch (event) {
-	case SM_ENTER:
-		player_send_uncached(player, FIRST_VERSION, LATEST_VERSION,
-				     "version report\n");
-		break;
-
 	case SM_RECV:
+		if (sm_recv(sm, "extension batch %d", &batch_version)) {
+			player->batch_version =
+			    CLAMP(batch_version, 0, BATCH_VERSION);
+			return TRUE;
+		}
+		if (sm_recv(sm, "extension game %d", &game_id)) {
+			Game *game = server_find_game(game_id);
+
+			if (game != NULL && player_move_to_game(player, game))
+				player_send_uncached(player, FIRST_VERSION,
+						     LATEST_VERSION,
+						     "extension game %d\n",
+						     game->id);
+			else
+				player_send_uncached(player, FIRST_VERSION,
+						     LATEST_VERSION,
+						     "NOTE %s\n",
+						     N_(""
+							"The game cannot be joined, "
+							"you join the default game."));
+			return TRUE;
+		}
+		/* A client that lost its connection, instead of the
+		 * version */
+		if (sm_recv(sm, "extension resume %d %S", &seq, &token)) {
+			if (!player_resume(player, token, seq))
+				player_send_uncached(player, FIRST_VERSION,
+						     LATEST_VERSION,
+						     "extension resume failed\n");
+			g_free(token);
+			return TRUE;
+		}
 		if (sm_recv(sm, "version %S", &version)) {
 			gboolean result = check_versions(version, player);
 			if (result) {
+				/* The client sends frames after this line */
+				if (player->version >= V0_12_BINARY)
+					sm_set_binary(sm, TRUE);
 				sm_goto(sm, (StateFunc) mode_check_status);
 			} else {
 				/* PROTOCOL_VERSION is the current version
@@ -1014,11 +1341,11 @@ static void start_tournament_mode(Player * player)
 			game->tournament_countdown =
 			    game->params->tournament_time;
 			game->tournament_timer =
-			    g_timeout_add(game->tournament_countdown *
-					  tournament_minute + 500,
-					  &tournament_start_cb, game);
-			g_timeout_add(1000, &talk_about_tournament_cb,
-				      game);
+			    worker_timeout_add(game->tournament_countdown *
+					       tournament_minute + 500,
+					       &tournament_start_cb, game);
+			worker_timeout_add(1000, &talk_about_tournament_cb,
+					   game);
 		} else {
 			if (game->tournament_timer != 0
 			    && game->num_players !=
@@ -1073,69 +1400,74 @@ static gboolean mode_check_status(Player * player, gint event)
 	return FALSE;
 }
 
-/* Returns a GList* to player 0 */
-GList *player_first_real(Game * game)
+/** Describe the network statistics of a player.
+ * @return The description, or NULL if the player has no connection
+ */
+gchar *player_network_stats(Player * player)
+{
+	const NetStats *stats = sm_get_net_stats(player->sm);
+
+	if (stats == NULL)
+		return NULL;
+	return net_stats_describe(stats);
+}
+
+/** Log the network statistics of all connected players. */
+void player_log_network_stats(Game * game)
 {
 	GList *list;
-	/* search for player 0 */
-	playerlist_inc_use_count(game);
+
 	for (list = game->player_list;
 	     list != NULL; list = g_list_next(list)) {
 		Player *player = list->data;
-		if (player->num == 0)
-			break;
+		gchar *stats = player_network_stats(player);
+
+		if (stats == NULL)
+			continue;
+		log_message(MSG_INFO,
+			    /* Server: the network statistics of a player */
+			    _("Network statistics of %s: %s\n"),
+			    player->name, stats);
+		g_free(stats);
 	}
-	playerlist_dec_use_count(game);
-	return list;
 }
 
-/* Returns a GList * to a player with a number one higher than last */
-GList *player_next_real(GList * last)
+/* Returns player 0 */
+Player *player_first_real(Game * game)
+{
+	return game->seats[0];
+}
+
+/* Returns the player with a number one higher than last */
+Player *player_next_real(Player * last)
 {
-	Player *player;
 	Game *game;
-	gint numplayers;
 	gint nextnum;
-	GList *list;
 
 	if (!last)
 		return NULL;
 
-	player = last->data;
-	game = player->game;
-	numplayers = game->params->num_players;
-	nextnum = player->num + 1;
-
-	if (nextnum >= numplayers)
+	game = last->game;
+	nextnum = last->num + 1;
+	if (nextnum >= game->params->num_players)
 		return NULL;
-
-	playerlist_inc_use_count(game);
-	for (list = game->player_list; list != NULL;
-	     list = g_list_next(list)) {
-		Player *scan = list->data;
-		if (scan->num == nextnum)
-			break;
-	}
-	playerlist_dec_use_count(game);
-	return list;
+	return game->seats[nextnum];
 }
 
+/* The connecting players have names too, so this searches them all */
 static Player *player_by_name(Game * game, char *name)
 {
 	GList *list;
 
-	playerlist_inc_use_count(game);
 	for (list = game->player_list;
 	     list != NULL; list = g_list_next(list)) {
 		Player *player = list->data;
 
 		if (player->name != NULL
 		    && strcmp(player->name, name) == 0) {
-			playerlist_dec_use_count(game);
 			return player;
 		}
 	}
-	playerlist_dec_use_count(game);
 
 	return NULL;
 }
@@ -1144,18 +1476,16 @@ Player *player_by_num(Game * game, gint num)
 {
 	GList *list;
 
-	playerlist_inc_use_count(game);
-	for (list = game->player_list;
-	     list != NULL; list = g_list_next(list)) {
+	if (num < 0)
+		return NULL;
+	if (!player_is_viewer(game, num))
+		return game->seats[num];
+	for (list = game->viewers; list != NULL; list = g_list_next(list)) {
 		Player *player = list->data;
 
-		if (player->num == num) {
-			playerlist_dec_use_count(game);
+		if (player->num == num)
 			return player;
-		}
 	}
-	playerlist_dec_use_count(game);
-
 	return NULL;
 }
 
@@ -1168,12 +1498,12 @@ gboolean player_is_viewer(Game * game, gint player_num)
  */
 Player *player_none(Game * game)
 {
-	static Player player;
+	Player *player = &game->none_player;
 
-	player.game = game;
-	player.num = -1;
-	player.disconnected = TRUE;
-	return &player;
+	player->game = game;
+	player->num = -1;
+	player->disconnected = TRUE;
+	return player;
 }
 
 /** Broadcast a message to all players and viewers - prepend "player %d " to
@@ -1197,43 +1527,71 @@ static void player_broadcast_internal(Player * player, BroadcastType type,
 {
 	Game *game = player->game;
 	GList *list;
+	NetBuffer *plain = NULL;
+	NetBuffer *prefixed = NULL;
 
-	playerlist_inc_use_count(game);
+	/* Each variant of the message is built once, and shared by the
+	 * sessions of all players that get it */
 	for (list = game->player_list; list != NULL;
 	     list = g_list_next(list)) {
 		Player *scan = list->data;
-		if ((scan->disconnected && !scan->sm->use_cache)
+		/* Disconnected players that can resume keep the
+		 * messages in their history */
+		if ((scan->disconnected && !scan->sm->use_cache
+		     && scan->resume_token == NULL)
 		    || scan->num < 0
 		    || scan->version < first_supported_version
 		    || scan->version > last_supported_version)
 			continue;
 		if (type == PB_SILENT
 		    || (scan == player && type == PB_RESPOND)) {
-			if (is_extension) {
-				player_send(scan, first_supported_version,
-					    last_supported_version,
-					    "extension %s", message);
-			} else {
-				player_send(scan, first_supported_version,
-					    last_supported_version, "%s",
-					    message);
-			}
+			if (plain == NULL)
+				plain =
+				    net_buffer_new(is_extension ?
+						   "extension " : NULL,
+						   message);
+			sm_write_buffer(scan->sm, plain);
 		} else if (scan != player || type == PB_ALL) {
-			if (is_extension) {
-				player_send(scan, first_supported_version,
-					    last_supported_version,
-					    "extension player %d %s",
-					    player->num, message);
-			} else {
-				player_send(scan, first_supported_version,
-					    last_supported_version,
-					    "player %d %s", player->num,
-					    message);
+			if (prefixed == NULL) {
+				gchar prefix[32];
+
+				g_snprintf(prefix, sizeof(prefix),
+					   "%splayer %d ",
+					   is_extension ? "extension " : "",
+					   player->num);
+				prefixed = net_buffer_new(prefix, message);
 			}
-
+			sm_write_buffer(scan->sm, prefixed);
 		}
 	}
-	playerlist_dec_use_count(game);
+
+	if (plain != NULL)
+		net_buffer_unref(plain);
+	if (prefixed != NULL)
+		net_buffer_unref(prefixed);
+}
+
+/* The buffer for broadcast messages is kept in the game, it is NULL while
+ * it is in use.  A broadcast that happens during a broadcast uses its own
+ * buffer.
+ */
+static GString *broadcast_buffer_take(Game * game)
+{
+	GString *buffer = game->broadcast_buffer;
+
+	if (buffer == NULL)
+		return g_string_sized_new(256);
+	game->broadcast_buffer = NULL;
+	g_string_truncate(buffer, 0);
+	return buffer;
+}
+
+static void broadcast_buffer_release(Game * game, GString * buffer)
+{
+	if (game->broadcast_buffer == NULL)
+		game->broadcast_buffer = buffer;
+	else
+		g_string_free(buffer, TRUE);
 }
 
 /** As player_broadcast, but will add the 'extension' keyword */
@@ -1242,17 +1600,66 @@ void player_broadcast_extension(Player * player, BroadcastType type,
 				ClientVersionType last_supported_version,
 				const char *fmt, ...)
 {
-	gchar *buff;
+	GString *buff = broadcast_buffer_take(player->game);
 	va_list ap;
 
 	va_start(ap, fmt);
-	buff = game_vprintf(fmt, ap);
+	game_vprintf_buffer(buff, fmt, ap);
 	va_end(ap);
 
-	player_broadcast_internal(player, type, buff, TRUE,
+	player_broadcast_internal(player, type, buff->str, TRUE,
 				  first_supported_version,
 				  last_supported_version);
-	g_free(buff);
+	broadcast_buffer_release(player->game, buff);
+}
+
+/* Send an envelope line to the players that understand batches */
+static void player_batch_write(Game * game, const gchar * message)
+{
+	GList *list;
+	NetBuffer *buffer = NULL;
+
+	for (list = game->player_list; list != NULL;
+	     list = g_list_next(list)) {
+		Player *scan = list->data;
+		if ((scan->disconnected && !scan->sm->use_cache
+		     && scan->resume_token == NULL)
+		    || scan->num < 0 || scan->batch_version == 0)
+			continue;
+		if (buffer == NULL)
+			buffer = net_buffer_new("extension ", message);
+		sm_write_buffer(scan->sm, buffer);
+	}
+
+	if (buffer != NULL)
+		net_buffer_unref(buffer);
+}
+
+/** Start a group of messages that the clients should handle as a whole.
+ * Batches can be nested, only the outermost one is sent.
+ */
+void player_batch_begin(Game * game)
+{
+	if (game->batch_depth++ == 0)
+		player_batch_write(game, "batch begin\n");
+}
+
+/** End a group of messages, and send everything that is queued */
+void player_batch_end(Game * game)
+{
+	GList *list;
+
+	g_return_if_fail(game->batch_depth > 0);
+	if (--game->batch_depth > 0)
+		return;
+
+	player_batch_write(game, "batch end\n");
+
+	for (list = game->player_list; list != NULL;
+	     list = g_list_next(list)) {
+		Player *scan = list->data;
+		sm_flush(scan->sm);
+	}
 }
 
 /** Broadcast a message to all players and viewers */
@@ -1261,17 +1668,17 @@ void player_broadcast(Player * player, BroadcastType type,
 		      ClientVersionType last_supported_version,
 		      const char *fmt, ...)
 {
-	gchar *buff;
+	GString *buff = broadcast_buffer_take(player->game);
 	va_list ap;
 
 	va_start(ap, fmt);
-	buff = game_vprintf(fmt, ap);
+	game_vprintf_buffer(buff, fmt, ap);
 	va_end(ap);
 
-	player_broadcast_internal(player, type, buff, FALSE,
+	player_broadcast_internal(player, type, buff->str, FALSE,
 				  first_supported_version,
 				  last_supported_version);
-	g_free(buff);
+	broadcast_buffer_release(player->game, buff);
 }
 
 /** Send a message to one player */
@@ -1280,7 +1687,6 @@ void player_send(Player * player,
 		 ClientVersionType last_supported_version, const char *fmt,
 		 ...)
 {
-	gchar *buff;
 	va_list ap;
 
 	if (player->version < first_supported_version
@@ -1288,11 +1694,8 @@ void player_send(Player * player,
 		return;
 
 	va_start(ap, fmt);
-	buff = game_vprintf(fmt, ap);
+	sm_vwrite(player->sm, fmt, ap);
 	va_end(ap);
-
-	sm_write(player->sm, buff);
-	g_free(buff);
 }
 
 /** Send a message to one player, even when caching is turned on */
@@ -1301,7 +1704,6 @@ void player_send_uncached(Player * player,
 			  ClientVersionType last_supported_version,
 			  const char *fmt, ...)
 {
-	gchar *buff;
 	va_list ap;
 
 	if (player->version < first_supported_version
@@ -1309,11 +1711,8 @@ void player_send_uncached(Player * player,
 		return;
 
 	va_start(ap, fmt);
-	buff = game_vprintf(fmt, ap);
+	sm_vwrite_uncached(player->sm, fmt, ap);
 	va_end(ap);
-
-	sm_write_uncached(player->sm, buff);
-	g_free(buff);
 }
 
 void player_set_name(Player * player, gchar * name)
@@ -1326,45 +1725,12 @@ void player_remove(Player * player)
 	driver->player_removed(player);
 }
 
-GList *list_from_player(Player * player)
-{
-	GList *list;
-	for (list = player_first_real(player->game); list != NULL;
-	     list = player_next_real(list))
-		if (list->data == player)
-			break;
-	g_assert(list != NULL);
-	return list;
-}
-
-GList *next_player_loop(GList * current, Player * first)
+Player *next_player_loop(Player * current, Player * first)
 {
 	current = player_next_real(current);
 	if (current == NULL)
 		current = player_first_real(first->game);
-	if (current->data == first)
+	if (current == first)
 		return NULL;
 	return current;
 }
-
-void playerlist_inc_use_count(Game * game)
-{
-	game->player_list_use_count++;
-}
-
-void playerlist_dec_use_count(Game * game)
-{
-	game->player_list_use_count--;
-	if (game->player_list_use_count == 0) {
-		GList *current;
-		GList *all_dead_players;
-		current = game->dead_players;
-		all_dead_players = game->dead_players;	/* Remember this for g_list_free */
-		game->dead_players = NULL;	/* Clear the list */
-		for (; current != NULL; current = g_list_next(current)) {
-			Player *p = current->data;
-			player_free(p);
-		}
-		g_list_free(all_dead_players);
-	}
-}
@@ -178,7 +178,7 @@ static void allocate_resources(Player * player, BuildRec * rec)
 		}
 	}
 	/* give out the gold */
-	distribute_first(list_from_player(player));
+	distribute_first(player);
 	return;
 }
 
@@ -232,20 +232,21 @@ static void try_setup_done(Player * player)
 /* find next player to do setup. */
 void next_setup_player(Game * game)
 {
+	record_sync(game);
 	if (game->reverse_setup) {
 		/* Going back for second setup phase
 		 */
-		GList *prev = NULL, *list;
-		for (list = player_first_real(game); list != NULL;
-		     list = player_next_real(list)) {
-			if (list == game->setup_player)
+		Player *prev = NULL, *scan;
+		for (scan = player_first_real(game); scan != NULL;
+		     scan = player_next_real(scan)) {
+			if (scan == game->setup_player)
 				break;
-			prev = list;
+			prev = scan;
 		}
 		game->setup_player = prev;
 		game->double_setup = FALSE;
 		if (game->setup_player != NULL) {
-			start_setup_player(game->setup_player->data);
+			start_setup_player(game->setup_player);
 		} else {
 			/* Start the game!!!
 			 */
@@ -254,9 +255,7 @@ void next_setup_player(Game * game)
 	} else {
 		/* First setup phase
 		 */
-		Player *player;
 		game->setup_player = player_next_real(game->setup_player);
-		player = game->setup_player->data;
 		/* Last player gets double setup
 		 */
 		game->double_setup
@@ -264,7 +263,7 @@ void next_setup_player(Game * game)
 		/* Prepare to go backwards next time
 		 */
 		game->reverse_setup = game->double_setup;
-		start_setup_player(game->setup_player->data);
+		start_setup_player(game->setup_player);
 	}
 }
 
@@ -299,16 +298,14 @@ gboolean mode_setup(Player * player, gint event)
 
 static void try_start_game(Game * game)
 {
-	GList *list;
+	Player *player;
 	int num;
 	int numturn;
 
 	num = 0;
 	numturn = 0;
-	for (list = player_first_real(game);
-	     list != NULL; list = player_next_real(list)) {
-		Player *player = list->data;
-
+	for (player = player_first_real(game);
+	     player != NULL; player = player_next_real(player)) {
 		if (sm_current(player->sm) == (StateFunc) mode_idle)
 			num++;
 
@@ -341,16 +338,14 @@ static void try_start_game(Game * game)
 	/* All players have connected, and are ready to begin
 	 */
 	if (game->tournament_timer != 0) {
-		g_source_remove(game->tournament_timer);
+		worker_source_remove(game->tournament_timer);
 		game->tournament_timer = 0;
 	}
-	meta_start_game();
+	meta_start_game(game);
 	game->setup_player = player_first_real(game);
-	while (((Player *) game->setup_player->data)->num < 0)
-		game->setup_player = game->setup_player->next;
 	game->double_setup = game->reverse_setup = FALSE;
 
-	start_setup_player(game->setup_player->data);
+	start_setup_player(game->setup_player);
 }
 
 /* Send the player list to the client
@@ -489,9 +484,9 @@ gboolean mode_pre_game(Player * player, gint event)
 	const gchar *prevstate;
 	gint i;
 	GList *next;
+	Player *p;
 	gint longestroadpnum = -1;
 	gint largestarmypnum = -1;
-	static gboolean recover_from_plenty = FALSE;
 	guint stack_offset;
 	gchar *player_style;
 
@@ -527,9 +522,17 @@ gboolean mode_pre_game(Player * player, gint event)
 			player_send_uncached(player, FIRST_VERSION, LATEST_VERSION,
 					 "extension special building phase time limit is %d\n", game->params->sbp_time);
 		}
+		/* Clients that answer this can receive the game and the
+		 * game info as compressed blocks */
+		player_send_uncached(player, FIRST_VERSION, LATEST_VERSION,
+				     "extension compress zlib\n");
 		break;
 
 	case SM_RECV:
+		if (sm_recv(sm, "extension compress zlib")) {
+			player->compress_join = TRUE;
+			return TRUE;
+		}
 		if (sm_recv(sm, "style %S", &player_style)) {
 			if (player->style)
 				g_free(player->style);
@@ -547,17 +550,23 @@ gboolean mode_pre_game(Player * player, gint event)
 			return TRUE;
 		}
 		if (sm_recv(sm, "game")) {
+			if (player->compress_join)
+				sm_deflate_begin(sm);
 			player_send_uncached(player, FIRST_VERSION,
 					     LATEST_VERSION, "game\n");
 			params_write_lines(game->params, FALSE,
 					   send_game_line, player);
 			player_send_uncached(player, FIRST_VERSION,
 					     LATEST_VERSION, "end\n");
+			if (player->compress_join)
+				sm_deflate_end(sm);
 			return TRUE;
 		}
 		if (sm_recv(sm, "gameinfo")) {
 			GList *list;
 
+			if (player->compress_join)
+				sm_deflate_begin(sm);
 			player_send_uncached(player, FIRST_VERSION,
 					     LATEST_VERSION, "gameinfo\n");
 			map_traverse_const(map, send_gameinfo_uncached,
@@ -642,7 +651,7 @@ gboolean mode_pre_game(Player * player, gint event)
 				prevstate = "MONOPOLY";
 			else if (state ==
 				 (StateFunc) mode_plenty_resources) {
-				recover_from_plenty = TRUE;
+				player->recover_from_plenty = TRUE;
 				prevstate = "PLENTY";
 			} else if (state == (StateFunc) mode_setup) {
 				if (game->double_setup)
@@ -738,9 +747,8 @@ gboolean mode_pre_game(Player * player, gint event)
 			}
 
 			/* Send info about other players */
-			for (next = player_first_real(game); next != NULL;
-			     next = player_next_real(next)) {
-				Player *p = (Player *) next->data;
+			for (p = player_first_real(game); p != NULL;
+			     p = player_next_real(p)) {
 				GList *list;
 				gint numassets = 0;
 				if (p->num == player->num)
@@ -796,6 +804,8 @@ gboolean mode_pre_game(Player * player, gint event)
 
 			player_send_uncached(player, FIRST_VERSION,
 					     LATEST_VERSION, "end\n");
+			if (player->compress_join)
+				sm_deflate_end(sm);
 			return TRUE;
 		}
 		if (sm_recv(sm, "start")) {
@@ -804,11 +814,8 @@ gboolean mode_pre_game(Player * player, gint event)
 
 			/* Some player was in the setup phase */
 			if (game->setup_player != NULL
-			    && (Player *) game->setup_player->data !=
-			    player) {
-				gint num =
-				    ((Player *) (game->setup_player->
-						 data))->num;
+			    && game->setup_player != player) {
+				gint num = game->setup_player->num;
 				if (game->double_setup)
 					player_send_uncached(player,
 							     FIRST_VERSION,
@@ -825,18 +832,17 @@ gboolean mode_pre_game(Player * player, gint event)
 							     reverse_setup);
 			}
 
-			if (recover_from_plenty) {
+			if (player->recover_from_plenty) {
 				player_send_uncached(player, FIRST_VERSION,
 						     LATEST_VERSION,
 						     "plenty %R\n",
 						     game->bank_deck);
-				recover_from_plenty = FALSE;
+				player->recover_from_plenty = FALSE;
 			}
 
 			/* send discard and gold info for all players */
-			for (next = player_first_real(game); next != NULL;
-			     next = player_next_real(next)) {
-				Player *p = (Player *) next->data;
+			for (p = player_first_real(game); p != NULL;
+			     p = player_next_real(p)) {
 				if (p->discard_num > 0) {
 					player_send_uncached(player,
 							     FIRST_VERSION,
@@ -911,6 +917,8 @@ gboolean mode_pre_game(Player * player, gint event)
 							     player->num);
 				}
 			}
+			/* The history starts with the cached lines */
+			player_enable_resume(player);
 			sm_set_use_cache(sm, FALSE);
 
 			if (player->disconnected) {
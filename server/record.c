@@ -0,0 +1,619 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* A record of a game holds the seed, the parameters, and the input of all
+ * connections in the order the game handled it.  The random numbers that
+ * the game draws are written between the input, so a replay of the input
+ * can check that it draws the same numbers at the same moments.
+ *
+ * The lines of a record:
+ *	seed <seed>
+ *	param <line of the parameters>
+ *	connect <connection> <batch version>
+ *	line <connection> <line that was received>
+ *	close <connection>
+ *	draw <range> <result>
+ *	random-order <1 if the order of the players is random>
+ *	event <event of a timer of the game>
+ *	token <connection> <token with which the player can resume>
+ *
+ * The record is the journal of the game: it is written as the game goes,
+ * and a game whose server stopped can be recovered from it.  A game that
+ * is not recorded in a directory keeps its record in memory, so it can
+ * still be saved.
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "server.h"
+
+struct GameRecord {
+	FILE *file;		/* the record, NULL if it is kept in text */
+	gchar *filename;	/* the name of file */
+	GString *text;		/* the record, if there is no file */
+	gboolean replay;	/* the game is a replay of a record */
+	gboolean paused;	/* the game is handed to another process */
+	gint next_connection;	/* the number of the next connection */
+	gsize replayed_len;	/* the part of the text that was replayed */
+};
+
+static gchar *record_dir = NULL;	/* where the games are recorded */
+static gboolean record_in_text = FALSE;	/* a replay is running */
+
+void record_set_dir(const gchar * dir)
+{
+	g_free(record_dir);
+	record_dir = g_strdup(dir);
+}
+
+static void record_printf(GameRecord * record, const gchar * fmt, ...)
+    G_GNUC_PRINTF(2, 3);
+
+static void record_printf(GameRecord * record, const gchar * fmt, ...)
+{
+	va_list ap;
+
+	if (record->paused)
+		return;
+	va_start(ap, fmt);
+	if (record->file != NULL)
+		vfprintf(record->file, fmt, ap);
+	else
+		g_string_append_vprintf(record->text, fmt, ap);
+	va_end(ap);
+}
+
+static void record_param(gpointer data, const gchar * line)
+{
+	record_printf(data, "param %s\n", line);
+}
+
+void record_start(Game * game)
+{
+	GameRecord *record;
+
+	g_return_if_fail(game->record == NULL);
+
+	record = g_malloc0(sizeof(*record));
+	record->replay = record_in_text;
+	if (!record_in_text && record_dir != NULL) {
+		gchar *name =
+		    g_strdup_printf("game-%d-%" G_GUINT32_FORMAT ".rec",
+				    game->id, game->seed);
+
+		record->filename = g_build_filename(record_dir, name, NULL);
+		record->file = fopen(record->filename, "w");
+		if (record->file == NULL)
+			log_message(MSG_ERROR,
+				    _("Cannot record the game in %s: %s\n"),
+				    record->filename, g_strerror(errno));
+		g_free(name);
+	}
+	if (record->file == NULL)
+		record->text = g_string_new(NULL);
+
+	game->record = record;
+	record_printf(record, "seed %" G_GUINT32_FORMAT "\n", game->seed);
+	params_write_lines(game->params, TRUE, record_param, record);
+}
+
+static void record_input(gpointer data, const gchar * line)
+{
+	Player *player = data;
+	GameRecord *record = player->game->record;
+
+	if (record == NULL)
+		return;
+	if (line != NULL)
+		record_printf(record, "line %d %s\n", player->connection,
+			      line);
+	else
+		record_printf(record, "close %d\n", player->connection);
+	/* A crash of the server loses at most the numbers drawn for the
+	 * last line, record_sync protects against a crash of the system */
+	if (record->file != NULL)
+		fflush(record->file);
+}
+
+void record_connect(Player * player)
+{
+	GameRecord *record = player->game->record;
+
+	if (record == NULL)
+		return;
+	player->connection = record->next_connection++;
+	record_printf(record, "connect %d %d\n", player->connection,
+		      player->batch_version);
+	sm_input_set(player->sm, record_input);
+}
+
+void record_leave(Player * player)
+{
+	GameRecord *record = player->game->record;
+
+	sm_input_set(player->sm, NULL);
+	if (record != NULL)
+		record_printf(record, "close %d\n", player->connection);
+}
+
+void record_draw(Game * game, gint range, gint result)
+{
+	if (game->record != NULL)
+		record_printf(game->record, "draw %d %d\n", range, result);
+}
+
+void record_random_order(Game * game)
+{
+	if (game->record != NULL)
+		record_printf(game->record, "random-order %d\n",
+			      game->random_order);
+}
+
+void record_event(Game * game, const gchar * event)
+{
+	if (game->record != NULL)
+		record_printf(game->record, "event %s\n", event);
+}
+
+void record_resume_token(Player * player)
+{
+	GameRecord *record = player->game->record;
+
+	/* A replay takes the token from the record */
+	if (record != NULL && !record->replay)
+		record_printf(record, "token %d %s\n", player->connection,
+			      player->resume_token);
+}
+
+void record_sync(Game * game)
+{
+	GameRecord *record = game->record;
+
+	if (record == NULL || record->file == NULL)
+		return;
+	if (fflush(record->file) != 0 || fsync(fileno(record->file)) != 0)
+		log_message(MSG_ERROR,
+			    _("Cannot write the record of the game: %s\n"),
+			    g_strerror(errno));
+}
+
+gchar *record_contents(Game * game, gsize * length,
+		       gchar ** error_message)
+{
+	GameRecord *record = game->record;
+	gchar *contents;
+	GError *error = NULL;
+
+	g_return_val_if_fail(record != NULL, NULL);
+
+	if (record->file == NULL) {
+		*length = record->text->len;
+		return g_strndup(record->text->str, record->text->len);
+	}
+	fflush(record->file);
+	if (!g_file_get_contents
+	    (record->filename, &contents, length, &error)) {
+		*error_message = g_strdup(error->message);
+		g_error_free(error);
+		return NULL;
+	}
+	return contents;
+}
+
+const gchar *record_filename(Game * game)
+{
+	return game->record != NULL ? game->record->filename : NULL;
+}
+
+gboolean record_save(Game * game, const gchar * filename,
+		     gchar ** error_message)
+{
+	gchar *contents;
+	gsize length;
+	GError *error = NULL;
+	gboolean saved;
+
+	contents = record_contents(game, &length, error_message);
+	if (contents == NULL)
+		return FALSE;
+	saved = g_file_set_contents(filename, contents, length, &error);
+	g_free(contents);
+	if (!saved) {
+		*error_message = g_strdup(error->message);
+		g_error_free(error);
+	}
+	return saved;
+}
+
+void record_pause(Game * game, gboolean pause)
+{
+	if (game->record == NULL)
+		return;
+	if (pause)
+		record_sync(game);
+	game->record->paused = pause;
+}
+
+void record_free(Game * game)
+{
+	GameRecord *record = game->record;
+
+	if (record == NULL)
+		return;
+	if (record->file != NULL)
+		fclose(record->file);
+	g_free(record->filename);
+	if (record->text != NULL)
+		g_string_free(record->text, TRUE);
+	g_free(record);
+	game->record = NULL;
+}
+
+Player *record_find_connection(Game * game, gint connection)
+{
+	GList *list;
+
+	for (list = game->player_list; list != NULL;
+	     list = g_list_next(list)) {
+		Player *player = list->data;
+
+		if (player->connection == connection)
+			return player;
+	}
+	return NULL;
+}
+
+/** The first line after the seed and the parameters */
+static guint record_first_event(gchar ** lines, guint len)
+{
+	guint idx;
+
+	for (idx = 1; idx < len; ++idx)
+		if (!g_str_has_prefix(lines[idx], "param "))
+			break;
+	return idx;
+}
+
+/** Split a record in lines, without the end of the last line */
+static gchar **record_split(const gchar * contents)
+{
+	gchar **lines = g_strsplit(contents, "\n", 0);
+	guint len = g_strv_length(lines);
+
+	if (len > 0 && lines[len - 1][0] == '\0') {
+		g_free(lines[len - 1]);
+		lines[len - 1] = NULL;
+	}
+	return lines;
+}
+
+/** Start the game that a record replays.
+ * @param lines The lines of the record
+ * @param name The name of the record, for the messages
+ * @retval first Is set to the first line after the seed and the
+ *               parameters
+ * @return The game, which records the replay in text, or NULL if the
+ *         lines are not a record
+ */
+static Game *replay_start(gchar ** lines, const gchar * name,
+			  guint * first)
+{
+	GameParams *params;
+	Game *game;
+	guint32 seed;
+	guint len = g_strv_length(lines);
+	guint idx;
+
+	/* The seed and the parameters come first */
+	params = params_new();
+	*first = record_first_event(lines, len);
+	for (idx = 1; idx < *first; ++idx)
+		if (!params_load_line(params, lines[idx] + 6))
+			break;
+	if (len == 0 || idx < *first
+	    || sscanf(lines[0], "seed %" G_GUINT32_FORMAT, &seed) != 1
+	    || !params_load_finish(params)) {
+		log_message(MSG_ERROR, _("%s is not a game record\n"), name);
+		params_free(params);
+		return NULL;
+	}
+
+	record_in_text = TRUE;
+	game = game_new(params, seed);
+	record_in_text = FALSE;
+	params_free(params);
+	/* The players are removed when the game stops */
+	game->is_running = TRUE;
+	return game;
+}
+
+/** Give the input of a line of the record to the game.
+ * The connections have no sessions, what the game sends is lost.
+ * @return FALSE if the input cannot be given
+ */
+static gboolean replay_line(Game * game, const gchar * line)
+{
+	gint connection;
+	gint batch_version;
+	gint value;
+	gint len;
+	Player *player;
+
+	if (sscanf(line, "connect %d %d", &connection, &batch_version) ==
+	    2) {
+		if (player_new_replay(game, batch_version) == NULL)
+			return FALSE;
+	} else if (sscanf(line, "line %d%n", &connection, &len) == 1
+		   && line[len] == ' ') {
+		player = record_find_connection(game, connection);
+		if (player == NULL)
+			return FALSE;
+		sm_inject(player->sm, line + len + 1);
+	} else if (sscanf(line, "close %d", &connection) == 1) {
+		player = record_find_connection(game, connection);
+		if (player == NULL || !player->sm->detached)
+			return FALSE;
+		sm_inject_close(player->sm);
+	} else if (sscanf(line, "random-order %d", &value) == 1) {
+		game->random_order = value;
+		record_random_order(game);
+	} else if (strcmp(line, "event tournament") == 0) {
+		tournament_start(game);
+	} else if (sscanf(line, "token %d%n", &connection, &len) == 1
+		   && line[len] == ' ') {
+		player = record_find_connection(game, connection);
+		if (player == NULL || player->resume_token == NULL)
+			return FALSE;
+		g_free(player->resume_token);
+		player->resume_token = g_strdup(line + len + 1);
+		record_printf(game->record, "%s\n", line);
+	} else if (!g_str_has_prefix(line, "draw "))
+		return FALSE;
+	/* The connections that were freed are gone before the next line,
+	 * so the names of new connections are the same */
+	player_reap(game);
+	return TRUE;
+}
+
+/** Replay the events of a record, and compare them with the record of
+ * the replay.
+ * @return TRUE if the replay is the same
+ */
+static gboolean replay_events(Game * game, gchar ** lines, guint first)
+{
+	gchar **replayed;
+	guint idx;
+	guint replayed_idx;
+	guint replayed_len;
+	gboolean same = TRUE;
+
+	for (idx = first; lines[idx] != NULL; ++idx) {
+		if (!replay_line(game, lines[idx])) {
+			log_message(MSG_ERROR,
+				    _("Line %d of the record cannot be "
+				      "replayed: %s\n"), idx + 1,
+				    lines[idx]);
+			same = FALSE;
+			break;
+		}
+	}
+
+	/* The replay records the input and the draws the same way */
+	replayed = g_strsplit(game->record->text->str, "\n", 0);
+	replayed_len = g_strv_length(replayed);
+	replayed_idx = record_first_event(replayed, replayed_len);
+	for (idx = first; same && lines[idx] != NULL;
+	     ++idx, ++replayed_idx) {
+		const gchar *replayed_line = replayed_idx < replayed_len ?
+		    replayed[replayed_idx] : "";
+
+		if (strcmp(lines[idx], replayed_line) != 0) {
+			log_message(MSG_ERROR,
+				    _("The replay differs at line %d: "
+				      "'%s' instead of '%s'\n"), idx + 1,
+				    replayed_line, lines[idx]);
+			same = FALSE;
+		}
+	}
+	g_strfreev(replayed);
+	return same;
+}
+
+/** Read a record from a file.
+ * @return The lines, or NULL if the file cannot be read
+ */
+static gchar **record_read(const gchar * filename)
+{
+	gchar *contents;
+	gchar **lines;
+	GError *error = NULL;
+
+	if (!g_file_get_contents(filename, &contents, NULL, &error)) {
+		log_message(MSG_ERROR, "%s\n", error->message);
+		g_error_free(error);
+		return NULL;
+	}
+	lines = record_split(contents);
+	g_free(contents);
+	return lines;
+}
+
+gboolean record_check(const gchar * filename)
+{
+	gchar **lines;
+	Game *game;
+	guint first;
+	gboolean same;
+
+	if ((lines = record_read(filename)) == NULL)
+		return FALSE;
+	if ((game = replay_start(lines, filename, &first)) == NULL) {
+		g_strfreev(lines);
+		return FALSE;
+	}
+
+	same = replay_events(game, lines, first);
+	if (same)
+		log_message(MSG_INFO,
+			    _("The replay of %s draws the same numbers\n"),
+			    filename);
+
+	game_free(game);
+	g_strfreev(lines);
+	return same;
+}
+
+/* The arguments of the parts of a replay that run in the worker of the
+ * game, so the timers that they start belong to the game */
+typedef struct {
+	Game *game;
+	gchar **lines;
+	guint first;
+	const gchar *journal;
+	RecordAttachFunc attach;
+	gpointer attach_data;
+	gboolean result;
+} Replay;
+
+static void replay_in_worker(gpointer data)
+{
+	Replay *replay = data;
+
+	replay->result =
+	    replay_events(replay->game, replay->lines, replay->first);
+}
+
+Game *record_replay(const gchar * contents, const gchar * name)
+{
+	Replay replay;
+
+	replay.lines = record_split(contents);
+	replay.game = replay_start(replay.lines, name, &replay.first);
+	if (replay.game != NULL) {
+		worker_call(replay.game->worker, replay_in_worker, &replay);
+		if (!replay.result) {
+			game_free(replay.game);
+			replay.game = NULL;
+		}
+	}
+	g_strfreev(replay.lines);
+	return replay.game;
+}
+
+/** Let a record that is kept in memory continue in its journal.
+ * The journal holds the lines of the replay already, the lines after
+ * them are appended.
+ */
+static void record_open_journal(GameRecord * record, const gchar * journal)
+{
+	FILE *file;
+
+	if ((file = fopen(journal, "a")) == NULL) {
+		log_message(MSG_ERROR,
+			    _("Cannot record the game in %s: %s\n"),
+			    journal, g_strerror(errno));
+		return;
+	}
+	fwrite(record->text->str + record->replayed_len, 1,
+	       record->text->len - record->replayed_len, file);
+	g_string_free(record->text, TRUE);
+	record->text = NULL;
+	record->file = file;
+	record->filename = g_strdup(journal);
+}
+
+static void continue_in_worker(gpointer data)
+{
+	Replay *replay = data;
+	Game *game = replay->game;
+	GameRecord *record = game->record;
+	GList *list;
+
+	/* The record continues in its file, or else in memory */
+	record->replayed_len = record->text->len;
+	if (replay->journal != NULL)
+		record_open_journal(record, replay->journal);
+	record->replay = FALSE;
+
+	if (replay->attach != NULL)
+		replay->attach(game, replay->attach_data);
+
+	/* The other peers are gone, their players wait for them to come
+	 * back */
+	for (list = game->player_list; list != NULL;
+	     list = g_list_next(list)) {
+		Player *player = list->data;
+
+		if (player->sm->detached)
+			sm_inject_close(player->sm);
+	}
+	player_reap(game);
+	record_sync(game);
+	game->is_running = FALSE;
+}
+
+void record_continue(Game * game, const gchar * journal,
+		     RecordAttachFunc attach, gpointer data)
+{
+	Replay replay;
+
+	replay.game = game;
+	replay.journal = journal;
+	replay.attach = attach;
+	replay.attach_data = data;
+	worker_call(game->worker, continue_in_worker, &replay);
+}
+
+void record_journal(Game * game, const gchar * journal)
+{
+	GameRecord *record = game->record;
+
+	g_return_if_fail(record != NULL && record->file == NULL);
+
+	record_open_journal(record, journal);
+	record_sync(game);
+}
+
+Game *record_recover(const gchar * filename)
+{
+	gchar *contents;
+	Game *game;
+	GError *error = NULL;
+
+	if (!g_file_get_contents(filename, &contents, NULL, &error)) {
+		log_message(MSG_ERROR, "%s\n", error->message);
+		g_error_free(error);
+		return NULL;
+	}
+	game = record_replay(contents, filename);
+	g_free(contents);
+	if (game == NULL) {
+		log_message(MSG_ERROR, _("The game of %s cannot be "
+					 "recovered\n"), filename);
+		return NULL;
+	}
+	record_continue(game, filename, NULL, NULL);
+	log_message(MSG_INFO, _("The game of %s is recovered\n"),
+		    filename);
+	return game;
+}
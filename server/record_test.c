@@ -0,0 +1,282 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* The tests of the records of games.  test-game.rec is the record of a
+ * whole game of four computer players on the default board, with seed 7.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include "driver.h"
+#include "common_glib.h"
+#include "server.h"
+
+#define TEST_RECORD TEST_GAME_DIR "/test-game.rec"
+
+/* The library calls these, the programs define them */
+void game_is_over(G_GNUC_UNUSED Game * game)
+{
+}
+
+void request_server_stop(G_GNUC_UNUSED Game * game)
+{
+}
+
+static UIDriver test_driver;
+
+/* The errors that were logged */
+static GString *errors;
+
+static void test_log(gint msg_type, const gchar * text)
+{
+	if (msg_type == MSG_ERROR)
+		g_string_append(errors, text);
+}
+
+static void test_player_event(G_GNUC_UNUSED void *data)
+{
+}
+
+/** Write a file for a test.
+ * @return The name, free it with g_free
+ */
+static gchar *write_temp_file(const gchar * contents)
+{
+	GError *error = NULL;
+	gchar *filename;
+	gint fd = g_file_open_tmp("record_test-XXXXXX", &filename, &error);
+
+	if (fd < 0)
+		g_error("%s", error->message);
+	close(fd);
+	if (!g_file_set_contents(filename, contents, -1, &error))
+		g_error("%s", error->message);
+	return filename;
+}
+
+/** The record of the test, with a line replaced.
+ * @return The record, free it with g_free
+ */
+static gchar *changed_record(guint number, const gchar * line)
+{
+	gchar *contents;
+	gchar **lines;
+	gchar *changed;
+	GError *error = NULL;
+
+	if (!g_file_get_contents(TEST_RECORD, &contents, NULL, &error))
+		g_error("%s", error->message);
+	lines = g_strsplit(contents, "\n", 0);
+	g_assert_cmpuint(number, <=, g_strv_length(lines));
+	g_free(lines[number - 1]);
+	lines[number - 1] = g_strdup(line);
+	changed = g_strjoinv("\n", lines);
+	g_strfreev(lines);
+	g_free(contents);
+	return changed;
+}
+
+static void test_check(void)
+{
+	g_string_truncate(errors, 0);
+	g_assert(record_check(TEST_RECORD));
+	g_assert_cmpstr(errors->str, ==, "");
+}
+
+static void test_check_draw(void)
+{
+	gchar *contents = changed_record(38, "draw 24 16");
+	gchar *filename = write_temp_file(contents);
+
+	/* The game draws 15, and the replay stops there */
+	g_string_truncate(errors, 0);
+	g_assert(!record_check(filename));
+	g_assert(strstr(errors->str,
+			"The replay differs at line 38: "
+			"'draw 24 15' instead of 'draw 24 16'\n") != NULL);
+
+	unlink(filename);
+	g_free(filename);
+	g_free(contents);
+}
+
+static void test_check_input(void)
+{
+	gchar *contents = changed_record(67, "line 7 version 0.12");
+	gchar *filename = write_temp_file(contents);
+
+	/* There is no connection 7 */
+	g_string_truncate(errors, 0);
+	g_assert(!record_check(filename));
+	g_assert(strstr(errors->str,
+			"Line 67 of the record cannot be replayed: "
+			"line 7 version 0.12\n") != NULL);
+
+	unlink(filename);
+	g_free(filename);
+	g_free(contents);
+}
+
+/** The state of a game and its players.
+ * @return The state, free it with g_free
+ */
+static gchar *game_state(Game * game)
+{
+	GString *state = g_string_new(NULL);
+	gint num;
+
+	g_string_append_printf(state, "turn %d %d %d\n", game->curr_player,
+			       game->rolled_dice, game->develop_next);
+	for (num = 0; num < game->params->num_players; ++num) {
+		Player *player = player_by_num(game, num);
+
+		g_assert(player != NULL);
+		g_string_append_printf(state,
+				       "%s %s %d %d %d %d,%d,%d,%d,%d %d "
+				       "%d %d\n", player->name,
+				       player->resume_token,
+				       player->num_roads,
+				       player->num_settlements,
+				       player->num_cities,
+				       player->assets[0], player->assets[1],
+				       player->assets[2], player->assets[3],
+				       player->assets[4],
+				       player->devel->num_cards,
+				       player->num_soldiers,
+				       player->develop_points);
+	}
+	return g_string_free(state, FALSE);
+}
+
+/** The first lines of the record of the test.
+ * @return The lines, free them with g_free
+ */
+static gchar *first_lines(guint number)
+{
+	gchar *contents;
+	gchar **lines;
+	gchar *first;
+	GError *error = NULL;
+
+	if (!g_file_get_contents(TEST_RECORD, &contents, NULL, &error))
+		g_error("%s", error->message);
+	lines = g_strsplit(contents, "\n", 0);
+	g_assert_cmpuint(number, <, g_strv_length(lines));
+	g_free(lines[number]);
+	lines[number] = g_strdup("");
+	for (++number; lines[number] != NULL; ++number) {
+		g_free(lines[number]);
+		lines[number] = NULL;
+	}
+	first = g_strjoinv("\n", lines);
+	g_strfreev(lines);
+	g_free(contents);
+	return first;
+}
+
+static void test_recover(void)
+{
+	/* The server stopped in the middle of the game, after a turn */
+	gchar *contents = first_lines(336);
+	gchar *filename = write_temp_file(contents);
+	gchar *recovered;
+	gchar *replay_state;
+	gchar *state;
+	Game *game;
+
+	/* The state at the end of the record, with the players still
+	 * connected */
+	g_string_truncate(errors, 0);
+	game = record_replay(contents, filename);
+	g_assert(game != NULL);
+	replay_state = game_state(game);
+	game_free(game);
+
+	/* The recovered game has the same state, its players wait to come
+	 * back */
+	game = record_recover(filename);
+	g_assert(game != NULL);
+	g_assert(!game->is_running);
+	state = game_state(game);
+	g_assert_cmpstr(state, ==, replay_state);
+	g_free(state);
+	game_free(game);
+
+	/* The record continues in the same file, and replays */
+	if (!g_file_get_contents(filename, &recovered, NULL, NULL))
+		g_assert_not_reached();
+	g_assert(g_str_has_prefix(recovered, contents));
+	g_assert(strstr(recovered + strlen(contents), "close ") != NULL);
+	g_assert(record_check(filename));
+
+	/* A second recovery rebuilds the same game, and adds nothing */
+	game = record_recover(filename);
+	g_assert(game != NULL);
+	state = game_state(game);
+	g_assert_cmpstr(state, ==, replay_state);
+	g_free(state);
+	game_free(game);
+	g_free(contents);
+	if (!g_file_get_contents(filename, &contents, NULL, NULL))
+		g_assert_not_reached();
+	g_assert_cmpstr(contents, ==, recovered);
+	g_assert_cmpstr(errors->str, ==, "");
+
+	unlink(filename);
+	g_free(filename);
+	g_free(recovered);
+	g_free(replay_state);
+	g_free(contents);
+}
+
+static void test_check_not_record(void)
+{
+	gchar *filename = write_temp_file("[game]\ntitle Default\n");
+
+	g_string_truncate(errors, 0);
+	g_assert(!record_check(filename));
+	g_assert(strstr(errors->str, "is not a game record\n") != NULL);
+
+	unlink(filename);
+	g_free(filename);
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+	errors = g_string_new(NULL);
+	test_driver.log_write = test_log;
+	test_driver.input_add_read = evl_glib_input_add_read;
+	test_driver.input_add_write = evl_glib_input_add_write;
+	test_driver.input_remove = evl_glib_input_remove;
+	test_driver.player_added = test_player_event;
+	test_driver.player_renamed = test_player_event;
+	test_driver.player_removed = test_player_event;
+	test_driver.player_change = test_player_event;
+	driver = &test_driver;
+	server_init();
+
+	g_test_add_func("/record/check", test_check);
+	g_test_add_func("/record/check/draw", test_check_draw);
+	g_test_add_func("/record/check/input", test_check_input);
+	g_test_add_func("/record/check/not-record", test_check_not_record);
+	g_test_add_func("/record/recover", test_recover);
+	return g_test_run();
+}
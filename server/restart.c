@@ -0,0 +1,520 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* A hot restart hands the games of the server to a new process, which
+ * runs the program as it is installed now.  The old process sends its
+ * listening sockets, and for each game its record and the sockets of its
+ * connections, over a socket pair.  The new process replays the records,
+ * and gives the connections of the replay their sockets.  The clients
+ * only notice a pause.
+ *
+ * The old process keeps everything until the new process answers, so
+ * the games stay where they are when the new process fails.
+ */
+
+#include "config.h"
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "admin.h"
+#include "server.h"
+
+/* The messages from the old process */
+enum {
+	RESTART_ADMIN,		/* the socket of the admin port */
+	RESTART_SHARED,		/* the socket of the shared port */
+	RESTART_JOURNAL,	/* the file of the record of the next game */
+	RESTART_CONNECTION,	/* a connection of the next game */
+	RESTART_GAME,		/* the record and the socket of a game */
+	RESTART_END
+};
+
+/* The state of the session of a connection */
+#define RESTART_BINARY 1
+#define RESTART_INFLATE 2
+
+typedef struct {
+	gint32 kind;
+	gint32 connection;	/* the connection in the record */
+	gint32 flags;		/* the state of the session */
+	guint32 length;		/* the length of the data that follows */
+} RestartHeader;
+
+typedef struct {
+	Player *player;		/* the player in the old process */
+	gint connection;
+	gint fd;
+	gint flags;
+	GString *unread;	/* the input that was not handled yet */
+} RestartConnection;
+
+typedef struct {
+	Game *game;
+	gchar *journal;		/* the file of the record, or NULL */
+	gchar *record;
+	gsize record_len;
+	gint accept_fd;
+	GList *connections;
+} RestartGame;
+
+static gchar **restart_argv;	/* the command line of this process */
+
+void restart_set_command(gchar ** argv)
+{
+	g_strfreev(restart_argv);
+	restart_argv = g_strdupv(argv);
+}
+
+static void restart_connection_free(RestartConnection * conn)
+{
+	g_string_free(conn->unread, TRUE);
+	g_free(conn);
+}
+
+static void restart_game_free(RestartGame * restart)
+{
+	g_list_foreach(restart->connections,
+		       (GFunc) restart_connection_free, NULL);
+	g_list_free(restart->connections);
+	g_free(restart->journal);
+	g_free(restart->record);
+	g_free(restart);
+}
+
+/** The command line of the new process, without the options that only
+ * the first start uses.
+ */
+static gchar **restart_command(gint sock)
+{
+	GPtrArray *argv = g_ptr_array_new();
+	gint idx;
+
+	for (idx = 0; restart_argv[idx] != NULL; ++idx) {
+		const gchar *arg = restart_argv[idx];
+
+		if (!strcmp(arg, "--take-over") || !strcmp(arg, "--recover")) {
+			if (restart_argv[idx + 1] != NULL)
+				++idx;
+			continue;
+		}
+		if (g_str_has_prefix(arg, "--take-over=")
+		    || g_str_has_prefix(arg, "--recover="))
+			continue;
+		g_ptr_array_add(argv, g_strdup(arg));
+	}
+	g_ptr_array_add(argv, g_strdup("--take-over"));
+	g_ptr_array_add(argv, g_strdup_printf("%d", sock));
+	g_ptr_array_add(argv, NULL);
+	return (gchar **) g_ptr_array_free(argv, FALSE);
+}
+
+/* The socket pair is the only socket that the new process inherits */
+static void restart_child_setup(gpointer data)
+{
+#ifdef HAVE_FCNTL
+	fcntl(GPOINTER_TO_INT(data), F_SETFD, 0);
+#endif
+}
+
+static gboolean restart_send(gint sock, gint kind, gint fd,
+			     gint connection, gint flags,
+			     const gchar * data, gsize len)
+{
+	RestartHeader header;
+
+	memset(&header, 0, sizeof(header));
+	header.kind = kind;
+	header.connection = connection;
+	header.flags = flags;
+	header.length = len;
+	if (!net_send_fd(sock, fd, (const gchar *) &header, sizeof(header)))
+		return FALSE;
+	return len == 0 || net_send_fd(sock, -1, data, len);
+}
+
+/** Receive a message of restart_send.
+ * @retval fd Is set to the socket that came with it, or -1
+ * @retval data Is set to the data, which is terminated (free it)
+ */
+static gboolean restart_recv(gint sock, RestartHeader * header,
+			     gint * fd, gchar ** data)
+{
+	gint unused;
+
+	if (!net_recv_fd(sock, fd, (gchar *) header, sizeof(*header)))
+		return FALSE;
+	*data = g_malloc(header->length + 1);
+	(*data)[header->length] = '\0';
+	if (header->length > 0
+	    && !net_recv_fd(sock, &unused, *data, header->length)) {
+		g_free(*data);
+		if (*fd >= 0)
+			close(*fd);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Take the sockets away from the connections of a game, and stop it
+ * from changing */
+static void restart_collect(gpointer data)
+{
+	RestartGame *restart = data;
+	Game *game = restart->game;
+	GList *list;
+	gchar *error_message;
+
+	server_accept_pause(game, TRUE);
+	for (list = game->player_list; list != NULL;
+	     list = g_list_next(list)) {
+		Player *player = list->data;
+		Session *ses = player->sm->ses;
+		RestartConnection *conn;
+
+		if (ses == NULL || !net_connected(ses))
+			continue;
+		conn = g_malloc0(sizeof(*conn));
+		conn->unread = g_string_new(NULL);
+		conn->flags = (ses->wire_binary ? RESTART_BINARY : 0)
+		    | (ses->inflate_enabled ? RESTART_INFLATE : 0);
+		conn->fd = net_hand_over(ses, conn->unread);
+		if (conn->fd < 0) {
+			/* It stays here, and is lost with this process */
+			restart_connection_free(conn);
+			continue;
+		}
+		conn->player = player;
+		conn->connection = player->connection;
+		restart->connections =
+		    g_list_prepend(restart->connections, conn);
+	}
+
+	record_pause(game, TRUE);
+	restart->journal = g_strdup(record_filename(game));
+	restart->record =
+	    record_contents(game, &restart->record_len, &error_message);
+	if (restart->record == NULL) {
+		log_message(MSG_ERROR, "%s\n", error_message);
+		g_free(error_message);
+	}
+	restart->accept_fd = game->accept_fd;
+}
+
+/* The new process failed, the game continues here */
+static void restart_take_back(gpointer data)
+{
+	RestartGame *restart = data;
+	Game *game = restart->game;
+	GList *list;
+
+	for (list = restart->connections; list != NULL;
+	     list = g_list_next(list)) {
+		RestartConnection *conn = list->data;
+		Session *ses = NULL;
+
+		if (g_list_find(game->player_list, conn->player) != NULL)
+			ses = conn->player->sm->ses;
+		if (ses != NULL && ses->fd < 0)
+			net_use_fd(ses, conn->fd, TRUE);
+		else
+			close(conn->fd);
+	}
+	record_pause(game, FALSE);
+	server_accept_pause(game, FALSE);
+}
+
+static gboolean restart_send_all(gint sock, GList * games)
+{
+	GList *list;
+
+	if (admin_accept_fd() >= 0
+	    && !restart_send(sock, RESTART_ADMIN, admin_accept_fd(), 0, 0,
+			     NULL, 0))
+		return FALSE;
+	if (server_shared_accept_fd() >= 0
+	    && !restart_send(sock, RESTART_SHARED,
+			     server_shared_accept_fd(), 0, 0, NULL, 0))
+		return FALSE;
+
+	for (list = games; list != NULL; list = g_list_next(list)) {
+		RestartGame *restart = list->data;
+		GList *conns;
+
+		if (restart->record == NULL)
+			return FALSE;
+		if (restart->journal != NULL
+		    && !restart_send(sock, RESTART_JOURNAL, -1, 0, 0,
+				     restart->journal,
+				     strlen(restart->journal)))
+			return FALSE;
+		for (conns = restart->connections; conns != NULL;
+		     conns = g_list_next(conns)) {
+			RestartConnection *conn = conns->data;
+
+			if (!restart_send(sock, RESTART_CONNECTION, conn->fd,
+					  conn->connection, conn->flags,
+					  conn->unread->str,
+					  conn->unread->len))
+				return FALSE;
+		}
+		if (!restart_send(sock, RESTART_GAME, restart->accept_fd, 0,
+				  0, restart->record, restart->record_len))
+			return FALSE;
+	}
+	return restart_send(sock, RESTART_END, -1, 0, 0, NULL, 0);
+}
+
+gboolean restart_hand_over(void)
+{
+	gint fds[2];
+	gchar *error_message;
+	gchar **argv;
+	GError *error = NULL;
+	GList *games;
+	GList *list;
+	GList *restarts = NULL;
+	gboolean done;
+	gchar answer;
+	gint unused;
+
+	if (restart_argv == NULL)
+		return FALSE;
+	if (!net_socketpair(fds, &error_message)) {
+		log_message(MSG_ERROR, "%s\n", error_message);
+		g_free(error_message);
+		return FALSE;
+	}
+	argv = restart_command(fds[1]);
+	done = g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH,
+			     restart_child_setup, GINT_TO_POINTER(fds[1]),
+			     NULL, &error);
+	g_strfreev(argv);
+	close(fds[1]);
+	if (!done) {
+		log_message(MSG_ERROR, "%s\n", error->message);
+		g_error_free(error);
+		close(fds[0]);
+		return FALSE;
+	}
+
+	log_message(MSG_INFO, _("Handing the games to a new process\n"));
+	games = server_running_games();
+	for (list = games; list != NULL; list = g_list_next(list)) {
+		RestartGame *restart = g_malloc0(sizeof(*restart));
+
+		restart->game = list->data;
+		worker_call(restart->game->worker, restart_collect, restart);
+		restarts = g_list_append(restarts, restart);
+	}
+	g_list_free(games);
+
+	/* The new process answers when it has replayed all games */
+	done = restart_send_all(fds[0], restarts)
+	    && net_recv_fd(fds[0], &unused, &answer, 1) && answer == 'y';
+	close(fds[0]);
+	if (done) {
+		log_message(MSG_INFO,
+			    _("The games run in the new process\n"));
+		/* The sockets and the records are not ours anymore */
+		exit(0);
+	}
+
+	log_message(MSG_ERROR, _("The games stay in this process\n"));
+	for (list = restarts; list != NULL; list = g_list_next(list)) {
+		RestartGame *restart = list->data;
+
+		worker_call(restart->game->worker, restart_take_back,
+			    restart);
+		restart_game_free(restart);
+	}
+	g_list_free(restarts);
+	return FALSE;
+}
+
+/* Give the connections of a replayed game their sockets */
+static void restart_attach(Game * game, gpointer data)
+{
+	RestartGame *restart = data;
+	GList *list;
+
+	for (list = restart->connections; list != NULL;
+	     list = g_list_next(list)) {
+		RestartConnection *conn = list->data;
+		Player *player = record_find_connection(game,
+							conn->connection);
+
+		if (player == NULL || !player->sm->detached) {
+			close(conn->fd);
+			conn->fd = -1;
+			continue;
+		}
+		/* The session owns the socket now */
+		sm_use_fd(player->sm, conn->fd, TRUE);
+		player_lookup_location(player, conn->fd);
+		conn->fd = -1;
+		if (conn->flags & RESTART_BINARY)
+			sm_set_binary(player->sm, TRUE);
+		if (conn->flags & RESTART_INFLATE)
+			sm_enable_inflate(player->sm);
+		net_unread(player->sm->ses, conn->unread->str,
+			   conn->unread->len);
+	}
+}
+
+/* The old process is gone, the record continues in its journal */
+static void restart_journal(gpointer data)
+{
+	RestartGame *restart = data;
+
+	record_journal(restart->game, restart->journal);
+}
+
+/* Close the sockets that were received for games that do not start,
+ * and stop the games */
+static void restart_discard(RestartGame * restart)
+{
+	GList *list;
+
+	for (list = restart->connections; list != NULL;
+	     list = g_list_next(list)) {
+		RestartConnection *conn = list->data;
+
+		if (conn->fd >= 0)
+			close(conn->fd);
+	}
+	if (restart->accept_fd >= 0)
+		close(restart->accept_fd);
+	if (restart->game != NULL)
+		game_free(restart->game);
+	restart_game_free(restart);
+}
+
+gboolean restart_take_over(gint sock, const gchar * hostname,
+			   const gchar * port, gboolean register_server,
+			   const gchar * meta_server_name)
+{
+	RestartHeader header;
+	RestartGame *next = g_malloc0(sizeof(*next));
+	GList *restarts = NULL;
+	GList *list;
+	gboolean ok = TRUE;
+	gboolean done = FALSE;
+	gchar answer;
+
+	while (ok && !done) {
+		gchar *data;
+		gint fd;
+
+		if (!restart_recv(sock, &header, &fd, &data)) {
+			ok = FALSE;
+			break;
+		}
+		switch (header.kind) {
+		case RESTART_ADMIN:
+			admin_listen_fd(fd);
+			break;
+		case RESTART_SHARED:
+			server_listen_shared_fd(port, fd);
+			break;
+		case RESTART_JOURNAL:
+			next->journal = g_strdup(data);
+			break;
+		case RESTART_CONNECTION:
+			{
+				RestartConnection *conn =
+				    g_malloc0(sizeof(*conn));
+
+				conn->connection = header.connection;
+				conn->flags = header.flags;
+				conn->fd = fd;
+				conn->unread =
+				    g_string_new_len(data, header.length);
+				next->connections =
+				    g_list_prepend(next->connections,
+						   conn);
+			}
+			break;
+		case RESTART_GAME:
+			next->accept_fd = fd;
+			next->game =
+			    record_replay(data, next->journal != NULL ?
+					  next->journal : "hot restart");
+			restarts = g_list_append(restarts, next);
+			ok = next->game != NULL;
+			next = g_malloc0(sizeof(*next));
+			break;
+		case RESTART_END:
+			done = TRUE;
+			break;
+		default:
+			if (fd >= 0)
+				close(fd);
+			ok = FALSE;
+			break;
+		}
+		g_free(data);
+	}
+	next->accept_fd = -1;
+	restart_discard(next);
+
+	/* The games get their sockets and run before the answer, so the
+	 * old process only stops when all of them do.  Their records stay
+	 * in memory until then, the journals still belong to the old
+	 * process */
+	for (list = restarts; ok && list != NULL; list = g_list_next(list)) {
+		RestartGame *restart = list->data;
+		Game *game = restart->game;
+
+		record_continue(game, NULL, restart_attach, restart);
+		game->accept_fd = restart->accept_fd;
+		restart->accept_fd = -1;
+		if (server_serve(game, hostname, port, register_server,
+				 meta_server_name) == NULL) {
+			/* The game is freed */
+			restart->game = NULL;
+			ok = FALSE;
+		}
+	}
+
+	/* The old process keeps the games if they cannot all run here */
+	answer = ok ? 'y' : 'n';
+	ok = net_send_fd(sock, -1, &answer, 1) && ok;
+	close(sock);
+	if (!ok) {
+		log_message(MSG_ERROR,
+			    _("The games cannot be taken over\n"));
+		g_list_foreach(restarts, (GFunc) restart_discard, NULL);
+		g_list_free(restarts);
+		return FALSE;
+	}
+
+	for (list = restarts; list != NULL; list = g_list_next(list)) {
+		RestartGame *restart = list->data;
+
+		if (restart->journal != NULL)
+			worker_call(restart->game->worker, restart_journal,
+				    restart);
+		restart_game_free(restart);
+	}
+	g_list_free(restarts);
+	log_message(MSG_INFO, _("The games are taken over\n"));
+	return TRUE;
+}
@@ -22,13 +22,11 @@
 #include "config.h"
 #include "server.h"
 
-static Hex *previous_robber_hex;
-
 static void move_pirate(Player * player, Hex * hex, gboolean is_undo)
 {
 	Map *map = hex->map;
 
-	previous_robber_hex = map->pirate_hex;
+	player->game->previous_robber_hex = map->pirate_hex;
 	map->pirate_hex = hex;
 	/* 0.10 didn't know about undo for movement, so move happens
 	 * only after stealing has been done.  */
@@ -45,7 +43,7 @@ static void move_robber(Player * player, Hex * hex, gboolean is_undo)
 {
 	Map *map = hex->map;
 
-	previous_robber_hex = map->robber_hex;
+	player->game->previous_robber_hex = map->robber_hex;
 	if (map->robber_hex)
 		map->robber_hex->robber = FALSE;
 	map->robber_hex = hex;
@@ -82,7 +80,7 @@ static void steal_card_from(Player * player, Player * victim)
 
 	/* Work out which card to steal from the victim
 	 */
-	steal = get_rand(num);
+	steal = get_rand(player->game, num);
 	for (idx = 0; idx < G_N_ELEMENTS(victim->assets); idx++) {
 		steal -= victim->assets[idx];
 		if (steal < 0)
@@ -460,10 +458,12 @@ void robber_place(Player * player)
 
 void robber_undo(Player * player)
 {
-	if (previous_robber_hex->terrain == SEA_TERRAIN)
-		move_pirate(player, previous_robber_hex, TRUE);
+	Hex *previous = player->game->previous_robber_hex;
+
+	if (previous->terrain == SEA_TERRAIN)
+		move_pirate(player, previous, TRUE);
 	else
-		move_robber(player, previous_robber_hex, TRUE);
+		move_robber(player, previous, TRUE);
 	sm_goto(player->sm, (StateFunc) mode_place_robber);
 	player_send(player, V0_11, LATEST_VERSION, "undo-robber\n");
 }
@@ -32,6 +32,22 @@
 static GameParams *load_game_desc(const gchar * fname);
 
 static GSList *_game_list = NULL;	/* The list of GameParams, ordered by title */
+static gboolean reverse_lookup = TRUE;	/* Look up the names of players */
+static gsize cache_limit = 512 * 1024;	/* Messages kept for reconnecting */
+static gsize read_limit = 0;	/* Longest line from a player, 0 for default */
+static GList *running_games = NULL;	/* The games that accept players */
+static GList *all_games = NULL;	/* The games that are allocated */
+static gint next_game_id = 1;	/* The id of the next game */
+static guint32 next_seed;	/* The seed of the next game */
+static gboolean use_next_seed = FALSE;	/* Is next_seed set? */
+/* Protects the lists of games and the ids, the workers use them too.
+ * The games are only created and freed by the main thread, so it can use
+ * the games in the lists after unlocking.
+ */
+static GStaticMutex games_mutex = G_STATIC_MUTEX_INIT;
+static gint shared_accept_fd = -1;	/* The port of all games, or -1 */
+static guint shared_accept_tag = 0;
+static gchar *shared_port = NULL;
 
 #define TERRAIN_DEFAULT	0
 #define TERRAIN_RANDOM	1
@@ -51,41 +67,55 @@ void start_timeout(Game * game)
 	if (!game->no_player_timeout)
 		return;
 	game->no_player_timer =
-	    g_timeout_add(game->no_player_timeout * 1000, timed_out, game);
+	    worker_timeout_add(game->no_player_timeout * 1000, timed_out,
+			       game);
 }
 
 void stop_timeout(Game * game)
 {
 	if (game->no_player_timer != 0) {
-		g_source_remove(game->no_player_timer);
+		worker_source_remove(game->no_player_timer);
 		game->no_player_timer = 0;
 	}
 }
 
-gint get_rand(gint range)
+gint get_rand(Game * game, gint range)
 {
-	return g_rand_int_range(g_rand_ctx, 0, range);
+	gint result = g_rand_int_range(game->rand, 0, range);
+
+	record_draw(game, range, result);
+	return result;
 }
 
-Game *game_new(const GameParams * params)
+Game *game_new(const GameParams * params, guint32 seed)
 {
 	Game *game;
 	gint idx;
 
 	game = g_malloc0(sizeof(*game));
 
+	g_static_mutex_lock(&games_mutex);
+	game->id = next_game_id++;
+	all_games = g_list_prepend(all_games, game);
+	g_static_mutex_unlock(&games_mutex);
+	game->worker = worker_next();
 	game->accept_tag = 0;
 	game->accept_fd = -1;
 	game->is_running = FALSE;
 	game->is_game_over = FALSE;
 	game->params = params_copy(params);
 	game->curr_player = -1;
+	game->seed = seed;
+	game->rand = g_rand_new_with_seed(seed);
+	/* The record starts before the first random choice */
+	record_start(game);
 
 	for (idx = 0; idx < G_N_ELEMENTS(game->bank_deck); idx++)
 		game->bank_deck[idx] = game->params->resource_count;
 	develop_shuffle(game);
 	if (params->random_terrain)
-		map_shuffle_terrain(game->params->map);
+		map_shuffle_terrain(game->params->map, game->rand);
+	turn_index_rolls(game);
 
 	return game;
 }
@@ -95,11 +125,27 @@ void game_free(Game * game)
 	if (game == NULL)
 		return;
 
+	/* The sockets and timers of the game belong to its worker */
+	if (!worker_is_current(game->worker)) {
+		worker_call(game->worker, (WorkerFunc) game_free, game);
+		return;
+	}
+
 	server_stop(game);
+	meta_unregister(game);
+	player_reap(game);
 
-	g_assert(game->player_list_use_count == 0);
+	g_static_mutex_lock(&games_mutex);
+	all_games = g_list_remove(all_games, game);
+	g_static_mutex_unlock(&games_mutex);
 	if (game->server_port != NULL)
 		g_free(game->server_port);
+	if (game->broadcast_buffer != NULL)
+		g_string_free(game->broadcast_buffer, TRUE);
+	record_free(game);
+	turn_free_rolls(game);
+	longest_road_free(game);
+	g_rand_free(game->rand);
 	params_free(game->params);
 	g_free(game);
 }
@@ -110,15 +156,21 @@ gint accept_connection(gint in_fd, gchar ** location)
 	gchar *error_message;
 	gchar *port;
 
+	g_assert(location != NULL);
+	*location = NULL;
+
 	fd = net_accept(in_fd, &error_message);
 	if (fd < 0) {
-		log_message(MSG_ERROR, "%s\n", error_message);
-		g_free(error_message);
+		/* No message when there are no more pending connections */
+		if (error_message != NULL) {
+			log_message(MSG_ERROR, "%s\n", error_message);
+			g_free(error_message);
+		}
 		return -1;
 	}
 
-	g_assert(location != NULL);
-	if (!net_get_peer_name(fd, location, &port, &error_message)) {
+	/* Don't block on DNS, the name is looked up later */
+	if (!net_get_peer_address(fd, location, &port, &error_message)) {
 		log_message(MSG_ERROR, "%s\n", error_message);
 		g_free(error_message);
 	}
@@ -126,28 +178,57 @@ gint accept_connection(gint in_fd, gchar ** location)
 	return fd;
 }
 
+/* Runs in the computer player process, just before it is started.
+ * Keep its end of the socket pair open.
+ */
+static void computer_player_setup(gpointer data)
+{
+	gint fd = GPOINTER_TO_INT(data);
+
+#ifdef HAVE_FCNTL
+	if (fd >= 0)
+		fcntl(fd, F_SETFD, 0);
+#endif
+}
+
 gint add_computer_player(Game * game, gboolean want_chat)
 {
-	gchar *child_argv[10];
+	gchar *child_argv[12];
 	GError *error = NULL;
 	gint ret = 0;
 	gint n = 0;
 	gint i;
+	gint fds[2] = { -1, -1 };
+	gchar *error_message;
 
 	child_argv[n++] = g_strdup(g_getenv("APP_AI"));
 	child_argv[n++] = g_strdup(g_getenv("APP_AI"));
-	child_argv[n++] = g_strdup("-s");
-	child_argv[n++] = g_strdup(PIONEERS_DEFAULT_GAME_HOST);
-	child_argv[n++] = g_strdup("-p");
-	child_argv[n++] = g_strdup(game->server_port);
+	/* Give the computer player a direct connection, instead of
+	 * letting it connect to the game port */
+	if (net_socketpair(fds, &error_message)) {
+		child_argv[n++] = g_strdup("--fd");
+		child_argv[n++] = g_strdup_printf("%d", fds[1]);
+	} else {
+		debug("%s", error_message);
+		g_free(error_message);
+		child_argv[n++] = g_strdup("-s");
+		child_argv[n++] = g_strdup(PIONEERS_DEFAULT_GAME_HOST);
+		child_argv[n++] = g_strdup("-p");
+		child_argv[n++] = g_strdup(game->server_port);
+		if (server_is_multi_game()) {
+			child_argv[n++] = g_strdup("--game-id");
+			child_argv[n++] = g_strdup_printf("%d", game->id);
+		}
+	}
 	child_argv[n++] = g_strdup("-n");
 	child_argv[n++] = player_new_computer_player(game);
 	if (!want_chat)
 		child_argv[n++] = g_strdup("-c");
 	child_argv[n] = NULL;
-	g_assert(n < 10);
+	g_assert(n < 12);
 
-	if (!g_spawn_async(NULL, child_argv, NULL, 0, NULL, NULL,
+	if (!g_spawn_async(NULL, child_argv, NULL, 0,
+			   computer_player_setup, GINT_TO_POINTER(fds[1]),
 			   NULL, &error)) {
 		log_message(MSG_ERROR,
 			    _("Error starting %s: %s"),
@@ -157,6 +238,17 @@ gint add_computer_player(Game * game, gboolean want_chat)
 	}
 	for (i = 0; child_argv[i] != NULL; i++)
 		g_free(child_argv[i]);
+
+	if (fds[1] >= 0) {
+		net_closesocket(fds[1]);
+		if (ret == 0) {
+			if (player_new_connection(game, fds[0],
+						  PIONEERS_DEFAULT_GAME_HOST)
+			    != NULL)
+				stop_timeout(game);
+		} else
+			net_closesocket(fds[0]);
+	}
 	return ret;
 }
 
@@ -164,34 +256,418 @@ gint add_computer_player(Game * game, gboolean want_chat)
 static void player_connect(Game * game)
 {
 	gchar *location;
-	gint fd = accept_connection(game->accept_fd, &location);
+	gint fd;
 
-	if (fd > 0) {
-		if (player_new_connection(game, fd, location) != NULL)
+	/* Accept all pending connections at once */
+	while ((fd = accept_connection(game->accept_fd, &location)) >= 0) {
+		Player *player = player_new_connection(game, fd, location);
+		if (player != NULL) {
 			stop_timeout(game);
+			if (reverse_lookup)
+				player_lookup_location(player, fd);
+		}
+		g_free(location);
 	}
-	g_free(location);
 }
 
-static gboolean game_server_start(Game * game, gboolean register_server,
-				  const gchar * meta_server_name)
+/** The game for a player that has not chosen one: the first game that
+ * has room, or else the first game.
+ * The acceptor of a server with worker threads reads the numbers of
+ * players of the other threads without a lock, a stale number only gives
+ * a worse choice.
+ */
+static Game *server_default_game(void)
+{
+	GList *list;
+	Game *found = NULL;
+
+	g_static_mutex_lock(&games_mutex);
+	for (list = running_games; list != NULL; list = g_list_next(list)) {
+		Game *game = list->data;
+
+		if (!game->is_game_over
+		    && game->num_players < game->params->num_players) {
+			found = game;
+			break;
+		}
+	}
+	if (found == NULL && running_games != NULL)
+		found = running_games->data;
+	g_static_mutex_unlock(&games_mutex);
+	return found;
+}
+
+/* A connection to the shared port of a server with worker threads.  The
+ * main thread asks which game the client joins, and then hands the
+ * socket to the worker of that game.
+ */
+typedef struct {
+	Session *ses;
+	gchar *location;
+	gint game_id;		/* the game that is joined */
+	gint batch_version;	/* the answer to the batch offer */
+} Handshake;
+
+/* The socket on its way to a worker */
+typedef struct {
+	gint fd;
+	gchar *location;
+	gint game_id;
+	gint batch_version;
+	gchar *line;		/* the last line of the handshake */
+} Handoff;
+
+/* Tell a client that there is no game for it, and close the socket */
+static void refuse_connection(gint fd)
+{
+	static const gchar refusal[] = "ERR No game is running\n";
+
+	if (write(fd, refusal, sizeof(refusal) - 1) !=
+	    (gssize) sizeof(refusal) - 1)
+		log_message(MSG_INFO,
+			    "Could not tell a client that no game is running\n");
+	net_closesocket(fd);
+}
+
+/* Runs in the worker of the game */
+static void shared_handoff(gpointer data)
+{
+	Handoff *handoff = data;
+	Game *game = server_find_game(handoff->game_id);
+	Player *player;
+
+	/* The game can have stopped in the meantime */
+	if (game == NULL || !worker_is_current(game->worker)) {
+		refuse_connection(handoff->fd);
+	} else {
+		player =
+		    player_new_handoff(game, handoff->fd,
+				       handoff->location,
+				       handoff->batch_version);
+		if (player != NULL) {
+			stop_timeout(game);
+			if (reverse_lookup)
+				player_lookup_location(player, handoff->fd);
+			/* This can free the player */
+			sm_inject(player->sm, handoff->line);
+		}
+	}
+	g_free(handoff->location);
+	g_free(handoff->line);
+	g_free(handoff);
+}
+
+static gboolean handshake_recv(const gchar * line, const gchar * fmt,
+			       ...)
+{
+	va_list ap;
+	gint offset;
+
+	va_start(ap, fmt);
+	offset = game_vscanf(line, fmt, ap);
+	va_end(ap);
+
+	return offset > 0 && line[offset] == '\0';
+}
+
+static void handshake_handoff(Handshake * handshake, const gchar * line)
+{
+	Game *game = server_find_game(handshake->game_id);
+	Handoff *handoff;
+
+	if (game == NULL)
+		game = server_default_game();
+	if (game == NULL) {
+		net_write(handshake->ses, "ERR No game is running\n");
+		net_close_when_flushed(handshake->ses);
+		return;
+	}
+
+	/* The client waits for the answer to this line, so nothing else
+	 * was sent yet.  The session is closed by the release. */
+	handoff = g_malloc0(sizeof(*handoff));
+	handoff->fd = net_release_fd(handshake->ses);
+	handoff->location = g_strdup(handshake->location);
+	handoff->game_id = game->id;
+	handoff->batch_version = handshake->batch_version;
+	handoff->line = g_strdup(line);
+	worker_post(game->worker, shared_handoff, handoff);
+}
+
+static void handshake_read(Handshake * handshake, const gchar * line)
+{
+	gint batch_version;
+	gint game_id;
+	gint seq;
+	const gchar *token;
+
+	if (handshake_recv(line, "extension batch %d", &batch_version)) {
+		handshake->batch_version =
+		    CLAMP(batch_version, 0, BATCH_VERSION);
+	} else if (handshake_recv(line, "extension game %d", &game_id)) {
+		if (server_find_game(game_id) != NULL) {
+			handshake->game_id = game_id;
+			net_printf(handshake->ses, "extension game %d\n",
+				   game_id);
+		} else
+			net_printf(handshake->ses, "NOTE %s\n",
+				   N_(""
+				      "The game cannot be joined, "
+				      "you join the default game."));
+	} else if (handshake_recv(line, "extension resume %d %s", &seq,
+				  &token)) {
+		/* The token starts with the id of the game */
+		handshake->game_id = atoi(token);
+		handshake_handoff(handshake, line);
+	} else if (g_str_has_prefix(line, "version ")) {
+		handshake_handoff(handshake, line);
+	}
+}
+
+static void handshake_event(NetEvent event, Handshake * handshake,
+			    gchar * line)
+{
+	switch (event) {
+	case NET_READ:
+		handshake_read(handshake, line);
+		break;
+	case NET_CLOSE:
+		net_free(&handshake->ses);
+		g_free(handshake->location);
+		g_free(handshake);
+		break;
+	default:
+		break;
+	}
+}
+
+static void handshake_new(Game * game, gint fd, const gchar * location)
+{
+	Handshake *handshake = g_malloc0(sizeof(*handshake));
+
+	handshake->ses = net_new((NetNotifyFunc) handshake_event, handshake);
+	handshake->location = g_strdup(location);
+	handshake->game_id = game->id;
+	net_use_fd(handshake->ses, fd, FALSE);
+
+	/* The same offers as mode_check_version */
+	net_printf(handshake->ses, "extension game %d\n", game->id);
+	net_printf(handshake->ses, "extension batch %d\n", BATCH_VERSION);
+	net_write(handshake->ses, "version report\n");
+}
+
+static void shared_connect(G_GNUC_UNUSED gpointer data)
+{
+	gchar *location;
+	gint fd;
+
+	while ((fd = accept_connection(shared_accept_fd, &location)) >= 0) {
+		Game *game = server_default_game();
+		Player *player;
+
+		if (game == NULL) {
+			refuse_connection(fd);
+			g_free(location);
+			continue;
+		}
+		if (workers_enabled()) {
+			handshake_new(game, fd, location);
+			g_free(location);
+			continue;
+		}
+		player = player_new_connection(game, fd, location);
+		if (player != NULL) {
+			stop_timeout(game);
+			if (reverse_lookup)
+				player_lookup_location(player, fd);
+		}
+		g_free(location);
+	}
+}
+
+gboolean server_listen_shared(const gchar * port)
 {
 	gchar *error_message;
+	gint fd;
+
+	g_return_val_if_fail(shared_accept_fd < 0, FALSE);
 
-	game->accept_fd =
-	    net_open_listening_socket(game->server_port, &error_message);
-	if (game->accept_fd == -1) {
+	fd = net_open_listening_socket(port, &error_message);
+	if (fd == -1) {
 		log_message(MSG_ERROR, "%s\n", error_message);
 		g_free(error_message);
 		return FALSE;
 	}
+	server_listen_shared_fd(port, fd);
+	return TRUE;
+}
+
+void server_listen_shared_fd(const gchar * port, gint fd)
+{
+	g_return_if_fail(shared_accept_fd < 0);
+
+	shared_accept_fd = fd;
+	shared_port = g_strdup(port);
+	shared_accept_tag =
+	    driver->input_add_read(shared_accept_fd,
+				   (InputFunc) shared_connect, NULL);
+}
+
+gint server_shared_accept_fd(void)
+{
+	return shared_accept_fd;
+}
+
+gboolean server_is_multi_game(void)
+{
+	return shared_accept_fd >= 0;
+}
+
+gboolean server_game_exists(const Game * game)
+{
+	gboolean exists;
+
+	g_static_mutex_lock(&games_mutex);
+	exists = game != NULL && g_list_find(all_games, game) != NULL;
+	g_static_mutex_unlock(&games_mutex);
+	return exists;
+}
+
+Game *server_find_game(gint id)
+{
+	GList *list;
+	Game *found = NULL;
+
+	g_static_mutex_lock(&games_mutex);
+	for (list = running_games; list != NULL; list = g_list_next(list)) {
+		Game *game = list->data;
+
+		if (game->id == id) {
+			found = game;
+			break;
+		}
+	}
+	g_static_mutex_unlock(&games_mutex);
+	return found;
+}
+
+static gboolean count_map_memory(const Hex * hex, gpointer closure)
+{
+	gsize *size = closure;
+	gint idx;
+
+	*size += sizeof(*hex);
+	/* The nodes and edges belong to the hex they are stored with */
+	for (idx = 0; idx < G_N_ELEMENTS(hex->nodes); ++idx) {
+		const Node *node = hex->nodes[idx];
+		const Edge *edge = hex->edges[idx];
+
+		if (node != NULL && node->x == hex->x && node->y == hex->y)
+			*size += sizeof(*node);
+		if (edge != NULL && edge->x == hex->x && edge->y == hex->y)
+			*size += sizeof(*edge);
+	}
+	return FALSE;
+}
+
+gsize server_game_memory(Game * game, gsize * fixed)
+{
+	gsize size;
+	GList *list;
+
+	size = sizeof(*game) + sizeof(*game->params) + sizeof(Map)
+	    + game->num_develop * sizeof(*game->develop_deck);
+	map_traverse_const(game->params->map, count_map_memory, &size);
+	if (fixed != NULL)
+		*fixed = size;
+
+	for (list = game->player_list; list != NULL;
+	     list = g_list_next(list)) {
+		Player *player = list->data;
+
+		size += sizeof(*player) + sizeof(*player->sm)
+		    + player->sm->cache_size + player->sm->history_size;
+	}
+	return size;
+}
+
+void server_set_reverse_lookup(gboolean enable)
+{
+	reverse_lookup = enable;
+}
+
+void server_set_seed(guint32 seed)
+{
+	next_seed = seed;
+	use_next_seed = TRUE;
+}
+
+void server_set_cache_limit(gsize limit)
+{
+	cache_limit = limit;
+}
+
+gsize server_get_cache_limit(void)
+{
+	return cache_limit;
+}
+
+void server_set_read_limit(gsize limit)
+{
+	read_limit = limit;
+}
+
+gsize server_get_read_limit(void)
+{
+	return read_limit;
+}
+
+void server_accept_pause(Game * game, gboolean pause)
+{
+	if (pause && game->accept_tag != 0) {
+		driver->input_remove(game->accept_tag);
+		game->accept_tag = 0;
+	}
+	if (!pause && game->accept_fd >= 0 && game->accept_tag == 0)
+		game->accept_tag =
+		    driver->input_add_read(game->accept_fd,
+					   (InputFunc) player_connect,
+					   game);
+}
+
+/* The arguments of game_server_start, which runs in the worker */
+typedef struct {
+	Game *game;
+	gboolean register_server;
+	const gchar *meta_server_name;
+	gboolean result;
+} GameServerStart;
+
+static gboolean game_server_start(Game * game, gboolean register_server,
+				  const gchar * meta_server_name)
+{
+	gchar *error_message;
+
+	/* The players of a multi-game server connect to the shared port,
+	 * the port of a game that is taken over is open already */
+	if (!server_is_multi_game() && game->accept_fd < 0) {
+		game->accept_fd =
+		    net_open_listening_socket(game->server_port,
+					      &error_message);
+		if (game->accept_fd == -1) {
+			log_message(MSG_ERROR, "%s\n", error_message);
+			g_free(error_message);
+			return FALSE;
+		}
+	}
 	game->is_running = TRUE;
+	g_static_mutex_lock(&games_mutex);
+	running_games = g_list_append(running_games, game);
+	g_static_mutex_unlock(&games_mutex);
 
 	start_timeout(game);
 
-	game->accept_tag = driver->input_add_read(game->accept_fd,
-						  (InputFunc)
-						  player_connect, game);
+	server_accept_pause(game, FALSE);
 
 	if (register_server) {
 		g_assert(meta_server_name != NULL);
@@ -201,6 +677,40 @@ static gboolean game_server_start(Game * game, gboolean register_server,
 	return TRUE;
 }
 
+static void game_server_start_in_worker(gpointer data)
+{
+	GameServerStart *start = data;
+
+	start->result =
+	    game_server_start(start->game, start->register_server,
+			      start->meta_server_name);
+}
+
+Game *server_serve(Game * game, const gchar * hostname,
+		   const gchar * port, gboolean register_server,
+		   const gchar * meta_server_name)
+{
+	GameServerStart start;
+
+	g_assert(game->server_port == NULL);
+	game->server_port =
+	    g_strdup(server_is_multi_game() ? shared_port : port);
+	g_assert(game->hostname == NULL);
+	if (hostname && strlen(hostname) > 0) {
+		game->hostname = g_strdup(hostname);
+	}
+
+	start.game = game;
+	start.register_server = register_server;
+	start.meta_server_name = meta_server_name;
+	worker_call(game->worker, game_server_start_in_worker, &start);
+	if (!start.result) {
+		game_free(game);
+		game = NULL;
+	}
+	return game;
+}
+
 /** Try to start a new server.
  * @param params The parameters of the game
  * @param hostname The hostname that will be visible in the meta server
@@ -215,7 +725,7 @@ Game *server_start(const GameParams * params, const gchar * hostname,
 		   const gchar * meta_server_name, gboolean random_order)
 {
 	Game *game;
-	guint32 randomseed = time(NULL);
+	guint32 seed;
 
 	g_return_val_if_fail(params != NULL, NULL);
 	g_return_val_if_fail(port != NULL, NULL);
@@ -230,40 +740,79 @@ Game *server_start(const GameParams * params, const gchar * hostname,
 	g_print("Quit when done: %d\n", params->quit_when_done);
 #endif
 
-	g_rand_ctx = g_rand_new_with_seed(randomseed);
-	log_message(MSG_INFO, "%s #%" G_GUINT32_FORMAT ".%s.%03d\n",
+	/* The seed is logged, so the game can be played again */
+	seed = use_next_seed ? next_seed : g_random_int();
+	use_next_seed = FALSE;
+	log_message(MSG_INFO, "%s #%" G_GUINT32_FORMAT "\n",
 		    /* Server: preparing game #..... */
-		    _("Preparing game"), randomseed, "G", get_rand(1000));
+		    _("Preparing game"), seed);
 
-	game = game_new(params);
-	g_assert(game->server_port == NULL);
-	game->server_port = g_strdup(port);
-	g_assert(game->hostname == NULL);
-	if (hostname && strlen(hostname) > 0) {
-		game->hostname = g_strdup(hostname);
-	}
+	game = game_new(params, seed);
 	game->random_order = random_order;
-	if (!game_server_start(game, register_server, meta_server_name)) {
-		game_free(game);
-		game = NULL;
-	}
-	return game;
+	record_random_order(game);
+	return server_serve(game, hostname, port, register_server,
+			    meta_server_name);
+}
+
+/** Start a server for a game that is rebuilt from its record.
+ * The parameters are those of server_start.
+ * @param filename The record of the game
+ * @return A pointer to the game, or NULL
+ */
+Game *server_recover(const gchar * filename, const gchar * hostname,
+		     const gchar * port, gboolean register_server,
+		     const gchar * meta_server_name)
+{
+	Game *game;
+
+	g_return_val_if_fail(port != NULL, NULL);
+
+	game = record_recover(filename);
+	if (game == NULL)
+		return NULL;
+	return server_serve(game, hostname, port, register_server,
+			    meta_server_name);
 }
 
 /** Stop the server.
  * @param game A game
  * @return TRUE if the game changed from running to stopped
 */
+/* The argument of server_stop, when it is called by another thread */
+typedef struct {
+	Game *game;
+	gboolean result;
+} ServerStop;
+
+static void server_stop_in_worker(gpointer data)
+{
+	ServerStop *stop = data;
+
+	stop->result = server_stop(stop->game);
+}
+
 gboolean server_stop(Game * game)
 {
 	GList *current;
 
+	/* The sockets of the players belong to the worker of the game */
+	if (game != NULL && !worker_is_current(game->worker)) {
+		ServerStop stop;
+
+		stop.game = game;
+		worker_call(game->worker, server_stop_in_worker, &stop);
+		return stop.result;
+	}
+
 	if (!server_is_running(game))
 		return FALSE;
 
-	meta_unregister();
+	meta_unregister(game);
 
 	game->is_running = FALSE;
+	g_static_mutex_lock(&games_mutex);
+	running_games = g_list_remove(running_games, game);
+	g_static_mutex_unlock(&games_mutex);
 	if (game->accept_tag) {
 		driver->input_remove(game->accept_tag);
 		game->accept_tag = 0;
@@ -273,7 +822,6 @@ gboolean server_stop(Game * game)
 		game->accept_fd = -1;
 	}
 
-	playerlist_inc_use_count(game);
 	current = game->player_list;
 	while (current != NULL) {
 		Player *player = current->data;
@@ -281,7 +829,6 @@ gboolean server_stop(Game * game)
 		player_free(player);
 		current = g_list_next(current);
 	}
-	playerlist_dec_use_count(game);
 
 	return TRUE;
 }
@@ -294,6 +841,16 @@ gboolean server_is_running(Game * game)
 	return FALSE;
 }
 
+GList *server_running_games(void)
+{
+	GList *games;
+
+	g_static_mutex_lock(&games_mutex);
+	games = g_list_copy(running_games);
+	g_static_mutex_unlock(&games_mutex);
+	return games;
+}
+
 static gint sort_function(gconstpointer a, gconstpointer b)
 {
 	return (strcmp(((const GameParams *) a)->title,
@@ -39,23 +39,32 @@ typedef enum {
 	V0_10, /**< Lowest supported version */
 	V0_11, /**< City walls, player style, robber undo */
 	V0_12, /**< Trade protocol simplified */
+	V0_12_BINARY, /**< Protocol of 0.12 in binary frames */
 	FIRST_VERSION = V0_10,
-	LATEST_VERSION = V0_12
+	LATEST_VERSION = V0_12_BINARY
 } ClientVersionType;
 
 #define TERRAIN_DEFAULT	0
 #define TERRAIN_RANDOM	1
 
 typedef struct Game Game;
+typedef struct MetaLink MetaLink;
+typedef struct Worker Worker;
+typedef struct GameRecord GameRecord;
 typedef struct {
 	StateMachine *sm;	/* state machine for this player */
 	Game *game;		/* game that player belongs to */
 
 	gchar *location;	/* reverse lookup player hostname */
+	GCancellable *location_lookup;	/* pending reverse lookup */
 	gint num;		/* number each player */
 	char *name;		/* give each player a name */
 	gchar *style;		/* description of the player icon */
 	ClientVersionType version;	/* version, so adapted messages can be sent */
+	gboolean compress_join;	/* the client accepts a compressed game */
+	gint batch_version;	/* version of the batch extension, 0 if none */
+	gchar *resume_token;	/* identifies the player when resuming */
+	gint connection;	/* number of the connection in the record */
 
 	GList *build_list;	/* list of building that can be undone */
 	gint prev_assets[NO_RESOURCE];	/* remember previous resources */
@@ -83,19 +92,31 @@ typedef struct {
 	gint market_played;	/* number of Market cards played */
 	gint islands_discovered;	/* number of islands discovered */
 	gint doing_special_building_phase; /* in the middle of SBP? */
+	gboolean recover_from_plenty;	/* the year of plenty is resent at start */
 	gboolean disconnected;
 } Player;
 
 struct Game {
+	gint id;		/* identifies the game in the server */
+	Worker *worker;		/* the thread of the game, NULL for the main thread */
+	guint32 seed;		/* the seed of rand */
+	GRand *rand;		/* all random choices of the game */
+	GameRecord *record;	/* record of the input, NULL if none */
 	GameParams *params;	/* game parameters */
 	gchar *hostname;	/* reported hostname */
+	MetaLink *meta;		/* registration at the meta-server */
+	Player none_player;	/* returned by player_none() */
 
 	int accept_fd;		/* socket for accepting new clients */
 	int accept_tag;		/* Gdk event tag for accept socket */
 
-	GList *player_list;	/* all players in the game */
-	GList *dead_players;	/* all players that should be removed when player_list_use_count == 0 */
-	gint player_list_use_count;	/* # functions is in use by */
+	GList *player_list;	/* all connections of the game */
+	Player *seats[MAX_PLAYERS];	/* the players, by number */
+	GList *viewers;		/* the viewers */
+	GList *dead_players;	/* freed, removed from player_list when idle */
+	guint reap_tag;		/* removes the dead players */
+	gint batch_depth;	/* nesting level of player_batch_begin */
+	GString *broadcast_buffer;	/* reused by player_broadcast */
 	gint num_players;	/* current number of players in the game */
 
 	gint tournament_countdown;	/* number of remaining minutes before AIs are added */
@@ -103,11 +124,13 @@ struct Game {
 
 	gboolean double_setup;
 	gboolean reverse_setup;
-	GList *setup_player;
+	Player *setup_player;
 
 	gboolean is_game_over;	/* is the game over? */
 	Player *longest_road;	/* who holds longest road */
+	GHashTable *road_networks;	/* the network of each road, ship and bridge */
 	Player *largest_army;	/* who has largest army */
+	Hex *previous_robber_hex;	/* where the robber goes on undo */
 
 	QuoteList *quotes;	/* domestic trade quotes */
 	gint quote_supply[NO_RESOURCE];	/* only valid when trading */
@@ -117,6 +140,7 @@ struct Game {
 	gint curr_turn;		/* current turn number */
 	gboolean rolled_dice;	/* has dice been rolled in turn yet? */
 	gint die1, die2;	/* latest dice values */
+	GPtrArray *roll_hexes[13];	/* the hexes of each roll */
 	gboolean played_develop;	/* has devel. card been played in turn? */
 	gboolean bought_develop;	/* has devel. card been bought in turn? */
 
@@ -138,6 +162,13 @@ struct Game {
 /**** global variables ****/
 /* buildutil.c */
 void check_longest_road(Game * game, gboolean can_cut);
+void longest_road_edge_changed(Game * game, Edge * edge);
+void longest_road_node_changed(Game * game, Node * node);
+void longest_road_free(Game * game);
+/** The length of the longest road of each player, from the networks.
+ * @param road_len Set for MAX_PLAYERS players
+ */
+void longest_road_lengths(Game * game, gint * road_len);
 void node_add(Player * player,
 	      BuildType type, int x, int y, int pos, gboolean paid_for,
 	      Points * special_points);
@@ -162,9 +193,9 @@ gboolean mode_discard_resources_place_robber(Player * player, gint event);
 /* meta.c */
 gchar *get_server_name(void);
 void meta_register(const gchar * server, const gchar * port, Game * game);
-void meta_unregister(void);
-void meta_start_game(void);
-void meta_report_num_players(gint num_players);
+void meta_unregister(Game * game);
+void meta_start_game(Game * game);
+void meta_report_num_players(Game * game);
 void meta_send_details(Game * game);
 
 /* player.c */
@@ -177,6 +208,19 @@ typedef enum {
 gchar *player_new_computer_player(Game * game);
 Player *player_new(Game * game, const gchar * name);
 Player *player_new_connection(Game * game, int fd, const gchar * location);
+/** A connection whose handshake was started by the acceptor of a server
+ *  with worker threads.  The offers were sent already.
+ * @param batch_version The batch version the client accepted
+ * @return The player, or NULL if it is refused
+ */
+Player *player_new_handoff(Game * game, int fd, const gchar * location,
+			   gint batch_version);
+/** A connection of a replayed record, without a session.
+ * @param batch_version The batch version the client accepted
+ * @return The player, or NULL if it is refused
+ */
+Player *player_new_replay(Game * game, gint batch_version);
+gboolean player_move_to_game(Player * player, Game * game);
 Player *player_by_num(Game * game, gint num);
 void player_set_name(Player * player, gchar * name);
 Player *player_none(Game * game);
@@ -188,6 +232,9 @@ void player_broadcast_extension(Player * player, BroadcastType type,
 				ClientVersionType first_supported_version,
 				ClientVersionType last_supported_version,
 				const char *fmt, ...);
+void player_enable_resume(Player * player);
+void player_batch_begin(Game * game);
+void player_batch_end(Game * game);
 void player_send(Player * player,
 		 ClientVersionType first_supported_version,
 		 ClientVersionType last_supported_version, const char *fmt,
@@ -200,13 +247,19 @@ void player_remove(Player * player);
 void player_free(Player * player);
 void player_archive(Player * player);
 void player_revive(Player * newp, char *name);
-GList *player_first_real(Game * game);
-GList *player_next_real(GList * last);
-GList *list_from_player(Player * player);
-GList *next_player_loop(GList * current, Player * first);
+/** Start a tournament game that is not full yet: the disconnected
+ * players are removed, and the game stops if no human is left.
+ * @return TRUE if computer players should fill the game
+ */
+gboolean tournament_start(Game * game);
+void player_lookup_location(Player * player, gint fd);
+gchar *player_network_stats(Player * player);
+void player_log_network_stats(Game * game);
+void player_reap(Game * game);
+Player *player_first_real(Game * game);
+Player *player_next_real(Player * last);
+Player *next_player_loop(Player * current, Player * first);
 gboolean mode_viewer(Player * player, gint event);
-void playerlist_inc_use_count(Game * game);
-void playerlist_dec_use_count(Game * game);
 gboolean player_is_viewer(Game * game, gint player_num);
 
 /* pregame.c */
@@ -236,16 +289,91 @@ void robber_undo(Player * player);
 /* server.c */
 void start_timeout(Game * game);
 void stop_timeout(Game * game);
-gint get_rand(gint range);
-Game *game_new(const GameParams * params);
+/** A random number from the generator of the game.
+ * @param game The game
+ * @param range The number of possible values
+ * @return A number from 0 to range - 1
+ */
+gint get_rand(Game * game, gint range);
+/** Create a game.
+ * @param params The parameters, they are copied
+ * @param seed The seed of the random generator of the game
+ */
+Game *game_new(const GameParams * params, guint32 seed);
 void game_free(Game * game);
 gint add_computer_player(Game * game, gboolean want_chat);
 Game *server_start(const GameParams * params, const gchar * hostname,
 		   const gchar * port, gboolean register_server,
 		   const gchar * meta_server_name, gboolean random_order);
+Game *server_recover(const gchar * filename, const gchar * hostname,
+		     const gchar * port, gboolean register_server,
+		     const gchar * meta_server_name);
+/** Let a game that was not started by server_start accept players.
+ * A game that has an accept_fd keeps listening on it.
+ * The other parameters are those of server_start.
+ * @return The game, or NULL if it is freed because it cannot start
+ */
+Game *server_serve(Game * game, const gchar * hostname,
+		   const gchar * port, gboolean register_server,
+		   const gchar * meta_server_name);
+/** Stop or continue accepting the players of a single-game server. */
+void server_accept_pause(Game * game, gboolean pause);
 gboolean server_stop(Game * game);
 gboolean server_is_running(Game * game);
+/** Use a seed for the next game that is started, instead of a random
+ * one.
+ */
+void server_set_seed(guint32 seed);
+/** The games that are running.
+ * @return A copy of the list, free it with g_list_free.  The games
+ *         belong to the server.
+ */
+GList *server_running_games(void);
+/** Let all games share one port, so one process hosts many games.
+ * The players choose the game when they connect.
+ * @param port The port to listen on
+ * @return TRUE on success
+ */
+gboolean server_listen_shared(const gchar * port);
+/** Let all games share a port that is open already.
+ * @param port The port the socket listens on
+ * @param fd The listening socket
+ */
+void server_listen_shared_fd(const gchar * port, gint fd);
+/** The socket of the shared port, or -1 if there is none */
+gint server_shared_accept_fd(void);
+gboolean server_is_multi_game(void);
+/** Find a running game.
+ * @param id The id of the game
+ * @return The game, or NULL if it does not exist
+ */
+Game *server_find_game(gint id);
+/** Is the game still allocated?  The game is not dereferenced, so a
+ * pointer to a game that was freed may be checked.
+ */
+gboolean server_game_exists(const Game * game);
+/** The memory that is used by a game.
+ * @param game The game
+ * @retval fixed The memory that is used without players
+ * @return The memory that is used, including the players
+ */
+gsize server_game_memory(Game * game, gsize * fixed);
 gint accept_connection(gint in_fd, gchar ** location);
+/** Turn the reverse lookup of the names of connecting players on/off.
+ *  When it is off, only the numeric address is shown.
+ */
+void server_set_reverse_lookup(gboolean enable);
+/** Set the maximum size of the messages that are kept for a player
+ *  while the game is sent to it.  The player is disconnected when it
+ *  needs more.
+ */
+void server_set_cache_limit(gsize limit);
+gsize server_get_cache_limit(void);
+/** Set the size of the input buffer of a player.  A longer line from the
+ *  player is discarded.  0 leaves the default of the network code.
+ */
+void server_set_read_limit(gsize limit);
+gsize server_get_read_limit(void);
 
 /**** game list control functions ****/
 void game_list_prepare(void);
@@ -271,6 +399,157 @@ void server_init(void);
 void game_is_over(Game * game);
 void request_server_stop(Game * game);
 
+/* worker.c */
+typedef void (*WorkerFunc) (gpointer data);
+/** Start the threads that run the games.
+ * The log messages of all threads are written by the main thread from
+ * now on.
+ * @param num The number of threads
+ * @return FALSE if a thread cannot be started
+ */
+gboolean workers_start(gint num);
+gboolean workers_enabled(void);
+/** The worker for a new game, the workers take turns.
+ * @return The worker, or NULL if there are no workers
+ */
+Worker *worker_next(void);
+/** Does the calling thread run the worker?
+ * @param worker The worker, or NULL for the main thread
+ */
+gboolean worker_is_current(const Worker * worker);
+/** Run a function in a worker, and wait until it is done.
+ * The function is called directly by the thread of the worker.  Only the
+ * main thread waits for the workers, so they cannot wait for each other.
+ * @param worker The worker, or NULL for the main thread
+ */
+void worker_call(Worker * worker, WorkerFunc func, gpointer data);
+/** Run a function in a worker, without waiting for it.
+ * @param worker The worker, or NULL for the main thread
+ */
+void worker_post(Worker * worker, WorkerFunc func, gpointer data);
+/** As g_timeout_add, in the main context of the calling thread */
+guint worker_timeout_add(guint interval, GSourceFunc func, gpointer data);
+/** As g_source_remove, for worker_timeout_add */
+void worker_source_remove(guint tag);
+
+/* record.c */
+/** Record the games in files in this directory.
+ * @param dir The directory, or NULL to stop recording
+ */
+void record_set_dir(const gchar * dir);
+/** Start the record of a new game, with its seed and parameters. */
+void record_start(Game * game);
+/** Record a new connection of the game, and all its input from now on. */
+void record_connect(Player * player);
+/** Record that the connection of the player leaves the game. */
+void record_leave(Player * player);
+/** Record a random number that the game used. */
+void record_draw(Game * game, gint range, gint result);
+/** Record the order of the players that is chosen at the start. */
+void record_random_order(Game * game);
+/** Record an event of a timer of the game, which a replay repeats.
+ * @param event "tournament" for the start of a tournament game
+ */
+void record_event(Game * game, const gchar * event);
+/** Record the token with which the player can resume. */
+void record_resume_token(Player * player);
+/** Write the record to disk.  Until now a crash of the system could lose
+ * the lines since the last sync.  It is called once per turn.
+ */
+void record_sync(Game * game);
+/** Save the record of a game, from which record_recover can rebuild it
+ * on this or another server.
+ * @param filename The copy of the record
+ * @retval error_message The reason it cannot be saved (free it)
+ * @return TRUE if the record is saved
+ */
+gboolean record_save(Game * game, const gchar * filename,
+		     gchar ** error_message);
+/** The record of a game.
+ * @retval length Is set to the length of the record
+ * @retval error_message The reason it cannot be read (free it)
+ * @return The record (free it), or NULL
+ */
+gchar *record_contents(Game * game, gsize * length,
+		       gchar ** error_message);
+/** The file of the record of a game.
+ * @return The name, or NULL if the record is kept in memory
+ */
+const gchar *record_filename(Game * game);
+/** Stop and restart writing the record, while the game is handed to
+ * another process.  The record is synced when it stops.
+ */
+void record_pause(Game * game, gboolean pause);
+/** The player of a connection of the record.
+ * @return The player, or NULL if the connection is gone
+ */
+Player *record_find_connection(Game * game, gint connection);
+void record_free(Game * game);
+/** Replay a record, and check that the game draws the same random
+ * numbers at the same moments.  The computer players are not started,
+ * and only the timers that are recorded as events are replayed.
+ * @param filename The record
+ * @return TRUE if the replay is the same
+ */
+gboolean record_check(const gchar * filename);
+/** Rebuild a game from a record.  The replay runs in the worker of the
+ * game, its connections have no sessions.
+ * @param contents The record
+ * @param name The name of the record, for the messages
+ * @return The game, or NULL if the record cannot be replayed
+ */
+Game *record_replay(const gchar * contents, const gchar * name);
+/** Called by record_continue, before the connections of the replay are
+ * closed, to give them their sessions back.
+ */
+typedef void (*RecordAttachFunc) (Game * game, gpointer data);
+/** Let a replayed game continue, with a record that is not a replay.
+ * The connections that still have no session are closed, so their
+ * players can take their seat again by name.
+ * @param game The game of record_replay
+ * @param journal The file in which the record continues, or NULL to
+ *                keep it in memory
+ * @param attach Gives sessions to connections, or NULL
+ * @param data The data for attach
+ */
+void record_continue(Game * game, const gchar * journal,
+		     RecordAttachFunc attach, gpointer data);
+/** Let a record that record_continue keeps in memory continue in the
+ * file of the record that was replayed.  The lines since the replay are
+ * appended to it.  Call it in the worker of the game.
+ * @param game The game of record_continue
+ * @param journal The file of the record
+ */
+void record_journal(Game * game, const gchar * journal);
+/** Rebuild a game from its record, after the server stopped without
+ * ending it.  The connections that were open are closed, so their
+ * players can take their seat again by name.  The record is continued
+ * in the same file.
+ * @param filename The record
+ * @return The game, which is not running yet, or NULL if the record
+ *         cannot be replayed
+ */
+Game *record_recover(const gchar * filename);
+
+/* restart.c */
+/** Remember the command line, to start the process that takes over.
+ * @param argv The arguments of main, before they are parsed
+ */
+void restart_set_command(gchar ** argv);
+/** Start a new process of the server, and hand it the games and the
+ * sockets.  This process exits when the new process has them.
+ * @return FALSE if the games stay in this process
+ */
+gboolean restart_hand_over(void);
+/** Take the games and the sockets over from the process that started
+ * this one.  The other parameters are those of server_start.
+ * @param sock The socket to the old process
+ * @return TRUE if all games are taken over
+ */
+gboolean restart_take_over(gint sock, const gchar * hostname,
+			   const gchar * port, gboolean register_server,
+			   const gchar * meta_server_name);
+
 /* trade.c */
 void trade_perform_maritime(Player * player,
 			    gint ratio, Resource supply, Resource receive);
@@ -287,6 +566,8 @@ void trade_begin_domestic(Player * player, gint * supply, gint * receive);
 gboolean mode_idle(Player * player, gint event);
 gboolean mode_turn(Player * player, gint event);
 void turn_next_player(Game * game);
+void turn_index_rolls(Game * game);
+void turn_free_rolls(Game * game);
 /** Check whether this player has won the game.
  *  If so, return TRUE and set all state machines to idle
  *  @param player Has this player won?
@@ -297,7 +578,7 @@ gboolean check_victory(Player * player);
 /* gold.c */
 gboolean gold_limited_bank(const Game * game, int limit,
 			   gint * limited_bank);
-void distribute_first(GList * list);
+void distribute_first(Player * player);
 gboolean mode_choose_gold(Player * player, gint event);
 gboolean mode_wait_for_gold_choosing_players(Player * player, gint event);
 
@@ -28,10 +28,8 @@ void build_add(Player *player, BuildType type, gint x, gint y, gint pos);
 
 void special_building_phase(Game *game)
 {
-	GList *list;
-	for(list = player_first_real(game); list != NULL; list = player_next_real(list)) {
-		Player *scan = list->data;
-
+	Player *scan;
+	for(scan = player_first_real(game); scan != NULL; scan = player_next_real(scan)) {
 		scan->doing_special_building_phase = 1;
 
 		sm_push(scan->sm, (StateFunc) mode_special_building_phase);
@@ -45,22 +43,21 @@ void special_building_phase(Game *game)
 
 void check_finished_special_building_phase(Game *game)
 {
-	GList *list;
+	Player *scan;
 	// is everyone finished yet?
-	for(list = player_first_real(game); list != NULL; list = player_next_real(list)) {
-		if(((Player *) list->data)->disconnected) {
-			((Player *) list->data)->doing_special_building_phase = 0;
+	for(scan = player_first_real(game); scan != NULL; scan = player_next_real(scan)) {
+		if(scan->disconnected) {
+			scan->doing_special_building_phase = 0;
 		}
-		if(((Player *) list->data)->doing_special_building_phase) {
+		if(scan->doing_special_building_phase) {
 			break;
 		}
 	}
-	if(list != NULL) {
+	if(scan != NULL) {
 		return;
 	}
 
-	for(list = player_first_real(game); list != NULL; list = player_next_real(list)) {
-		Player *scan = list->data;
+	for(scan = player_first_real(game); scan != NULL; scan = player_next_real(scan)) {
 		player_send(scan, FIRST_VERSION, LATEST_VERSION, "OK\n");
 		sm_pop(scan->sm);
 	}
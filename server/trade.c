@@ -191,14 +191,13 @@ void trade_finish_domestic(Player * player)
 {
 	StateMachine *sm = player->sm;
 	Game *game = player->game;
-	GList *list;
+	Player *scan;
 
 	player_broadcast(player, PB_RESPOND, FIRST_VERSION, LATEST_VERSION,
 			 "domestic-trade finish\n");
 	sm_pop(sm);
-	for (list = player_first_real(game);
-	     list != NULL; list = player_next_real(list)) {
-		Player *scan = list->data;
+	for (scan = player_first_real(game);
+	     scan != NULL; scan = player_next_real(scan)) {
 		if (scan != player && !player_is_viewer(game, scan->num))
 			sm_pop(scan->sm);
 	}
@@ -282,7 +281,7 @@ static void process_call_domestic(Player * player, gint * supply,
 				  gint * receive)
 {
 	Game *game = player->game;
-	GList *list;
+	Player *scan;
 	gint i;
 
 	for (i = 0; i < NO_RESOURCE; i++) {
@@ -296,9 +295,8 @@ static void process_call_domestic(Player * player, gint * supply,
 	/* make sure all the others are back in quote mode.  They may have
 	 * gone to monitor mode (after rejecting), but they should be able
 	 * to reply to the new call */
-	for (list = player_first_real(game); list != NULL;
-	     list = player_next_real(list)) {
-		Player *scan = list->data;
+	for (scan = player_first_real(game); scan != NULL;
+	     scan = player_next_real(scan)) {
 		if (!player_is_viewer(game, scan->num) && scan != player) {
 			sm_goto(scan->sm, (StateFunc) mode_domestic_quote);
 		}
@@ -414,7 +412,7 @@ gboolean mode_domestic_initiate(Player * player, gint event)
 void trade_begin_domestic(Player * player, gint * supply, gint * receive)
 {
 	Game *game = player->game;
-	GList *list;
+	Player *scan;
 
 	sm_push(player->sm, (StateFunc) mode_domestic_initiate);
 	quotelist_new(&game->quotes);
@@ -422,9 +420,8 @@ void trade_begin_domestic(Player * player, gint * supply, gint * receive)
 	/* push all others to quote mode.  process_call_domestic pops and
 	 * repushes them all, so this is needed to keep the state stack
 	 * from corrupting. */
-	for (list = player_first_real(game); list != NULL;
-	     list = player_next_real(list)) {
-		Player *scan = list->data;
+	for (scan = player_first_real(game); scan != NULL;
+	     scan = player_next_real(scan)) {
 		if (!player_is_viewer(game, scan->num) && scan != player)
 			sm_push(scan->sm, (StateFunc) mode_domestic_quote);
 	}
@@ -343,6 +343,7 @@ static void build_move(Player * player, gint sx, gint sy, gint spos,
 	map->has_moved_ship = TRUE;
 
 	/* check the longest road while the ship is moving */
+	longest_road_edge_changed(game, from);
 	check_longest_road(game, FALSE);
 
 	/* administrate the arrival of the ship */
@@ -350,22 +351,49 @@ static void build_move(Player * player, gint sx, gint sy, gint spos,
 	to->type = BUILD_SHIP;
 
 	/* check the longest road again */
+	longest_road_edge_changed(game, to);
 	check_longest_road(game, FALSE);
 }
 
-typedef struct {
-	Game *game;
-	int roll;
-} GameRoll;
+static gboolean index_roll(Hex * hex, gpointer closure)
+{
+	Game *game = closure;
+
+	if (hex->roll >= 2 && hex->roll < G_N_ELEMENTS(game->roll_hexes))
+		g_ptr_array_add(game->roll_hexes[hex->roll], hex);
+	return FALSE;
+}
 
-static gboolean distribute_resources(const Hex * hex, gpointer closure)
+/** Index the hexes by their roll, so a roll only looks at the hexes
+ * that produce.  The rolls of the map are fixed once the terrain is
+ * shuffled; the buildings and the robber are read at the roll.
+ */
+void turn_index_rolls(Game * game)
+{
+	gint idx;
+
+	for (idx = 0; idx < G_N_ELEMENTS(game->roll_hexes); idx++)
+		game->roll_hexes[idx] = g_ptr_array_new();
+	map_traverse(game->params->map, index_roll, game);
+}
+
+void turn_free_rolls(Game * game)
+{
+	gint idx;
+
+	for (idx = 0; idx < G_N_ELEMENTS(game->roll_hexes); idx++)
+		if (game->roll_hexes[idx] != NULL) {
+			g_ptr_array_free(game->roll_hexes[idx], TRUE);
+			game->roll_hexes[idx] = NULL;
+		}
+}
+
+static void distribute_resources(Game * game, const Hex * hex)
 {
 	int idx;
-	GameRoll *data = closure;
 
-	if (hex->roll != data->roll || hex->robber)
-		/* return false so the traverse function continues */
-		return FALSE;
+	if (hex->robber)
+		return;
 
 	for (idx = 0; idx < G_N_ELEMENTS(hex->nodes); idx++) {
 		const Node *node = hex->nodes[idx];
@@ -374,7 +402,7 @@ static gboolean distribute_resources(const Hex * hex, gpointer closure)
 
 		if (node->type == BUILD_NONE)
 			continue;
-		player = player_by_num(data->game, node->owner);
+		player = player_by_num(game, node->owner);
 		if (player != NULL) {
 			num = (node->type == BUILD_CITY) ? 2 : 1;
 			if (hex->terrain == GOLD_TERRAIN)
@@ -388,9 +416,6 @@ static gboolean distribute_resources(const Hex * hex, gpointer closure)
 				      "Tried to assign resources to NULL player.\n"));
 		}
 	}
-
-	/* return false so the traverse function continues */
-	return FALSE;
 }
 
 gboolean check_victory(Player * player)
@@ -419,21 +444,21 @@ gboolean check_victory(Player * player)
 	}
 
 	if (points >= game->params->victory_points) {
-		GList *list;
+		Player *scan;
 
 		player_broadcast(player, PB_ALL, FIRST_VERSION,
 				 LATEST_VERSION, "won with %d\n", points);
 		game->is_game_over = TRUE;
 		/* Set all state machines to idle, to make sure nothing
 		 * happens. */
-		for (list = player_first_real(game); list != NULL;
-		     list = player_next_real(list)) {
-			Player *scan = list->data;
+		for (scan = player_first_real(game); scan != NULL;
+		     scan = player_next_real(scan)) {
 			sm_pop_all_and_goto(scan->sm,
 					    (StateFunc) mode_idle);
 		}
-		meta_unregister();
+		meta_unregister(game);
 
+		player_log_network_stats(game);
 		game_is_over(game);
 		return TRUE;
 	}
@@ -446,7 +471,6 @@ gboolean mode_turn(Player * player, gint event)
 {
 	StateMachine *sm = player->sm;
 	Game *game = player->game;
-	const Map *map = game->params->map;
 	BuildType build_type;
 	DevelType devel_type;
 	gint x, y, pos;
@@ -459,7 +483,7 @@ gboolean mode_turn(Player * player, gint event)
 	if (event != SM_RECV)
 		return FALSE;
 	if (sm_recv(sm, "roll")) {
-		GameRoll data;
+		GPtrArray *hexes;
 		gint roll;
 
 		if (game->rolled_dice) {
@@ -470,8 +494,8 @@ gboolean mode_turn(Player * player, gint event)
 
 		/* roll the dice until we like it */
 		while (TRUE) {
-			game->die1 = get_rand(6) + 1;
-			game->die2 = get_rand(6) + 1;
+			game->die1 = get_rand(game, 6) + 1;
+			game->die2 = get_rand(game, 6) + 1;
 			roll = game->die1 + game->die2;
 			game->rolled_dice = TRUE;
 
@@ -486,6 +510,10 @@ gboolean mode_turn(Player * player, gint event)
 			/* sevens_rule == 0: don't reroll anything */
 			break;
 		}
+		/* The roll, the discards and the production are
+		 * one update for the clients */
+		player_batch_begin(game);
+
 		/* The administrator can override the dice */
 		if (admin_dice_roll >= 2) {
 			game->die1 = admin_dice_roll > 6 ? 6 : 1;
@@ -509,14 +537,17 @@ gboolean mode_turn(Player * player, gint event)
 			 */
 			discard_resources(game);
 			/* there are no resources to distribute on a 7 */
+			player_batch_end(game);
 			return TRUE;
 		}
 		resource_start(game);
-		data.game = game;
-		data.roll = roll;
-		map_traverse_const(map, distribute_resources, &data);
+		hexes = game->roll_hexes[roll];
+		for (idx = 0; idx < hexes->len; idx++)
+			distribute_resources(game,
+					     g_ptr_array_index(hexes, idx));
 		/* distribute resources and gold (includes resource_end) */
-		distribute_first(list_from_player(player));
+		distribute_first(player);
+		player_batch_end(game);
 		return TRUE;
 	}
 	/* try to end a turn */
@@ -596,28 +627,28 @@ gboolean mode_idle(Player * player, G_GNUC_UNUSED gint event)
 void turn_next_player(Game * game)
 {
 	Player *player = NULL;
-	GList *list = NULL;
+
+	/* The turn that ends is on disk before the next starts */
+	record_sync(game);
 
 	/* the first time this is called there is no curr_player yet */
 	if (game->curr_player >= 0) {
 		player = player_by_num(game, game->curr_player);
 		game->curr_player = -1;
 		g_assert(player != NULL);
-		list = list_from_player(player);
 	}
 
 	do {
 		/* next player */
-		if (list)
-			list = player_next_real(list);
+		if (player)
+			player = player_next_real(player);
 		/* See if it's the first player's turn again */
-		if (list == NULL) {
-			list = player_first_real(game);
+		if (player == NULL) {
+			player = player_first_real(game);
 			game->curr_turn++;
 		}
 		/* sanity check */
-		g_assert(list != NULL && list->data != NULL);
-		player = list->data;
+		g_assert(player != NULL);
 		/* disconnected players don't take turns */
 	} while (player->disconnected);
 
@@ -0,0 +1,285 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* The games of a multi-game server can run in worker threads.  Each
+ * worker runs its own main loop, and a game only runs in the worker it
+ * was given when it was created: its sockets, its timers and its
+ * registration at the meta-server.  The main thread accepts the
+ * connections and runs the admin port.
+ */
+
+#include "config.h"
+#include "server.h"
+
+struct Worker {
+	GThread *thread;
+	GMainContext *context;	/* the sources of the games of the worker */
+	GMainLoop *loop;
+};
+
+static GPtrArray *workers;	/* all workers, NULL if there are none */
+static guint next_worker;	/* the worker of the next game */
+
+/* The worker of the calling thread, NULL in the main thread */
+static GStaticPrivate current_worker = G_STATIC_PRIVATE_INIT;
+
+/* The main thread waits for worker_call with these */
+static GMutex *call_mutex;
+static GCond *call_cond;
+
+typedef struct {
+	WorkerFunc func;
+	gpointer data;
+	gboolean done;
+} WorkerTask;
+
+/* The log messages of all threads are written by the main thread.  The
+ * threads push them on a stack without taking a lock, the main thread
+ * takes the whole stack at once and writes it in the order of the
+ * pushes.
+ */
+typedef struct LogEntry LogEntry;
+struct LogEntry {
+	LogEntry *next;
+	gchar *timestamp;	/* NULL if the message has none */
+	gint type;
+	gchar *text;
+};
+
+static LogEntry *log_stack;	/* the newest message first */
+static LogFunc log_write;	/* writes the messages in the main thread */
+/* log_message writes the timestamp separately, it waits here for its
+ * message */
+static GStaticPrivate log_timestamp = G_STATIC_PRIVATE_INIT;
+
+static gboolean log_flush(G_GNUC_UNUSED gpointer data)
+{
+	LogEntry *entry;
+	LogEntry *ordered = NULL;
+
+	do {
+		entry = g_atomic_pointer_get(&log_stack);
+	} while (!g_atomic_pointer_compare_and_exchange
+		 ((gpointer *) & log_stack, entry, NULL));
+
+	/* The stack has the newest message first */
+	while (entry != NULL) {
+		LogEntry *next = entry->next;
+
+		entry->next = ordered;
+		ordered = entry;
+		entry = next;
+	}
+
+	while (ordered != NULL) {
+		entry = ordered;
+		ordered = entry->next;
+		if (entry->timestamp != NULL)
+			log_write(MSG_TIMESTAMP, entry->timestamp);
+		log_write(entry->type, entry->text);
+		g_free(entry->timestamp);
+		g_free(entry->text);
+		g_free(entry);
+	}
+	return FALSE;
+}
+
+static void log_push(gint msg_type, const gchar * text)
+{
+	LogEntry *entry;
+	LogEntry *top;
+
+	if (msg_type == MSG_TIMESTAMP) {
+		g_static_private_set(&log_timestamp, g_strdup(text), g_free);
+		return;
+	}
+
+	entry = g_malloc(sizeof(*entry));
+	entry->timestamp =
+	    g_strdup(g_static_private_get(&log_timestamp));
+	g_static_private_set(&log_timestamp, NULL, NULL);
+	entry->type = msg_type;
+	entry->text = g_strdup(text);
+
+	do {
+		top = g_atomic_pointer_get(&log_stack);
+		entry->next = top;
+	} while (!g_atomic_pointer_compare_and_exchange
+		 ((gpointer *) & log_stack, top, entry));
+
+	if (worker_is_current(NULL))
+		/* The messages of the main thread are written at once,
+		 * after those that are waiting */
+		log_flush(NULL);
+	else if (top == NULL)
+		/* The first message wakes up the main thread */
+		g_idle_add(log_flush, NULL);
+}
+
+static gpointer worker_run(gpointer data)
+{
+	Worker *worker = data;
+
+	g_static_private_set(&current_worker, worker, NULL);
+	g_main_context_push_thread_default(worker->context);
+	g_main_loop_run(worker->loop);
+	g_main_context_pop_thread_default(worker->context);
+	return NULL;
+}
+
+gboolean workers_start(gint num)
+{
+	gint idx;
+
+	g_return_val_if_fail(workers == NULL, FALSE);
+	g_return_val_if_fail(num > 0, FALSE);
+
+	call_mutex = g_mutex_new();
+	call_cond = g_cond_new();
+	log_write =
+	    driver->log_write !=
+	    NULL ? driver->log_write : log_message_string_console;
+	log_set_func(log_push);
+
+	workers = g_ptr_array_new();
+	for (idx = 0; idx < num; ++idx) {
+		Worker *worker = g_malloc0(sizeof(*worker));
+		GError *error = NULL;
+
+		worker->context = g_main_context_new();
+		worker->loop = g_main_loop_new(worker->context, FALSE);
+		worker->thread =
+		    g_thread_create(worker_run, worker, TRUE, &error);
+		if (worker->thread == NULL) {
+			log_message(MSG_ERROR,
+				    _("Cannot start thread %d: %s\n"),
+				    idx, error->message);
+			g_error_free(error);
+			g_main_loop_unref(worker->loop);
+			g_main_context_unref(worker->context);
+			g_free(worker);
+			return FALSE;
+		}
+		g_ptr_array_add(workers, worker);
+	}
+	return TRUE;
+}
+
+gboolean workers_enabled(void)
+{
+	return workers != NULL && workers->len > 0;
+}
+
+Worker *worker_next(void)
+{
+	Worker *worker;
+
+	if (!workers_enabled())
+		return NULL;
+	worker = g_ptr_array_index(workers, next_worker % workers->len);
+	++next_worker;
+	return worker;
+}
+
+gboolean worker_is_current(const Worker * worker)
+{
+	return g_static_private_get(&current_worker) == worker;
+}
+
+static gboolean worker_task_run(gpointer data)
+{
+	WorkerTask *task = data;
+
+	task->func(task->data);
+	g_free(task);
+	return FALSE;
+}
+
+static void worker_attach(Worker * worker, GSourceFunc func,
+			  gpointer data)
+{
+	GSource *source = g_idle_source_new();
+
+	g_source_set_priority(source, G_PRIORITY_DEFAULT);
+	g_source_set_callback(source, func, data, NULL);
+	g_source_attach(source, worker != NULL ? worker->context : NULL);
+	g_source_unref(source);
+}
+
+void worker_post(Worker * worker, WorkerFunc func, gpointer data)
+{
+	WorkerTask *task = g_malloc0(sizeof(*task));
+
+	task->func = func;
+	task->data = data;
+	worker_attach(worker, worker_task_run, task);
+}
+
+static gboolean worker_call_run(gpointer data)
+{
+	WorkerTask *task = data;
+
+	task->func(task->data);
+	g_mutex_lock(call_mutex);
+	task->done = TRUE;
+	g_cond_broadcast(call_cond);
+	g_mutex_unlock(call_mutex);
+	return FALSE;
+}
+
+void worker_call(Worker * worker, WorkerFunc func, gpointer data)
+{
+	WorkerTask task;
+
+	if (worker_is_current(worker)) {
+		func(data);
+		return;
+	}
+	g_return_if_fail(worker_is_current(NULL));
+
+	task.func = func;
+	task.data = data;
+	task.done = FALSE;
+	worker_attach(worker, worker_call_run, &task);
+
+	g_mutex_lock(call_mutex);
+	while (!task.done)
+		g_cond_wait(call_cond, call_mutex);
+	g_mutex_unlock(call_mutex);
+}
+
+guint worker_timeout_add(guint interval, GSourceFunc func, gpointer data)
+{
+	GSource *source = g_timeout_source_new(interval);
+	guint tag;
+
+	g_source_set_callback(source, func, data, NULL);
+	tag = g_source_attach(source, g_main_context_get_thread_default());
+	g_source_unref(source);
+	return tag;
+}
+
+void worker_source_remove(guint tag)
+{
+	GSource *source =
+	    g_main_context_find_source_by_id
+	    (g_main_context_get_thread_default(), tag);
+
+	if (source != NULL)
+		g_source_destroy(source);
+}
@@ -0,0 +1,504 @@
+/* Pioneers - Implementation of the excellent Settlers of Catan board game.
+ *   Go buy a copy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* The tests of the worker threads of a multi-game server: the calls into
+ * a worker, the order of the log messages of several threads, and the
+ * hand-off of a connection from the shared port to the worker of its
+ * game.  Run with -m perf to play games of computer players on a server
+ * with one thread, and on a server with a thread for each game.
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include "driver.h"
+#include "common_glib.h"
+#include "server.h"
+
+#define NUM_WORKERS 2
+#define LOG_MESSAGES 200
+#define PERF_GAMES 4
+#define PLAYERS_PER_GAME 4
+
+/* The library calls these, the programs define them */
+void game_is_over(G_GNUC_UNUSED Game * game)
+{
+}
+
+void request_server_stop(G_GNUC_UNUSED Game * game)
+{
+}
+
+static UIDriver test_driver;
+
+/* The log messages in the order they were written, with "timestamp" for
+ * the timestamps */
+static GPtrArray *log_lines;
+
+static void test_log(gint msg_type, const gchar * text)
+{
+	/* The workers leave the writing to the main thread */
+	g_assert(worker_is_current(NULL));
+	g_ptr_array_add(log_lines,
+			g_strdup(msg_type ==
+				 MSG_TIMESTAMP ? "timestamp" : text));
+}
+
+static void test_player_event(G_GNUC_UNUSED void *data)
+{
+}
+
+/** Connect to a port of this host.
+ * @return The socket, or -1
+ */
+static gint connect_to(const gchar * port)
+{
+	struct addrinfo hints;
+	struct addrinfo *addresses;
+	struct addrinfo *address;
+	gint fd = -1;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo("localhost", port, &hints, &addresses) != 0)
+		return -1;
+	for (address = addresses; address != NULL && fd < 0;
+	     address = address->ai_next) {
+		fd = socket(address->ai_family, address->ai_socktype,
+			    address->ai_protocol);
+		if (fd >= 0
+		    && connect(fd, address->ai_addr,
+			       address->ai_addrlen) != 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(addresses);
+	return fd;
+}
+
+/** The port a socket listens on.
+ * @return The port, free it with g_free
+ */
+static gchar *socket_port(gint fd)
+{
+	struct sockaddr_storage address;
+	socklen_t length = sizeof(address);
+
+	g_assert(getsockname(fd, (struct sockaddr *) &address, &length) ==
+		 0);
+	if (address.ss_family == AF_INET6)
+		return g_strdup_printf("%d",
+				       ntohs(((struct sockaddr_in6 *)
+					      &address)->sin6_port));
+	return g_strdup_printf("%d",
+			       ntohs(((struct sockaddr_in *)
+				      &address)->sin_port));
+}
+
+/** A port that nothing listens on now.
+ * @return The port, free it with g_free
+ */
+static gchar *free_port(void)
+{
+	gchar *error_message;
+	gint fd = net_open_listening_socket("0", &error_message);
+	gchar *port;
+
+	if (fd < 0)
+		g_error("%s", error_message);
+	port = socket_port(fd);
+	close(fd);
+	return port;
+}
+
+/** Read from a socket until the text arrives, while the main thread
+ * handles its events.
+ * @return The data, free it with g_free
+ */
+static gchar *read_until(gint fd, const gchar * text)
+{
+	GString *data = g_string_new(NULL);
+	GTimer *timer = g_timer_new();
+
+	while (strstr(data->str, text) == NULL) {
+		gchar buff[1024];
+		gssize num;
+
+		g_assert_cmpfloat(g_timer_elapsed(timer, NULL), <, 10.0);
+		while (g_main_context_iteration(NULL, FALSE));
+		num = recv(fd, buff, sizeof(buff), MSG_DONTWAIT);
+		if (num > 0)
+			g_string_append_len(data, buff, num);
+		else {
+			g_assert(num < 0);
+			g_assert(errno == EAGAIN || errno == EWOULDBLOCK);
+			g_usleep(1000);
+		}
+	}
+	g_timer_destroy(timer);
+	return g_string_free(data, FALSE);
+}
+
+typedef struct {
+	Worker *worker;		/* the worker that should run the function */
+	gboolean in_worker;	/* it ran there */
+	GThread *thread;	/* the thread that ran it */
+	gint calls;
+} CallCheck;
+
+static void check_call(gpointer data)
+{
+	CallCheck *check = data;
+
+	check->in_worker = worker_is_current(check->worker);
+	check->thread = g_thread_self();
+	++check->calls;
+}
+
+static void test_call(void)
+{
+	CallCheck posted[NUM_WORKERS];
+	CallCheck called[NUM_WORKERS];
+	CallCheck direct;
+	gint idx;
+
+	g_assert(workers_enabled());
+	g_assert(worker_is_current(NULL));
+
+	for (idx = 0; idx < NUM_WORKERS; ++idx) {
+		Worker *worker = worker_next();
+
+		g_assert(worker != NULL);
+		g_assert(!worker_is_current(worker));
+		memset(&posted[idx], 0, sizeof(posted[idx]));
+		memset(&called[idx], 0, sizeof(called[idx]));
+		posted[idx].worker = worker;
+		called[idx].worker = worker;
+
+		/* The call waits for the function, and the tasks of a
+		 * worker run in order */
+		worker_post(worker, check_call, &posted[idx]);
+		worker_call(worker, check_call, &called[idx]);
+		g_assert_cmpint(called[idx].calls, ==, 1);
+		g_assert(called[idx].in_worker);
+		g_assert(called[idx].thread != g_thread_self());
+		g_assert_cmpint(posted[idx].calls, ==, 1);
+		g_assert(posted[idx].in_worker);
+		g_assert(posted[idx].thread == called[idx].thread);
+	}
+	/* Each worker has its own thread */
+	g_assert(called[0].thread != called[1].thread);
+
+	/* The main thread calls itself directly */
+	memset(&direct, 0, sizeof(direct));
+	worker_call(NULL, check_call, &direct);
+	g_assert_cmpint(direct.calls, ==, 1);
+	g_assert(direct.in_worker);
+	g_assert(direct.thread == g_thread_self());
+}
+
+static void log_messages(gpointer data)
+{
+	const gchar *name = data;
+	gint idx;
+
+	for (idx = 0; idx < LOG_MESSAGES; ++idx)
+		log_message(MSG_INFO, "%s %d\n", name, idx);
+}
+
+static void nothing(G_GNUC_UNUSED gpointer data)
+{
+}
+
+static void test_log_order(void)
+{
+	static const gchar *const names[] = { "main", "first", "second" };
+	gint next[G_N_ELEMENTS(names)];
+	Worker *first = worker_next();
+	Worker *second = worker_next();
+	guint idx;
+
+	g_ptr_array_foreach(log_lines, (GFunc) g_free, NULL);
+	g_ptr_array_set_size(log_lines, 0);
+
+	/* All threads log at the same time */
+	worker_post(first, log_messages, (gpointer) names[1]);
+	worker_post(second, log_messages, (gpointer) names[2]);
+	log_messages((gpointer) names[0]);
+	worker_call(first, nothing, NULL);
+	worker_call(second, nothing, NULL);
+	while (log_lines->len < 2 * G_N_ELEMENTS(names) * LOG_MESSAGES)
+		g_main_context_iteration(NULL, TRUE);
+	g_assert_cmpuint(log_lines->len, ==,
+			 2 * G_N_ELEMENTS(names) * LOG_MESSAGES);
+
+	/* Each message follows its timestamp, and the messages of a
+	 * thread keep their order */
+	memset(next, 0, sizeof(next));
+	for (idx = 0; idx < log_lines->len; idx += 2) {
+		const gchar *timestamp = g_ptr_array_index(log_lines, idx);
+		const gchar *text = g_ptr_array_index(log_lines, idx + 1);
+		gchar name[16];
+		gint num;
+		guint thread;
+
+		g_assert_cmpstr(timestamp, ==, "timestamp");
+		g_assert(sscanf(text, "%15s %d", name, &num) == 2);
+		for (thread = 0; thread < G_N_ELEMENTS(names); ++thread)
+			if (strcmp(name, names[thread]) == 0)
+				break;
+		g_assert_cmpuint(thread, <, G_N_ELEMENTS(names));
+		g_assert_cmpint(num, ==, next[thread]);
+		++next[thread];
+	}
+}
+
+typedef struct {
+	Game *game;
+	guint num_players;
+} PlayerCount;
+
+static void count_players(gpointer data)
+{
+	PlayerCount *count = data;
+
+	count->num_players = g_list_length(count->game->player_list);
+}
+
+static void test_handoff(void)
+{
+	gchar *filename = g_build_filename(TEST_GAME_DIR, "default.game",
+					   NULL);
+	GameParams *params = params_load_file(filename);
+	PlayerCount first;
+	PlayerCount second;
+	gchar *port;
+	gchar *line;
+	gchar *reply;
+	gint fd;
+
+	g_assert(params != NULL);
+	g_assert(server_listen_shared("0"));
+	port = socket_port(server_shared_accept_fd());
+	first.game = server_start(params, "localhost", port, FALSE, NULL,
+				  TRUE);
+	second.game = server_start(params, "localhost", port, FALSE, NULL,
+				   TRUE);
+	g_assert(first.game != NULL);
+	g_assert(second.game != NULL);
+	g_assert(first.game->worker != second.game->worker);
+
+	/* The main thread answers until the version */
+	fd = connect_to(port);
+	g_assert(fd >= 0);
+	g_free(read_until(fd, "version report\n"));
+	line = g_strdup_printf("extension game %d\n", second.game->id);
+	g_assert(send(fd, line, strlen(line), 0) == (gssize) strlen(line));
+	g_free(read_until(fd, line));
+	g_free(line);
+
+	/* The worker of the game reads the version line, and its player
+	 * asks for the status */
+	line = "version 0.12\n";
+	g_assert(send(fd, line, strlen(line), 0) == (gssize) strlen(line));
+	reply = read_until(fd, "\n");
+	g_assert_cmpstr(reply, ==, "status report\n");
+	g_free(reply);
+	worker_call(first.game->worker, count_players, &first);
+	worker_call(second.game->worker, count_players, &second);
+	g_assert_cmpuint(first.num_players, ==, 0);
+	g_assert_cmpuint(second.num_players, ==, 1);
+
+	close(fd);
+	game_free(first.game);
+	game_free(second.game);
+	params_free(params);
+	g_free(port);
+	g_free(filename);
+}
+
+/** Start a program, with its output thrown away.
+ * @return The process
+ */
+static GPid spawn(gchar ** argv)
+{
+	GPid pid;
+	GError *error = NULL;
+
+	if (!g_spawn_async(NULL, argv, NULL,
+			   G_SPAWN_DO_NOT_REAP_CHILD |
+			   G_SPAWN_STDOUT_TO_DEV_NULL |
+			   G_SPAWN_STDERR_TO_DEV_NULL, NULL, NULL, &pid,
+			   &error))
+		g_error("%s: %s", argv[0], error->message);
+	return pid;
+}
+
+/** Play games of computer players on a multi-game server.
+ * @param num_threads The threads of the server
+ * @param num_games The games
+ * @return The time until all computer players left, in seconds
+ */
+static gdouble play_games(gint num_threads, gint num_games)
+{
+	gchar *threads = g_strdup_printf("%d", num_threads);
+	gchar *admin_port = free_port();
+	gchar *game_port = free_port();
+	gchar *server_argv[] = {
+		TEST_SERVER, "--multi-game", "--threads", threads,
+		"--admin-wait", "--admin-port", admin_port,
+		"--port", game_port, NULL
+	};
+	GPid server;
+	GPid *players;
+	FILE *replies;
+	gint admin_fd = -1;
+	gint tries;
+	gint idx;
+	gdouble elapsed;
+
+	server = spawn(server_argv);
+	for (tries = 0; tries < 1000 && admin_fd < 0; ++tries) {
+		admin_fd = connect_to(admin_port);
+		if (admin_fd < 0)
+			g_usleep(10 * 1000);
+	}
+	g_assert(admin_fd >= 0);
+	replies = fdopen(dup(admin_fd), "r");
+	g_assert(replies != NULL);
+
+	players = g_new(GPid, num_games * PLAYERS_PER_GAME);
+	for (idx = 0; idx < num_games; ++idx) {
+		static const gchar setup[] =
+		    "admin set-register-server 0\n"
+		    "admin set-game Default\n";
+		static const gchar create[] = "admin create-game\n";
+		gchar line[256];
+		gint id = 0;
+		gint player;
+
+		if (idx == 0)
+			g_assert(write(admin_fd, setup, strlen(setup)) ==
+				 (gssize) strlen(setup));
+		g_assert(write(admin_fd, create, strlen(create)) ==
+			 (gssize) strlen(create));
+		while (id == 0) {
+			g_assert(fgets(line, sizeof(line), replies) != NULL);
+			sscanf(line, "INFO game created %d", &id);
+		}
+
+		if (idx == 0)
+			g_test_timer_start();
+		for (player = 0; player < PLAYERS_PER_GAME; ++player) {
+			gchar *game_id = g_strdup_printf("%d", id);
+			gchar *name =
+			    g_strdup_printf("ai%d-%d", idx, player);
+			gchar *player_argv[] = {
+				TEST_AI, "-s", "localhost", "-p",
+				game_port, "--game-id", game_id, "-n",
+				name, "-t", "0", "-c", NULL
+			};
+
+			players[idx * PLAYERS_PER_GAME + player] =
+			    spawn(player_argv);
+			g_free(name);
+			g_free(game_id);
+		}
+	}
+
+	/* A computer player leaves when its game is over */
+	for (idx = 0; idx < num_games * PLAYERS_PER_GAME; ++idx) {
+		gint status;
+
+		g_assert(waitpid(players[idx], &status, 0) == players[idx]);
+		g_assert(WIFEXITED(status));
+		g_assert_cmpint(WEXITSTATUS(status), ==, 0);
+		g_spawn_close_pid(players[idx]);
+	}
+	elapsed = g_test_timer_elapsed();
+
+	kill(server, SIGTERM);
+	waitpid(server, NULL, 0);
+	g_spawn_close_pid(server);
+	fclose(replies);
+	close(admin_fd);
+	g_free(players);
+	g_free(game_port);
+	g_free(admin_port);
+	g_free(threads);
+	return elapsed;
+}
+
+static void test_games_speed(void)
+{
+	gdouble one;
+	gdouble many;
+
+	if (!g_file_test(TEST_SERVER, G_FILE_TEST_IS_EXECUTABLE)
+	    || !g_file_test(TEST_AI, G_FILE_TEST_IS_EXECUTABLE)) {
+		g_test_message("The server and the computer player are "
+			       "needed to play games");
+		return;
+	}
+	one = play_games(1, PERF_GAMES);
+	many = play_games(PERF_GAMES, PERF_GAMES);
+	g_test_minimized_result(one, "%d games, 1 thread: %.2f s",
+				PERF_GAMES, one);
+	g_test_minimized_result(many, "%d games, %d threads: %.2f s",
+				PERF_GAMES, PERF_GAMES, many);
+}
+
+int main(int argc, char *argv[])
+{
+	if (!g_thread_supported())
+		g_thread_init(NULL);
+	g_test_init(&argc, &argv, NULL);
+	log_lines = g_ptr_array_new();
+	test_driver.log_write = test_log;
+	test_driver.input_add_read = evl_glib_input_add_read;
+	test_driver.input_add_write = evl_glib_input_add_write;
+	test_driver.input_remove = evl_glib_input_remove;
+	test_driver.player_added = test_player_event;
+	test_driver.player_renamed = test_player_event;
+	test_driver.player_removed = test_player_event;
+	test_driver.player_change = test_player_event;
+	driver = &test_driver;
+	server_init();
+
+	/* The games are found in the directory of the tests */
+	g_setenv("PIONEERS_DIR", TEST_GAME_DIR, TRUE);
+	g_assert(workers_start(NUM_WORKERS));
+
+	g_test_add_func("/worker/call", test_call);
+	g_test_add_func("/worker/log", test_log_order);
+	g_test_add_func("/worker/hand-off", test_handoff);
+	if (g_test_perf())
+		g_test_add_func("/worker/games/speed", test_games_speed);
+	return g_test_run();
+}